@@ -36,12 +36,16 @@ class CodeGenerater(object):
         self.params = params
         self.config = config
         assert len(self.graph.get_inputs()) == 1, 'Codegenerator does not support multiple inputs.'
+        self.tasks = []
+        self.conv_chains = []
         self.template = Template({
             'graph': self.graph,
             'params': self.params,
             'config': self.config,
             'graph_input': self.graph.get_inputs()[0],
             'graph_output': self.graph.non_variables[-1],
+            'tasks': self.tasks,
+            'conv_chains': self.conv_chains,
         })
         self.src_dir = path.join(self.config.output_pj_path, 'src')
         self.header_dir = path.join(self.config.output_pj_path, 'include')
@@ -119,14 +123,107 @@ class CodeGenerater(object):
                                self.header_dir,
                                quantized_convs=qconvs_convs)
 
+    def alias_concat_inputs(self):
+        """Let the producers of a channel-high-major concat write straight into its output.
+
+        In ChHWBCl the channel blocks are the outermost dimension, so each input of a
+        ConcatOnDepth is a contiguous range of the output buffer. When every input is
+        produced by a node used only by the concat, the producer's view is made a slice
+        of the concat buffer and the copy in func_ConcatOnDepth disappears.
+        Concats of constants or of the graph input keep the copy, as nothing writes
+        those in place.
+        """
+        b = 32
+
+        for op in self.graph.non_variables:
+            if op.op_type != 'ConcatOnDepth' or op.dimension != 'ChHWBCl':
+                continue
+
+            inputs = list(op.input_ops.values())
+            if any(x.is_variable for x in inputs):
+                continue
+            if len(inputs) != len(set(x.name for x in inputs)):
+                continue
+
+            def can_alias(x):
+                return x.dimension == op.dimension and x.dtype == op.dtype \
+                    and x.op_type != 'Split' and len(x.output_op_list) == 1 \
+                    and x.aliased_buffer == ''
+
+            if not all(can_alias(x) for x in inputs):
+                continue
+            # every input but the last must fill whole channel blocks
+            if any(x.channel % b != 0 for x in inputs[:-1]):
+                continue
+
+            offset = 0
+            for x in inputs:
+                x.aliased_buffer = op.name
+                x.aliased_offset = offset
+                offset += x.shape[0]
+
+    def fuse_conv_chains(self):
+        """Find the chains of quantized convolutions that can run without handing their intermediate
+        outputs to the CPU.
+
+        A chain is a run of stride-1 3x3 (padding 1) or 1x1 convolutions with thresholds, each the
+        only consumer of the one before. At run time the first one runs the whole chain, see
+        func_QuantizedConv2DChainWithThreshold, and the others do nothing: the tiling backends
+        compute it in bands of rows, the FPGA as one command list whose intermediate outputs stay in
+        the device buffers, since the thresholded output of the accelerator is already the ChHWBCl
+        input of the next convolution. Chains whose outputs do not fit those buffers are found at
+        init, see dlk::impl::TCAConv2dChainFits, and run one convolution at a time.
+        """
+        def eligible(op):
+            if op.op_type != 'Conv' or not op.has_thresholds or op.dimension != 'ChHWBCl':
+                return False
+            x = op.input_ops['X']
+            if x.op_type == 'Input' or x.height != op.height or x.width != op.width:
+                return False
+            if op.strides != [1, 1] or any(d != 1 for d in op.dilations):
+                return False
+            k = (op.kernel_height, op.kernel_width)
+            return (k == (3, 3) and op.pads == [1, 1, 1, 1]) or (k == (1, 1) and op.pads == [0, 0, 0, 0])
+
+        def next_in_chain(op):
+            if len(op.output_op_list) != 1 or op.aliased_buffer != '':
+                return None
+            y = op.output_op_list[0]
+            return y if eligible(y) and y.input_ops['X'] is op else None
+
+        self.conv_chains.clear()
+        for op in self.graph.non_variables:
+            if not eligible(op) or op.fused_head != '':
+                continue
+            chain = [op]
+            y = next_in_chain(op)
+            while y is not None:
+                chain.append(y)
+                y = next_in_chain(y)
+            if len(chain) < 2:
+                continue
+            op.fused_chain = chain[1:]
+            for y in chain[1:]:
+                y.fused_head = op.name
+            self.conv_chains.append(chain)
+
     def reuse_output_buffers(self):
 
         operations = self.graph.non_variables
         candidates = defaultdict(set)
 
+        # buffers shared through aliasing must stay live for the whole span of their users
+        alias_targets = set(x.aliased_buffer for x in operations if x.aliased_buffer != '')
+
+        # a fused chain runs as a whole where its first convolution is
+        position = {op.name: i for i, op in enumerate(operations)}
+        for op in operations:
+            if getattr(op, 'fused_head', '') != '':
+                position[op.name] = position[op.fused_head]
+
         for idx, op in enumerate(operations):
-            prev_ops = operations[:idx]
-            next_ops = operations[idx:]
+            prev_ops = operations[:position[op.name]]
+            next_ops = operations[position[op.name]:]
 
             next_inputs = []
             for x in next_ops:
@@ -139,6 +236,8 @@ class CodeGenerater(object):
                     aliased.add(prev_op.name)
                     for i in prev_op.input_ops.values():
                         aliased.add(i.name)
+                if prev_op.aliased_buffer != '' or prev_op.name in alias_targets:
+                    aliased.add(prev_op.name)
                 if prev_op.name not in next_inputs and prev_op.size >= op.size and prev_op.dtype == op.dtype:
                     candidates[op.name].add(prev_op.name)
 
@@ -147,6 +246,8 @@ class CodeGenerater(object):
         being_reused = []
         reusing = []
         for op in operations:
+            if op.aliased_buffer != '' or op.name in alias_targets:
+                continue
             cs = candidates[op.name]
             if cs:
                 reusable_buffer = None
@@ -159,3 +260,48 @@ class CodeGenerater(object):
                     op.available_buffer = reusable_buffer
                     being_reused.append(reusable_buffer)
                     reusing.append(op.name)
+
+    def build_task_graph(self):
+        """Find the nodes every node has to wait for, so that Network::run can run independent branches
+        concurrently.
+
+        Besides its inputs, a node reusing a buffer waits for the previous owner of the buffer and for
+        every reader of it. All of them come earlier in graph.non_variables, which therefore stays a
+        valid sequential order. Convolutions and matrix multiplications share scratch buffers
+        (kn2row, device buffers, packed matrices), so they are marked exclusive and never overlap,
+        except for the quantized ones ('device') on the FPGA, which take turns on the accelerator and
+        hold one of the ping-pong DeviceSlots each.
+        The first convolution of a fused chain may run the whole chain, so it also waits for what the
+        others wait for, and its cost is that of the chain.
+        """
+        operations = self.graph.non_variables
+        index = {op.name: i for i, op in enumerate(operations)}
+
+        readers = defaultdict(set)
+        for i, op in enumerate(operations):
+            for x in op.input_ops.values():
+                if x.name in index:
+                    readers[x.name].add(i)
+
+        def waits_for(op):
+            deps = set(index[x.name] for x in op.input_ops.values() if x.name in index)
+            if op.available_buffer != '':
+                deps.add(index[op.available_buffer])
+                deps |= readers[op.available_buffer]
+            return deps
+
+        self.tasks.clear()
+        for i, op in enumerate(operations):
+            nodes = [i] + [index[y.name] for y in getattr(op, 'fused_chain', [])]
+            deps = set()
+            for n in nodes:
+                deps |= waits_for(operations[n])
+            deps.difference_update(nodes)
+            assert all(d < i for d in deps), f'{op.name} depends on a later node'
+
+            self.tasks.append({
+                'deps': sorted(deps),
+                'exclusive': op.op_type in ['Conv', 'MatMul'],
+                'device': op.op_type == 'Conv' and op.is_quantized and op.input_ops['X'].op_type != 'Input',
+                'cost_nodes': nodes,
+            })
@@ -60,6 +60,8 @@ class Operator(object):
         self._check_consistency()
         self._rank = len(shape)
         self._available_buffer = ''
+        self._aliased_buffer = ''
+        self._aliased_offset = 0
 
     def update_shape(self, shape: List[int], dimension_format: str) -> None:
         self._shape: List[int] = shape
@@ -396,6 +398,24 @@ class Operator(object):
     def available_buffer(self, v: str) -> None:
         self._available_buffer = v
 
+    @property
+    def aliased_buffer(self) -> str:
+        """Name of the node whose buffer this node writes its output into, or '' if it owns one."""
+        return self._aliased_buffer
+
+    @aliased_buffer.setter
+    def aliased_buffer(self, v: str) -> None:
+        self._aliased_buffer = v
+
+    @property
+    def aliased_offset(self) -> int:
+        """Offset in the outermost dimension of `aliased_buffer` where this node's output starts."""
+        return self._aliased_offset
+
+    @aliased_offset.setter
+    def aliased_offset(self, v: int) -> None:
+        self._aliased_offset = v
+
     def transpose(self, perm: List[int]) -> None:
         """Transpose the shape and format. This operation is destructive."""
         self._assert(len(set(perm)) == len(self._shape), "Illegal permutation specified.")
@@ -549,6 +569,8 @@ class Constant(Variable):
         self._kn2row_data = kn2row_data
         self._kn2row_dimension_format = kn2row_dimension_format
         self._kn2row_shape = kn2row_shape
+        self._winograd_data: Optional[np.ndarray] = None
+        self._winograd_tile = 0
         super().__init__(name, shape, dtype, {}, data, dimension_format=dimension_format)
 
     def run_forward(self) -> np.ndarray:
@@ -583,6 +605,24 @@ class Constant(Variable):
     def kn2row_shape(self) -> List[int]:
         return self._kn2row_shape
 
+    @property
+    def winograd_data(self) -> Optional[np.ndarray]:
+        """Return the kernels transformed for Winograd convolution, if any."""
+        return self._winograd_data
+
+    @winograd_data.setter
+    def winograd_data(self, val: Optional[np.ndarray]) -> None:
+        self._winograd_data = val
+
+    @property
+    def winograd_tile(self) -> int:
+        """Return the output tile size m of F(m x m, 3 x 3), or 0 if not transformed."""
+        return self._winograd_tile
+
+    @winograd_tile.setter
+    def winograd_tile(self, val: int) -> None:
+        self._winograd_tile = val
+
 
 class Output(Variable):
     """Output class."""
@@ -1013,6 +1053,8 @@ class Conv(Operator):
         self._quantizer: Optional['Quantizer'] = None
         self._thresholds = thresholds
         self._original_shape = shape
+        self._fused_chain: List['Conv'] = []
+        self._fused_head = ''
         super().__init__(name, shape, dtype, input_ops, dimension_format=dimension_format)
         # if kernel shape is not assigned, estimate kernel shape from input W's shape
 
@@ -1108,6 +1150,10 @@ class Conv(Operator):
         """Get pads."""
         return self._pads
 
+    @pads.setter
+    def pads(self, value: List[int]) -> None:
+        self._pads = value
+
     @property
     def strides(self) -> List[int]:
         """Get strides."""
@@ -1195,6 +1241,24 @@ class Conv(Operator):
     def thresholds(self, val: List[float]) -> None:
         self._thresholds = val
 
+    @property
+    def fused_chain(self) -> List['Conv']:
+        """The convolutions after this one that can run fused with it, band by band, or []."""
+        return self._fused_chain
+
+    @fused_chain.setter
+    def fused_chain(self, val: List['Conv']) -> None:
+        self._fused_chain = val
+
+    @property
+    def fused_head(self) -> str:
+        """Name of the first convolution of the fused chain this one belongs to, or ''."""
+        return self._fused_head
+
+    @fused_head.setter
+    def fused_head(self, val: str) -> None:
+        self._fused_head = val
+
     @classmethod
     def infer_shape(cls, lists: Dict[str, List[int]], format: str, input_formats: List[str],
                     attrs: Dict[str, Any]) -> List[int]:
@@ -2737,7 +2801,8 @@ class Pad(Operator):
         input A, assume input A has dimension of D the padded size of each dimension D
         of the output C is given by the formula below:
                 B[D, 0] + A.dim_size(D) + B[D, 1]
-        Note. currently only the channel-wise paddings are supported.
+        Note. func_Pad only pads channels; height and width paddings are only supported
+        when pass_fold_pad_into_conv moves them into the following float convolution.
 
     Output
     ------
@@ -2759,8 +2824,8 @@ class Pad(Operator):
 
     def _check_consistency(self) -> None:
         super()._check_consistency()
-        self._assert(np.all(self.input_ops['B'].data[:-1] == 0),
-                     f'{self.op_type}" {self.name}" only supports channel-wise paddings')
+        self._assert(np.all(self.input_ops['B'].data[0] == 0),
+                     f'{self.op_type}" {self.name}" does not support batch paddings')
 
     @property
     def _dispatch_name(self) -> str:
@@ -86,6 +86,70 @@ def pass_transpose(graph: Graph) -> None:
         m.transpose(permutation)
 
 
+def pass_fold_pad_into_conv(graph: Graph) -> None:
+    """Removes a Pad node P whose only consumer is a float convolution C.
+       The padded channels are zeros and contribute nothing to C, so the matching slices of the
+       weights of C are dropped instead. Height and width paddings are added to the pads of C.
+       C then reads the input of P directly.
+       Quantized convolutions keep their Pad: their kernels only support the same padding on
+       every side.
+
+    Args:
+        graph (Graph): The input graph. It will be modified in-place.
+
+    """
+    exec_list = [n for n in sort_graph(graph) if n.op_type == 'Pad']
+    to_be_removed = []
+
+    for pad in exec_list:
+        consumers = pad.output_op_list
+        if len(consumers) != 1 or consumers[0].op_type != 'Conv':
+            continue
+
+        conv = consumers[0]
+        in_op = pad.input_ops['A']
+        padding = pad.input_ops['B']
+        weight = conv.input_ops['W']
+        if conv.input_ops['X'] != pad or pad.dimension != 'NHWC' or padding.op_type != 'Constant':
+            continue
+        # quantized convolutions read packed inputs which are already padded to whole words
+        if weight.op_type != 'Constant' or len(weight.output_op_list) != 1:
+            continue
+
+        (batch_pre, batch_post), (top, bottom), (left, right), (pre, post) = padding.data.tolist()
+        if batch_pre != 0 or batch_post != 0:
+            continue
+        axis = weight.dimension.replace('I', 'C').index('C')
+        unpadded_data = np.take(weight.data, range(pre, pre + in_op.channel), axis=axis)
+
+        unpadded_weight = Constant(
+            weight.name + '_unpadded',
+            weight.dtype,
+            unpadded_data,
+            dimension_format=weight.dimension
+        )
+        graph.add_op(unpadded_weight)
+        unpadded_weight.add_outputs({'output': [conv]})
+        conv.add_input('W', unpadded_weight)
+
+        # pads are [top, bottom, left, right]
+        pad_top, pad_bottom, pad_left, pad_right = conv.pads
+        conv.pads = [pad_top + top, pad_bottom + bottom, pad_left + left, pad_right + right]
+
+        conv.add_input('X', in_op)
+        for output_name, consumer_list in in_op.output_ops.items():
+            if pad in consumer_list:
+                consumer_list[consumer_list.index(pad)] = conv
+                break
+
+        to_be_removed += [pad, weight]
+        if len(padding.output_op_list) == 1:
+            to_be_removed.append(padding)
+
+    for op in to_be_removed:
+        graph.remove_op(op)
+
+
 def pass_constant_folding(graph: Graph) -> None:
     """Given a node N, if the value of each input of N is known at compilation time then N will be executed.
        The node N and its inputs will be replaced with a Constant node which holds the computed output of N.
@@ -651,3 +715,57 @@ def pass_lookup(graph: Graph) -> None:
 
     for op in to_be_removed:
         graph.remove_op(op)
+
+
+def pass_winograd_weights(graph: Graph) -> None:
+    """Given a float 3x3 stride 1 convolution C with constant weights, transforms the weights of C for
+       Winograd F(m x m, 3 x 3) convolution on the runtime. m is 4 when the output of C spans at least two
+       4x4 tiles in each direction and 2 otherwise. Convolutions with few channels are left to kn2row, since
+       the input and output transforms would dominate there.
+
+    Args:
+        graph (Graph): The input graph. It will be modified in-place.
+
+    """
+    min_channels = 16
+    oc_align = 8  # dlk::impl::winograd_oc_align
+    transforms = {
+        2: np.array([[1, 0, 0],
+                     [1 / 2, 1 / 2, 1 / 2],
+                     [1 / 2, -1 / 2, 1 / 2],
+                     [0, 0, 1]]),
+        4: np.array([[1 / 4, 0, 0],
+                     [-1 / 6, -1 / 6, -1 / 6],
+                     [-1 / 6, 1 / 6, -1 / 6],
+                     [1 / 24, 1 / 12, 1 / 6],
+                     [1 / 24, -1 / 12, 1 / 6],
+                     [0, 0, 1]]),
+    }
+
+    exec_list = [n for n in sort_graph(graph) if n.op_type == 'Conv']
+    for conv in exec_list:
+        weight = conv.input_ops['W']
+        if conv.is_quantized or weight.op_type != 'Constant' or len(weight.output_op_list) != 1:
+            continue
+        if conv.kernel_height != 3 or conv.kernel_width != 3 or any(s != 1 for s in conv.strides):
+            continue
+        if any(d != 1 for d in conv.dilations):
+            continue
+
+        dim = weight.dimension.replace('I', 'C').replace('O', 'N')
+        g = weight.data.transpose([dim.index(s) for s in 'NHWC'])
+        oc, _, _, ic = g.shape
+        if ic < min_channels or oc < min_channels:
+            continue
+
+        m = 4 if conv.height >= 8 and conv.width >= 8 else 2
+        gt = transforms[m]
+        alpha = m + 2
+
+        # U = G g G^T for every (input, output) channel pair, laid out as [alpha * alpha][ic][oc]
+        u = np.einsum('ak,okli,bl->abio', gt, g.astype(np.float64), gt).reshape(alpha * alpha, ic, oc)
+        oc_pad = (oc + oc_align - 1) // oc_align * oc_align
+        u = np.pad(u, [(0, 0), (0, 0), (0, oc_pad - oc)], 'constant')
+
+        weight.winograd_data = u.astype(np.float32)
+        weight.winograd_tile = m
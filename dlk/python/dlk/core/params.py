@@ -14,8 +14,11 @@
 # limitations under the License.
 # =============================================================================
 """Parameter module."""
+import hashlib
 from typing import List
 
+import numpy as np
+
 from core.config import Config
 from core.data_types import *
 from core.operators import Conv
@@ -142,3 +145,19 @@ class Params(object):
     @property
     def max_size_qkernels_per_pe(self):
         return int(self.max_elems_kernel)
+
+    @property
+    def weights_id(self) -> str:
+        """Hash of the kernels and thresholds Network::init uploads to the FPGA, as a C++ literal.
+
+        The reserved memory keeps them across runs; WeightStore looks this id up to skip the upload.
+        """
+        h = hashlib.sha256()
+        for conv in self.graph.convs(quantized_only=True):
+            kernel = conv.input_nodes[1]
+            h.update(np.asarray(kernel.transposed_shape, dtype=np.int64).tobytes())
+            h.update(np.asarray(kernel.transposed_data, dtype=np.int64).tobytes())
+            if conv.has_thresholds:
+                h.update(np.asarray(conv.thresholds, dtype=np.int64).tobytes())
+        # 0 marks a free entry of the table
+        return f'0x{int(h.hexdigest()[:16], 16) or 1:016x}ull'
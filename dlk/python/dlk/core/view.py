@@ -14,15 +14,18 @@
 # limitations under the License.
 # =============================================================================
 import copy
-from textwrap import dedent
+from textwrap import dedent, indent
+
+import numpy as np
 
 from core.data_types import *
 
 
 class View(object):
+    alias_op_types = ['Identity', 'Abs', 'Mean', 'StopGradient']
+
     def __init__(self, op):
         self.op = op
-        self.reuse_buffer_str = ''
 
     @property
     def rank(self):
@@ -39,12 +42,59 @@ class View(object):
     def shape_as_cpp(self):
         return ','.join(map(lambda x: str(x), self.op.shape))
 
-    def run(self):
+    @staticmethod
+    def _size_in_bytes(op):
+        if op.op_type == 'Constant':
+            return op.data.nbytes
+        elements = 1
+        for d in op.shape:
+            elements *= d
+        if op.dtype == QUANTIZED_PACKED():
+            # packed shapes count bits
+            return elements // 8
+        try:
+            return elements * np.dtype(op.dtype.nptype()).itemsize
+        except NotImplementedError:
+            return elements * 4
+
+    @property
+    def cost_as_cpp(self):
+        """Operations and bytes moved by this node, and whether the operations are bit operations of a
+        bit-serial convolution rather than FLOPs, as a C++ initializer list."""
+        op = self.op
+        binary = False
+        if op.op_type == 'Conv':
+            x_op = op.input_ops['X']
+            macs = op.height * op.width * op.channel * op.kernel_height * op.kernel_width * x_op.channel
+            if op.is_quantized:
+                # 1-bit weights times n-bit activations, one AND and one popcount-add per bit pair
+                nbit_qinput = 8 if x_op.op_type == 'Input' else 2
+                ops = 2 * macs * nbit_qinput
+                binary = True
+            else:
+                ops = 2 * macs
+        elif op.op_type in ['MaxPool', 'AveragePool']:
+            ops = op.height * op.width * op.channel * op.kernel_height * op.kernel_width
+        else:
+            ops = 1
+            for d in op.shape:
+                ops *= d
+            if op.dtype == QUANTIZED_PACKED():
+                # one operation per element, not per bit plane
+                ops //= op.shape[-2]
+
+        moved = sum(self._size_in_bytes(i) for i in op.input_ops.values()) + self._size_in_bytes(op)
+        return f'{ops}.0, {moved}.0, {"true" if binary else "false"}'
+
+    @property
+    def declaration(self):
+        """Declaration of the output of this node that is not made with the other buffers: the view of
+        a reused buffer, or the pointer of an alias. It is emitted before any node runs, since the
+        nodes of Network::run are separate scopes."""
         op = self.op
-        input_ops = op.input_ops
-        output_ops = op.output_ops
-        inputs_string = self.inputs_to_string(op, input_ops)
-        shape_string = self.shape_to_string(op.shape)
+
+        if op.op_type in self.alias_op_types:
+            return self.render_alias(op, op.input_ops, op.output_ops)
 
         if op.available_buffer != '':
             if len(op.output_ops.keys()) > 1:
@@ -54,10 +104,37 @@ class View(object):
 
             shape_string = self.shape_to_string(op.shape, channel_active=True)
 
-            self.reuse_buffer_str = f"""TensorView<{op.dtype.cpptype()}, \
-            MemoryLayout::{op.dimension}>::tensor_info_t<std::size_t> {op_name}_shape = {{ {shape_string} }};
-            TensorView<{op.dtype.cpptype()}, \
-            MemoryLayout::{op.dimension}> {op_name}({op.available_buffer}_raw, {op_name}_shape);"""
+            return f"StaticTensorView<{op.dtype.cpptype()}, " \
+                f"MemoryLayout::{op.dimension}, {shape_string}> {op_name}({op.available_buffer}_raw);"
+
+        return ''
+
+    @property
+    def parameters_declaration(self):
+        """Declarations of the parameter structs that run() fills in, local to each node so that nodes
+        can run concurrently."""
+        op = self.op
+        if op.op_type == 'Conv':
+            declarations = 'struct convolution_parameters Conv2D_struct;'
+            if op.is_quantized and op.input_ops['X'].op_type != 'Input':
+                declarations += '\nstruct binary_convolution_parameters binConv2D_struct = binConv2D_defaults;'
+                declarations += '\nconst DeviceSlots::Lease device_slot(device_slots, binConv2D_struct);'
+            return declarations
+        structs = {
+            'MaxPool': 'max_pooling_parameters',
+            'AveragePool': 'avg_pooling_parameters',
+            'MaxPoolWithArgmax': 'MaxPoolWithArgmax_parameters',
+        }
+        if op.op_type in structs:
+            return f'struct {structs[op.op_type]} {op.op_type}_struct;'
+        return ''
+
+    def run(self):
+        op = self.op
+        input_ops = op.input_ops
+        output_ops = op.output_ops
+        inputs_string = self.inputs_to_string(op, input_ops)
+        shape_string = self.shape_to_string(op.shape)
 
         if self.op.op_type == 'QTZ_binary_mean_scaling':
             if len(input_ops) != 1:
@@ -94,9 +171,8 @@ class View(object):
             )
 
         elif self.op.op_type == 'Identity':
-            if len(input_ops) != 1:
-                self.raise_invalid_args_exception(op, input_ops, output_ops)
-            return self.render_alias(op, input_ops, output_ops)
+            # see declaration
+            return ""
 
         elif self.op.op_type == 'Conv':
             if len(input_ops) != 2:
@@ -112,69 +188,19 @@ class View(object):
             b = 32
             od = op.channel
             pad = op.pads[0]
+            # pads are [top, bottom, left, right]
+            pad_top, pad_bottom, pad_left, pad_right = op.pads
             stride = op.strides[0]
             nbit_qinput = 8 if x_op.op_type == 'Input' else 2
 
             if op.is_quantized and nbit_qinput == 2:
-                qk_elems = w_op.data.shape[1]
-
-                kh = self.op.kernel_height
-                kw = self.op.kernel_width
-                kd = x_op.channel
-                k_elems = kh * kw * kd
-                od = ((od + b - 1) // b) * b
-
-                inputs_string = self.inputs_to_string(op, input_ops)
-
-                if op.has_thresholds:
-                    threshold = f'{op.name}_thresholds'
-                    thresholds_addr = f'THRESHOLD_ADDR + {op.name}_thresholds_offset'
-                    conv_func = 'func_QuantizedConv2DWithThreshold'
-                    nbit_aqtz = self.op.a_quantizer[0].nbit
-                    max_value = self.op.a_quantizer[0].max_v
-                else:
-                    threshold = 'nullptr'
-                    thresholds_addr = '0'
-                    conv_func = 'func_QuantizedConv2D'
-                    nbit_aqtz = 2
-                    max_value = 2.0
-
-                # temporary: formula which derive number of qinput is not complete
-                render_string = self.format_string(
-                    f"""
-                    Conv2D_struct.input_height = {ih};
-                    Conv2D_struct.input_width = {iw};
-                    Conv2D_struct.kernel_height = {kh};
-                    Conv2D_struct.kernel_width = {kw};
-                    Conv2D_struct.kernel_depth = {kd};
-                    Conv2D_struct.kernel_elements = {k_elems};
-                    Conv2D_struct.output_channels = {od};
-                    Conv2D_struct.output_height = {oh};
-                    Conv2D_struct.output_width = {ow};
-                    Conv2D_struct.padding = {pad};
-                    Conv2D_struct.stride_along_height = {stride};
-                    Conv2D_struct.stride_along_width = {stride};
-
-                    binConv2D_struct.normal_conv_params = Conv2D_struct;
-                    binConv2D_struct.bin_input_extra_bits = 0;
-                    binConv2D_struct.bin_input_bitwidth = {nbit_qinput};
-                    binConv2D_struct.bin_kernel_ndata = {qk_elems};
-                    binConv2D_struct.bin_input_nwords = {qk_elems};
-                    binConv2D_struct.bin_input_ndata = {qk_elems}*{nbit_qinput};
-                    binConv2D_struct.device_input_buf = device_input_buf;
-                    binConv2D_struct.device_output_buf = device_output_buf;
-                    binConv2D_struct.thresholds = {threshold};
-                    binConv2D_struct.n_bit = {nbit_aqtz};
-                    binConv2D_struct.max_value = {max_value};
-                    binConv2D_struct.debug_name = "{op.name}";
-#ifdef RUN_ON_FPGA
-                    binConv2D_struct.device_kernel_phys_addr = KERNEL_ADDR + {op.name}_kernel_offset;
-                    binConv2D_struct.device_thresholds_phys_addr = {thresholds_addr};
-#endif
-
-                    {conv_func}({inputs_string}, {op.name}, scaling_factors::{op.name}, binConv2D_struct);
-                    """
-                )
+                parameters, call = self.render_quantized_conv(op)
+                render_string = parameters + '\n\n' + call
+                if op.fused_head != '':
+                    render_string = f'if (!fuse_convs || !{op.fused_head}_fused) {{\n' \
+                        + indent(render_string, '  ') + '\n}'
+                elif op.fused_chain:
+                    render_string = self.render_fused_chain(op) + ' else {\n' + indent(render_string, '  ') + '\n}'
 
             else:
                 # temporary
@@ -186,6 +212,13 @@ class View(object):
 
                 inputs_string = self.inputs_to_string(op, input_ops)
 
+                if w_op.op_type == 'Constant' and w_op.winograd_data is not None:
+                    winograd_weights = f'{w_op.name}_winograd'
+                    winograd_tile = w_op.winograd_tile
+                else:
+                    winograd_weights = 'nullptr'
+                    winograd_tile = 0
+
                 render_string = self.format_string(
                     f"""
                     Conv2D_struct.input_height = {ih};
@@ -198,8 +231,14 @@ class View(object):
                     Conv2D_struct.output_height = {oh};
                     Conv2D_struct.output_width = {ow};
                     Conv2D_struct.padding = {pad};
+                    Conv2D_struct.padding_top = {pad_top};
+                    Conv2D_struct.padding_bottom = {pad_bottom};
+                    Conv2D_struct.padding_left = {pad_left};
+                    Conv2D_struct.padding_right = {pad_right};
                     Conv2D_struct.stride_along_height = {stride};
                     Conv2D_struct.stride_along_width = {stride};
+                    Conv2D_struct.winograd_weights = {winograd_weights};
+                    Conv2D_struct.winograd_tile = {winograd_tile};
 
                     func_Conv2D({inputs_string}, {op.name}, Conv2D_struct);
                     """
@@ -332,9 +371,8 @@ class View(object):
             )
 
         elif self.op.op_type == 'Abs':
-            if len(input_ops) != 1:
-                self.raise_invalid_args_exception(op, input_ops, output_ops)
-            return self.render_alias(op, input_ops, output_ops)
+            # see declaration
+            return ""
 
         elif self.op.op_type == 'Max':
             if len(input_ops) != 2:
@@ -351,12 +389,12 @@ class View(object):
         elif self.op.op_type == 'Mean':
             if len(input_ops) != 2:
                 self.raise_invalid_args_exception(op, input_ops, output_ops)
-            return self.render_alias(op, input_ops, output_ops)
+            # see declaration
+            return ""
 
         elif self.op.op_type == 'StopGradient':
-            if len(input_ops) != 1:
-                self.raise_invalid_args_exception(op, input_ops, output_ops)
-            return self.render_alias(op, input_ops, output_ops)
+            # see declaration
+            return ""
 
         elif self.op.op_type == 'Sign':
             return ""
@@ -620,6 +658,13 @@ class View(object):
 
             inputs_string = self.inputs_to_string(op, concat_input)
 
+            if all(v.aliased_buffer == op.name for v in concat_input.values()):
+                return self.format_string(
+                    f"""
+                    // {op.name}: inputs are already written in place
+                    """
+                )
+
             return self.format_string(
                 f"""
                 func_ConcatOnDepth(std::make_tuple({inputs_string}), {op.name});
@@ -692,6 +737,9 @@ class View(object):
             inputs_string = self.inputs_to_string(op, input_ops)
 
             a_op = input_ops['A']
+            if np.any(input_ops['B'].data[:-1] != 0):
+                raise ValueError(f'{op.name}: func_Pad only pads channels; '
+                                 'spatial paddings must be folded into a float convolution')
 
             return self.format_string(
                 f"""
@@ -719,6 +767,107 @@ class View(object):
 
         raise TypeError(f"{self.op.op_type} is not supported in View.run().")
 
+    def render_quantized_conv(self, op):
+        """Statements filling Conv2D_struct and binConv2D_struct for a quantized convolution with a
+        2-bit input, and the call running it."""
+        input_ops = op.input_ops
+        x_op = input_ops['X']
+        w_op = input_ops['W']
+
+        ih = x_op.height
+        iw = x_op.width
+        oh = op.height
+        ow = op.width
+        b = 32
+        od = op.channel
+        pad = op.pads[0]
+        # pads are [top, bottom, left, right]
+        pad_top, pad_bottom, pad_left, pad_right = op.pads
+        stride = op.strides[0]
+        nbit_qinput = 2
+
+        qk_elems = w_op.data.shape[1]
+
+        kh = op.kernel_height
+        kw = op.kernel_width
+        kd = x_op.channel
+        k_elems = kh * kw * kd
+        od = ((od + b - 1) // b) * b
+
+        inputs_string = self.inputs_to_string(op, input_ops)
+
+        if op.has_thresholds:
+            threshold = f'{op.name}_thresholds'
+            thresholds_addr = f'thresholds_phys_base + {op.name}_thresholds_offset'
+            conv_func = 'func_QuantizedConv2DWithThreshold'
+            nbit_aqtz = op.a_quantizer[0].nbit
+            max_value = op.a_quantizer[0].max_v
+        else:
+            threshold = 'nullptr'
+            thresholds_addr = '0'
+            conv_func = 'func_QuantizedConv2D'
+            nbit_aqtz = 2
+            max_value = 2.0
+
+        # temporary: formula which derive number of qinput is not complete
+        parameters = self.format_string(
+            f"""
+            Conv2D_struct.input_height = {ih};
+            Conv2D_struct.input_width = {iw};
+            Conv2D_struct.kernel_height = {kh};
+            Conv2D_struct.kernel_width = {kw};
+            Conv2D_struct.kernel_depth = {kd};
+            Conv2D_struct.kernel_elements = {k_elems};
+            Conv2D_struct.output_channels = {od};
+            Conv2D_struct.output_height = {oh};
+            Conv2D_struct.output_width = {ow};
+            Conv2D_struct.padding = {pad};
+            Conv2D_struct.padding_top = {pad_top};
+            Conv2D_struct.padding_bottom = {pad_bottom};
+            Conv2D_struct.padding_left = {pad_left};
+            Conv2D_struct.padding_right = {pad_right};
+            Conv2D_struct.stride_along_height = {stride};
+            Conv2D_struct.stride_along_width = {stride};
+            Conv2D_struct.winograd_weights = nullptr;
+            Conv2D_struct.winograd_tile = 0;
+
+            binConv2D_struct.normal_conv_params = Conv2D_struct;
+            binConv2D_struct.bin_input_extra_bits = 0;
+            binConv2D_struct.bin_input_bitwidth = {nbit_qinput};
+            binConv2D_struct.bin_kernel_ndata = {qk_elems};
+            binConv2D_struct.bin_input_nwords = {qk_elems};
+            binConv2D_struct.bin_input_ndata = {qk_elems}*{nbit_qinput};
+            binConv2D_struct.thresholds = {threshold};
+            binConv2D_struct.n_bit = {nbit_aqtz};
+            binConv2D_struct.max_value = {max_value};
+            binConv2D_struct.debug_name = "{op.name}";
+            #ifdef RUN_ON_FPGA
+            binConv2D_struct.device_kernel_phys_addr = kernel_phys_base + {op.name}_kernel_offset;
+            binConv2D_struct.device_thresholds_phys_addr = {thresholds_addr};
+            #endif
+            """
+        )
+        call = f'{conv_func}({inputs_string}, {op.name}, scaling_factors::{op.name}, binConv2D_struct);'
+        return parameters, call
+
+    def render_fused_chain(self, op):
+        """Runs the chain starting at op with func_QuantizedConv2DChainWithThreshold, see
+        CodeGenerater.fuse_conv_chains."""
+        chain = [op] + op.fused_chain
+        kernels = ', '.join(f'&{c.input_ops["W"].name}' for c in chain)
+        lines = [
+            f'// also runs {", ".join(c.name for c in op.fused_chain)}',
+            f'const kernel_t* const chain_kernels[] = {{ {kernels} }};',
+            f'struct binary_convolution_parameters chain_params[{len(chain)}];',
+        ]
+        for i, c in enumerate(chain):
+            parameters, _ = self.render_quantized_conv(c)
+            lines += ['', parameters, f'chain_params[{i}] = binConv2D_struct;']
+        x = self.inputs_to_string(op, {'X': op.input_ops['X']})
+        y = chain[-1].name
+        lines += ['', f'func_QuantizedConv2DChainWithThreshold({x}, chain_kernels, chain_params, {len(chain)}, {y});']
+        return f'if (fuse_convs && {op.name}_fused) {{\n' + indent('\n'.join(lines), '  ') + '\n}'
+
     def render_alias(self, op, input_ops, output_ops):
         if len(input_ops) != 1:
             self.raise_invalid_args_exception(op, input_ops, output_ops)
@@ -726,9 +875,6 @@ class View(object):
             return f'{op.dtype.cpptype()}* {op.name} = {input_ops["input"].name};'
 
     def format_string(self, string):
-        if self.reuse_buffer_str:
-            string = self.reuse_buffer_str + '\n' + string
-
         return dedent(string).strip()
 
     def inputs_to_string(self, op, inputs):
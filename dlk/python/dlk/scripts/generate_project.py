@@ -28,11 +28,11 @@ from core.graph import Graph
 from core.params import Params
 from code_generater import CodeGenerater
 from frontend import TensorFlowIO
-from core.optimizer import pass_remove_identities, pass_transpose, pass_constant_folding, \
+from core.optimizer import pass_remove_identities, pass_transpose, pass_fold_pad_into_conv, pass_constant_folding, \
     pass_propagate_quantization_details_into_conv, pass_compute_thresholds, pass_pack_weights, \
     pass_quantize_convolutions, pass_propagate_datatypes, \
     pass_propagate_format, pass_propagate_output_type_backward, \
-    pass_lookup
+    pass_lookup, pass_winograd_weights
 
 SCRITPS_DIR = path.abspath(path.dirname(__file__))
 DLK_ROOT_DIR = path.abspath(path.join(SCRITPS_DIR, '..'))
@@ -53,6 +53,7 @@ def optimize_graph_step(graph: Graph, config: Config) -> None:
 
     pass_remove_identities(graph)
     pass_transpose(graph)
+    pass_fold_pad_into_conv(graph)
 
     if config.activate_hard_quantization:
         pass_lookup(graph)
@@ -68,6 +69,7 @@ def optimize_graph_step(graph: Graph, config: Config) -> None:
     pass_propagate_format(graph)
 
     pass_constant_folding(graph)
+    pass_winograd_weights(graph)
 
 
 def generate_code_step(graph: Graph, config: Config) -> None:
@@ -84,7 +86,10 @@ def generate_code_step(graph: Graph, config: Config) -> None:
                             params,
                             config)
 
+    builder.alias_concat_inputs()
+    builder.fuse_conv_chains()
     builder.reuse_output_buffers()
+    builder.build_task_graph()
     builder.generate_files_from_template()
     builder.generate_inputs()
 
@@ -0,0 +1,100 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef DLK_ACTIVATION_DUMP_H_INCLUDED
+#define DLK_ACTIVATION_DUMP_H_INCLUDED
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "global.h"
+#include "tensor_view.h"
+
+template <typename T> struct npy_descr;
+template <> struct npy_descr<float> { static constexpr const char* value = "<f4"; };
+template <> struct npy_descr<int32_t> { static constexpr const char* value = "<i4"; };
+template <> struct npy_descr<uint32_t> { static constexpr const char* value = "<u4"; };
+template <> struct npy_descr<int16_t> { static constexpr const char* value = "<i2"; };
+template <> struct npy_descr<uint16_t> { static constexpr const char* value = "<u2"; };
+template <> struct npy_descr<int8_t> { static constexpr const char* value = "|i1"; };
+template <> struct npy_descr<uint8_t> { static constexpr const char* value = "|u1"; };
+template <> struct npy_descr<uint64_t> { static constexpr const char* value = "<u8"; };
+
+// Writes node outputs to .npy files while the network runs.
+//
+// Nodes are selected at runtime with Select() or the DLK_DUMP environment
+// variable: a comma-separated list of node names, name prefixes ending in
+// '*' ("*" is every node) and node index ranges "first-last". Only every
+// Nth run is dumped (SetEvery(), DLK_DUMP_EVERY). Output i of a node goes to
+// <dir>/<run>/<node><i>.npy (SetDirectory(), DLK_DUMP_DIR, "debug" by default).
+//
+// Dump() only copies the tensor; a background thread writes each file with
+// a single write(). While more than max_pending_bytes are queued, further
+// dumps are dropped rather than stalling the network; Flush() reports them.
+class ActivationDump
+{
+public:
+  static constexpr std::size_t max_pending_bytes = 256 << 20;
+
+  // An empty spec disables dumping.
+  static void Select(const std::string& spec);
+  static void SetEvery(unsigned every);
+  static void SetDirectory(const std::string& dir);
+  static bool IsEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+  // Called at the start of every run; returns whether this run is dumped.
+  static bool BeginRun();
+  // Whether the index-th node of the graph is dumped in this run.
+  static bool Wants(std::size_t index, const char* name) {
+    return run_dumped.load(std::memory_order_relaxed) && Selected(index, name);
+  }
+
+  template <typename TView>
+  static void Dump(const char* name, unsigned output, const TView& view) {
+    using elem_t = std::remove_cv_t<typename TView::base_t>;
+    using raw_t = std::remove_cv_t<typename Base<elem_t>::type>;
+    const auto& shape = view.get_shape();
+    std::vector<std::size_t> npy_shape(shape.begin(), shape.end());
+    if (!std::is_same<elem_t, raw_t>::value && !npy_shape.empty()) {
+      // packed: the innermost dimension counts bits, the file stores words
+      const std::size_t bits = sizeof(raw_t) * CHAR_BIT;
+      npy_shape.back() = (npy_shape.back() + bits - 1) / bits;
+    }
+    std::size_t count = 1;
+    for (const auto len : npy_shape) {
+      count *= len;
+    }
+    Enqueue(name, output, npy_descr<raw_t>::value, npy_shape,
+        const_cast<const elem_t*>(view.data()), count * sizeof(raw_t));
+  }
+
+  // Blocks until every queued file is written. Returns the number of dumps
+  // dropped so far because the queue was full or a file could not be written.
+  static std::size_t Flush();
+
+private:
+  static std::atomic<bool> enabled;
+  static std::atomic<bool> run_dumped;
+
+  static bool Selected(std::size_t index, const char* name);
+  static void Enqueue(const char* name, unsigned output, const char* descr,
+      const std::vector<std::size_t>& shape, const void* data, std::size_t bytes);
+};
+
+#endif // DLK_ACTIVATION_DUMP_H_INCLUDED
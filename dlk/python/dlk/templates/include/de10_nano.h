@@ -16,7 +16,12 @@ limitations under the License.
 #pragma once
 #include "global.h"
 #include "memdriver.h"
+#include "tca_wait.h"
 #include "time_measurement.h"
+#ifdef TCA_EMULATOR
+#include "tca_emulator.h"
+#endif
+#include <atomic>
 #include <cassert>
 #include <cstddef>
 
@@ -136,7 +141,7 @@ struct Parameters {
     uint32_t bnqEnable;
 };
 
-Parameters calcParameters(uint32_t inputHeight, uint32_t inputWidth, uint32_t inputChannels, uint32_t inputTileWidth, uint32_t inputTileHeight,
+inline Parameters calcParameters(uint32_t inputHeight, uint32_t inputWidth, uint32_t inputChannels, uint32_t inputTileWidth, uint32_t inputTileHeight,
     uint32_t outputChannels, uint32_t kernelHeight, uint32_t kernelWidth, uint32_t inputAddress, uint32_t kernelAddress, uint32_t thresholdAddress, uint32_t outputAddress, bool enable_bnq) {
 
   auto divRoundUp = [](uint32_t x, uint32_t y) {
@@ -259,17 +264,43 @@ Parameters calcParameters(uint32_t inputHeight, uint32_t inputWidth, uint32_t in
   return p;
 }
 
-void RunTCA(unsigned long input_addr, unsigned long output_addr, unsigned long kernel_addr,
+// The CSR block of the accelerator, mapped on first use. UseCsr substitutes
+// a software stand-in (tests, emulation) and must come before the first
+// convolution.
+inline volatile uint32_t*& csr_pointer() {
+  static volatile uint32_t* csr = nullptr;
+  return csr;
+}
+
+inline void UseCsr(volatile uint32_t* csr) {
+  csr_pointer() = csr;
+}
+
+inline volatile uint32_t* CsrBlock() {
+  auto& csr = csr_pointer();
+  if (csr == nullptr) {
+    static MappedMem csr_mmap(HPS_TO_FPGA_LW_BASE, 0xFF);
+    csr = reinterpret_cast<volatile uint32_t*>(csr_mmap.get());
+  }
+  return csr;
+}
+
+// The registers of a convolution, for StartTCA.
+inline Parameters TCAParameters(unsigned long input_addr, unsigned long output_addr, unsigned long kernel_addr,
   unsigned long thresholds_addr, unsigned in_w, unsigned in_h, unsigned in_c, unsigned nbits_in_data,
   unsigned out_w, unsigned out_h, unsigned out_c, unsigned k_w, unsigned k_h, unsigned pad, unsigned stride) {
 
   unsigned use_threshold = (thresholds_addr != 0) ? 1 : 0;
 
-  static MappedMem csr_mmap(HPS_TO_FPGA_LW_BASE, 0xFF);
-  static volatile uint32_t* csr = reinterpret_cast<uint32_t*>(csr_mmap.get());
-    auto tileWidth = 32u;
-    auto tileHeight = 32u;
-    auto p = calcParameters(in_h, in_w, in_c, tileWidth, tileHeight, out_c, k_h, k_w, input_addr, kernel_addr, thresholds_addr, output_addr, use_threshold == 1);
+  auto tileWidth = 32u;
+  auto tileHeight = 32u;
+  return calcParameters(in_h, in_w, in_c, tileWidth, tileHeight, out_c, k_h, k_w, input_addr, kernel_addr, thresholds_addr, output_addr, use_threshold == 1);
+}
+
+// Programs a convolution and starts it without waiting for it: the caller
+// may do other work before WaitTCA. One job at a time.
+inline void StartTCA(const Parameters& p) {
+  volatile uint32_t* csr = CsrBlock();
 
     csr[static_cast<std::size_t>(Csr::admaInputAddress)] = p.admaInputAddress;
     csr[static_cast<std::size_t>(Csr::admaInputHCount)] = p.admaInputHCount;
@@ -323,14 +354,33 @@ void RunTCA(unsigned long input_addr, unsigned long output_addr, unsigned long k
     csr[static_cast<std::size_t>(Csr::qdmaStartAddress)] = p.qdmaStartAddress;
     csr[static_cast<std::size_t>(Csr::bnqEnable)] = p.bnqEnable;
 
-    // std::cout << "Status " << csr[Csr::statusRegister)] << std::endl;
+    Completion::Arm();
     csr[static_cast<std::size_t>(Csr::start)] = 1;
+#ifdef TCA_EMULATOR
+    emulator::Start(csr);
+#endif
+}
+
+inline void StartTCA(unsigned long input_addr, unsigned long output_addr, unsigned long kernel_addr,
+  unsigned long thresholds_addr, unsigned in_w, unsigned in_h, unsigned in_c, unsigned nbits_in_data,
+  unsigned out_w, unsigned out_h, unsigned out_c, unsigned k_w, unsigned k_h, unsigned pad, unsigned stride) {
+  StartTCA(TCAParameters(input_addr, output_addr, kernel_addr, thresholds_addr, in_w, in_h, in_c, nbits_in_data,
+      out_w, out_h, out_c, k_w, k_h, pad, stride));
+}
 
-    // std::cout << "Status " << csr[Csr::statusRegister)] << std::endl;
-    while (csr[static_cast<std::size_t>(Csr::statusRegister)] != 127) {
-        // std::cout << "Status " << csr[Csr::statusRegister] << std::endl;
-        continue;
-    }
+// Waits for the job of the last StartTCA to finish, as Completion::Policy
+// says.
+inline void WaitTCA() {
+  Completion::Wait(&CsrBlock()[static_cast<std::size_t>(Csr::statusRegister)]);
+  std::atomic_thread_fence(std::memory_order_acquire);
+}
+
+inline void RunTCA(unsigned long input_addr, unsigned long output_addr, unsigned long kernel_addr,
+  unsigned long thresholds_addr, unsigned in_w, unsigned in_h, unsigned in_c, unsigned nbits_in_data,
+  unsigned out_w, unsigned out_h, unsigned out_c, unsigned k_w, unsigned k_h, unsigned pad, unsigned stride) {
+  StartTCA(input_addr, output_addr, kernel_addr, thresholds_addr, in_w, in_h, in_c, nbits_in_data,
+      out_w, out_h, out_c, k_w, k_h, pad, stride);
+  WaitTCA();
 }
 
 } // namespace de10_nano
@@ -0,0 +1,82 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef DLK_DEVICE_SLOTS_H_INCLUDED
+#define DLK_DEVICE_SLOTS_H_INCLUDED
+
+#include <condition_variable>
+#include <mutex>
+
+#include "dma_buffer.h"
+#include "global.h"
+#include "operators.h"
+
+// The device_input_buf / device_output_buf pairs of the quantized
+// convolutions.
+//
+// On the FPGA there are two pairs (ping-pong): while the accelerator runs a
+// convolution out of one, another convolution packs its input into the other
+// and copies out its output, and independent branches keep the CPU busy.
+// Slots are handed out in turn, so back-to-back convolutions alternate
+// between them. Other builds have one pair, which their convolutions (marked
+// exclusive in the task graph) never contend for.
+class DeviceSlots
+{
+public:
+  static constexpr unsigned max_slots = 2;
+
+  struct Slot {
+    QUANTIZED_PACKED* input;
+    BIN_CONV_OUTPUT* output;
+    DMA_Buffer* dma_input; // nullptr off the FPGA
+    DMA_Buffer* dma_output;
+  };
+
+  // Ignored once max_slots are there.
+  void Add(const Slot& slot);
+  unsigned Size() const { return count; }
+
+  // Holds a slot, written into p, from the packing of the input to the last
+  // read of the output; waits while every slot is held.
+  class Lease
+  {
+  public:
+    Lease(DeviceSlots& slots, binary_convolution_parameters& p);
+    ~Lease();
+
+    unsigned Index() const { return index; }
+
+  private:
+    DeviceSlots& slots;
+    unsigned index;
+
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+  };
+
+private:
+  Slot slots[max_slots];
+  bool busy[max_slots] = {};
+  unsigned count = 0;
+  unsigned next = 0; // handed out first when free
+
+  std::mutex mutex;
+  std::condition_variable released;
+
+  unsigned acquire();
+  void release(unsigned index);
+};
+
+#endif // DLK_DEVICE_SLOTS_H_INCLUDED
@@ -21,39 +21,65 @@ limitations under the License.
 #include <errno.h>
 #include <string.h>
 
+#include <algorithm>
 #include <iostream>
-#include <fstream>
-#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
 
-class DMA_Buffer
+#ifdef TCA_EMULATOR
+#include "tca_emulator.h"
+#endif
+
+// A udmabuf device, or a window of /dev/mem, mapped once.
+//
+// DMA_Buffers are carved out of it, so that the device buffers of a network
+// share one mapping and one set of udmabuf control files. Cache maintenance
+// works on byte ranges: on the Cortex-A9 a flush costs in proportion to its
+// size, so callers sync what they wrote or are about to read and nothing
+// more. The control files are opened once, and sync_offset / sync_size are
+// only written when they change.
+class DMA_Region
 {
 
 public:
 
-  DMA_Buffer()
+  DMA_Region()
     :
     mm_buffer(nullptr),
-    mapped_size_in_bytes(0)
-  {}
+    mapped_size_in_bytes(0),
+    phys_addr(0),
+    allocated(0),
+    using_dma_cache(false)
+  {
+    for(int i = 0; i < ctrl_count; ++i)
+    {
+      ctrl[i] = -1;
+      written[i] = ~0ul;
+    }
+  }
 
 
-  ~DMA_Buffer()
+  ~DMA_Region()
   {
+#ifndef TCA_EMULATOR
     if(mm_buffer != nullptr)
-    {
       munmap((void *) mm_buffer, mapped_size_in_bytes);
-
-      if(using_dma_cache)
-      {
-        for(auto p : ctrl)
-          close(p.second);
-      }
+    for(int i = 0; i < ctrl_count; ++i)
+    {
+      if(ctrl[i] >= 0)
+        close(ctrl[i]);
     }
+#endif
   }
 
 
-  bool init(const std::string &device_name, uint32_t elements, uint32_t element_size, bool use_dma_cache, unsigned long physical_address)
+  // With use_dma_cache, maps the whole udmabuf device_name (size is then
+  // ignored); otherwise size bytes of device_name at physical_address.
+  // root is prepended to /dev and /sys, e.g. for a fake device in tests.
+  bool init(const std::string &device_name, unsigned long size, bool use_dma_cache, unsigned long physical_address,
+            const std::string &root = "")
   {
     if(mm_buffer != nullptr)
     {
@@ -61,35 +87,38 @@ public:
       return false;
     }
 
-    const std::string device_file = "/dev/" + device_name;
+#ifdef TCA_EMULATOR
+    // emulated memory needs no cache maintenance; udmabuf devices get a fresh range
+    using_dma_cache = false;
+    mapped_size_in_bytes = use_dma_cache ? emulated_udmabuf_size : size;
+    phys_addr = use_dma_cache ? de10_nano::emulator::Allocate(mapped_size_in_bytes) : physical_address;
+    mm_buffer = de10_nano::emulator::Map(phys_addr, mapped_size_in_bytes);
+    memset((void *) mm_buffer, 0, mapped_size_in_bytes);
+    return true;
+#endif
+
+    const std::string device_file = root + "/dev/" + device_name;
     using_dma_cache = use_dma_cache;
 
     if(using_dma_cache)
     {
-        const std::string sys_class_device_directory = "/sys/class/udmabuf/" + device_name;
+      const std::string sys_class_device_directory = root + "/sys/class/udmabuf/" + device_name + "/";
 
-        // read only control attributes
-        for(auto name : ro_ctrl_names)
-        {
-            std::string fname = sys_class_device_directory + "/" + name;
-            ctrl[name] = open(fname.c_str(), O_RDONLY);
-        }
+      // constant values, read only one time
+      if(!read_number(sys_class_device_directory + "phys_addr", 16, phys_addr) ||
+         !read_number(sys_class_device_directory + "size", 10, size))
+        return false;
 
-        // read/write control attributes
-        for(auto name : rw_ctrl_names)
+      const char *names[ctrl_count] = {"sync_for_cpu", "sync_for_device", "sync_offset", "sync_size"};
+      for(int i = 0; i < ctrl_count; ++i)
+      {
+        ctrl[i] = open((sys_class_device_directory + names[i]).c_str(), O_WRONLY);
+        if(ctrl[i] < 0)
         {
-            std::string fname = sys_class_device_directory + "/" + name;
-            ctrl[name] = open(fname.c_str(), O_WRONLY);
-        }
-
-        // constant value, read only one time
-        ssize_t bytes_read = read(ctrl["phys_addr"], attribute_buffer, 1024);
-        if(bytes_read == 0)
-          return false;
-
-        int match = sscanf(attribute_buffer, "%lx", &phys_addr);
-        if(match != 1)
+          std::cout << "Error: " << names[i] << ": " << strerror(errno) << std::endl;
           return false;
+        }
+      }
     }
     else
     {
@@ -106,83 +135,299 @@ public:
       return false;
     }
 
-    mapped_size_in_bytes = elements * element_size;
     mm_buffer = mmap(
       nullptr,
-      mapped_size_in_bytes,
+      size,
       PROT_READ | PROT_WRITE,
       MAP_SHARED,
       dev_fd,
-      physical_address
+      using_dma_cache ? 0 : physical_address
     );
 
     close(dev_fd);
     if(mm_buffer == MAP_FAILED)
     {
+      mm_buffer = nullptr;
       std::cout << "Error: " << strerror(errno) << std::endl;
       return false;
     }
+    mapped_size_in_bytes = size;
 
     memset((void *) mm_buffer, 0, mapped_size_in_bytes);
 
     return true;
   }
 
-  unsigned long physical_address()
+
+  // size bytes at a page boundary, so that no cache line is shared with
+  // another buffer; false once the region is full
+  bool allocate(unsigned long size, unsigned long &offset)
+  {
+    const unsigned long begin = (allocated + page_size - 1) / page_size * page_size;
+    if(mm_buffer == nullptr || begin + size > mapped_size_in_bytes)
+      return false;
+    offset = begin;
+    allocated = begin + size;
+    return true;
+  }
+
+  unsigned long physical_address() const
   {
     return phys_addr;
   }
 
-  bool sync_for_cpu()
+  unsigned long size_in_bytes() const
   {
-    if(using_dma_cache)
-    {
-      ssize_t written = write(ctrl["sync_for_cpu"], "1", 1);
-      return written == strlen("1");
-    }
-    else
+    return mapped_size_in_bytes;
+  }
+
+  volatile uint8_t* data() const
+  {
+    return static_cast<volatile uint8_t *>(mm_buffer);
+  }
+
+  bool sync_for_cpu(unsigned long offset, unsigned long size)
+  {
+    return sync(ctrl_sync_for_cpu, offset, size);
+  }
+
+  bool sync_for_device(unsigned long offset, unsigned long size)
+  {
+    return sync(ctrl_sync_for_device, offset, size);
+  }
+
+
+private:
+  DMA_Region(const DMA_Region &);
+  DMA_Region& operator=(const DMA_Region &);
+
+  enum Ctrl { ctrl_sync_for_cpu, ctrl_sync_for_device, ctrl_sync_offset, ctrl_sync_size, ctrl_count };
+
+  static constexpr unsigned long page_size = 4096;
+#ifdef TCA_EMULATOR
+  static constexpr unsigned long emulated_udmabuf_size = 64ul << 20;
+#endif
+
+  // offset, size and trigger go together: buffers of the region may sync
+  // from several threads
+  bool sync(Ctrl direction, unsigned long offset, unsigned long size)
+  {
+    if(!using_dma_cache || size == 0)
       return true;
+    std::lock_guard<std::mutex> lock(mutex);
+    return write_number(ctrl_sync_offset, offset) &&
+           write_number(ctrl_sync_size, size) &&
+           write(ctrl[direction], "1", 1) == 1;
   }
 
-  bool sync_for_device()
+  // The sysfs attributes keep their value, so unchanged ones are skipped.
+  // Written as echo would, newline included.
+  bool write_number(Ctrl attribute, unsigned long value)
   {
-    if(using_dma_cache) {
-      ssize_t written = write(ctrl["sync_for_device"], "1", 1);
-      return written == strlen("1");
-    }
-    else
+    if(written[attribute] == value)
       return true;
+    char digits[24];
+    char *begin = digits + sizeof(digits) - 1;
+    digits[sizeof(digits) - 1] = '\n';
+    unsigned long rest = value;
+    do
+    {
+      *--begin = '0' + rest % 10;
+      rest /= 10;
+    } while(rest != 0);
+    const ssize_t len = digits + sizeof(digits) - begin;
+    const bool ok = write(ctrl[attribute], begin, len) == len;
+    written[attribute] = ok ? value : ~0ul;
+    return ok;
   }
 
-  bool sync_size(unsigned long size)
+  static bool read_number(const std::string &path, int base, unsigned long &value)
   {
-    if(using_dma_cache)
+    const int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+      return false;
+    char text[64] = {};
+    const ssize_t bytes_read = read(fd, text, sizeof(text) - 1);
+    close(fd);
+    if(bytes_read <= 0)
+      return false;
+    char *end;
+    value = strtoul(text, &end, base);
+    return end != text;
+  }
+
+private:
+  volatile void *mm_buffer;
+  unsigned long mapped_size_in_bytes;
+  unsigned long phys_addr;
+  unsigned long allocated;
+  bool using_dma_cache;
+
+  int ctrl[ctrl_count];
+  unsigned long written[ctrl_count]; // last value of sync_offset / sync_size
+  std::mutex mutex;
+};
+
+
+// The udmabuf devices of a network (udmabuf0, udmabuf1, ...), opened as
+// buffers need them. A buffer goes into the first device it fits in, so one
+// large udmabuf holds every device buffer, and devices that are only as
+// large as one buffer each get one as before.
+class DMA_Memory
+{
+
+public:
+
+  // root as in DMA_Region::init
+  explicit DMA_Memory(const std::string &prefix = "udmabuf", unsigned max_devices = 8,
+                      const std::string &root = "")
+    :
+    prefix(prefix),
+    max_devices(max_devices),
+    root(root)
+  {}
+
+  bool allocate(unsigned long size, DMA_Region *&region, unsigned long &offset)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for(auto &r : regions)
+    {
+      if(r->allocate(size, offset))
+      {
+        region = r.get();
+        return true;
+      }
+    }
+    while(regions.size() < max_devices)
+    {
+      std::unique_ptr<DMA_Region> r(new DMA_Region());
+      if(!r->init(prefix + std::to_string(regions.size()), 0, true, 0, root))
+        return false;
+      regions.push_back(std::move(r));
+      if(regions.back()->allocate(size, offset))
+      {
+        region = regions.back().get();
+        return true;
+      }
+    }
+    return false;
+  }
+
+
+private:
+  DMA_Memory(const DMA_Memory &);
+  DMA_Memory& operator=(const DMA_Memory &);
+
+private:
+  std::string prefix;
+  unsigned max_devices;
+  std::string root;
+  std::vector<std::unique_ptr<DMA_Region>> regions;
+  std::mutex mutex;
+};
+
+
+// A device buffer: a region of its own, or a part of a DMA_Memory.
+//
+// sync_for_cpu / sync_for_device cover the range set by sync_offset and
+// sync_size (relative to the buffer, the whole buffer until set), or the
+// range they are given.
+class DMA_Buffer
+{
+
+public:
+
+  DMA_Buffer()
+    :
+    region(nullptr),
+    offset(0),
+    size(0),
+    range_offset(0),
+    range_size(0)
+  {}
+
+
+  bool init(const std::string &device_name, uint32_t elements, uint32_t element_size, bool use_dma_cache, unsigned long physical_address)
+  {
+    if(region != nullptr)
     {
-      sprintf(attribute_buffer, "%lu", size);
-      ssize_t len = strlen(attribute_buffer);
-      ssize_t written = write(ctrl["sync_size"], attribute_buffer, len);
-      return written == len;
+      std::cout << "Error: DMA buffer " << device_name << " already initalized" << std::endl;
+      return false;
     }
 
+    std::unique_ptr<DMA_Region> r(new DMA_Region());
+    const unsigned long bytes = (unsigned long) elements * element_size;
+    if(!r->init(device_name, bytes, use_dma_cache, physical_address) || !r->allocate(bytes, offset))
+      return false;
+    own = std::move(r);
+    region = own.get();
+    size = range_size = bytes;
     return true;
   }
 
-  bool sync_offset(unsigned long offset)
+  bool init(DMA_Memory &memory, uint32_t elements, uint32_t element_size)
   {
-    if(using_dma_cache)
+    if(region != nullptr)
+    {
+      std::cout << "Error: DMA buffer already initalized" << std::endl;
+      return false;
+    }
+
+    const unsigned long bytes = (unsigned long) elements * element_size;
+    if(!memory.allocate(bytes, region, offset))
     {
-      sprintf(attribute_buffer, "%lu", offset);
-      ssize_t len = strlen(attribute_buffer);
-      ssize_t written = write(ctrl["sync_offset"], attribute_buffer, len);
-      return written == len;
+      region = nullptr;
+      return false;
     }
+    size = range_size = bytes;
+    return true;
+  }
+
+  unsigned long physical_address()
+  {
+    return region->physical_address() + offset;
+  }
+
+  unsigned long size_in_bytes() const
+  {
+    return size;
+  }
+
+  bool sync_for_cpu()
+  {
+    return sync_for_cpu(range_offset, range_size);
+  }
+
+  bool sync_for_device()
+  {
+    return sync_for_device(range_offset, range_size);
+  }
 
+  bool sync_for_cpu(unsigned long begin, unsigned long bytes)
+  {
+    return region->sync_for_cpu(offset + begin, clamp(begin, bytes));
+  }
+
+  bool sync_for_device(unsigned long begin, unsigned long bytes)
+  {
+    return region->sync_for_device(offset + begin, clamp(begin, bytes));
+  }
+
+  bool sync_size(unsigned long bytes)
+  {
+    range_size = bytes;
+    return true;
+  }
+
+  bool sync_offset(unsigned long begin)
+  {
+    range_offset = begin;
     return true;
   }
 
   volatile void* buffer()
   {
-    return mm_buffer;
+    return region != nullptr ? region->data() + offset : nullptr;
   }
 
 
@@ -190,15 +435,16 @@ private:
   DMA_Buffer(const DMA_Buffer &);
   DMA_Buffer& operator=(const DMA_Buffer &);
 
-private:
-  volatile void *mm_buffer;
-  uint32_t mapped_size_in_bytes;
-  unsigned long phys_addr;
-  char attribute_buffer[1024];
-  bool using_dma_cache;
-
-  const std::vector<std::string> ro_ctrl_names = {"phys_addr", "size"};
-  const std::vector<std::string> rw_ctrl_names = {"sync_for_cpu", "sync_for_device", "sync_offset", "sync_size"};
+  unsigned long clamp(unsigned long begin, unsigned long bytes) const
+  {
+    return begin >= size ? 0 : std::min(bytes, size - begin);
+  }
 
-  std::map<std::string, int> ctrl;
+private:
+  std::unique_ptr<DMA_Region> own; // with a device of its own
+  DMA_Region *region;
+  unsigned long offset;
+  unsigned long size;
+  unsigned long range_offset;
+  unsigned long range_size;
 };
@@ -0,0 +1,117 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef DLK_DRIFT_MONITOR_H_INCLUDED
+#define DLK_DRIFT_MONITOR_H_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "global.h"
+#include "operators.h"
+#include "tensor_view.h"
+
+// Shadow check of quantized convolutions against a reference implementation.
+//
+// Every Nth run (SetEvery(), DLK_DRIFT_EVERY; 0 disables) each quantized
+// convolution hands a copy of its input codes and device output to a
+// background thread, which recomputes the layer conv_general-style in float
+// from the unpacked codes and binary weights, applies the thresholds if the
+// layer has them, and accumulates per layer:
+//  - the largest absolute difference, in accumulator units or in codes for
+//    layers with thresholds,
+//  - the cosine similarity between the reference and the device output,
+//  - the share of differing elements,
+//  - histograms of the input codes and, with thresholds, the output codes
+//    (codes piling up at 0 or at the top code point at calibration drift).
+// While the thread is behind, further samples are skipped so that the
+// network never waits for it. The reference computation is recorded as the
+// "DriftMonitor" region of the profiler.
+class DriftMonitor
+{
+public:
+  static constexpr std::size_t max_pending_samples = 16;
+
+  static void SetEvery(unsigned every);
+  static bool IsEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+  // Called at the start of every run; returns whether this run is checked.
+  static bool BeginRun();
+
+  // Called by a quantized convolution after p.device_output_buf is written.
+  template <typename T, MemoryLayout layout>
+  static void Check(const TensorView<T, layout>& input,
+      const kernel_t& kernel,
+      const binary_convolution_parameters& p) {
+    if (!run_checked.load(std::memory_order_relaxed)) {
+      return;
+    }
+    const auto& cp = p.normal_conv_params;
+    const std::size_t ih = cp.input_height, iw = cp.input_width, ic = cp.kernel_depth;
+    const std::size_t blocks = channel_blocks(input);
+    std::vector<std::uint8_t> codes(ih * iw * ic);
+    for (std::size_t y = 0; y < ih; ++y) {
+      for (std::size_t x = 0; x < iw; ++x) {
+        for (std::size_t cb = 0; cb < blocks && cb * 32 < ic; ++cb) {
+          std::uint8_t* dst = &codes[(y * iw + x) * ic + cb * 32];
+          for (std::size_t bit = 0; bit < p.bin_input_bitwidth; ++bit) {
+            const std::uint32_t word = input_word(input, y, x, cb, bit);
+            for (std::size_t c = 0; c < 32 && cb * 32 + c < ic; ++c) {
+              dst[c] |= ((word >> c) & 1) << bit;
+            }
+          }
+        }
+      }
+    }
+    Submit(kernel, p, std::move(codes));
+  }
+
+  // Waits for the pending samples.
+  static void Flush();
+  // Prints the statistics of every checked layer.
+  static void Report();
+  // Writes them as CSV, one line per layer.
+  static bool WriteSummary(const std::string& path);
+
+private:
+  static std::atomic<bool> enabled;
+  static std::atomic<bool> run_checked;
+
+  template <typename T>
+  static std::size_t channel_blocks(const TensorView<T, MemoryLayout::HWChBCl>& input) {
+    return input.get_shape()[2];
+  }
+  template <typename T>
+  static std::size_t channel_blocks(const TensorView<T, MemoryLayout::ChHWBCl>& input) {
+    return input.get_shape()[0];
+  }
+  template <typename T>
+  static std::uint32_t input_word(const TensorView<T, MemoryLayout::HWChBCl>& input,
+      std::size_t y, std::size_t x, std::size_t cb, std::size_t bit) {
+    return input(y, x, cb, bit, 0).Raw();
+  }
+  template <typename T>
+  static std::uint32_t input_word(const TensorView<T, MemoryLayout::ChHWBCl>& input,
+      std::size_t y, std::size_t x, std::size_t cb, std::size_t bit) {
+    return input(cb, y, x, bit, 0).Raw();
+  }
+
+  static void Submit(const kernel_t& kernel, const binary_convolution_parameters& p,
+      std::vector<std::uint8_t>&& codes);
+};
+
+#endif // DLK_DRIFT_MONITOR_H_INCLUDED
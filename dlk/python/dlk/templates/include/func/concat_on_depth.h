@@ -53,8 +53,8 @@ constexpr std::size_t index_width(const MemoryLayout layout) {
   }
 }
 
-template<class T>
-T& access(const TensorView<T, MemoryLayout::ChHWBCl>& tensor,
+template<class TView, std::enable_if_t<TView::layout == MemoryLayout::ChHWBCl, int> = 0>
+typename TView::base_t& access(const TView& tensor,
     const std::size_t ch,
     const std::size_t h,
     const std::size_t w,
@@ -62,8 +62,8 @@ T& access(const TensorView<T, MemoryLayout::ChHWBCl>& tensor,
   return tensor(ch, h, w, digit, 0);
 }
 
-template<class T>
-T& access(const TensorView<T, MemoryLayout::HWChBCl>& tensor,
+template<class TView, std::enable_if_t<TView::layout == MemoryLayout::HWChBCl, int> = 0>
+typename TView::base_t& access(const TView& tensor,
     const std::size_t ch,
     const std::size_t h,
     const std::size_t w,
@@ -71,26 +71,26 @@ T& access(const TensorView<T, MemoryLayout::HWChBCl>& tensor,
   return tensor(h, w, ch, digit, 0);
 }
 
-template<class T>
-T& access(const TensorView<T, MemoryLayout::NHWC>& tensor,
+template<class TView, std::enable_if_t<TView::layout == MemoryLayout::NHWC, int> = 0>
+typename TView::base_t& access(const TView& tensor,
     const std::size_t h,
     const std::size_t w,
     const std::size_t ch) {
   return tensor(0, h, w, ch);
 }
 
-template <typename TOut, MemoryLayout output_layout, std::size_t I, typename... TInputs>
+template <typename TOut, MemoryLayout output_layout, typename TOutView, std::size_t I, typename... TInputs>
 class ConcatOnDepth;
 
-template <typename TOut, MemoryLayout output_layout, std::size_t I, typename Enable, typename... TInputs>
+template <typename TOut, MemoryLayout output_layout, typename TOutView, std::size_t I, typename Enable, typename... TInputs>
 struct ConcatOnDepthImpl;
 
-template <typename TQOut, MemoryLayout output_layout, std::size_t I, typename...TInputs>
-struct ConcatOnDepthImpl<QuantizedPacked<TQOut>, output_layout, I, typename std::enable_if<(I < sizeof...(TInputs))>::type, TInputs...> {
+template <typename TQOut, MemoryLayout output_layout, typename TOutView, std::size_t I, typename...TInputs>
+struct ConcatOnDepthImpl<QuantizedPacked<TQOut>, output_layout, TOutView, I, typename std::enable_if<(I < sizeof...(TInputs))>::type, TInputs...> {
   void operator()(const std::tuple<TInputs...>& inputs,
       const std::size_t stride_depth,
       const std::size_t offset_depth,
-      const TensorView<QuantizedPacked<TQOut>, output_layout>& output) {
+      const TOutView& output) {
     const auto shape = output.get_shape();
     const auto out_height = shape[index_height(output_layout)];
     const auto out_width = shape[index_width(output_layout)];
@@ -108,17 +108,17 @@ struct ConcatOnDepthImpl<QuantizedPacked<TQOut>, output_layout, I, typename std:
         }
       }
     }
-    ConcatOnDepth<QuantizedPacked<TQOut>, output_layout, I+1, TInputs...> func;
+    ConcatOnDepth<QuantizedPacked<TQOut>, output_layout, TOutView, I+1, TInputs...> func;
     func(inputs, stride_depth, offset_depth + depth, output);
   }
 };
 
-template <MemoryLayout output_layout, std::size_t I, typename...TInputs>
-struct ConcatOnDepthImpl<float, output_layout, I, typename std::enable_if<(I < sizeof...(TInputs))>::type, TInputs...> {
+template <MemoryLayout output_layout, typename TOutView, std::size_t I, typename...TInputs>
+struct ConcatOnDepthImpl<float, output_layout, TOutView, I, typename std::enable_if<(I < sizeof...(TInputs))>::type, TInputs...> {
   void operator()(const std::tuple<TInputs...>& inputs,
       const std::size_t stride_depth,
       const std::size_t offset_depth,
-      const TensorView<float, output_layout>& output) {
+      const TOutView& output) {
     const auto shape = output.get_shape();
     const auto out_height = shape[index_height(output_layout)];
     const auto out_width = shape[index_width(output_layout)];
@@ -133,35 +133,38 @@ struct ConcatOnDepthImpl<float, output_layout, I, typename std::enable_if<(I < s
         }
       }
     }
-    ConcatOnDepth<float, output_layout, I+1, TInputs...> func;
+    ConcatOnDepth<float, output_layout, TOutView, I+1, TInputs...> func;
     func(inputs, stride_depth, offset_depth + depth, output);
   }
 };
 
-template <typename TOut, MemoryLayout output_layout, std::size_t I, typename...TInputs>
-struct ConcatOnDepthImpl<TOut, output_layout, I, typename std::enable_if<!(I < sizeof...(TInputs))>::type, TInputs...> {
+template <typename TOut, MemoryLayout output_layout, typename TOutView, std::size_t I, typename...TInputs>
+struct ConcatOnDepthImpl<TOut, output_layout, TOutView, I, typename std::enable_if<!(I < sizeof...(TInputs))>::type, TInputs...> {
   void operator()(const std::tuple<TInputs...>& inputs,
       const std::size_t stride_depth,
       const std::size_t offset_depth,
-      const TensorView<TOut, output_layout>& output) {
+      const TOutView& output) {
     // nothing to do
   }
 };
 
-template <typename TOut, MemoryLayout output_layout, std::size_t I, typename... TInputs>
-class ConcatOnDepth : public ConcatOnDepthImpl<TOut, output_layout, I, void, TInputs...> {};
+template <typename TOut, MemoryLayout output_layout, typename TOutView, std::size_t I, typename... TInputs>
+class ConcatOnDepth : public ConcatOnDepthImpl<TOut, output_layout, TOutView, I, void, TInputs...> {};
 
 } // namespace impl
 } // namespace detail
 
-template<class... TInputs, class TOut, MemoryLayout output_layout>
+template<class... TInputs, class TOutView>
 void func_ConcatOnDepth(const std::tuple<TInputs...>& inputs,
-    const TensorView<TOut, output_layout>& output) {
-  Measurement::Start("func_ConcatOnDepth");
+    const TOutView& output) {
+  static const auto region = Measurement::Intern("func_ConcatOnDepth");
+  Measurement::Start(region);
+  using TOut = typename TOutView::base_t;
+  constexpr auto output_layout = TOutView::layout;
   const auto shape = output.get_shape();
   const auto index = dlk::impl::index_channels_high(output_layout);
   const auto depth = shape[index];
-  dlk::impl::ConcatOnDepth<TOut, output_layout, 0, TInputs...> func;
+  dlk::impl::ConcatOnDepth<TOut, output_layout, TOutView, 0, TInputs...> func;
   func(inputs, depth, 0, output);
   Measurement::Stop();
 }
@@ -20,10 +20,14 @@ limitations under the License.
 #include "time_measurement.h"
 #include "tensor_view.h"
 
-inline void func_DepthToSpace(const TensorView<float, MemoryLayout::NHWC>& input,
-    const TensorView<float, MemoryLayout::NHWC>& output,
+template <typename TInput, typename TOutput,
+    std::enable_if_t<is_view_of<TInput, float, MemoryLayout::NHWC>::value
+      && is_view_of<TOutput, float, MemoryLayout::NHWC>::value, int> = 0>
+void func_DepthToSpace(const TInput& input,
+    const TOutput& output,
     T_UINT a, T_UINT b, T_UINT kernel_size, T_UINT stride) {
-  Measurement::Start("DepthToSpace");
+  static const auto region = Measurement::Intern("DepthToSpace");
+  Measurement::Start(region);
 
   const auto out_shape = output.get_shape();
   const auto out_height = out_shape[1];
@@ -48,10 +52,14 @@ inline void func_DepthToSpace(const TensorView<float, MemoryLayout::NHWC>& input
   Measurement::Stop();
 }
 
-inline void func_DepthToSpace(const TensorView<QUANTIZED_PACKED, MemoryLayout::HWChBCl>& input,
-    const TensorView<QUANTIZED_PACKED, MemoryLayout::HWChBCl>& output,
+template <typename TInput, typename TOutput,
+    std::enable_if_t<is_view_of<TInput, QUANTIZED_PACKED, MemoryLayout::HWChBCl>::value
+      && is_view_of<TOutput, QUANTIZED_PACKED, MemoryLayout::HWChBCl>::value, int> = 0>
+void func_DepthToSpace(const TInput& input,
+    const TOutput& output,
     T_UINT a, T_UINT b, T_UINT kernel_size, T_UINT stride) {
-  Measurement::Start("DepthToSpace");
+  static const auto region = Measurement::Intern("DepthToSpace");
+  Measurement::Start(region);
 
   const auto out_shape = output.get_shape();
   const auto out_height = out_shape[0];
@@ -79,10 +87,14 @@ inline void func_DepthToSpace(const TensorView<QUANTIZED_PACKED, MemoryLayout::H
   Measurement::Stop();
 }
 
-inline void func_DepthToSpace(const TensorView<QUANTIZED_PACKED, MemoryLayout::ChHWBCl>& input,
-    const TensorView<QUANTIZED_PACKED, MemoryLayout::ChHWBCl>& output,
+template <typename TInput, typename TOutput,
+    std::enable_if_t<is_view_of<TInput, QUANTIZED_PACKED, MemoryLayout::ChHWBCl>::value
+      && is_view_of<TOutput, QUANTIZED_PACKED, MemoryLayout::ChHWBCl>::value, int> = 0>
+void func_DepthToSpace(const TInput& input,
+    const TOutput& output,
     T_UINT a, T_UINT b, T_UINT kernel_size, T_UINT stride) {
-  Measurement::Start("DepthToSpace");
+  static const auto region = Measurement::Intern("DepthToSpace");
+  Measurement::Start(region);
 
   const auto out_shape = output.get_shape();
   const auto out_height = out_shape[1];
@@ -19,6 +19,7 @@ limitations under the License.
 #include <algorithm>
 #include "global.h"
 #include "tensor_view.h"
+#include "thread_pool.h"
 #include "time_measurement.h"
 #include "pack_input_to_qwords.h"
 #include <limits.h>
@@ -32,7 +33,8 @@ void func_ExtractImagePatches(
     const TensorView<T, MemoryLayout::NHWC>& input,
     const TensorView<T, MemoryLayout::NHWC>& output,
     T_UINT kernel_size, T_UINT stride) {
-  Measurement::Start("ExtractImagePatches");
+  static const auto region = Measurement::Intern("ExtractImagePatches");
+  Measurement::Start(region);
 
   const auto in_shape = input.get_shape();
   const T_UINT input_width = in_shape[2];
@@ -68,7 +70,8 @@ inline void func_ExtractImagePatches(
     const TensorView<QUANTIZED_PACKED, MemoryLayout::HWChBCl>& input,
     const TensorView<QUANTIZED_PACKED, MemoryLayout::HWChBCl>& output,
     T_UINT kernel_size, T_UINT stride) {
-  Measurement::Start("ExtractImagePatches");
+  static const auto region = Measurement::Intern("ExtractImagePatches");
+  Measurement::Start(region);
 
   const auto in_shape = input.get_shape();
   const T_UINT input_width = in_shape[1];
@@ -169,7 +172,8 @@ inline void func_ExtractImagePatches(
     const TensorView<QUANTIZED_PACKED, MemoryLayout::ChHWBCl>& output,
     T_UINT kernel_size, T_UINT stride)
 {
-  Measurement::Start("ExtractImagePatches");
+  static const auto region = Measurement::Intern("ExtractImagePatches");
+  Measurement::Start(region);
   const auto in_shape = input.get_shape();
   const T_UINT input_height = in_shape[1];
   const T_UINT input_width = in_shape[2];
@@ -196,8 +200,7 @@ inline void func_ExtractImagePatches(
     const uint64_t mask64 = mask * 0x1'0000'0001ull;
 #endif
     const T_UINT blocks = kernel_area / out_depth;
-#pragma omp parallel for
-    for(T_UINT wi = 0; wi < out_height; wi++)
+    dlk::parallel_for<T_UINT>(0, out_height, [&](T_UINT wi) {
       for(T_UINT wj = 0; wj < out_width; wj++)
 #ifdef USE_NEON
         for(T_UINT k = 0; k < out_depth; ++k) {
@@ -241,6 +244,7 @@ inline void func_ExtractImagePatches(
           *reinterpret_cast<uint64_t*>(output.data() + out_idx) = out;
         }
 #endif
+    });
   } else {
     for(T_UINT ih = 0; ih < input_depth; ++ih)
       for(T_UINT wi = 0; wi < out_height; wi++)
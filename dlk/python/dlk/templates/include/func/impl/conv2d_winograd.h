@@ -0,0 +1,42 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef DLK_FUNC_IMPL_CONV2D_WINOGRAD_H_INCLUDED
+#define DLK_FUNC_IMPL_CONV2D_WINOGRAD_H_INCLUDED
+
+#include "global.h"
+#include "operators.h" // FIXME(nikolay): for convolution_parameters definition, rid of it later
+#include "tensor_view.h"
+
+namespace dlk {
+
+namespace impl {
+
+// Output channels of the transformed weights are padded to this multiple,
+// so that every vector width we target divides it.
+constexpr std::size_t winograd_oc_align = 8;
+
+// 3x3 stride 1 convolution with Winograd F(m x m, 3 x 3), m = p.winograd_tile (2 or 4).
+// p.winograd_weights holds G g G^T of every kernel, computed by the code generator,
+// laid out as [(m + 2) * (m + 2)][kernel_depth][output channels rounded up to winograd_oc_align].
+void conv3x3_winograd(const TensorView<T_FLOAT, MemoryLayout::NHWC>& input,
+    const TensorView<T_FLOAT, MemoryLayout::NHWC>& output,
+    const convolution_parameters& p);
+
+} // namespace impl
+
+} // namespace dlk
+
+#endif // DLK_FUNC_IMPL_CONV2D_WINOGRAD_H_INCLUDED
@@ -36,6 +36,22 @@ using kn2row_input_t = TensorView<kn2row_input_elem_t, MemoryLayout::ChHWBCl>;
 void TCAConv2d(const kn2row_input_t& input,
     const kernel_t& kernel,
     const binary_convolution_parameters &p);
+
+// Runs count thresholded convolutions on the accelerator, each on the output
+// of the one before, as one command list: the intermediate outputs stay in
+// the device buffers of params[0], alternating between its input and output
+// buffer, and caches are synchronized only for the input of the first and
+// the output of the last, which is returned. The outputs must fit those
+// buffers, see TCAConv2dChainFits.
+QUANTIZED_PACKED* TCAConv2dChain(const kn2row_input_t& input,
+    const binary_convolution_parameters params[],
+    std::size_t count);
+
+// Whether TCAConv2dChain can run a chain on these device buffers, where
+// output_elems[k] is the output height * width * channels (rounded up to 32)
+// of convolution k. Networks run the other chains one convolution at a time.
+bool TCAConv2dChainFits(const std::size_t output_elems[], std::size_t count,
+    const DMA_Buffer& input_buffer, const DMA_Buffer& output_buffer);
 #endif
 
 
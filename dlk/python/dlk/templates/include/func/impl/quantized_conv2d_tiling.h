@@ -35,6 +35,37 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
                                   const kernel_t& kernel,
                                   const binary_convolution_parameters &p);
 
+// Output rows [row_begin, row_end) of a stride-1 convolution, for running a
+// layer one horizontal band at a time. The input holds the input rows from
+// in_row_offset on (input.get_shape()[1] of them) and p.device_output_buf
+// out_rows output rows from out_row_offset on; rows outside the image are
+// still taken as padding.
+struct tiling_rows_t {
+  std::size_t row_begin;
+  std::size_t row_end;
+  std::size_t in_row_offset;
+  std::size_t out_row_offset;
+  std::size_t out_rows;
+};
+
+void QuantizedConv2DTiling(const tiling_input_t& input,
+                                  const kernel_t& kernel,
+                                  const binary_convolution_parameters &p,
+                                  const tiling_rows_t& rows);
+
+// Runs count stride-1 convolutions with thresholds, each taking the output of
+// the one before, depth-first: the final output is computed in bands of rows,
+// on the ThreadPool, and each band goes through the whole chain with the
+// intermediate rows it needs, halo included, in per-thread scratch sized to
+// stay in cache. Halo rows are computed by both bands next to them, so that
+// bands never wait for each other. output gets the final output, in the
+// layout of the input.
+void QuantizedConv2DTilingChain(const tiling_input_t& input,
+    const kernel_t* const kernels[],
+    const binary_convolution_parameters params[],
+    std::size_t count,
+    tiling_input_elem_t* output);
+
 } // namespace impl
 
 } // namespace dlk
@@ -34,6 +34,21 @@ void unary_op(const TensorView<T, layout>& input,
   }
 }
 
+template <typename T, MemoryLayout layout, typename F>
+void unary_op(const StridedTensorView<T, layout>& input,
+    const StridedTensorView<T, layout>& output,
+    F f) {
+  assert(input.get_shape() == output.get_shape());
+  if (input.is_contiguous() && output.is_contiguous()) {
+    unary_op(input.dense(), output.dense(), f);
+    return;
+  }
+  typename StridedTensorView<T, layout>::template tensor_info_t<std::size_t> index = {};
+  do {
+    output.data()[output.get_offset_ary(index)] = f(input.data()[input.get_offset_ary(index)]);
+  } while (input.next(index));
+}
+
 } // namespace impl
 
 } // namespace dlk
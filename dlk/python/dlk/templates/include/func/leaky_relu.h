@@ -35,7 +35,8 @@ template <typename T, MemoryLayout layout>
 void func_LeakyRelu(const TensorView<T, layout>& input,
     const TensorView<T, layout>& output,
     T alpha) {
-  Measurement::Start("LeakyReLu");
+  static const auto region = Measurement::Intern("LeakyReLu");
+  Measurement::Start(region);
 
   leaky_relu<T> f(alpha);
   dlk::impl::unary_op(input, output, f);
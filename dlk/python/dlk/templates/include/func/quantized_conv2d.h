@@ -16,6 +16,7 @@ limitations under the License.
 #ifndef DLK_FUNC_QUANTIZED_CONV2D_H_INCLUDED
 #define DLK_FUNC_QUANTIZED_CONV2D_H_INCLUDED
 
+#include <atomic>
 #include <vector>
 #include <memory>
 #include <stdexcept>
@@ -23,18 +24,18 @@ limitations under the License.
 #include "tensor_view.h"
 #include "tensor_convert.h"
 #include "operators.h"
+#include "drift_monitor.h"
+#include "thread_pool.h"
 #include "time_measurement.h"
 #include "func/impl/quantized_conv2d_tiling.h"
 #include "func/impl/quantized_conv2d_kn2row.h"
-#ifdef _OPENMP
-#include <omp.h>
-#endif
 
 template <typename T, MemoryLayout layout>
 void QuantizedConv2D(const TensorView<T, layout>& input,
     const kernel_t& kernel,
     binary_convolution_parameters p) {
-  Measurement::Start("QuantizedConv2D");
+  static const auto region = Measurement::Intern("QuantizedConv2D");
+  Measurement::Start(region);
 
   constexpr T_UINT TilingInTypeBitWidth = dlk::impl::tiling_input_elem_t::BitCount;
   T_UINT kh = p.normal_conv_params.kernel_height;
@@ -42,14 +43,25 @@ void QuantizedConv2D(const TensorView<T, layout>& input,
   T_UINT padding = p.normal_conv_params.padding;
   T_UINT ih = p.normal_conv_params.input_height;
   T_UINT iw = p.normal_conv_params.input_width;
-  T_UINT ic = p.normal_conv_params.kernel_depth;
+  // Packed words are zero beyond the last channel and the packed kernel is
+  // padded to whole words, so depth is rounded up instead of requiring a Pad.
+  T_UINT ic = (p.normal_conv_params.kernel_depth + TilingInTypeBitWidth - 1)
+      / TilingInTypeBitWidth * TilingInTypeBitWidth;
+  p.normal_conv_params.kernel_depth = ic;
   T_UINT oc = p.normal_conv_params.output_channels;
   auto size = oc * ih * iw;
   if (p.device_output_buf == nullptr)
     p.device_output_buf = new BIN_CONV_OUTPUT[size]();
 
-  if ((kh == 3 && kw == 3 && padding == 1) ||
-      (kh == 1 && kw == 1 && padding == 0)) {
+  // The tiling, kn2row and TCA kernels pad every side by `padding`. Asymmetric
+  // padding is not supported here, and pass_fold_pad_into_conv keeps the Pad
+  // node in front of a quantized convolution.
+  const auto& cp = p.normal_conv_params;
+  const bool uniform = cp.padding_top == padding && cp.padding_bottom == padding
+    && cp.padding_left == padding && cp.padding_right == padding;
+
+  if (uniform && ((kh == 3 && kw == 3 && padding == 1) ||
+      (kh == 1 && kw == 1 && padding == 0))) {
 #ifdef RUN_ON_FPGA
     dlk::impl::kn2row_input_t::tensor_info_t<std::size_t> shape = {
       (ic + QUANTIZED_PACKED::BitCount - 1) / QUANTIZED_PACKED::BitCount,
@@ -85,9 +97,13 @@ void QuantizedConv2D(const TensorView<T, layout>& input,
     dlk::impl::QuantizedConv2DKn2Row(tmp, kernel, p);
 #endif
   } else {
-    throw std::invalid_argument("Unsupported convolution parameter");
+    throw std::invalid_argument(uniform
+        ? "Unsupported convolution parameter"
+        : "Unsupported convolution parameter: asymmetric padding");
   }
 
+  DriftMonitor::Check(input, kernel, p);
+
   Measurement::Stop();
 }
 
@@ -100,7 +116,8 @@ void func_QuantizedConv2D(
     const binary_convolution_parameters& p) {
   QuantizedConv2D(input, kernel, p);
 
-  Measurement::Start("QuantizedConv2D_ApplyScalingFactor");
+  static const auto region = Measurement::Intern("QuantizedConv2D_ApplyScalingFactor");
+  Measurement::Start(region);
 
   unsigned out_elems = p.normal_conv_params.output_height *
                        p.normal_conv_params.output_width *
@@ -146,7 +163,8 @@ void func_QuantizedConv2D(
   // temporary: (2^n - 1) * (max - min)
   T_FLOAT post_qtz_factor = 2.0 / 3.0;
 
-  Measurement::Start("QuantizedConv2D_ApplyScalingFactor");
+  static const auto region = Measurement::Intern("QuantizedConv2D_ApplyScalingFactor");
+  Measurement::Start(region);
 
   int out_index = 0;
   for (int h = 0; h < ncp.output_height; ++h)
@@ -173,21 +191,15 @@ void func_QuantizedConv2DWithThreshold(
 
   const auto bytes = out_elems / 8 * p.n_bit;
 
-  Measurement::Start("Memcpy");
-
-#ifdef _OPENMP
-  const int num_blocks = bytes / sizeof(QUANTIZED_PACKED);
-  const int num_threads = omp_get_max_threads();
-  const int chunk_size = (num_blocks + num_threads - 1) / num_threads;
-#pragma omp parallel for
-  for (int i = 0; i < num_blocks; i += chunk_size) {
-    memcpy(output.data() + i,
-        (QUANTIZED_PACKED*)(p.device_output_buf) + i,
-        std::min(chunk_size, num_blocks - i) * sizeof(QUANTIZED_PACKED));
-  }
-#else
-  memcpy(output.data(), (void*)p.device_output_buf, bytes);
-#endif
+  static const auto region = Measurement::Intern("Memcpy");
+  Measurement::Start(region);
+
+  const std::size_t num_blocks = bytes / sizeof(QUANTIZED_PACKED);
+  dlk::parallel_for_range<std::size_t>(0, num_blocks, [&](std::size_t begin, std::size_t end) {
+    memcpy(output.data() + begin,
+        (QUANTIZED_PACKED*)(p.device_output_buf) + begin,
+        (end - begin) * sizeof(QUANTIZED_PACKED));
+  });
 
   Measurement::Stop();
 }
@@ -201,7 +213,8 @@ void func_QuantizedConv2DWithThreshold(
     const binary_convolution_parameters& p) {
   QuantizedConv2D(input, kernel, p);
 
-  Measurement::Start("linear_to_float");
+  static const auto region = Measurement::Intern("linear_to_float");
+  Measurement::Start(region);
 
   T_FLOAT n = (1 << p.n_bit) - 1;
   const auto& np = p.normal_conv_params;
@@ -229,6 +242,102 @@ void func_QuantizedConv2DWithThreshold(
   Measurement::Stop();
 }
 
+// Fused execution of the chains found by CodeGenerater.fuse_conv_chains:
+// depth-first on the tiling backends, as one command list on the FPGA. The
+// generic backend does not have it; there IsEnabled() is always false and
+// the convolutions of a chain run one by one. DLK_CONV_FUSION=0 turns it off.
+class QuantizedConv2DChain
+{
+public:
+  static void SetEnabled(bool on) { enabled.store(on, std::memory_order_relaxed); }
+  static bool IsEnabled() {
+#if defined USE_NEON || defined USE_AVX || defined RUN_ON_FPGA
+    return enabled.load(std::memory_order_relaxed);
+#else
+    return false;
+#endif
+  }
+
+private:
+  static std::atomic<bool> enabled;
+};
+
+// Runs count thresholded convolutions, each taking the output of the one
+// before, without writing the intermediate outputs: see
+// dlk::impl::QuantizedConv2DTilingChain and dlk::impl::TCAConv2dChain.
+template <typename T, MemoryLayout layout>
+void func_QuantizedConv2DChainWithThreshold(
+    const TensorView<T, layout>& input,
+    const kernel_t* const kernels[],
+    binary_convolution_parameters params[],
+    const std::size_t count,
+    const TensorView<QUANTIZED_PACKED, MemoryLayout::ChHWBCl>& output) {
+#if (defined USE_NEON || defined USE_AVX) && !defined RUN_ON_FPGA
+  static const auto region = Measurement::Intern("QuantizedConv2DChain");
+  Measurement::Start(region);
+
+  constexpr T_UINT TilingInTypeBitWidth = dlk::impl::tiling_input_elem_t::BitCount;
+  for (std::size_t i = 0; i < count; ++i) {
+    auto& cp = params[i].normal_conv_params;
+    cp.kernel_depth = (cp.kernel_depth + TilingInTypeBitWidth - 1)
+        / TilingInTypeBitWidth * TilingInTypeBitWidth;
+  }
+
+  const auto& cp = params[0].normal_conv_params;
+  dlk::impl::tiling_input_t::tensor_info_t<std::size_t> shape = {
+    cp.kernel_depth / TilingInTypeBitWidth,
+    cp.input_height,
+    cp.input_width,
+    params[0].bin_input_bitwidth,
+    TilingInTypeBitWidth
+  };
+  dlk::impl::tiling_input_t tmp(params[0].device_input_buf, shape);
+  convert_tensor(input, tmp);
+  dlk::impl::QuantizedConv2DTilingChain(tmp, kernels, params, count,
+      reinterpret_cast<dlk::impl::tiling_input_elem_t*>(output.data()));
+
+  Measurement::Stop();
+#elif defined RUN_ON_FPGA
+  static const auto region = Measurement::Intern("QuantizedConv2DChain");
+  Measurement::Start(region);
+
+  constexpr T_UINT b = QUANTIZED_PACKED::BitCount;
+  for (std::size_t i = 0; i < count; ++i) {
+    auto& cp = params[i].normal_conv_params;
+    cp.kernel_depth = (cp.kernel_depth + b - 1) / b * b;
+  }
+
+  const auto& cp = params[0].normal_conv_params;
+  dlk::impl::kn2row_input_t::tensor_info_t<std::size_t> shape = {
+    cp.kernel_depth / b,
+    cp.input_height,
+    cp.input_width,
+    params[0].bin_input_bitwidth,
+    b
+  };
+  dlk::impl::kn2row_input_t tmp(params[0].device_input_buf, shape);
+  convert_tensor(input, tmp);
+  const QUANTIZED_PACKED* result = dlk::impl::TCAConv2dChain(tmp, params, count);
+
+  static const auto memcpy_region = Measurement::Intern("Memcpy");
+  Measurement::Start(memcpy_region);
+
+  const auto& last = params[count - 1];
+  const std::size_t out_elems = last.normal_conv_params.output_height *
+      last.normal_conv_params.output_width * last.normal_conv_params.output_channels;
+  const std::size_t num_blocks = out_elems / 8 * last.n_bit / sizeof(QUANTIZED_PACKED);
+  dlk::parallel_for_range<std::size_t>(0, num_blocks, [&](std::size_t begin, std::size_t end) {
+    memcpy(output.data() + begin, result + begin, (end - begin) * sizeof(QUANTIZED_PACKED));
+  });
+
+  Measurement::Stop();
+
+  Measurement::Stop();
+#else
+  throw std::invalid_argument("Convolution chains need a tiling backend or the FPGA");
+#endif
+}
+
 template <typename T, MemoryLayout layout>
 void func_QuantizedConv2DWithThreshold(
     const TensorView<T, layout>& input,
@@ -25,7 +25,8 @@ template <typename T, MemoryLayout layout_l, MemoryLayout layout_r>
 void func_RealDiv(const TensorView<T, layout_l>& lhs,
     const TensorView<T, layout_r>& rhs,
     const TensorView<T, dlk::impl::output_layout(layout_l, layout_r)>& output) {
-  Measurement::Start("RealDiv");
+  static const auto region = Measurement::Intern("RealDiv");
+  Measurement::Start(region);
 
   dlk::impl::binary_op<T, layout_l, layout_r, std::divides<T>> bin_op;
   bin_op(lhs, rhs, output, std::divides<T>());
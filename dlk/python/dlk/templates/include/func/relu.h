@@ -17,6 +17,7 @@ limitations under the License.
 #define DLK_FUNC_RELU_H_INCLUDED
 
 #include "global.h"
+#include "time_measurement.h"
 #include "tensor_view.h"
 #include "func/impl/unary_op.h"
 
@@ -26,7 +27,8 @@ T relu(const T& x) { return std::max(x, T(0)); }
 template <typename T, MemoryLayout layout>
 void func_Relu(const TensorView<T, layout>& input,
     const TensorView<T, layout>& output) {
-  Measurement::Start("ReLu");
+  static const auto region = Measurement::Intern("ReLu");
+  Measurement::Start(region);
 
   dlk::impl::unary_op(input, output, relu<T>);
 
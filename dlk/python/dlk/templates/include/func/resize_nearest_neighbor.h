@@ -24,7 +24,8 @@ limitations under the License.
 inline void func_ResizeNearestNeighbor(const TensorView<float, MemoryLayout::NHWC>& input,
     const TensorView<float, MemoryLayout::NHWC>& output) {
 
-  Measurement::Start("ResizeNearestNeighbor");
+  static const auto region = Measurement::Intern("ResizeNearestNeighbor");
+  Measurement::Start(region);
 
   const auto in_shape = input.get_shape();
   const auto in_height = in_shape[1];
@@ -53,7 +54,8 @@ inline void func_ResizeNearestNeighbor(const TensorView<float, MemoryLayout::NHW
 
 inline void func_ResizeNearestNeighbor(const TensorView<QUANTIZED_PACKED, MemoryLayout::HWChBCl>& input,
     const TensorView<QUANTIZED_PACKED, MemoryLayout::HWChBCl>& output) {
-  Measurement::Start("ResizeNearestNeighbor");
+  static const auto region = Measurement::Intern("ResizeNearestNeighbor");
+  Measurement::Start(region);
 
   const auto in_shape = input.get_shape();
   const auto in_height = in_shape[0];
@@ -85,7 +87,8 @@ inline void func_ResizeNearestNeighbor(const TensorView<QUANTIZED_PACKED, Memory
 
 inline void func_ResizeNearestNeighbor(const TensorView<QUANTIZED_PACKED, MemoryLayout::ChHWBCl>& input,
     const TensorView<QUANTIZED_PACKED, MemoryLayout::ChHWBCl>& output) {
-  Measurement::Start("ResizeNearestNeighbor");
+  static const auto region = Measurement::Intern("ResizeNearestNeighbor");
+  Measurement::Start(region);
 
   const auto in_shape = input.get_shape();
   const auto in_height = in_shape[1];
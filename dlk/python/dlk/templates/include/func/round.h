@@ -24,7 +24,8 @@ limitations under the License.
 template <typename T, MemoryLayout layout>
 void func_Round(const TensorView<T, layout>& input,
     const TensorView<T, layout>& output) {
-  Measurement::Start("Round");
+  static const auto region = Measurement::Intern("Round");
+  Measurement::Start(region);
 
   dlk::impl::unary_op(input, output, std::round);
 
@@ -25,7 +25,8 @@ void func_Scale(const TensorView<T_INT, layout>& input,
     const TensorView<T_FLOAT, MemoryLayout::Atom>& factor,
     const TensorView<T_FLOAT, layout>& output,
     unsigned input_bitwidth) {
-  Measurement::Start("Scale");
+  static const auto region = Measurement::Intern("Scale");
+  Measurement::Start(region);
 
   assert(input.get_shape() == output.get_shape());
   T_UINT elements = output.size();
@@ -16,33 +16,58 @@ limitations under the License.
 #ifndef DLK_FUNC_SPLIT_H_INCLUDED
 #define DLK_FUNC_SPLIT_H_INCLUDED
 
+#include <algorithm>
+#include <cassert>
+
 #include "global.h"
 #include "time_measurement.h"
 #include "tensor_view.h"
 
-template<class T>
-void func_Split(const TensorView<T, MemoryLayout::NHWC>& input,
-    const TensorView<T, MemoryLayout::NHWC> * const outputs, T_UINT *depths, T_UINT num_split)
-{
-  Measurement::Start("func_Split");
-
-  const auto in_shape = input.get_shape();
-  const auto in_height = in_shape[1];
-  const auto in_width = in_shape[2];
-  const auto in_depth = in_shape[3];
-  const auto out_depth = in_depth / num_split;
+namespace dlk {
 
-  T_UINT output_index[32] = {0};
-  T_UINT input_index = 0;
+namespace impl {
 
-  for(T_UINT i = 0; i < in_height * in_width; i++){
-    for(T_UINT n = 0; n < num_split; n++){
-      for(T_UINT d = 0; d < depths[n]; d++){
-        outputs[n].data()[output_index[n]++] = input.data()[input_index++];
-      }
+// Copies each output from a slice of the input along the channel axis.
+// depths are in channels; a QuantizedPacked axis counts blocks of 32.
+// The input is dense, so from axis inwards a slice is one contiguous run
+// per index of the outer axes.
+template<class T, MemoryLayout layout>
+void split_on_channels(const TensorView<T, layout>& input,
+    const TensorView<T, layout> * const outputs, const T_UINT *depths, T_UINT num_split,
+    const std::size_t axis)
+{
+  const std::size_t block = std::is_same<T, typename Base<T>::type>::value ? 1 : 32;
+  std::size_t offset = 0;
+  for (T_UINT n = 0; n < num_split; n++) {
+    const std::size_t depth = depths[n] / block;
+    const auto in = slice(input, axis, offset, depth);
+    const auto& strides = in.get_strides();
+    const std::size_t run = depth * strides[axis];
+    const std::size_t outer_stride = axis > 0 ? strides[axis - 1] : 0;
+    std::size_t outer = 1;
+    for (std::size_t i = 0; i < axis; ++i) {
+      outer *= in.get_shape()[i];
+    }
+    assert(outputs[n].size() == outer * run);
+    for (std::size_t i = 0; i < outer; ++i) {
+      const T* const first = in.data() + i * outer_stride;
+      std::copy(first, first + run, outputs[n].data() + i * run);
     }
+    offset += depth;
   }
+}
+
+} // namespace impl
 
+} // namespace dlk
+
+template<class T>
+void func_Split(const TensorView<T, MemoryLayout::NHWC>& input,
+    const TensorView<T, MemoryLayout::NHWC> * const outputs, T_UINT *depths, T_UINT num_split)
+{
+  static const auto region = Measurement::Intern("func_Split");
+  Measurement::Start(region);
+  dlk::impl::split_on_channels(input, outputs, depths, num_split, 3);
   Measurement::Stop();
 }
 
@@ -50,33 +75,9 @@ template<class T>
 void func_Split(const TensorView<T, MemoryLayout::HWChBCl>& input,
     const TensorView<T, MemoryLayout::HWChBCl> * const outputs, T_UINT *depths, T_UINT num_split)
 {
-  Measurement::Start("func_Split");
-
-  const auto in_shape = input.get_shape();
-  T_UINT in_height = in_shape[0];
-  T_UINT in_width = in_shape[1];
-  T_UINT bits = in_shape[3];
-
-  if (!std::is_same<T, typename Base<T>::type>::value) {
-    // quantized and packed inputs
-    for(T_UINT i = 0; i < num_split; i++)
-      depths[i] /= 32;
-  }
-
-  T_UINT index = 0;
-  for(T_UINT n = 0; n < num_split; n++) {
-    for(T_UINT d = 0; d < depths[n]; d++) {
-      for(T_UINT h = 0; h < in_height; h++) {
-        for(T_UINT w = 0; w < in_width; w++) {
-          for(T_UINT digit = 0; digit < bits; ++digit) {
-            outputs[n](h, w, d, digit, 0) = input(h, w, index, digit, 0);
-          }
-        }
-      }
-      ++index;
-    }
-  }
-
+  static const auto region = Measurement::Intern("func_Split");
+  Measurement::Start(region);
+  dlk::impl::split_on_channels(input, outputs, depths, num_split, 2);
   Measurement::Stop();
 }
 
@@ -84,33 +85,9 @@ template<class T>
 void func_Split(const TensorView<T, MemoryLayout::ChHWBCl>& input,
     const TensorView<T, MemoryLayout::ChHWBCl> * const outputs, T_UINT *depths, T_UINT num_split)
 {
-  Measurement::Start("func_Split");
-
-  const auto in_shape = input.get_shape();
-  T_UINT in_height = in_shape[1];
-  T_UINT in_width = in_shape[2];
-  T_UINT bits = in_shape[3];
-
-  if (!std::is_same<T, typename Base<T>::type>::value) {
-    // quantized and packed inputs
-    for(T_UINT i = 0; i < num_split; i++)
-      depths[i] /= 32;
-  }
-
-  T_UINT index = 0;
-  for(T_UINT n = 0; n < num_split; n++) {
-    for(T_UINT d = 0; d < depths[n]; d++) {
-      for(T_UINT h = 0; h < in_height; h++) {
-        for(T_UINT w = 0; w < in_width; w++) {
-          for(T_UINT digit = 0; digit < bits; ++digit) {
-            outputs[n](d, h, w, digit, 0) = input(index, h, w, digit, 0);
-          }
-        }
-      }
-      ++index;
-    }
-  }
-
+  static const auto region = Measurement::Intern("func_Split");
+  Measurement::Start(region);
+  dlk::impl::split_on_channels(input, outputs, depths, num_split, 0);
   Measurement::Stop();
 }
 
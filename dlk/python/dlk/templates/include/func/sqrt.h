@@ -26,7 +26,8 @@ limitations under the License.
 template <typename T, MemoryLayout layout>
 void func_Sqrt(const TensorView<T, layout>& input,
     const TensorView<T, layout>& output) {
-  Measurement::Start("sqrt");
+  static const auto region = Measurement::Intern("sqrt");
+  Measurement::Start(region);
 
   dlk::impl::unary_op(input, output, std::sqrt);
 
@@ -99,7 +99,9 @@ struct Base<QuantizedPacked<T>> {
 
 #define IP_CSR_ADDR 0xFF200000
 #define TH_IP_CSR_ADDR 0xFF200100
-#define INPUT_ADDR 0x20000000
+#define INPUT0_ADDR 0x20000000
+#define INPUT1_ADDR 0x24000000
+#define INPUT_ADDR INPUT0_ADDR
 #define OUTPUT0_ADDR 0x28000000
 #define OUTPUT1_ADDR 0x30000000
 #define OUTPUT_ADDR OUTPUT0_ADDR
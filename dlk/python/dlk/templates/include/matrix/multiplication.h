@@ -43,7 +43,8 @@ void matrix_multiplication(
    MatrixView<V, MatrixOrder::ColMajor>& C) {
 
   assert(A.cols() == B.rows());
-  Measurement::Start("matrix_multiplication");
+  static const auto region = Measurement::Intern("matrix_multiplication");
+  Measurement::Start(region);
 
 #ifdef USE_NEON
   if (A.cols() == 3 && A.rows() % 4 == 0) {
@@ -77,7 +77,8 @@ void matrix_shift_add(MatrixView<T, MatrixOrder::ColMajor>& buf,
                       MatrixView<T, MatrixOrder::ColMajor>& result,
                       const struct convolution_parameters& p,
                       const int block_offset) {
-  Measurement::Start("matrix_shift_add1");
+  static const auto clear_region = Measurement::Intern("matrix_shift_add1");
+  Measurement::Start(clear_region);
 
   const int h = p.input_height;
   const int w = p.input_width;
@@ -101,7 +102,8 @@ void matrix_shift_add(MatrixView<T, MatrixOrder::ColMajor>& buf,
 
   Measurement::Stop();
 
-  Measurement::Start("matrix_shift_add2");
+  static const auto add_region = Measurement::Intern("matrix_shift_add2");
+  Measurement::Start(add_region);
 
   for (int k = 0; k < col_block; ++k) {
     const auto true_k = k + block_offset;
@@ -23,7 +23,8 @@ namespace dlk {
 
 template<typename T>
 void matrix_transpose(MatrixView<T, MatrixOrder::ColMajor>& m, MatrixView<T, MatrixOrder::ColMajor>& out) {
-  Measurement::Start("matrix_transpose (col_major)");
+  static const auto region = Measurement::Intern("matrix_transpose (col_major)");
+  Measurement::Start(region);
 
   for (unsigned int j = 0; j < m.cols(); ++j) {
     for (unsigned int i = 0; i < m.rows(); ++i) {
@@ -36,7 +37,8 @@ void matrix_transpose(MatrixView<T, MatrixOrder::ColMajor>& m, MatrixView<T, Mat
 
 template<typename T>
 void matrix_transpose(MatrixView<T, MatrixOrder::RowMajor>& m, MatrixView<T, MatrixOrder::RowMajor>& out) {
-  Measurement::Start("matrix_transpose (row_major)");
+  static const auto region = Measurement::Intern("matrix_transpose (row_major)");
+  Measurement::Start(region);
 
   for (unsigned int i = 0; i < m.rows(); ++i) {
     for (unsigned int j = 0; j < m.cols(); ++j) {
@@ -24,6 +24,10 @@ limitations under the License.
 #include <memory>
 #include <system_error>
 
+#ifdef TCA_EMULATOR
+#include "tca_emulator.h"
+#endif
+
 class FileDescriptor {
  public:
   FileDescriptor() : fd(-1) {}
@@ -40,7 +44,12 @@ class FileDescriptor {
 
 class MappedMem {
  public:
-  MappedMem(std::size_t base, std::size_t size) : length(0) {
+  MappedMem(std::size_t base, std::size_t size) : ptr(MAP_FAILED), length(0) {
+#ifdef TCA_EMULATOR
+    // owned by the emulator, length stays 0
+    ptr = de10_nano::emulator::Map(base, size);
+    return;
+#endif
     FileDescriptor fd(open("/dev/mem", O_RDWR | O_SYNC));
     if (fd == -1) {
       return;
@@ -53,7 +62,7 @@ class MappedMem {
     length = size;
   }
   ~MappedMem() {
-    if (ptr != MAP_FAILED) {
+    if (ptr != MAP_FAILED && length != 0) {
       munmap(ptr, length);
     }
   }
@@ -18,6 +18,7 @@ limitations under the License.
 
 #include "global.h"
 #include "dma_buffer.h"
+#include "device_slots.h"
 
 #define SYM_PUBLIC __attribute__ ((visibility ("default")))
 #define SYM_LOCAL  __attribute__ ((visibility ("hidden")))
@@ -37,10 +38,16 @@ public:
 
     bool run(float *network_input, float *network_output);
 
+    // Prints operations, bytes and the achieved GOPS and GB/s of every layer from the
+    // per-layer Measurement regions of the runs so far. Layers below a fifth of the roofline
+    // min(peak compute, intensity * peak_gbps) are flagged; a zero peak disables the flags.
+    // peak_gbops applies to bit-serial convolutions, peak_gflops to everything else.
+    void roofline_report(double peak_gflops, double peak_gbps, double peak_gbops) const;
+
 private:
     // declarations
     {% for node in graph.non_variables %}
-    {% if node.available_buffer == '' %}
+    {% if node.available_buffer == '' and node.aliased_buffer == '' %}
     {% for out_k in node.output_ops.keys() -%}
     {% if node.output_ops.keys()|length > 1 %}
     {{ node.dtype.cpptype() }} *{{ node.name + '_' + out_k }}_raw = 0;
@@ -69,8 +76,19 @@ private:
     const int max_device_input_elems = MAX_SIZE_QINPUTS_PER_LAYER;
     const int max_device_output_elems = MAX_SIZE_OUTPUTS_PER_LAYER;
 
-    DMA_Buffer dma_input_buffer;
-    DMA_Buffer dma_output_buffer;
+    // ping-pong pairs on the FPGA, see DeviceSlots; with udmabuf they are
+    // carved out of dma_memory
+    DMA_Memory dma_memory;
+    DMA_Buffer dma_input_buffer[DeviceSlots::max_slots];
+    DMA_Buffer dma_output_buffer[DeviceSlots::max_slots];
+    DeviceSlots device_slots;
+    {%- if conv_chains %}
+
+    // fused chains which fit the device buffers; the others run one convolution at a time
+    {%- for chain in conv_chains %}
+    bool {{ chain[0].name }}_fused = true;
+    {%- endfor %}
+    {%- endif %}
 
 #if defined RUN_ON_FPGA
   {% set offset = namespace(o=0) -%}
@@ -97,6 +115,11 @@ private:
   {%     endif -%}
   {% endfor -%}
   const uint32_t total_thresholds_size = std::max(1, {{th_offset.o}});
+
+  // hash of the kernels and thresholds; the placement WeightStore gave them
+  const uint64_t weights_id = {{ params.weights_id }};
+  unsigned long kernel_phys_base = KERNEL_ADDR;
+  unsigned long thresholds_phys_base = THRESHOLD_ADDR;
 #endif // RUN_ON_FPGA
 };
 
@@ -33,6 +33,15 @@ struct convolution_parameters {
   T_UINT stride_along_height;
   T_UINT stride_along_width;
   T_UINT padding;
+  // spatial padding per side, may be asymmetric (e.g. TF 'SAME' with even kernels)
+  T_UINT padding_top;
+  T_UINT padding_bottom;
+  T_UINT padding_left;
+  T_UINT padding_right;
+  // G g G^T of the kernels for the Winograd path (nullptr when not applicable)
+  const T_FLOAT* winograd_weights;
+  // output tile size m of F(m x m, 3 x 3), 2 or 4
+  T_UINT winograd_tile;
 };
 
 struct binary_convolution_parameters {
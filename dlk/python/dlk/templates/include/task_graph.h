@@ -0,0 +1,88 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef DLK_TASK_GRAPH_H_INCLUDED
+#define DLK_TASK_GRAPH_H_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+namespace dlk {
+
+// Dependency graph of the nodes of a network, run on the ThreadPool.
+//
+// Nodes whose estimated cost is at least wide_cost run one at a time on the
+// calling thread with the whole pool for their own loops. The cheaper ones
+// run side by side, one thread each: every pool thread takes ready nodes
+// from its own queue, steals from the others when it runs dry, and queues
+// the successors that a finished node makes ready so that they run where
+// their input is still in cache. Exclusive nodes never run concurrently
+// with each other.
+//
+// So a node gets either the whole pool or one thread, not a share of the
+// pool in proportion to its cost: the ThreadPool runs one loop at a time,
+// and a loop started from inside another runs on its caller alone, so the
+// pool cannot be split between nodes running side by side.
+//
+// Graphs without independent branches, a pool of one thread and
+// SetEnabled(false) (or DLK_GRAPH_PARALLEL=0) fall back to running the
+// nodes in their index order, which must be a topological order.
+class TaskGraph
+{
+public:
+  // Operations below which a node does not get the whole pool. About 1M
+  // operations is 0.1 to 1 ms on the target cores: far above the few
+  // microseconds a pool loop costs to start, while the small layers of a
+  // branch stay below it and run side by side.
+  static constexpr double wide_cost = 1 << 20;
+
+  struct Node {
+    double cost;   // estimated operations
+    bool exclusive; // uses scratch shared with other exclusive nodes
+    std::vector<unsigned> deps; // earlier nodes this one waits for
+  };
+
+  explicit TaskGraph(std::vector<Node> nodes);
+
+  static void SetEnabled(bool on) { enabled.store(on, std::memory_order_relaxed); }
+  static bool IsEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+  // Calls run_node(i) for every node i, each after the nodes it depends on.
+  // Safe to call from several threads at once.
+  template <typename Body>
+  void Run(Body&& run_node) const {
+    using body_t = std::remove_reference_t<Body>;
+    Execute([](void* ctx, unsigned node) {
+      (*static_cast<body_t*>(ctx))(node);
+    }, const_cast<void*>(static_cast<const void*>(&run_node)));
+  }
+
+private:
+  using node_fn = void (*)(void* ctx, unsigned node);
+
+  static std::atomic<bool> enabled;
+
+  std::vector<Node> nodes;
+  std::vector<std::vector<unsigned>> successors;
+  bool chain; // every node depends on the one before
+
+  void Execute(node_fn fn, void* ctx) const;
+};
+
+} // namespace dlk
+
+#endif // DLK_TASK_GRAPH_H_INCLUDED
@@ -0,0 +1,63 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef DLK_TCA_EMULATOR_H_INCLUDED
+#define DLK_TCA_EMULATOR_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+
+namespace de10_nano {
+
+// Software model of the TCA accelerator for builds with TCA_EMULATOR
+// (lm_x86_fpga_emu and friends), so that the RUN_ON_FPGA code paths run on
+// a host without the board.
+//
+// Physical memory is host memory: MappedMem and DMA_Region map the reserved
+// DDR range, udmabuf devices and the CSR block from here instead of /dev/mem.
+// A job started by StartTCA runs on a thread of its own and walks the tiles
+// the CSRs describe (ADMA input tiles with their padding, WDMA kernel blocks,
+// A2F tile sizes, QDMA thresholds when BNQ is on, FDMA output tiles), so
+// calcParameters is checked along with the data layouts. Registers that do
+// not describe a consistent convolution are reported on stderr and counted.
+//
+// DLK_TCA_EMULATOR_GOPS makes each job last at least as long as the
+// accelerator would at that rate, for scheduling experiments.
+namespace emulator {
+
+// Host memory for [phys, phys + size), zeroed on first use. Throws
+// std::out_of_range outside the emulated ranges.
+void* Map(unsigned long phys, std::size_t size);
+
+// A fresh physical range, for buffers whose address the driver picks.
+unsigned long Allocate(std::size_t size);
+
+// Takes the job programmed into csr, whose start register was just written.
+void Start(volatile uint32_t* csr);
+
+// The stand-in for the UIO device of the TCA interrupt (see Completion): a
+// socket whose writes of 1 unmask the interrupt and which becomes readable,
+// with the event count, when a job ends while it is unmasked.
+int InterruptFd();
+
+// Jobs run and jobs whose registers or addresses were rejected so far.
+std::size_t Jobs();
+std::size_t Errors();
+
+} // namespace emulator
+
+} // namespace de10_nano
+
+#endif // DLK_TCA_EMULATOR_H_INCLUDED
@@ -0,0 +1,57 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef DLK_TCA_WAIT_H_INCLUDED
+#define DLK_TCA_WAIT_H_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+
+namespace de10_nano {
+
+// How WaitTCA waits for the accelerator to finish a job.
+//
+//   spin       reads the status register until it says done; lowest
+//              latency, but takes a core for the whole convolution
+//   poll       spins briefly, then sleeps between reads with a growing
+//              interval (the default)
+//   interrupt  sleeps in read() on the UIO device of the TCA interrupt
+//              (DLK_TCA_UIO, /dev/uio0 by default) and falls back to poll
+//              when there is none
+//
+// DLK_TCA_WAIT or SetPolicy picks one per deployment. TCA_EMULATOR builds
+// get a stand-in UIO device from the emulator.
+enum class WaitPolicy { spin, poll, interrupt };
+
+class Completion
+{
+public:
+  static void SetPolicy(WaitPolicy p) { policy.store(p, std::memory_order_relaxed); }
+  // "spin", "poll" or "interrupt"; false and no change for anything else.
+  static bool SetPolicy(const char* name);
+  static WaitPolicy Policy() { return policy.load(std::memory_order_relaxed); }
+
+  // Before the start register is written: unmasks the interrupt.
+  static void Arm();
+  // Returns once *status reads done.
+  static void Wait(volatile uint32_t* status);
+
+private:
+  static std::atomic<WaitPolicy> policy;
+};
+
+} // namespace de10_nano
+
+#endif // DLK_TCA_WAIT_H_INCLUDED
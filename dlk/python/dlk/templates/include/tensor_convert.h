@@ -18,15 +18,13 @@ limitations under the License.
 
 #include "global.h"
 #include "tensor_view.h"
+#include "thread_pool.h"
 #include "time_measurement.h"
 #include "func/impl/quantized_conv2d_kn2row.h"
 #include "func/impl/quantized_conv2d_tiling.h"
 #ifdef USE_NEON
 #include <arm_neon.h>
 #endif
-#ifdef _OPENMP
-#include <omp.h>
-#endif
 
 inline void convert_tensor(const TensorView<BIN_CONV_OUTPUT, MemoryLayout::HWC>& before,
     const TensorView<BIN_CONV_OUTPUT, MemoryLayout::ChHWCl>& after) {
@@ -36,7 +34,8 @@ inline void convert_tensor(const TensorView<BIN_CONV_OUTPUT, MemoryLayout::HWC>&
   const auto out_shape = after.get_shape();
   const auto channel_high = out_shape[0];
   const auto channel_low = out_shape[3];
-  Measurement::Start("Convert Tensor");
+  static const auto region = Measurement::Intern("Convert Tensor");
+  Measurement::Start(region);
   for (std::size_t dh = 0; dh < channel_high; ++dh)
     for (std::size_t r = 0; r < in_height; ++r)
       for (std::size_t c = 0; c < in_width; ++c)
@@ -52,9 +51,9 @@ inline void convert_tensor(const TensorView<QUANTIZED_PACKED, MemoryLayout::HWCh
   const auto width = in_shape[1];
   const auto channel = in_shape[2];
   const auto bits = in_shape[3];
-  Measurement::Start("Convert Tensor");
-#pragma omp parallel for
-  for (std::size_t i = 0; i < height; ++i)
+  static const auto region = Measurement::Intern("Convert Tensor");
+  Measurement::Start(region);
+  dlk::parallel_for<std::size_t>(0, height, [&](std::size_t i) {
     for (std::size_t j = 0; j < width; ++j)
       for (std::size_t k = 0; k < channel; ++k) {
         const auto idx_before = i * width * channel * bits
@@ -71,6 +70,7 @@ inline void convert_tensor(const TensorView<QUANTIZED_PACKED, MemoryLayout::HWCh
             *reinterpret_cast<uint64_t*>(before.data() + idx_before);
 #endif
       }
+  });
   Measurement::Stop();
 }
 
@@ -81,9 +81,9 @@ inline void convert_tensor(const TensorView<QUANTIZED_PACKED, MemoryLayout::ChHW
   const auto width = in_shape[2];
   const auto channel = in_shape[0];
   const auto bits = in_shape[3];
-  Measurement::Start("Convert Tensor");
-#pragma omp parallel for
-  for (std::size_t i = 0; i < height; ++i)
+  static const auto region = Measurement::Intern("Convert Tensor");
+  Measurement::Start(region);
+  dlk::parallel_for<std::size_t>(0, height, [&](std::size_t i) {
     for (std::size_t j = 0; j < width; ++j)
       for (std::size_t k = 0; k < channel; ++k) {
         const auto idx_before = k * height * width * bits
@@ -100,6 +100,7 @@ inline void convert_tensor(const TensorView<QUANTIZED_PACKED, MemoryLayout::ChHW
             *reinterpret_cast<uint64_t*>(before.data() + idx_before);
 #endif
       }
+  });
   Measurement::Stop();
 }
 
@@ -112,17 +113,11 @@ template <typename T, MemoryLayout layout>
 void convert_tensor(const TensorView<T, layout>& before,
     const TensorView<T, layout>& after) {
   const auto num_elems = before.size();
-  Measurement::Start("Convert Tensor");
-#ifdef _OPENMP
-  const auto num_threads = omp_get_max_threads();
-  const auto chunk_size = (num_elems + num_threads - 1) / num_threads;
-#pragma omp parallel for
-  for (int i = 0; i < num_elems; i += chunk_size) {
-    std::copy(before.data() + i, before.data() + std::min(i + chunk_size, num_elems), after.data() + i);
-  }
-#else
-  std::copy(before.data(), before.data() + num_elems, after.data());
-#endif
+  static const auto region = Measurement::Intern("Convert Tensor");
+  Measurement::Start(region);
+  dlk::parallel_for_range<std::size_t>(0, num_elems, [&](std::size_t begin, std::size_t end) {
+    std::copy(before.data() + begin, before.data() + end, after.data() + begin);
+  });
   Measurement::Stop();
 }
 
@@ -17,7 +17,9 @@ limitations under the License.
 #define DLK_TENSOR_VIEW_H_INCLUDED
 
 #include <cassert>
+#include <climits>
 #include <array>
+#include <type_traits>
 #include "global.h"
 
 enum class MemoryLayout {
@@ -244,6 +246,247 @@ class TensorView<QuantizedPacked<T>, memory_layout> {
   tensor_info_t<std::size_t> shape;
 };
 
+// TensorView whose shape is fixed at compile time. Strides are constant
+// expressions, so the compiler can fold the index arithmetic in kernels
+// which take the static view; everything else sees it as a TensorView.
+template <typename T, MemoryLayout memory_layout, std::size_t... dims>
+class StaticTensorView : public TensorView<T, memory_layout> {
+ public:
+  using base_t = T;
+  using view_t = TensorView<T, memory_layout>;
+  static constexpr auto layout = memory_layout;
+  static constexpr auto dim = get_dim(layout);
+  static_assert(sizeof...(dims) == dim, "Unmatched dimension");
+  explicit StaticTensorView(base_t* const ptr)
+    : view_t(ptr, {dims...}) {}
+  template <typename... Ts>
+  base_t& operator()(Ts&&... args) const {
+    return *data(args...);
+  }
+  template <typename... Ts>
+  base_t* data(Ts&&... args) const {
+    static_assert(sizeof...(Ts) == dim, "Unmatched dimension");
+    return view_t::data() + get_offset(args...);
+  }
+  base_t* data() const {
+    return view_t::data();
+  }
+  template <typename... Ts>
+  static constexpr std::size_t get_offset(Ts&&... args) {
+    const std::size_t offsets[] = {static_cast<std::size_t>(args)...};
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i < sizeof...(Ts); ++i) {
+      assert(offsets[i] < extent(i));
+      offset += offsets[i] * stride(i);
+    }
+    return offset;
+  }
+  static constexpr std::size_t size() {
+    std::size_t prod = 1;
+    for (std::size_t i = 0; i < dim; ++i) {
+      prod *= extent(i);
+    }
+    return prod;
+  }
+  // Number of addressable elements along axis i.
+  static constexpr std::size_t extent(const std::size_t i) {
+    const std::size_t shape[] = {dims...};
+    return is_packed() && i == dim - 1
+      ? (shape[i] + sizeof(T) * CHAR_BIT - 1) / (sizeof(T) * CHAR_BIT)
+      : shape[i];
+  }
+  static constexpr std::size_t stride(const std::size_t i) {
+    std::size_t s = 1;
+    for (std::size_t j = i + 1; j < dim; ++j) {
+      s *= extent(j);
+    }
+    return s;
+  }
+ private:
+  static constexpr bool is_packed() {
+    return !std::is_same<T, typename Base<T>::type>::value;
+  }
+};
+
+// True if TView is TensorView<T, layout> or a view derived from it, so
+// kernels can take static views without giving up overloading on layout.
+template <typename TView, typename T, MemoryLayout layout>
+struct is_view_of : std::is_base_of<TensorView<T, layout>, TView> {};
+
+constexpr bool is_channel_high_major(const MemoryLayout& layout) {
+  return layout == MemoryLayout::ChHWCl || layout == MemoryLayout::ChHWBCl;
+}
+
+// View of the channel-high blocks [offset, offset + count) of a tensor whose
+// outermost dimension is the channel-high one. Such blocks are contiguous,
+// so the returned view aliases the buffer of the original tensor.
+template <typename T, MemoryLayout layout>
+TensorView<T, layout> channel_high_slice(const TensorView<T, layout>& tensor,
+    const std::size_t offset, const std::size_t count) {
+  static_assert(is_channel_high_major(layout), "Channel high is not the outermost dimension");
+  auto shape = tensor.get_shape();
+  assert(offset + count <= shape[0]);
+  const auto block_size = tensor.size() / shape[0];
+  shape[0] = count;
+  return TensorView<T, layout>(tensor.data() + offset * block_size, shape);
+}
+
+template <typename T>
+struct is_quantized_packed : std::false_type {};
+
+template <typename T>
+struct is_quantized_packed<QuantizedPacked<T>> : std::true_type {};
+
+// Tensor view with explicit strides, e.g. a sub-range of another tensor.
+// Strides are counted in base_t elements. As in TensorView, the innermost
+// index of a QuantizedPacked tensor addresses packed words, not bits.
+// Kernels which only iterate the tensor take this view; the dense
+// TensorView is left untouched so the common path pays nothing for it.
+template <typename T, MemoryLayout memory_layout>
+class StridedTensorView {
+ public:
+  using base_t = T;
+  static constexpr auto layout = memory_layout;
+  static constexpr auto dim = get_dim(layout);
+  template <typename U>
+  using tensor_info_t = std::array<U, dim>;
+  StridedTensorView(base_t* const ptr,
+    const tensor_info_t<std::size_t>& shape,
+    const tensor_info_t<std::size_t>& strides)
+    : ptr(ptr), shape(shape), strides(strides) {}
+  StridedTensorView(const TensorView<T, layout>& dense)
+    : ptr(dense.data()), shape(dense.get_shape()), strides(dense_strides(dense.get_shape())) {}
+  template <typename... Ts>
+  base_t& operator()(Ts&&... args) const {
+    return *data(args...);
+  }
+  template <typename... Ts>
+  base_t* data(Ts&&... args) const {
+    static_assert(sizeof...(Ts) == dim, "Unmatched dimension");
+    return ptr + get_offset(args...);
+  }
+  base_t* data() const {
+    return ptr;
+  }
+  template <typename... Ts>
+  std::size_t get_offset(Ts&&... args) const {
+    const std::array<std::size_t, sizeof...(Ts)> offsets = {static_cast<std::size_t>(args)...};
+    return get_offset_ary(offsets);
+  }
+  template <std::size_t N>
+  std::size_t get_offset_ary(const std::array<std::size_t, N>& arg) const {
+    constexpr std::size_t n = dim < N ? dim : N;
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+      assert(arg[i] < extent(i, shape[i]));
+      offset += arg[i] * strides[i];
+    }
+    return offset;
+  }
+  const tensor_info_t<std::size_t>& get_shape() const {
+    return shape;
+  }
+  const tensor_info_t<std::size_t>& get_strides() const {
+    return strides;
+  }
+  std::size_t size() const {
+    std::size_t prod = 1;
+    for (std::size_t i = 0; i < dim; ++i) {
+      prod *= extent(i, shape[i]);
+    }
+    return prod;
+  }
+  // The stride of an axis of extent 1 is never used, e.g. the outermost
+  // one of a slice along it.
+  bool is_contiguous() const {
+    const auto dense = dense_strides(shape);
+    for (std::size_t i = 0; i < dim; ++i) {
+      if (extent(i, shape[i]) > 1 && strides[i] != dense[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
+  // Dense view of the same memory; only valid when is_contiguous().
+  TensorView<T, layout> dense() const {
+    assert(is_contiguous());
+    return TensorView<T, layout>(ptr, shape);
+  }
+  // Elements [begin, begin + count) along axis.
+  StridedTensorView slice(const std::size_t axis,
+      const std::size_t begin, const std::size_t count) const {
+    assert(axis < dim);
+    assert(begin + count <= shape[axis]);
+    auto new_shape = shape;
+    new_shape[axis] = count;
+    return StridedTensorView(ptr + first_index(axis, begin) * strides[axis], new_shape, strides);
+  }
+  // Box [begin, begin + count) over all axes.
+  StridedTensorView subview(const tensor_info_t<std::size_t>& begin,
+      const tensor_info_t<std::size_t>& count) const {
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i < dim; ++i) {
+      assert(begin[i] + count[i] <= shape[i]);
+      offset += first_index(i, begin[i]) * strides[i];
+    }
+    return StridedTensorView(ptr + offset, count, strides);
+  }
+  // Moves index to the next element in row-major order.
+  // Returns false once every element has been visited.
+  bool next(tensor_info_t<std::size_t>& index) const {
+    for (std::ptrdiff_t i = dim - 1; i >= 0; --i) {
+      if (++index[i] < extent(i, shape[i])) {
+        return true;
+      }
+      index[i] = 0;
+    }
+    return false;
+  }
+  static tensor_info_t<std::size_t> dense_strides(const tensor_info_t<std::size_t>& shape) {
+    tensor_info_t<std::size_t> strides;
+    std::size_t stride = 1;
+    for (std::ptrdiff_t i = dim - 1; i >= 0; --i) {
+      strides[i] = stride;
+      stride *= extent(i, shape[i]);
+    }
+    return strides;
+  }
+ private:
+  // Number of addressable elements along axis i for a logical extent n.
+  static std::size_t extent(const std::size_t i, const std::size_t n) {
+    if (is_quantized_packed<T>::value && i == dim - 1) {
+      return (n + bit_count() - 1) / bit_count();
+    }
+    return n;
+  }
+  static std::size_t first_index(const std::size_t i, const std::size_t n) {
+    if (is_quantized_packed<T>::value && i == dim - 1) {
+      assert(n % bit_count() == 0);
+      return n / bit_count();
+    }
+    return n;
+  }
+  static constexpr std::size_t bit_count() {
+    return sizeof(T) * CHAR_BIT;
+  }
+  base_t* ptr;
+  tensor_info_t<std::size_t> shape;
+  tensor_info_t<std::size_t> strides;
+};
+
+template <typename T, MemoryLayout layout>
+StridedTensorView<T, layout> slice(const TensorView<T, layout>& tensor,
+    const std::size_t axis, const std::size_t begin, const std::size_t count) {
+  return StridedTensorView<T, layout>(tensor).slice(axis, begin, count);
+}
+
+template <typename T, MemoryLayout layout>
+StridedTensorView<T, layout> subview(const TensorView<T, layout>& tensor,
+    const typename TensorView<T, layout>::template tensor_info_t<std::size_t>& begin,
+    const typename TensorView<T, layout>::template tensor_info_t<std::size_t>& count) {
+  return StridedTensorView<T, layout>(tensor).subview(begin, count);
+}
+
 #ifdef RUN_ON_FPGA
 using kernel_t = TensorView<QUANTIZED_PACKED_KERNEL, MemoryLayout::OhIhHWOlIl>;
 #elif defined USE_NEON || defined USE_AVX
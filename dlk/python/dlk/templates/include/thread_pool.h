@@ -0,0 +1,101 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef DLK_THREAD_POOL_H_INCLUDED
+#define DLK_THREAD_POOL_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+namespace dlk {
+
+// Worker threads shared by every kernel of the library.
+//
+// The calling thread works too, so a pool of n threads starts n - 1 workers,
+// each pinned to one CPU. The thread that configures the pool, on its first
+// use or in Configure(), is pinned to the first CPU and is expected to be
+// the one running the network; its affinity stays narrowed afterwards. By default the pool takes the CPUs of the highest
+// capacity (cpu_capacity, else cpuinfo_max_freq) among those the process may
+// run on, i.e. only the big cores of a big.LITTLE system; DLK_NUM_THREADS
+// (or OMP_NUM_THREADS) and DLK_CPU_MASK override the count and the CPUs.
+// When more threads than big cores are asked for, the next fastest CPUs are
+// added; work is handed out in small chunks from a shared counter, so slower
+// cores simply take fewer of them.
+//
+// Idle workers spin for a while before they sleep, so the back-to-back
+// loops of a network run do not pay a wake-up each. A loop started from
+// inside another one, or while another thread is using the pool, runs on
+// the calling thread alone.
+class ThreadPool
+{
+public:
+  // n == 0 keeps the default count and cpu_mask == 0 the default CPUs.
+  // Returns false if cpu_mask names no CPU the process may run on.
+  // Must not be called while a loop is running.
+  static bool Configure(unsigned n, std::uint64_t cpu_mask);
+  static unsigned Size();
+  // 0 on the calling thread, 1 .. Size() - 1 on the workers.
+  static unsigned ThreadIndex();
+
+  // Calls body(first, last) on disjoint chunks covering [0, count).
+  template <typename Body>
+  static void Run(std::size_t count, Body&& body) {
+    using body_t = std::remove_reference_t<Body>;
+    Dispatch(count, [](void* ctx, std::size_t first, std::size_t last) {
+      (*static_cast<body_t*>(ctx))(first, last);
+    }, &body);
+  }
+
+private:
+  using chunk_fn = void (*)(void* ctx, std::size_t first, std::size_t last);
+  static void Dispatch(std::size_t count, chunk_fn fn, void* ctx);
+};
+
+// for (T i = begin; i < end; i += step) body(i), spread over the pool.
+template <typename T, typename Body>
+void parallel_for(const T begin, const T end, const T step, Body&& body) {
+  if (!(begin < end)) {
+    return;
+  }
+  const std::size_t count = (end - begin + step - 1) / step;
+  ThreadPool::Run(count, [&](std::size_t first, std::size_t last) {
+    for (std::size_t n = first; n < last; ++n) {
+      body(static_cast<T>(begin + n * step));
+    }
+  });
+}
+
+template <typename T, typename Body>
+void parallel_for(const T begin, const T end, Body&& body) {
+  parallel_for(begin, end, T(1), std::forward<Body>(body));
+}
+
+// Calls body(first, last) on disjoint ranges covering [begin, end), for loops
+// that want to handle a whole chunk at once (memcpy, hand-blocked kernels).
+template <typename T, typename Body>
+void parallel_for_range(const T begin, const T end, Body&& body) {
+  if (!(begin < end)) {
+    return;
+  }
+  ThreadPool::Run(end - begin, [&](std::size_t first, std::size_t last) {
+    body(static_cast<T>(begin + first), static_cast<T>(begin + last));
+  });
+}
+
+} // namespace dlk
+
+#endif // DLK_THREAD_POOL_H_INCLUDED
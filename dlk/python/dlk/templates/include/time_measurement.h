@@ -16,50 +16,102 @@ limitations under the License.
 #ifndef TIME_MEASURE_HEADER
 #define TIME_MEASURE_HEADER
 
+#include <atomic>
 #include <map>
 #include <string>
 #include <vector>
 #include <chrono>
+#include <cstdint>
 #include <iostream>
 #include <memory>
 #include <unordered_map>
 
-#define TIME_ORDER std::chrono::microseconds
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
+#define TIME_ORDER std::chrono::microseconds
 
+// Per-region profiler.
+//
+// Start/Stop only test a flag while disabled, so it is compiled in everywhere and
+// switched at runtime with Enable() or the DLK_PROFILE environment variable
+// (FUNC_TIME_MEASUREMENT makes it enabled by default). Every thread appends
+// finished regions to its own ring buffer, so it is safe on the pool threads.
+// Report() should be called while no region is being measured.
 class Measurement
 {
-private:
+public:
+  using RegionId = std::uint32_t;
 
-  struct measure
-  {
-    std::chrono::system_clock::time_point start;
-    std::chrono::system_clock::time_point end;
-  };
+  // Returns the same id for every call with the same name.
+  // Hot call sites can keep it in a function-local static.
+  static RegionId Intern(const char* name);
+  static const char* Name(RegionId id);
 
-  struct Node {
-    Node(const std::string& name, size_t position)
-        : name(name), position(position) {
+  static void Start(RegionId id) {
+    if (enabled.load(std::memory_order_relaxed)) {
+      Begin(id);
+    }
+  }
+  // The region is looked up by the contents of measure_name, which need not
+  // outlive the call.
+  static void Start(const char* measure_name) {
+    if (enabled.load(std::memory_order_relaxed)) {
+      Begin(measure_name);
     }
+  }
+  static void Stop() {
+    if (enabled.load(std::memory_order_relaxed)) {
+      End();
+    }
+  }
 
-    std::string name;
-    size_t position;
-    std::vector<measure> measurements;
-    std::unordered_map<std::string, std::unique_ptr<Node>> children;
-  };
+  static void Enable(bool on) { enabled.store(on, std::memory_order_relaxed); }
+  static bool IsEnabled() { return enabled.load(std::memory_order_relaxed); }
 
-  static std::map<std::string, std::vector<Measurement::measure> > times;
-  static std::vector<std::string> current_context;
+  // Counts cycles, instructions, L1D and LLC misses and branch misses per
+  // region with perf_event_open (also enabled by DLK_PROFILE_COUNTERS).
+  // Each thread opens its own counter group at its first region; where that
+  // fails (no PMU, containers, perf_event_paranoid) regions are timed only.
+  static void EnableCounters(bool on);
+  static bool CountersEnabled();
 
-  static std::vector<Node*> stack;
-  static std::vector<std::unique_ptr<Node>> roots;
+  // Prints the region tree of every thread with all durations in TIME_ORDER.
+  static void Report();
+  // Writes a trace-event JSON file (chrome://tracing, Perfetto) with one
+  // complete event per region, one track per thread.
+  static bool WriteTrace(const std::string& path);
+  // Writes a CSV with count, min, median, p99, mean and total time in
+  // TIME_ORDER of every region name over all threads and runs.
+  static bool WriteSummary(const std::string& path);
+  // Durations in TIME_ORDER of every recorded region with this name, over all threads.
+  static std::vector<double> Durations(const char* name);
+  // Drops every recorded region; interned ids stay valid.
+  static void Clear();
+
+  // Raw timestamp in clock ticks: rdtsc on x86, cntvct on AArch64 and
+  // steady_clock nanoseconds elsewhere. See TicksToNanoseconds().
+  static std::uint64_t Now() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    std::uint64_t ticks;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+  }
+  static double TicksToNanoseconds(std::uint64_t ticks);
 
-  static void DumpTimeTree(const Node&, int level);
+private:
+  static std::atomic<bool> enabled;
 
-public:
-  static void Start(const std::string &measure_name);
-  static void Stop();
-  static void Report();
+  static void Begin(RegionId id);
+  static void Begin(const char* measure_name);
+  static void End();
 };
 
 #endif
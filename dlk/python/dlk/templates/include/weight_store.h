@@ -0,0 +1,71 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef DLK_WEIGHT_STORE_H_INCLUDED
+#define DLK_WEIGHT_STORE_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace de10_nano {
+
+// The kernels and thresholds of the quantized convolutions in the reserved
+// DDR ranges the accelerator reads them from (KERNEL_ADDR and THRESHOLD_ADDR).
+//
+// That memory outlives the process, so the first page of the kernel range
+// holds a table of the models uploaded so far: the id of each one (a hash of
+// its weights from the code generator, params.weights_id), where its kernels
+// and thresholds are, a digest of the bytes and when it was last placed.
+// A model found there is not uploaded again, which saves the copy through
+// /dev/mem on every start. Others get room next to the models already there,
+// evicting the least recently placed ones when they do not fit, so that a few
+// models can stay resident and be switched between. Evicting a model another
+// process still runs breaks that process; size the models accordingly.
+//
+// DLK_WEIGHTS_VERIFY=1 checks the digest of a resident copy before using it
+// and DLK_WEIGHTS_UPLOAD=1 uploads regardless. Processes take turns at the
+// table through flock on DLK_WEIGHTS_LOCK (/tmp/dlk_weights.lock).
+class WeightStore
+{
+public:
+  // Copied to offset from the start of the model's kernels or thresholds.
+  struct Chunk {
+    std::size_t offset;
+    const void* data;
+    std::size_t size;
+  };
+
+  struct Placement {
+    unsigned long kernel_addr;
+    unsigned long thresholds_addr;
+    bool uploaded; // false when the resident copy is used
+  };
+
+  // Finds or uploads model id, whose kernels and thresholds take kernel_size
+  // and thresholds_size bytes. False when the model does not fit or the
+  // memory cannot be mapped.
+  static bool Place(uint64_t id,
+                    const std::vector<Chunk>& kernels, std::size_t kernel_size,
+                    const std::vector<Chunk>& thresholds, std::size_t thresholds_size,
+                    Placement& placement);
+
+  // Forgets every model, e.g. after the board was reconfigured.
+  static void Clear();
+};
+
+} // namespace de10_nano
+
+#endif // DLK_WEIGHT_STORE_H_INCLUDED
@@ -14,13 +14,22 @@ limitations under the License.
 ==============================================================================*/
 
 #include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
 #include <cstring>
+#include <fstream>
+#include <string>
 #include <vector>
+#include <sys/resource.h>
 
 #include "global.h"
 #include "dlk_test.h"
 #include "network.h"
 #include "time_measurement.h"
+#include "drift_monitor.h"
+#include "thread_pool.h"
 #include "npy.hpp"
 
 template<typename T>
@@ -36,13 +45,180 @@ std::ostream& operator<<(std::ostream &os, const std::vector<T> &v)
     return os;
 }
 
+struct BenchResult {
+  int threads;
+  double mean_ms;
+  double median_ms;
+  double p90_ms;
+  double p99_ms;
+  double min_ms;
+  double max_ms;
+};
+
+// nearest-rank percentile of sorted samples
+static double percentile(const std::vector<double>& sorted, double q)
+{
+  const auto rank = static_cast<std::size_t>(std::ceil(q * sorted.size()));
+  return sorted[std::max<std::size_t>(rank, 1) - 1];
+}
+
+static int bench(int argc, char *argv[])
+{
+  int warmup = 10;
+  int iterations = 100;
+  int max_threads = 0;
+  std::string json_path;
+  std::string input_path;
+
+  for (int i = 2; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--warmup" && has_value) {
+      warmup = std::atoi(argv[++i]);
+    } else if (arg == "--iterations" && has_value) {
+      iterations = std::atoi(argv[++i]);
+    } else if (arg == "--threads" && has_value) {
+      max_threads = std::atoi(argv[++i]);
+    } else if (arg == "--json" && has_value) {
+      json_path = argv[++i];
+    } else if (arg == "--input" && has_value) {
+      input_path = argv[++i];
+    } else {
+      std::cout << "Error: unknown bench option " << arg << std::endl;
+      std::cout << "Use: " << argv[0] << " --bench [--warmup N] [--iterations N] [--threads N]"
+                << " [--json <file or ->] [--input <.npy input file>]" << std::endl;
+      return 1;
+    }
+  }
+  if (iterations <= 0 || warmup < 0) {
+    std::cout << "Error: iterations must be positive and warmup non-negative" << std::endl;
+    return 1;
+  }
+
+  std::vector<{{ graph_input.dtype.cpptype() }}> input({{ graph_input.view.size_in_words_as_cpp }});
+  if (!input_path.empty()) {
+    std::vector<unsigned long> input_shape;
+    try {
+      npy::LoadArrayFromNumpy(input_path, input_shape, input);
+    }
+    catch(std::exception &ex) {
+      std::cout << "Unable to load the input: " << ex.what() << std::endl;
+      return -1;
+    }
+    if(input.size() != {{ graph_input.view.size_in_words_as_cpp }}) {
+      std::cout << "Error: input shape should be {{ graph_input.view.size_in_words_as_cpp }} but got " << input_shape << std::endl;
+      return -1;
+    }
+  }
+  std::vector<{{ graph_output.dtype.cpptype() }}> output({{ graph_output.view.size_in_words_as_cpp }});
+
+  // the profiler would be part of what we measure, unless asked for explicitly
+  if (std::getenv("DLK_PROFILE") == nullptr) {
+    Measurement::Enable(false);
+  }
+
+  Network nn;
+  if (!nn.init()) {
+    std::cout << "Error: cannot initialize the network" << std::endl;
+    return 1;
+  }
+
+  std::vector<int> thread_counts;
+  if (max_threads > 0) {
+    for (int t = 1; t <= max_threads; ++t) {
+      thread_counts.push_back(t);
+    }
+  } else {
+    thread_counts.push_back(dlk::ThreadPool::Size());
+  }
+
+  // the sweep leaves the pool as it found it
+  const unsigned configured_threads = dlk::ThreadPool::Size();
+  std::vector<BenchResult> results;
+  for (int threads : thread_counts) {
+    if (max_threads > 0) {
+      dlk::ThreadPool::Configure(threads, 0);
+    }
+    for (int i = 0; i < warmup; ++i) {
+      nn.run(input.data(), output.data());
+    }
+
+    std::vector<double> latencies;
+    latencies.reserve(iterations);
+    for (int i = 0; i < iterations; ++i) {
+      const auto start = std::chrono::steady_clock::now();
+      nn.run(input.data(), output.data());
+      const auto end = std::chrono::steady_clock::now();
+      latencies.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    double sum = 0;
+    for (auto l : latencies) {
+      sum += l;
+    }
+    results.push_back({threads, sum / iterations, percentile(latencies, 0.5), percentile(latencies, 0.9),
+                       percentile(latencies, 0.99), latencies.front(), latencies.back()});
+  }
+  if (max_threads > 0) {
+    dlk::ThreadPool::Configure(configured_threads, 0);
+  }
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  const long peak_rss_kb = usage.ru_maxrss;
+
+  // keep stdout parseable when the JSON goes there
+  if (json_path != "-") {
+    std::printf("%8s %10s %10s %10s %10s %10s %10s %10s\n",
+        "threads", "mean[ms]", "median", "p90", "p99", "min", "max", "fps");
+    for (const auto& r : results) {
+      std::printf("%8d %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.2f\n",
+          r.threads, r.mean_ms, r.median_ms, r.p90_ms, r.p99_ms, r.min_ms, r.max_ms, 1000.0 / r.mean_ms);
+    }
+    std::printf("peak RSS: %ld KiB\n", peak_rss_kb);
+  }
+
+  if (!json_path.empty()) {
+    std::ofstream file;
+    if (json_path != "-") {
+      file.open(json_path);
+      if (!file) {
+        std::cout << "Error: cannot open " << json_path << std::endl;
+        return 1;
+      }
+    }
+    std::ostream& out = json_path == "-" ? std::cout : file;
+    out << "{\"warmup\":" << warmup << ",\"iterations\":" << iterations
+        << ",\"peak_rss_kb\":" << peak_rss_kb << ",\"results\":[";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+      const auto& r = results[i];
+      out << (i == 0 ? "" : ",") << "{\"threads\":" << r.threads
+          << ",\"mean_ms\":" << r.mean_ms << ",\"median_ms\":" << r.median_ms
+          << ",\"p90_ms\":" << r.p90_ms << ",\"p99_ms\":" << r.p99_ms
+          << ",\"min_ms\":" << r.min_ms << ",\"max_ms\":" << r.max_ms
+          << ",\"fps\":" << 1000.0 / r.mean_ms << "}";
+    }
+    out << "]}" << std::endl;
+  }
+
+  return 0;
+}
+
 
 int main(int argc, char *argv[])
 {
+  if(argc >= 2 && std::strcmp(argv[1], "--bench") == 0)
+  {
+    return bench(argc, argv);
+  }
+
   if(argc != 3)
   {
     std::cout << "Error: The number of arguments is invalid" << std::endl;
     std::cout << "Use: " << argv[0] << " <.npy debug input file> <.npy debug expected output file>" << std::endl;
+    std::cout << "     " << argv[0] << " --bench [--warmup N] [--iterations N] [--threads N]"
+              << " [--json <file or ->] [--input <.npy input file>]" << std::endl;
     return 1;
   }
 
@@ -83,13 +259,35 @@ int main(int argc, char *argv[])
 
   std::vector<{{ graph_output.dtype.cpptype() }}> output({{ graph_output.view.size_in_words_as_cpp }});
 
+  // DLK_ROOFLINE="<peak GFLOPS>,<peak GB/s>[,<peak binary GOPS>]"
+  const char* roofline = std::getenv("DLK_ROOFLINE");
+  if (roofline != nullptr) {
+    Measurement::Enable(true);
+  }
+
   Measurement::Start("TotalRunTime");
   nn.run(debug_input_data.data(), output.data());
   Measurement::Stop();
 
   bool test_result = dlk_test::compare(output.data(), "Default network test ", debug_output_data.data(), output.size());
 
+  // waits for the shadow checks, which are profiled too
+  DriftMonitor::Report();
   Measurement::Report();
+  if (roofline != nullptr) {
+    double peak_gflops = 0, peak_gbps = 0, peak_gbops = 0;
+    std::sscanf(roofline, "%lf,%lf,%lf", &peak_gflops, &peak_gbps, &peak_gbops);
+    nn.roofline_report(peak_gflops, peak_gbps, peak_gbops);
+  }
+  if (const char* path = std::getenv("DLK_PROFILE_TRACE")) {
+    Measurement::WriteTrace(path);
+  }
+  if (const char* path = std::getenv("DLK_PROFILE_CSV")) {
+    Measurement::WriteSummary(path);
+  }
+  if (const char* path = std::getenv("DLK_DRIFT_CSV")) {
+    DriftMonitor::WriteSummary(path);
+  }
 
   return test_result;
 }
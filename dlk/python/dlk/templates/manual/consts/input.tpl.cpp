@@ -90,4 +90,13 @@ const TensorView<{{ node.dtype.cpptype() }}, MemoryLayout::{{ node.dimension }}>
 
 {% endif %}
 
+{% if node.winograd_data is not none -%}
+// kernels transformed for Winograd F({{ node.winograd_tile }}x{{ node.winograd_tile }}, 3x3)
+const T_FLOAT {{ node.name }}_winograd[] = {
+  {% for d in node.winograd_data.flatten() -%}
+  {{- d -}},
+  {%- endfor %}
+};
+{% endif %}
+
 {%- endif %}
@@ -38,6 +38,10 @@ extern const TensorView<{{ node.dtype.cpptype() }}, MemoryLayout::{{ node.dimens
 
 {%- endif %}
 
+{% if node.winograd_data is not none -%}
+extern const T_FLOAT {{ node.name }}_winograd[];
+{%- endif %}
+
 
 #endif //{{ name }}_H_INCLUDED
 
@@ -0,0 +1,290 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include "activation_dump.h"
+
+namespace {
+
+struct Entry {
+  enum class Kind { All, Name, Prefix, Range } kind;
+  std::string name;
+  std::size_t first, last;
+};
+
+struct File {
+  std::string root;
+  std::string dir;
+  std::string path;
+  std::vector<char> bytes; // header and data
+};
+
+std::vector<Entry> parse(const std::string& spec) {
+  std::vector<Entry> entries;
+  std::size_t begin = 0;
+  while (begin <= spec.size()) {
+    auto end = spec.find(',', begin);
+    if (end == std::string::npos) {
+      end = spec.size();
+    }
+    const auto item = spec.substr(begin, end - begin);
+    begin = end + 1;
+    if (item.empty()) {
+      continue;
+    }
+
+    Entry e{Entry::Kind::Name, item, 0, 0};
+    const auto dash = item.find('-');
+    const bool digits = item.find_first_not_of("0123456789-") == std::string::npos;
+    if (item == "*") {
+      e.kind = Entry::Kind::All;
+    } else if (item.back() == '*') {
+      e.kind = Entry::Kind::Prefix;
+      e.name.pop_back();
+    } else if (digits && dash != std::string::npos && dash > 0 && dash + 1 < item.size()) {
+      e.kind = Entry::Kind::Range;
+      e.first = std::strtoul(item.c_str(), nullptr, 10);
+      e.last = std::strtoul(item.c_str() + dash + 1, nullptr, 10);
+    } else if (digits && dash == std::string::npos) {
+      e.kind = Entry::Kind::Range;
+      e.first = e.last = std::strtoul(item.c_str(), nullptr, 10);
+    }
+    entries.push_back(e);
+  }
+  return entries;
+}
+
+bool write_all(const File& file) {
+  mkdir(file.root.c_str(), 0755);
+  mkdir(file.dir.c_str(), 0755);
+  const int fd = open(file.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  const char* p = file.bytes.data();
+  std::size_t left = file.bytes.size();
+  while (left > 0) {
+    const auto n = write(fd, p, left);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      close(fd);
+      return false;
+    }
+    p += n;
+    left -= n;
+  }
+  return close(fd) == 0;
+}
+
+// Version 1.0 header, padded so that the data starts 64-byte aligned.
+std::string npy_header(const char* descr, const std::vector<std::size_t>& shape) {
+  std::string dict = std::string("{'descr': '") + descr + "', 'fortran_order': False, 'shape': (";
+  for (const auto len : shape) {
+    dict += std::to_string(len) + ", ";
+  }
+  if (shape.size() > 1) {
+    dict.resize(dict.size() - 1);
+  }
+  dict += "), }";
+  constexpr std::size_t preamble = 10;
+  const std::size_t total = (preamble + dict.size() + 1 + 63) / 64 * 64;
+  dict.append(total - preamble - dict.size() - 1, ' ');
+  dict += '\n';
+
+  const std::uint16_t len = dict.size();
+  std::string header("\x93NUMPY\x01\x00", 8);
+  header += static_cast<char>(len & 0xff);
+  header += static_cast<char>(len >> 8);
+  return header + dict;
+}
+
+class State {
+ public:
+  State() {
+    const char* spec = std::getenv("DLK_DUMP");
+    const char* every_env = std::getenv("DLK_DUMP_EVERY");
+    const char* dir_env = std::getenv("DLK_DUMP_DIR");
+    if (every_env != nullptr && std::atoi(every_env) > 0) {
+      every = std::atoi(every_env);
+    }
+    if (dir_env != nullptr && dir_env[0] != '\0') {
+      dir = dir_env;
+    }
+    if (spec != nullptr) {
+      entries = parse(spec);
+    }
+  }
+
+  std::mutex mutex; // guards everything below
+  std::vector<Entry> entries;
+  unsigned every = 1;
+  std::string dir = "debug";
+  std::uint64_t runs = 0;
+  std::uint64_t current_run = 0;
+
+  std::condition_variable queued;
+  std::condition_variable drained;
+  std::deque<File> queue;
+  std::size_t pending_bytes = 0;
+  bool writing = false;
+  bool writer_started = false;
+  std::size_t dropped = 0;
+
+  void start_writer() {
+    if (!writer_started) {
+      writer_started = true;
+      std::thread([this] { writer(); }).detach();
+    }
+  }
+
+ private:
+  void writer() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      queued.wait(lock, [this] { return !queue.empty(); });
+      File file = std::move(queue.front());
+      queue.pop_front();
+      writing = true;
+      lock.unlock();
+      const bool ok = write_all(file);
+      lock.lock();
+      if (!ok) {
+        ++dropped;
+        std::cerr << "ActivationDump: cannot write " << file.path << std::endl;
+      }
+      pending_bytes -= file.bytes.size();
+      writing = false;
+      if (queue.empty()) {
+        drained.notify_all();
+      }
+    }
+  }
+};
+
+// Never destroyed: the detached writer may still use it during exit.
+State& state() {
+  static State* s = new State();
+  return *s;
+}
+
+} // namespace
+
+std::atomic<bool> ActivationDump::enabled(!state().entries.empty());
+std::atomic<bool> ActivationDump::run_dumped(false);
+
+void ActivationDump::Select(const std::string& spec) {
+  auto& s = state();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  s.entries = parse(spec);
+  enabled.store(!s.entries.empty(), std::memory_order_relaxed);
+}
+
+void ActivationDump::SetEvery(unsigned every) {
+  auto& s = state();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  s.every = every > 0 ? every : 1;
+}
+
+void ActivationDump::SetDirectory(const std::string& dir) {
+  auto& s = state();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  s.dir = dir;
+}
+
+bool ActivationDump::BeginRun() {
+  if (!IsEnabled()) {
+    run_dumped.store(false, std::memory_order_relaxed);
+    return false;
+  }
+  auto& s = state();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  s.current_run = s.runs++;
+  const bool dumped = s.current_run % s.every == 0;
+  run_dumped.store(dumped, std::memory_order_relaxed);
+  return dumped;
+}
+
+bool ActivationDump::Selected(std::size_t index, const char* name) {
+  auto& s = state();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  for (const auto& e : s.entries) {
+    switch (e.kind) {
+      case Entry::Kind::All: return true;
+      case Entry::Kind::Name:
+        if (e.name == name) return true;
+        break;
+      case Entry::Kind::Prefix:
+        if (std::strncmp(name, e.name.c_str(), e.name.size()) == 0) return true;
+        break;
+      case Entry::Kind::Range:
+        if (e.first <= index && index <= e.last) return true;
+        break;
+    }
+  }
+  return false;
+}
+
+void ActivationDump::Enqueue(const char* name, unsigned output, const char* descr,
+    const std::vector<std::size_t>& shape, const void* data, std::size_t bytes) {
+  auto& s = state();
+  std::unique_lock<std::mutex> lock(s.mutex);
+  if (s.pending_bytes + bytes > max_pending_bytes) {
+    ++s.dropped;
+    return;
+  }
+  File file;
+  file.root = s.dir;
+  file.dir = s.dir + "/" + std::to_string(s.current_run);
+  file.path = file.dir + "/" + name + std::to_string(output) + ".npy";
+  s.pending_bytes += bytes;
+  lock.unlock();
+
+  // node names like "conv:0" are fine on Linux; only '/' would break the path
+  for (auto i = file.dir.size() + 1; i < file.path.size(); ++i) {
+    if (file.path[i] == '/') file.path[i] = '_';
+  }
+  const auto header = npy_header(descr, shape);
+  file.bytes.reserve(header.size() + bytes);
+  file.bytes.assign(header.begin(), header.end());
+  const char* p = static_cast<const char*>(data);
+  file.bytes.insert(file.bytes.end(), p, p + bytes);
+
+  lock.lock();
+  s.pending_bytes += file.bytes.size() - bytes;
+  s.queue.push_back(std::move(file));
+  s.start_writer();
+  s.queued.notify_one();
+}
+
+std::size_t ActivationDump::Flush() {
+  auto& s = state();
+  std::unique_lock<std::mutex> lock(s.mutex);
+  s.drained.wait(lock, [&s] { return s.queue.empty() && !s.writing; });
+  return s.dropped;
+}
@@ -0,0 +1,63 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "device_slots.h"
+
+void DeviceSlots::Add(const Slot& slot) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (count < max_slots) {
+    slots[count++] = slot;
+  }
+}
+
+unsigned DeviceSlots::acquire() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    for (unsigned k = 0; k < count; ++k) {
+      const unsigned index = (next + k) % count;
+      if (!busy[index]) {
+        busy[index] = true;
+        next = (index + 1) % count;
+        return index;
+      }
+    }
+    released.wait(lock);
+  }
+}
+
+void DeviceSlots::release(unsigned index) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    busy[index] = false;
+  }
+  released.notify_one();
+}
+
+DeviceSlots::Lease::Lease(DeviceSlots& slots, binary_convolution_parameters& p)
+  : slots(slots), index(slots.acquire()) {
+  const Slot& slot = slots.slots[index];
+  p.device_input_buf = slot.input;
+  p.device_output_buf = slot.output;
+  p.dma_input_buffer = slot.dma_input;
+  p.dma_output_buffer = slot.dma_output;
+  if (slot.dma_input != nullptr) {
+    p.device_input_phys_addr = slot.dma_input->physical_address();
+    p.device_output_phys_addr = slot.dma_output->physical_address();
+  }
+}
+
+DeviceSlots::Lease::~Lease() {
+  slots.release(index);
+}
@@ -0,0 +1,366 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+#include "drift_monitor.h"
+#include "time_measurement.h"
+
+namespace {
+
+struct Sample {
+  std::string name;
+  convolution_parameters cp;
+  kernel_t kernel;
+  std::vector<std::uint8_t> codes; // HWC, kernel_depth channels
+  unsigned in_bits;
+  unsigned out_bits;
+  const BIN_CONV_OUTPUT* thresholds;
+  // accumulators (ChHWCl) or, with thresholds, packed codes (ChHWBCl)
+  std::vector<T_INT16> output;
+  std::vector<std::uint32_t> packed_output;
+};
+
+struct LayerStats {
+  std::string name;
+  std::size_t samples = 0;
+  double max_abs_error = 0;
+  double cosine_sum = 0;
+  double cosine_min = 1;
+  std::uint64_t mismatches = 0;
+  std::uint64_t elements = 0;
+  std::vector<std::uint64_t> in_codes;
+  std::vector<std::uint64_t> out_codes;
+};
+
+// The binary weight of (o, y, x, i) of kernel_t as +1/-1. Only the kn2row
+// (HWOI) kernel is stored as is; the tiling and FPGA kernels hold the
+// inverted bits.
+#ifdef RUN_ON_FPGA
+int weight(const TensorView<QUANTIZED_PACKED_KERNEL, MemoryLayout::OhIhHWOlIl>& k,
+    std::size_t o, std::size_t y, std::size_t x, std::size_t i) {
+  return (k(o / 32, i / 32, y, x, o % 32, 0).Raw() >> (i % 32)) & 1 ? -1 : 1;
+}
+#elif defined USE_NEON || defined USE_AVX
+int weight(const TensorView<QUANTIZED_PACKED_KERNEL, MemoryLayout::OHWI>& k,
+    std::size_t o, std::size_t y, std::size_t x, std::size_t i) {
+  return (k(o, y, x, i / 32).Raw() >> (i % 32)) & 1 ? -1 : 1;
+}
+#else
+int weight(const TensorView<QUANTIZED_PACKED_KERNEL, MemoryLayout::HWOI>& k,
+    std::size_t o, std::size_t y, std::size_t x, std::size_t i) {
+  return (k(y, x, o, i / 32).Raw() >> (i % 32)) & 1 ? 1 : -1;
+}
+#endif
+
+// Same mapping as ApplyThresholds.
+int threshold(const BIN_CONV_OUTPUT* ts, std::size_t o, float d) {
+  const T_INT ts0 = ts[NUM_OF_A2W1_THRESHOLD * o];
+  const T_INT ts1 = ts[NUM_OF_A2W1_THRESHOLD * o + 1];
+  const T_INT ts2 = ts[NUM_OF_A2W1_THRESHOLD * o + 2];
+  const T_INT flag = ts[NUM_OF_A2W1_THRESHOLD * o + 3];
+  if (flag == 1) {
+    return d < ts0 ? 0 : d < ts1 ? 1 : d < ts2 ? 2 : 3;
+  } else if (flag == -1) {
+    return d > ts2 ? 0 : d > ts1 ? 1 : d > ts0 ? 2 : 3;
+  } else if (flag == 0) {
+    return 0;
+  }
+  return flag - 2;
+}
+
+// conv_general on the unpacked codes
+std::vector<float> reference(const Sample& s) {
+  const auto& p = s.cp;
+  const std::size_t ic = p.kernel_depth;
+  const std::size_t kh = p.kernel_height, kw = p.kernel_width;
+  std::vector<std::int8_t> weights(p.output_channels * kh * kw * ic); // OHWI
+  for (std::size_t o = 0; o < p.output_channels; o++)
+  for (std::size_t y = 0; y < kh; y++)
+  for (std::size_t x = 0; x < kw; x++)
+  for (std::size_t i = 0; i < ic; i++) {
+    weights[((o * kh + y) * kw + x) * ic + i] = weight(s.kernel, o, y, x, i);
+  }
+
+  std::vector<float> out(p.output_channels * p.output_height * p.output_width);
+  for (T_UINT wi = 0; wi < p.output_height; wi++)
+  for (T_UINT wj = 0; wj < p.output_width; wj++)
+  for (T_UINT o = 0; o < p.output_channels; o++) {
+    float acc = 0;
+    for (T_UINT ki = 0; ki < p.kernel_height; ki++) {
+      const T_INT row = (wi * p.stride_along_height) - p.padding_top + ki;
+      if (row < 0 || row >= (T_INT) p.input_height) {
+        continue;
+      }
+      for (T_UINT kj = 0; kj < p.kernel_width; kj++) {
+        const T_INT col = (wj * p.stride_along_width) - p.padding_left + kj;
+        if (col < 0 || col >= (T_INT) p.input_width) {
+          continue;
+        }
+        const std::uint8_t* in = &s.codes[(row * p.input_width + col) * ic];
+        const std::int8_t* k = &weights[((o * kh + ki) * kw + kj) * ic];
+        for (std::size_t i = 0; i < ic; i++) {
+          acc += in[i] * k[i];
+        }
+      }
+    }
+    out[(wi * p.output_width + wj) * p.output_channels + o] = acc;
+  }
+  return out;
+}
+
+void compare(const Sample& s, LayerStats& stats) {
+  const auto& p = s.cp;
+  const std::size_t oc = p.output_channels, oh = p.output_height, ow = p.output_width;
+  const auto ref = reference(s);
+
+  if (stats.in_codes.empty()) {
+    stats.in_codes.resize(1 << s.in_bits);
+    if (s.thresholds != nullptr) {
+      stats.out_codes.resize(1 << s.out_bits);
+    }
+  }
+  for (const auto code : s.codes) {
+    ++stats.in_codes[std::min<std::size_t>(code, stats.in_codes.size() - 1)];
+  }
+
+  double dot = 0, ref_norm = 0, dev_norm = 0;
+  for (std::size_t y = 0; y < oh; ++y) {
+    for (std::size_t x = 0; x < ow; ++x) {
+      for (std::size_t o = 0; o < oc; ++o) {
+        const std::size_t pixel = (o / 32) * oh * ow + y * ow + x;
+        float expected = ref[(y * ow + x) * oc + o];
+        float actual;
+        if (s.thresholds != nullptr) {
+          expected = threshold(s.thresholds, o, expected);
+          int code = 0;
+          for (unsigned bit = 0; bit < s.out_bits; ++bit) {
+            code |= ((s.packed_output[pixel * s.out_bits + bit] >> (o % 32)) & 1) << bit;
+          }
+          ++stats.out_codes[code];
+          actual = code;
+        } else {
+          actual = s.output[pixel * 32 + o % 32];
+        }
+        const double error = std::abs(expected - actual);
+        stats.max_abs_error = std::max(stats.max_abs_error, error);
+        stats.mismatches += error != 0;
+        dot += expected * actual;
+        ref_norm += expected * expected;
+        dev_norm += actual * actual;
+      }
+    }
+  }
+  stats.elements += oc * oh * ow;
+
+  double cosine = 1;
+  if (ref_norm > 0 || dev_norm > 0) {
+    cosine = ref_norm > 0 && dev_norm > 0 ? dot / std::sqrt(ref_norm * dev_norm) : 0;
+  }
+  stats.cosine_sum += cosine;
+  stats.cosine_min = std::min(stats.cosine_min, cosine);
+  ++stats.samples;
+}
+
+std::string histogram(const std::vector<std::uint64_t>& counts) {
+  std::uint64_t total = 0;
+  for (const auto c : counts) {
+    total += c;
+  }
+  std::string out;
+  char buf[16];
+  for (const auto c : counts) {
+    std::snprintf(buf, sizeof(buf), "%s%.1f", out.empty() ? "" : "/", total ? 100.0 * c / total : 0.0);
+    out += buf;
+  }
+  return out;
+}
+
+class State {
+ public:
+  State() {
+    const char* every_env = std::getenv("DLK_DRIFT_EVERY");
+    if (every_env != nullptr && std::atoi(every_env) > 0) {
+      every = std::atoi(every_env);
+    }
+  }
+
+  std::mutex mutex; // guards everything below
+  unsigned every = 0;
+  std::uint64_t runs = 0;
+
+  std::condition_variable queued;
+  std::condition_variable drained;
+  std::deque<Sample> queue;
+  bool checking = false;
+  bool worker_started = false;
+  std::size_t skipped = 0;
+  std::vector<LayerStats> layers; // in order of first check
+
+  void start_worker() {
+    if (!worker_started) {
+      worker_started = true;
+      std::thread([this] { worker(); }).detach();
+    }
+  }
+
+  LayerStats& layer(const std::string& name) {
+    for (auto& l : layers) {
+      if (l.name == name) {
+        return l;
+      }
+    }
+    layers.emplace_back();
+    layers.back().name = name;
+    return layers.back();
+  }
+
+ private:
+  void worker() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      queued.wait(lock, [this] { return !queue.empty(); });
+      Sample sample = std::move(queue.front());
+      queue.pop_front();
+      checking = true;
+      LayerStats stats = layer(sample.name);
+      lock.unlock();
+
+      static const auto region = Measurement::Intern("DriftMonitor");
+      Measurement::Start(region);
+      compare(sample, stats);
+      Measurement::Stop();
+
+      lock.lock();
+      layer(sample.name) = std::move(stats);
+      checking = false;
+      if (queue.empty()) {
+        drained.notify_all();
+      }
+    }
+  }
+};
+
+// Never destroyed: the detached worker may still use it during exit.
+State& state() {
+  static State* s = new State();
+  return *s;
+}
+
+} // namespace
+
+std::atomic<bool> DriftMonitor::enabled(state().every > 0);
+std::atomic<bool> DriftMonitor::run_checked(false);
+
+void DriftMonitor::SetEvery(unsigned every) {
+  auto& s = state();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  s.every = every;
+  enabled.store(every > 0, std::memory_order_relaxed);
+}
+
+bool DriftMonitor::BeginRun() {
+  if (!IsEnabled()) {
+    run_checked.store(false, std::memory_order_relaxed);
+    return false;
+  }
+  auto& s = state();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  const bool checked = s.every > 0 && s.runs++ % s.every == 0;
+  run_checked.store(checked, std::memory_order_relaxed);
+  return checked;
+}
+
+void DriftMonitor::Submit(const kernel_t& kernel, const binary_convolution_parameters& p,
+    std::vector<std::uint8_t>&& codes) {
+  auto& s = state();
+  {
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (s.queue.size() >= max_pending_samples) {
+      ++s.skipped;
+      return;
+    }
+  }
+
+  const auto& cp = p.normal_conv_params;
+  const std::size_t blocks = (cp.output_channels + 31) / 32;
+  const std::size_t pixels = cp.output_height * cp.output_width;
+  Sample sample{p.debug_name != nullptr ? p.debug_name : "", cp, kernel, std::move(codes),
+      p.bin_input_bitwidth, p.n_bit, p.thresholds, {}, {}};
+  if (p.thresholds != nullptr) {
+    const auto* words = reinterpret_cast<const volatile std::uint32_t*>(p.device_output_buf);
+    sample.packed_output.assign(words, words + blocks * pixels * p.n_bit);
+  } else {
+    sample.output.assign(p.device_output_buf, p.device_output_buf + blocks * pixels * 32);
+  }
+
+  std::lock_guard<std::mutex> lock(s.mutex);
+  s.queue.push_back(std::move(sample));
+  s.start_worker();
+  s.queued.notify_one();
+}
+
+void DriftMonitor::Flush() {
+  auto& s = state();
+  std::unique_lock<std::mutex> lock(s.mutex);
+  s.drained.wait(lock, [&s] { return s.queue.empty() && !s.checking; });
+}
+
+void DriftMonitor::Report() {
+  Flush();
+  auto& s = state();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  if (s.layers.empty()) {
+    return;
+  }
+  std::printf("DriftMonitor (%zu samples skipped)\n", s.skipped);
+  std::printf("%-32s %8s %12s %10s %10s %10s  %s\n", "layer", "samples", "max |err|",
+      "mean cos", "min cos", "mismatch%", "input codes % [/ output codes %]");
+  for (const auto& l : s.layers) {
+    std::string codes = histogram(l.in_codes);
+    if (!l.out_codes.empty()) {
+      codes += " / " + histogram(l.out_codes);
+    }
+    std::printf("%-32s %8zu %12.1f %10.6f %10.6f %10.3f  %s\n", l.name.c_str(), l.samples,
+        l.max_abs_error, l.cosine_sum / l.samples, l.cosine_min,
+        l.elements ? 100.0 * l.mismatches / l.elements : 0.0, codes.c_str());
+  }
+}
+
+bool DriftMonitor::WriteSummary(const std::string& path) {
+  Flush();
+  std::ofstream out(path);
+  if (!out) {
+    return false;
+  }
+  auto& s = state();
+  std::lock_guard<std::mutex> lock(s.mutex);
+  out << "layer,samples,max_abs_error,mean_cosine,min_cosine,mismatch_rate,input_codes,output_codes\n";
+  for (const auto& l : s.layers) {
+    out << l.name << ',' << l.samples << ',' << l.max_abs_error << ','
+        << l.cosine_sum / l.samples << ',' << l.cosine_min << ','
+        << (l.elements ? static_cast<double>(l.mismatches) / l.elements : 0.0) << ','
+        << histogram(l.in_codes) << ',' << histogram(l.out_codes) << '\n';
+  }
+  return static_cast<bool>(out);
+}
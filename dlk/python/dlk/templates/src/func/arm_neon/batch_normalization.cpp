@@ -18,6 +18,7 @@ limitations under the License.
 
 #include "global.h"
 #include "func/batch_normalization.h"
+#include "thread_pool.h"
 #include "time_measurement.h"
 
 #include <arm_neon.h>
@@ -32,7 +33,8 @@ void func_BatchNormalization(const TensorView<T_FLOAT, MemoryLayout::NHWC>& inpu
     const TensorView<T_FLOAT, MemoryLayout::C>& variance,
     T_FLOAT epsilon,
     const TensorView<T_FLOAT, MemoryLayout::NHWC>& output) {
-  Measurement::Start("BatchNorm");
+  static const auto region = Measurement::Intern("BatchNorm");
+  Measurement::Start(region);
 
   const auto out_shape = output.get_shape();
   T_UINT out_height = out_shape[1];
@@ -67,9 +69,7 @@ void func_BatchNormalization(const TensorView<T_FLOAT, MemoryLayout::NHWC>& inpu
     shift[i] = beta(i) - (scale[i] * mean(i));
   }
 
-// TODO(nlpng): remove use of OpenMP library
-#pragma omp parallel for
-  for (T_UINT f = 0; f < size; f++) {
+  dlk::parallel_for<T_UINT>(0, size, [&](T_UINT f) {
     T_FLOAT *in_temp = input.data() + f * out_depth;
     T_FLOAT *out_temp = output.data() + f * out_depth;
 
@@ -86,7 +86,7 @@ void func_BatchNormalization(const TensorView<T_FLOAT, MemoryLayout::NHWC>& inpu
     for (; d < out_depth; d++) {
       *out_temp++ = *in_temp++ * scale[d] + shift[d];
     }
-  }
+  });
 
   Measurement::Stop();
 }
@@ -23,7 +23,8 @@ limitations under the License.
 void func_AveragePool(const TensorView<T_FLOAT, MemoryLayout::NHWC>& input,
     const TensorView<T_FLOAT, MemoryLayout::NHWC>& output,
     struct avg_pooling_parameters app) {
-  Measurement::Start("AveragePool");
+  static const auto region = Measurement::Intern("AveragePool");
+  Measurement::Start(region);
 
   assert (app.kernel_depth == 1 && "kernel depth 1 is not supported.");
   assert (app.input_depth == app.kernel_depth * app.output_channels && \
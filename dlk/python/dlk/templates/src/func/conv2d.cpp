@@ -13,6 +13,7 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 
@@ -20,6 +21,7 @@ limitations under the License.
 
 #include "global.h"
 #include "func/conv2d.h"
+#include "func/impl/conv2d_winograd.h"
 #include "matrix_view.h"
 #include "matrix/shift_add.h"
 #include "matrix/multiplication.h"
@@ -49,8 +51,10 @@ void conv3x3_kn2row(const TensorView<T, MemoryLayout::NHWC>& input,
   // need to initialize output
   std::memset(output.data(), 0, oc * ih * iw * sizeof(U));
 
-  Measurement::Start("kn2row");
-  Measurement::Start("kn2row-buf");
+  static const auto region = Measurement::Intern("kn2row");
+  static const auto buf_region = Measurement::Intern("kn2row-buf");
+  Measurement::Start(region);
+  Measurement::Start(buf_region);
 
   assert(p.input_height > 0);
   assert(p.input_width > 0);
@@ -105,7 +109,8 @@ void conv1x1_kn2row(const TensorView<T, MemoryLayout::NHWC>& input,
   int kh = p.kernel_height;
   int kw = p.kernel_width;
 
-  Measurement::Start("kn2row-1x1");
+  static const auto region = Measurement::Intern("kn2row-1x1");
+  Measurement::Start(region);
 
 
    assert(p.input_height > 0);
@@ -127,6 +132,9 @@ void conv_general(
   const TensorView<T, MemoryLayout::NHWC>& output,
   struct convolution_parameters p)
 {
+  // channels beyond the input depth read as zero
+  const T_UINT in_depth = std::min<T_UINT>(input.get_shape()[3], p.kernel_depth);
+
   for(T_UINT wi = 0; wi < p.output_height; wi++)
   for(T_UINT wj = 0; wj < p.output_width; wj++)
   {
@@ -141,17 +149,17 @@ void conv_general(
 
       for(T_UINT ki = 0; ki < p.kernel_height; ki++)
       {
-        T_INT row = (wi * p.stride_along_height) - p.padding + ki;
+        T_INT row = (wi * p.stride_along_height) - p.padding_top + ki;
         inside_row = (row >= 0 && row < (T_INT) p.input_height);
 
         for(T_UINT kj = 0; kj < p.kernel_width; kj++)
         {
-          T_INT col = (wj * p.stride_along_width)  - p.padding + kj;
+          T_INT col = (wj * p.stride_along_width)  - p.padding_left + kj;
           inside_col = (col >= 0 && col < (T_INT) p.input_width);
 
           for(T_UINT kz = 0; kz < p.kernel_depth; kz++)
           {
-            if (inside_row && inside_col) {
+            if (inside_row && inside_col && kz < in_depth) {
               unsigned k_idx = current_kernel_index + kernel_offset;
 
               T in_data = input(0, row, col, kz);
@@ -176,12 +184,25 @@ void convolution(
   const TensorView<T, MemoryLayout::NHWC>& output,
   struct convolution_parameters p)
 {
+  // kn2row needs the same padding on every side and a dense input
+  const bool uniform = input.get_shape()[3] == p.kernel_depth
+    && p.padding_top == p.padding && p.padding_bottom == p.padding
+    && p.padding_left == p.padding && p.padding_right == p.padding;
+
+  // weights pre-transformed by the code generator select the Winograd path
+  if (p.winograd_weights != nullptr && input.get_shape()[3] == p.kernel_depth
+      && p.kernel_height == 3 && p.kernel_width == 3
+      && p.stride_along_height == 1 && p.stride_along_width == 1) {
+    dlk::impl::conv3x3_winograd(input, output, p);
+    return;
+  }
+
   // use special implementation for 1x1 conv
-  if (p.kernel_height == 1 && p.kernel_width == 1 && p.padding == 0) {
+  if (uniform && p.kernel_height == 1 && p.kernel_width == 1 && p.padding == 0) {
     int kernels_size = p.kernel_height * p.kernel_width * p.kernel_depth * p.output_channels;
     conv1x1_kn2row(input, kernels, output, p);
     return;
-  } else if (p.kernel_height == 3 && p.kernel_width == 3 && p.padding == 1) {
+  } else if (uniform && p.kernel_height == 3 && p.kernel_width == 3 && p.padding == 1) {
     int kernels_size = p.kernel_height * p.kernel_width * p.kernel_depth * p.output_channels;
     const auto kernels_hwoi_buf = std::make_unique<T[]>(kernels_size);
     using hwoi_t = TensorView<T, MemoryLayout::HWOI>;
@@ -207,7 +228,8 @@ void func_Conv2D(const TensorView<T_FLOAT, MemoryLayout::NHWC>& input,
     const TensorView<T_FLOAT, MemoryLayout::OHWI>& weights,
     const TensorView<T_FLOAT, MemoryLayout::NHWC>& output,
     struct convolution_parameters p) {
-  Measurement::Start("Convolution");
+  static const auto region = Measurement::Intern("Convolution");
+  Measurement::Start(region);
 
   unsigned out_height = output.get_shape()[1];
   unsigned out_width = output.get_shape()[2];
@@ -30,7 +30,8 @@ void func_BatchNormalization(const TensorView<T_FLOAT, MemoryLayout::NHWC>& inpu
     const TensorView<T_FLOAT, MemoryLayout::C>& variance,
     T_FLOAT epsilon,
     const TensorView<T_FLOAT, MemoryLayout::NHWC>& output) {
-  Measurement::Start("BatchNorm");
+  static const auto region = Measurement::Intern("BatchNorm");
+  Measurement::Start(region);
 
   const unsigned out_height = output.get_shape()[1];
   const unsigned out_width = output.get_shape()[2];
@@ -18,23 +18,19 @@ limitations under the License.
 
 #include "global.h"
 #include "func/impl/quantized_conv2d_tiling.h"
+#include "thread_pool.h"
 #include "time_measurement.h"
 
 #include <arm_neon.h>
 
-#ifdef _OPENMP
-#include <omp.h>
-#endif
-
 namespace dlk {
 
 namespace impl {
 
-static auto buf_th = std::make_unique<BIN_CONV_OUTPUT[]>(NUM_OF_A2W1_THRESHOLD * MAX_IN_C);
-
 void pack_input_for_tiling(const TensorView<QUANTIZED_NOT_PACKED, MemoryLayout::NHWC>& input,
     const tiling_input_t& output) {
-  Measurement::Start("Pack_input_for_tiling");
+  static const auto region = Measurement::Intern("Pack_input_for_tiling");
+  Measurement::Start(region);
   const T_UINT in_channels = input.get_shape()[3];
   const T_UINT in_height = input.get_shape()[1];
   const T_UINT in_width = input.get_shape()[2];
@@ -42,8 +38,7 @@ void pack_input_for_tiling(const TensorView<QUANTIZED_NOT_PACKED, MemoryLayout::
   
   constexpr T_UINT InTypeBitWidth = CHAR_BIT * sizeof(uint32_t);
   const T_UINT in_stride = (in_channels + InTypeBitWidth - 1) / InTypeBitWidth;
-#pragma omp parallel for schedule(dynamic)
-  for (unsigned int in_ch_high = 0; in_ch_high < in_stride; ++in_ch_high) {
+  dlk::parallel_for<unsigned int>(0, in_stride, [&](unsigned int in_ch_high) {
     for (unsigned int row = 0; row < in_height; ++row) {
       for (unsigned int col = 0; col < in_width; ++col) {
         for (unsigned int in_bit_ch = 0; in_bit_ch < in_bitwidth; ++in_bit_ch) {
@@ -51,9 +46,8 @@ void pack_input_for_tiling(const TensorView<QUANTIZED_NOT_PACKED, MemoryLayout::
         }
       }
     }
-  }
-#pragma omp parallel for schedule(dynamic)
-  for (unsigned int row = 0; row < in_height; ++row) {
+  });
+  dlk::parallel_for<unsigned int>(0, in_height, [&](unsigned int row) {
     for (unsigned int col = 0; col < in_width; ++col) {
       for (unsigned int in_ch_high = 0; in_ch_high < in_channels; in_ch_high += InTypeBitWidth) {
         for (unsigned int in_ch_low = 0; in_ch_low < InTypeBitWidth; ++in_ch_low) {
@@ -67,14 +61,15 @@ void pack_input_for_tiling(const TensorView<QUANTIZED_NOT_PACKED, MemoryLayout::
         }
       }
     }
-  }
+  });
 
   Measurement::Stop();
 }
 
 void QuantizedConv2DTiling(const tiling_input_t& input,
                                   const kernel_t& kernel,
-                                  const binary_convolution_parameters &p) {
+                                  const binary_convolution_parameters &p,
+                                  const tiling_rows_t& rows) {
   constexpr T_UINT InTypeBitWidth = tiling_input_elem_t::BitCount;
   convolution_parameters cp = p.normal_conv_params;
   const T_UINT out_channels = cp.output_channels;
@@ -89,12 +84,17 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
   const T_UINT out_height = cp.output_height;
   const T_UINT out_width = cp.output_width;
   const T_UINT out_size = out_height * out_width * out_channels;
+  const T_UINT in_rows = input.get_shape()[1];
+  const T_UINT out_rows = rows.out_rows;
+  const T_UINT row_begin = rows.row_begin;
+  const T_UINT row_end = rows.row_end;
 
   assert(kh * kw < 32);
   assert(in_height * in_width == out_height * out_width);
   assert((in_channels % InTypeBitWidth) == 0);
 
-  Measurement::Start("Quantized Conv2D Tiling");
+  // per call, as several bands of different layers may run at once
+  BIN_CONV_OUTPUT buf_th[NUM_OF_A2W1_THRESHOLD * MAX_IN_C];
   if (p.thresholds != nullptr) {
     for (T_UINT i = 0; i < out_channels; i += 8) {
       const auto v = vld4q_s16(p.thresholds + NUM_OF_A2W1_THRESHOLD * i);
@@ -104,7 +104,7 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
       res.val[1] = vsubq_s16(v.val[1], is_neg);
       res.val[2] = vsubq_s16(v.val[2], is_neg);
       res.val[3] = v.val[3];
-      vst4q_s16(buf_th.get() + NUM_OF_A2W1_THRESHOLD * i, res);
+      vst4q_s16(buf_th + NUM_OF_A2W1_THRESHOLD * i, res);
     }
   }
   constexpr uint8_t coeff_ary[16] = {
@@ -116,7 +116,7 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
 #ifdef AARCH32
   const T_UINT TileHeightMax = 20; // configurable
   const T_UINT TileWidthMax = 20; // configurable
-  const T_UINT TileHeight = std::min(in_height, TileHeightMax);
+  const T_UINT TileHeight = std::min(row_end - row_begin, TileHeightMax);
   const T_UINT TileWidth = std::min(in_width, TileWidthMax);
   constexpr T_UINT InChUnroll = InTypeBitWidth; // hardcoded, not configurable
   constexpr T_UINT OutChUnroll = 16; // hardcoded, not configurable
@@ -125,15 +125,14 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
   constexpr T_UINT khMax = 5; // hardcoded, not configurable
   constexpr T_UINT kwMax = 5; // hardcoded, not configurable
 
-  const T_UINT row_tile_count = (in_height + TileHeight - 1) / TileHeight;
+  const T_UINT row_tile_count = (row_end - row_begin + TileHeight - 1) / TileHeight;
   const T_UINT col_tile_count = (in_width + TileWidth - 1) / TileWidth;
   const T_UINT out_tile_count = (out_channels + OutChUnroll2 - 1) / OutChUnroll2;
   const T_UINT total_tile_count = row_tile_count * col_tile_count * out_tile_count;
-#pragma omp parallel for
-  for (T_UINT tile_index = 0; tile_index < total_tile_count; ++tile_index) {
+  dlk::parallel_for<T_UINT>(0, total_tile_count, [&](T_UINT tile_index) {
     T_UINT out_ch_high = tile_index % out_tile_count;
     T_UINT col_high = (tile_index / out_tile_count) % col_tile_count * TileWidth;
-    T_UINT row_high = tile_index / (out_tile_count * col_tile_count) * TileHeight;
+    T_UINT row_high = row_begin + tile_index / (out_tile_count * col_tile_count) * TileHeight;
     uint32_t out_ts[TileWidthMax*TileWidthMax*OutChUnroll2/OutChUnroll];
     for (unsigned int Om = 0; Om < OutChUnroll2; Om += OutChUnroll) {
       BIN_CONV_OUTPUT out_tile[TileHeightMax*TileWidthMax*OutChUnroll];
@@ -169,7 +168,7 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
         }
         tiling_input_elem_t in_tile[(TileHeightMax + khMax - 1)*(TileWidthMax + kwMax - 1)*InBitChUnroll];
         for (unsigned int row = 0; row < TileHeight + kh - 1; ++row) {
-          if (row_high + row >= in_height + 2*padding) break;
+          if (row_high + row >= in_height + 2*padding || row_high + row >= row_end + kh - 1) break;
           for (unsigned int col = 0; col < TileWidth + kw - 1; ++col) {
             if (col_high + col >= in_width + 2*padding) break;
             const auto in_tile_index = row * (TileWidth + kw - 1) * InBitChUnroll
@@ -178,8 +177,8 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
                 || col_high + col < padding || col_high + col >= in_width + padding) {
               vst1_u32(reinterpret_cast<uint32_t*>(in_tile + in_tile_index), vdup_n_u32(0));
             } else {
-              const auto index = (in_ch_high / InTypeBitWidth) * in_height * in_width * in_bitwidth
-                + (row_high + row - padding) * in_width * in_bitwidth
+              const auto index = (in_ch_high / InTypeBitWidth) * in_rows * in_width * in_bitwidth
+                + (row_high + row - padding - rows.in_row_offset) * in_width * in_bitwidth
                 + (col_high + col - padding) * in_bitwidth;
               const auto v = vld1_u32(reinterpret_cast<uint32_t*>(input.data() + index));
               vst1_u32(reinterpret_cast<uint32_t*>(in_tile + in_tile_index), v);
@@ -264,14 +263,14 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
       }
       if (p.thresholds != nullptr) {
 #define LOAD_TH(k) \
-  const auto ts##k = vld4q_s16(buf_th.get() + NUM_OF_A2W1_THRESHOLD * (out_ch_high * OutChUnroll2 + Om + 8 * k)); \
+  const auto ts##k = vld4q_s16(buf_th + NUM_OF_A2W1_THRESHOLD * (out_ch_high * OutChUnroll2 + Om + 8 * k)); \
   const auto is_neg##k = vreinterpretq_s16_u16(vcltq_s16(ts##k.val[3], vdupq_n_s16(0))); \
   const auto m2_##k = vsubq_s16(ts##k.val[3], vdupq_n_s16(2)); \
   const auto is_const##k = vcgeq_s16(m2_##k, vdupq_n_s16(0));
         LOAD_TH(0)
         LOAD_TH(1)
         for (unsigned int row = 0; row < TileHeight; ++row) {
-          if (row_high + row >= out_height) break;
+          if (row_high + row >= row_end) break;
           for (unsigned int col = 0; col < TileWidth; ++col) {
             if (col_high + col >= out_width) break;
 #define APPLY(k) \
@@ -300,15 +299,15 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
 #undef APPLY
       } else {
         for (unsigned int row = 0; row < TileHeight; ++row) {
-          if (row_high + row >= out_height) break;
+          if (row_high + row >= row_end) break;
           for (unsigned int col = 0; col < TileWidth; ++col) {
             if (col_high + col >= out_width) break;
             const auto buf_index = row * TileWidth * OutChUnroll
                 + col * OutChUnroll;
             const auto v0 = vld1q_s16(out_tile + buf_index +  0);
             const auto v1 = vld1q_s16(out_tile + buf_index +  8);
-            const auto index = out_ch_high * out_height * out_width * OutChUnroll2
-                + (row_high + row) * out_width * OutChUnroll2
+            const auto index = out_ch_high * out_rows * out_width * OutChUnroll2
+                + (row_high + row - rows.out_row_offset) * out_width * OutChUnroll2
                 + (col_high + col) * OutChUnroll2
                 + Om;
             vst1q_s16(p.device_output_buf + index +  0, v0);
@@ -323,25 +322,25 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
       };
       const auto table = vld1_u8(table_ary);
       for (unsigned int row = 0; row < TileHeight; ++row) {
-        if (row_high + row >= out_height) break;
+        if (row_high + row >= row_end) break;
         for (unsigned int col = 0; col < TileWidth; ++col) {
           if (col_high + col >= out_width) break;
           const auto buf_index = row * TileWidth * 2
               + col * 2;
           const auto v = vreinterpret_u8_u32(vld1_u32(out_ts + buf_index));
           const auto trnv = vreinterpret_u32_u8(vtbl1_u8(v, table));
-          const auto index = out_ch_high * out_height * out_width * in_bitwidth
-              + (row_high + row) * out_width * in_bitwidth
+          const auto index = out_ch_high * out_rows * out_width * in_bitwidth
+              + (row_high + row - rows.out_row_offset) * out_width * in_bitwidth
               + (col_high + col) * in_bitwidth;
           vst1_u32(reinterpret_cast<uint32_t*>(p.device_output_buf) + index, trnv);
         }
       }
     }
-  }
+  });
 #else
   const std::size_t TileHeightMax = 20; // configurable
   const std::size_t TileWidthMax = 20; // configurable
-  const std::size_t TileHeight = std::min((std::size_t)in_height, TileHeightMax);
+  const std::size_t TileHeight = std::min((std::size_t)(row_end - row_begin), TileHeightMax);
   const std::size_t TileWidth = std::min((std::size_t)in_width + (in_width & 1), TileWidthMax);
   constexpr std::size_t InChUnroll = InTypeBitWidth; // hardcoded, not configurable
   constexpr std::size_t OutChUnroll = 16; // hardcoded, not configurable
@@ -353,15 +352,14 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
 
   const std::size_t kh_s = cp.kernel_height;
   const std::size_t kw_s = cp.kernel_width;
-  const std::size_t row_tile_count = (in_height + TileHeight - 1) / TileHeight;
+  const std::size_t row_tile_count = (row_end - row_begin + TileHeight - 1) / TileHeight;
   const std::size_t col_tile_count = (in_width + TileWidth - 1) / TileWidth;
   const std::size_t out_tile_count = (out_channels + OutChUnroll2 - 1) / OutChUnroll2;
   const std::size_t total_tile_count = row_tile_count * col_tile_count * out_tile_count;
-#pragma omp parallel for
-  for (std::size_t tile_index = 0; tile_index < total_tile_count; ++tile_index) {
+  dlk::parallel_for<std::size_t>(0, total_tile_count, [&](std::size_t tile_index) {
     std::size_t out_ch_high = tile_index % out_tile_count;
     std::size_t col_high = (tile_index / out_tile_count) % col_tile_count * TileWidth;
-    std::size_t row_high = tile_index / (out_tile_count * col_tile_count) * TileHeight;
+    std::size_t row_high = row_begin + tile_index / (out_tile_count * col_tile_count) * TileHeight;
     uint32_t out_ts[TileHeightMax*TileWidthMax*OutChUnroll2/OutChUnroll];
     for (std::size_t Om = 0; Om < OutChUnroll2; Om += OutChUnroll) {
       BIN_CONV_OUTPUT out_tile[TileHeightMax*TileWidthMax*OutChUnroll];
@@ -397,7 +395,7 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
         }
         tiling_input_elem_t in_tile[(TileHeightMax + khMax - 1)*(TileWidthMax + kwMax - 1)*InBitChUnroll];
         for (std::size_t row = 0; row < TileHeight + kh_s - 1; ++row) {
-          if (row_high + row >= in_height + 2*padding) break;
+          if (row_high + row >= in_height + 2*padding || row_high + row >= row_end + kh - 1) break;
           for (std::size_t col = 0; col < TileWidth + kw_s - 1; ++col) {
             if (col_high + col >= in_width + 2*padding) break;
             const auto in_tile_index = row * (TileWidth + kw_s - 1) * InBitChUnroll
@@ -406,8 +404,8 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
                 || col_high + col < padding || col_high + col >= in_width + padding) {
               vst1_u32(reinterpret_cast<uint32_t*>(in_tile + in_tile_index), vdup_n_u32(0));
             } else {
-              const auto index = (in_ch_high / InTypeBitWidth) * in_height * in_width * in_bitwidth
-                + (row_high + row - padding) * in_width * in_bitwidth
+              const auto index = (in_ch_high / InTypeBitWidth) * in_rows * in_width * in_bitwidth
+                + (row_high + row - padding - rows.in_row_offset) * in_width * in_bitwidth
                 + (col_high + col - padding) * in_bitwidth;
               const auto v = vld1_u32(reinterpret_cast<uint32_t*>(input.data() + index));
               vst1_u32(reinterpret_cast<uint32_t*>(in_tile + in_tile_index), v);
@@ -529,14 +527,14 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
       }
       if (p.thresholds != nullptr) {
 #define LOAD_TH(k) \
-  const auto ts##k = vld4q_s16(buf_th.get() + NUM_OF_A2W1_THRESHOLD * (out_ch_high * OutChUnroll2 + Om + 8 * k)); \
+  const auto ts##k = vld4q_s16(buf_th + NUM_OF_A2W1_THRESHOLD * (out_ch_high * OutChUnroll2 + Om + 8 * k)); \
   const auto is_neg##k = vreinterpretq_s16_u16(vcltq_s16(ts##k.val[3], vdupq_n_s16(0))); \
   const auto m2_##k = vsubq_s16(ts##k.val[3], vdupq_n_s16(2)); \
   const auto is_const##k = vcgeq_s16(m2_##k, vdupq_n_s16(0));
         LOAD_TH(0)
         LOAD_TH(1)
         for (std::size_t row = 0; row < TileHeight; ++row) {
-          if (row_high + row >= out_height) break;
+          if (row_high + row >= row_end) break;
           for (std::size_t col = 0; col < TileWidth; ++col) {
             if (col_high + col >= out_width) break;
 #define APPLY(k) \
@@ -564,15 +562,15 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
 #undef APPLY
       } else {
         for (std::size_t row = 0; row < TileHeight; ++row) {
-          if (row_high + row >= out_height) break;
+          if (row_high + row >= row_end) break;
           for (std::size_t col = 0; col < TileWidth; ++col) {
             if (col_high + col >= out_width) break;
             const auto buf_index = row * TileWidth * OutChUnroll
                 + col * OutChUnroll;
             const auto v0 = vld1q_s16(out_tile + buf_index +  0);
             const auto v1 = vld1q_s16(out_tile + buf_index +  8);
-            const auto index = out_ch_high * out_height * out_width * OutChUnroll2
-                + (row_high + row) * out_width * OutChUnroll2
+            const auto index = out_ch_high * out_rows * out_width * OutChUnroll2
+                + (row_high + row - rows.out_row_offset) * out_width * OutChUnroll2
                 + (col_high + col) * OutChUnroll2
                 + Om;
             vst1q_s16(p.device_output_buf + index +  0, v0);
@@ -587,22 +585,31 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
       };
       const auto table = vld1_u8(table_ary);
       for (std::size_t row = 0; row < TileHeight; ++row) {
-        if (row_high + row >= out_height) break;
+        if (row_high + row >= row_end) break;
         for (std::size_t col = 0; col < TileWidth; ++col) {
           if (col_high + col >= out_width) break;
           const auto buf_index = row * TileWidth * 2
               + col * 2;
           const auto v = vreinterpret_u8_u32(vld1_u32(out_ts + buf_index));
           const auto trnv = vreinterpret_u32_u8(vtbl1_u8(v, table));
-          const auto index = out_ch_high * out_height * out_width * in_bitwidth
-              + (row_high + row) * out_width * in_bitwidth
+          const auto index = out_ch_high * out_rows * out_width * in_bitwidth
+              + (row_high + row - rows.out_row_offset) * out_width * in_bitwidth
               + (col_high + col) * in_bitwidth;
           vst1_u32(reinterpret_cast<uint32_t*>(p.device_output_buf) + index, trnv);
         }
       }
     }
-  }
+  });
 #endif
+}
+
+void QuantizedConv2DTiling(const tiling_input_t& input,
+                                  const kernel_t& kernel,
+                                  const binary_convolution_parameters &p) {
+  const std::size_t out_height = p.normal_conv_params.output_height;
+  static const auto region = Measurement::Intern("Quantized Conv2D Tiling");
+  Measurement::Start(region);
+  QuantizedConv2DTiling(input, kernel, p, {0, out_height, 0, 0, out_height});
   Measurement::Stop();
 }
 
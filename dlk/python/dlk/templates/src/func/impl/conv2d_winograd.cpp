@@ -0,0 +1,271 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include "func/impl/conv2d_winograd.h"
+#include "thread_pool.h"
+#include "time_measurement.h"
+
+#if defined USE_AVX
+#include <x86intrin.h>
+#elif defined USE_NEON
+#include <arm_neon.h>
+#endif
+
+namespace dlk {
+
+namespace impl {
+
+namespace {
+
+#if defined USE_AVX
+using vfloat = __m256;
+constexpr std::size_t VecWidth = 8;
+inline vfloat vload(const float* p) { return _mm256_loadu_ps(p); }
+inline void vstore(float* p, const vfloat v) { _mm256_storeu_ps(p, v); }
+inline vfloat vzero() { return _mm256_setzero_ps(); }
+inline vfloat vmla(const vfloat acc, const vfloat a, const float b) {
+  return _mm256_fmadd_ps(a, _mm256_set1_ps(b), acc);
+}
+#elif defined USE_NEON
+using vfloat = float32x4_t;
+constexpr std::size_t VecWidth = 4;
+inline vfloat vload(const float* p) { return vld1q_f32(p); }
+inline void vstore(float* p, const vfloat v) { vst1q_f32(p, v); }
+inline vfloat vzero() { return vdupq_n_f32(0.0f); }
+inline vfloat vmla(const vfloat acc, const vfloat a, const float b) {
+  return vmlaq_n_f32(acc, a, b);
+}
+#else
+using vfloat = float;
+constexpr std::size_t VecWidth = 1;
+inline vfloat vload(const float* p) { return *p; }
+inline void vstore(float* p, const vfloat v) { *p = v; }
+inline vfloat vzero() { return 0.0f; }
+inline vfloat vmla(const vfloat acc, const vfloat a, const float b) { return acc + a * b; }
+#endif
+
+static_assert(winograd_oc_align % VecWidth == 0, "vector width must divide the output channel padding");
+
+// tiles transformed together; keeps the per-thread buffers within L2
+constexpr std::size_t TileBlock = 8;
+
+// Transform matrices from Lavin & Gray, "Fast Algorithms for Convolutional Neural Networks".
+constexpr float BT2[4][4] = {
+  { 1,  0, -1,  0},
+  { 0,  1,  1,  0},
+  { 0, -1,  1,  0},
+  { 0,  1,  0, -1},
+};
+constexpr float AT2[2][4] = {
+  { 1,  1,  1,  0},
+  { 0,  1, -1, -1},
+};
+constexpr float BT4[6][6] = {
+  { 4,  0, -5,  0,  1,  0},
+  { 0, -4, -4,  1,  1,  0},
+  { 0,  4, -4, -1,  1,  0},
+  { 0, -2, -1,  2,  1,  0},
+  { 0,  2, -1, -2,  1,  0},
+  { 0,  4,  0, -5,  0,  1},
+};
+constexpr float AT4[4][6] = {
+  { 1,  1,  1,  1,  1,  0},
+  { 0,  1, -1,  2, -2,  0},
+  { 0,  1,  1,  4,  4,  0},
+  { 0,  1, -1,  8, -8,  1},
+};
+
+// out = C in C^T, computed as two separable passes. Zero coefficients are
+// skipped; with C a constant the branches fold away after unrolling.
+template <std::size_t Rows, std::size_t Cols>
+inline void transform(const float (&c)[Rows][Cols],
+    const vfloat (&in)[Cols][Cols],
+    vfloat (&out)[Rows][Rows]) {
+  vfloat tmp[Rows][Cols];
+  for (std::size_t i = 0; i < Rows; ++i) {
+    for (std::size_t l = 0; l < Cols; ++l) {
+      auto acc = vzero();
+      for (std::size_t k = 0; k < Cols; ++k) {
+        if (c[i][k] != 0) acc = vmla(acc, in[k][l], c[i][k]);
+      }
+      tmp[i][l] = acc;
+    }
+  }
+  for (std::size_t i = 0; i < Rows; ++i) {
+    for (std::size_t j = 0; j < Rows; ++j) {
+      auto acc = vzero();
+      for (std::size_t l = 0; l < Cols; ++l) {
+        if (c[j][l] != 0) acc = vmla(acc, tmp[i][l], c[j][l]);
+      }
+      out[i][j] = acc;
+    }
+  }
+}
+
+// Loads n <= VecWidth floats, zero-filling the rest.
+inline vfloat load_partial(const float* p, const std::size_t n) {
+  if (n == VecWidth) {
+    return vload(p);
+  }
+  float tmp[VecWidth] = {};
+  std::copy(p, p + n, tmp);
+  return vload(tmp);
+}
+
+inline void store_partial(float* p, const vfloat v, const std::size_t n) {
+  if (n == VecWidth) {
+    vstore(p, v);
+    return;
+  }
+  float tmp[VecWidth];
+  vstore(tmp, v);
+  std::copy(tmp, tmp + n, p);
+}
+
+template <std::size_t M>
+void winograd(const TensorView<T_FLOAT, MemoryLayout::NHWC>& input,
+    const TensorView<T_FLOAT, MemoryLayout::NHWC>& output,
+    const convolution_parameters& p,
+    const float (&bt)[M + 2][M + 2],
+    const float (&at)[M][M + 2]) {
+  constexpr std::size_t Alpha = M + 2;
+  const std::size_t ih = p.input_height;
+  const std::size_t iw = p.input_width;
+  const std::size_t ic = p.kernel_depth;
+  const std::size_t ic_pad = (ic + VecWidth - 1) / VecWidth * VecWidth;
+  const std::size_t oh = p.output_height;
+  const std::size_t ow = p.output_width;
+  const std::size_t oc = p.output_channels;
+  const std::size_t oc_pad = (oc + winograd_oc_align - 1) / winograd_oc_align * winograd_oc_align;
+  const std::size_t tiles_h = (oh + M - 1) / M;
+  const std::size_t tiles_w = (ow + M - 1) / M;
+  const std::size_t num_tiles = tiles_h * tiles_w;
+  const std::ptrdiff_t pad_top = p.padding_top;
+  const std::ptrdiff_t pad_left = p.padding_left;
+  const float* const u = p.winograd_weights;
+
+  // per thread v: [Alpha * Alpha][TileBlock][ic_pad], m: [Alpha * Alpha][TileBlock][oc_pad]
+  // Both are written before they are read, so they are only grown, never cleared.
+  const std::size_t v_size = Alpha * Alpha * TileBlock * ic_pad;
+  const std::size_t m_size = Alpha * Alpha * TileBlock * oc_pad;
+
+  parallel_for<std::size_t>(0, num_tiles, TileBlock, [&](std::size_t t0) {
+    thread_local std::vector<float> v_scratch, m_scratch;
+    if (v_scratch.size() < v_size) {
+      v_scratch.resize(v_size);
+    }
+    if (m_scratch.size() < m_size) {
+      m_scratch.resize(m_size);
+    }
+    float* const v = v_scratch.data();
+    float* const m = m_scratch.data();
+    const std::size_t nb = std::min(TileBlock, num_tiles - t0);
+
+    // input transform: V = B^T d B
+    for (std::size_t t = 0; t < nb; ++t) {
+      const std::ptrdiff_t row0 = ((t0 + t) / tiles_w) * M - pad_top;
+      const std::ptrdiff_t col0 = ((t0 + t) % tiles_w) * M - pad_left;
+      for (std::size_t c = 0; c < ic_pad; c += VecWidth) {
+        const std::size_t n = std::min(VecWidth, ic - std::min(ic, c));
+        vfloat d[Alpha][Alpha];
+        for (std::size_t k = 0; k < Alpha; ++k) {
+          for (std::size_t l = 0; l < Alpha; ++l) {
+            const auto row = row0 + static_cast<std::ptrdiff_t>(k);
+            const auto col = col0 + static_cast<std::ptrdiff_t>(l);
+            const bool inside = row >= 0 && row < static_cast<std::ptrdiff_t>(ih)
+              && col >= 0 && col < static_cast<std::ptrdiff_t>(iw) && n > 0;
+            d[k][l] = inside ? load_partial(input.data() + (row * iw + col) * ic + c, n) : vzero();
+          }
+        }
+        vfloat transformed[Alpha][Alpha];
+        transform(bt, d, transformed);
+        for (std::size_t k = 0; k < Alpha; ++k) {
+          for (std::size_t l = 0; l < Alpha; ++l) {
+            vstore(v + ((k * Alpha + l) * TileBlock + t) * ic_pad + c, transformed[k][l]);
+          }
+        }
+      }
+    }
+
+    // element-wise products summed over input channels: M[xi] = V[xi] U[xi]
+    for (std::size_t xi = 0; xi < Alpha * Alpha; ++xi) {
+      const float* const u_xi = u + xi * ic * oc_pad;
+      for (std::size_t t = 0; t < nb; ++t) {
+        const float* const v_t = v + (xi * TileBlock + t) * ic_pad;
+        float* const m_t = m + (xi * TileBlock + t) * oc_pad;
+        for (std::size_t o = 0; o < oc_pad; o += VecWidth) {
+          vstore(m_t + o, vzero());
+        }
+        for (std::size_t c = 0; c < ic; ++c) {
+          const float vc = v_t[c];
+          const float* const u_c = u_xi + c * oc_pad;
+          for (std::size_t o = 0; o < oc_pad; o += VecWidth) {
+            vstore(m_t + o, vmla(vload(m_t + o), vload(u_c + o), vc));
+          }
+        }
+      }
+    }
+
+    // output transform: Y = A^T M A
+    for (std::size_t t = 0; t < nb; ++t) {
+      const std::size_t out_row0 = ((t0 + t) / tiles_w) * M;
+      const std::size_t out_col0 = ((t0 + t) % tiles_w) * M;
+      for (std::size_t o = 0; o < oc; o += VecWidth) {
+        const std::size_t n = std::min(VecWidth, oc - o);
+        vfloat mt[Alpha][Alpha];
+        for (std::size_t k = 0; k < Alpha; ++k) {
+          for (std::size_t l = 0; l < Alpha; ++l) {
+            mt[k][l] = vload(m + ((k * Alpha + l) * TileBlock + t) * oc_pad + o);
+          }
+        }
+        vfloat y[M][M];
+        transform(at, mt, y);
+        for (std::size_t i = 0; i < M && out_row0 + i < oh; ++i) {
+          for (std::size_t j = 0; j < M && out_col0 + j < ow; ++j) {
+            store_partial(output.data() + ((out_row0 + i) * ow + out_col0 + j) * oc + o, y[i][j], n);
+          }
+        }
+      }
+    }
+  });
+}
+
+} // namespace
+
+void conv3x3_winograd(const TensorView<T_FLOAT, MemoryLayout::NHWC>& input,
+    const TensorView<T_FLOAT, MemoryLayout::NHWC>& output,
+    const convolution_parameters& p) {
+  assert(p.kernel_height == 3 && p.kernel_width == 3);
+  assert(p.stride_along_height == 1 && p.stride_along_width == 1);
+  assert(p.winograd_weights != nullptr);
+
+  static const auto region = Measurement::Intern("winograd");
+  Measurement::Start(region);
+  if (p.winograd_tile == 4) {
+    winograd<4>(input, output, p, BT4, AT4);
+  } else {
+    assert(p.winograd_tile == 2);
+    winograd<2>(input, output, p, BT2, AT2);
+  }
+  Measurement::Stop();
+}
+
+} // namespace impl
+
+} // namespace dlk
@@ -15,6 +15,8 @@ limitations under the License.
 
 #include <cassert>
 #include <cstdio>
+#include <mutex>
+#include <vector>
 
 #include "de10_nano.h"
 #include "func/impl/quantized_conv2d_kn2row.h"
@@ -27,6 +29,27 @@ namespace
 {
 const unsigned int in_nbits = 2;
 const unsigned int byte_nbits = 8;
+
+// the accelerator runs one convolution at a time, see DeviceSlots
+std::mutex tca_mutex;
+
+unsigned long input_bytes(const convolution_parameters& cp) {
+  const T_UINT b = 32;
+  const T_UINT depth = ((cp.kernel_depth + b - 1) / b) * b;
+  return cp.input_height * cp.input_width * depth * in_nbits / byte_nbits;
+}
+
+unsigned long thresholded_output_bytes(const convolution_parameters& cp) {
+  const T_UINT b = 32;
+  const T_UINT out_c = ((cp.output_channels + b - 1) / b) * b;
+  return cp.output_height * cp.output_width * out_c * in_nbits / byte_nbits;
+}
+
+// convolution k of a chain writes the input buffer if k is odd, else the output buffer
+bool chain_output_fits(std::size_t k, unsigned long bytes,
+    const DMA_Buffer& input_buffer, const DMA_Buffer& output_buffer) {
+  return bytes <= (k % 2 == 0 ? output_buffer : input_buffer).size_in_bytes();
+}
 } // namespace
 
 namespace dlk
@@ -68,20 +91,86 @@ void TCAConv2d(const kn2row_input_t& input,
       output_byte_size /= 8;
     }
 
-    Measurement::Start("Sync UDMABuf Input");
-    p.dma_input_buffer->sync_size(input_byte_size);
-    p.dma_input_buffer->sync_for_device();
+    static const auto sync_input_region = Measurement::Intern("Sync UDMABuf Input");
+    Measurement::Start(sync_input_region);
+    p.dma_input_buffer->sync_for_device(0, input_byte_size);
     Measurement::Stop();
 
-    Measurement::Start("Conv2D TCA");
-    de10_nano::RunTCA(p.device_input_phys_addr, p.device_output_phys_addr, p.device_kernel_phys_addr, p.device_thresholds_phys_addr, in_w, in_h,
-      k_c, MAX_NBIT_QINPUT, out_w, out_h, out_c, k_w, k_h, cp.padding, cp.stride_along_height);
+    {
+      std::lock_guard<std::mutex> lock(tca_mutex);
+      static const auto tca_region = Measurement::Intern("Conv2D TCA");
+      Measurement::Start(tca_region);
+      de10_nano::StartTCA(p.device_input_phys_addr, p.device_output_phys_addr, p.device_kernel_phys_addr, p.device_thresholds_phys_addr, in_w, in_h,
+        k_c, MAX_NBIT_QINPUT, out_w, out_h, out_c, k_w, k_h, cp.padding, cp.stride_along_height);
+      de10_nano::WaitTCA();
+      Measurement::Stop();
+    }
+
+    static const auto sync_output_region = Measurement::Intern("Sync UDMABuf Output");
+    Measurement::Start(sync_output_region);
+    p.dma_output_buffer->sync_for_cpu(0, output_byte_size);
     Measurement::Stop();
+}
 
-    Measurement::Start("Sync UDMABuf Output");
-    p.dma_output_buffer->sync_size(output_byte_size);
-    p.dma_output_buffer->sync_for_cpu();
+bool TCAConv2dChainFits(const std::size_t output_elems[], const std::size_t count,
+    const DMA_Buffer& input_buffer, const DMA_Buffer& output_buffer) {
+  for (std::size_t k = 0; k < count; ++k) {
+    if (!chain_output_fits(k, output_elems[k] * in_nbits / byte_nbits, input_buffer, output_buffer)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+QUANTIZED_PACKED* TCAConv2dChain(const kn2row_input_t& input,
+    const binary_convolution_parameters params[],
+    const std::size_t count) {
+  const binary_convolution_parameters& first = params[0];
+  DMA_Buffer* const buffers[] = { first.dma_input_buffer, first.dma_output_buffer };
+  const unsigned long addresses[] = { first.device_input_phys_addr, first.device_output_phys_addr };
+  void* const data[] = { (void*) first.device_input_buf, (void*) first.device_output_buf };
+
+  // the whole command list, before the first job starts; convolution k
+  // reads buffer k % 2 and writes the other one
+  std::vector<de10_nano::Parameters> jobs;
+  jobs.reserve(count);
+  for (std::size_t k = 0; k < count; ++k) {
+    const binary_convolution_parameters& p = params[k];
+    const convolution_parameters& cp = p.normal_conv_params;
+    // checked by the network at init, see TCAConv2dChainFits
+    assert(p.thresholds != NULL);
+    assert(chain_output_fits(k, thresholded_output_bytes(cp), *buffers[0], *buffers[1]));
+    const T_UINT b = 32;
+    jobs.push_back(de10_nano::TCAParameters(addresses[k % 2], addresses[(k + 1) % 2],
+        p.device_kernel_phys_addr, p.device_thresholds_phys_addr,
+        cp.input_width, cp.input_height, cp.kernel_depth, MAX_NBIT_QINPUT,
+        cp.output_width, cp.output_height, ((cp.output_channels + b - 1) / b) * b,
+        cp.kernel_width, cp.kernel_height, cp.padding, cp.stride_along_height));
+  }
+
+  static const auto sync_input_region = Measurement::Intern("Sync UDMABuf Input");
+  Measurement::Start(sync_input_region);
+  buffers[0]->sync_for_device(0, input_bytes(first.normal_conv_params));
+  Measurement::Stop();
+
+  {
+    std::lock_guard<std::mutex> lock(tca_mutex);
+    static const auto tca_region = Measurement::Intern("Conv2D TCA chain");
+    Measurement::Start(tca_region);
+    for (const auto& job : jobs) {
+      de10_nano::StartTCA(job);
+      de10_nano::WaitTCA();
+    }
     Measurement::Stop();
+  }
+
+  const std::size_t last = count % 2;
+  static const auto sync_output_region = Measurement::Intern("Sync UDMABuf Output");
+  Measurement::Start(sync_output_region);
+  buffers[last]->sync_for_cpu(0, thresholded_output_bytes(params[count - 1].normal_conv_params));
+  Measurement::Stop();
+
+  return static_cast<QUANTIZED_PACKED*>(data[last]);
 }
 
 } // namespace impl
@@ -16,6 +16,7 @@ limitations under the License.
 #include "global.h"
 #include "matrix_view.h"
 #include "operators.h" // FIXME(nikolay): for binary_convolution_parameters definition, rid of it later
+#include "thread_pool.h"
 #include "time_measurement.h"
 
 namespace dlk {
@@ -25,10 +26,10 @@ namespace impl {
 void ApplyThresholds(
     dlk::MatrixView<BIN_CONV_OUTPUT, dlk::MatrixOrder::ColMajor> &result,
     const binary_convolution_parameters &p) {
-  Measurement::Start("ApplyThresholds");
+  static const auto region = Measurement::Intern("ApplyThresholds");
+  Measurement::Start(region);
 
-#pragma omp parallel for
-  for (unsigned int j = 0; j < result.cols(); ++j) {
+  dlk::parallel_for<unsigned int>(0, result.cols(), [&](unsigned int j) {
     for (unsigned int i = 0; i < result.rows(); ++i) {
       BIN_CONV_OUTPUT d = *result.data(i, j);
       T_INT ts0 = p.thresholds[NUM_OF_A2W1_THRESHOLD * i];
@@ -63,7 +64,7 @@ void ApplyThresholds(
       }
       *result.data(i, j) = new_d;
     }
-  }
+  });
 
   Measurement::Stop();
 }
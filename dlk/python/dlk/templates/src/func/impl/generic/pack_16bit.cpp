@@ -26,7 +26,8 @@ void pack_16bit(const BIN_CONV_OUTPUT input[], QUANTIZED_PACKED output[], const
   using base = QUANTIZED_PACKED::base_t;
   const auto bits = QUANTIZED_PACKED::BitCount;
   assert((length % bits) == 0);
-  Measurement::Start("pack bits");
+  static const auto region = Measurement::Intern("pack bits");
+  Measurement::Start(region);
   std::size_t j = 0;
   QUANTIZED_PACKED msb(0), lsb(0);
   for (std::size_t i = 0; i < length; i += bits) {
@@ -49,7 +49,8 @@ void QuantizedConv2DKn2Row(const kn2row_input_t& input,
 
   assert(ih * iw == oh * ow);
 
-  Measurement::Start("quantized-kn2row");
+  static const auto region = Measurement::Intern("quantized-kn2row");
+  Measurement::Start(region);
 
   auto output_ = MatrixView<BIN_CONV_OUTPUT, MatrixOrder::ColMajor>(
       p.device_output_buf, oc, ih * iw);
@@ -18,26 +18,19 @@ limitations under the License.
 
 #include "global.h"
 #include "func/impl/quantized_conv2d_tiling.h"
+#include "thread_pool.h"
 #include "time_measurement.h"
 
 #include <x86intrin.h>
 
-#ifdef _OPENMP
-#include <omp.h>
-#endif
-
 namespace dlk {
 
 namespace impl {
 
-static const auto buf_th0 = std::make_unique<BIN_CONV_OUTPUT[]>(MAX_IN_C);
-static const auto buf_th1 = std::make_unique<BIN_CONV_OUTPUT[]>(MAX_IN_C);
-static const auto buf_th2 = std::make_unique<BIN_CONV_OUTPUT[]>(MAX_IN_C);
-static const auto buf_flg = std::make_unique<BIN_CONV_OUTPUT[]>(MAX_IN_C);
-
 void pack_input_for_tiling(const TensorView<QUANTIZED_NOT_PACKED, MemoryLayout::NHWC>& input,
     const tiling_input_t& output) {
-  Measurement::Start("Pack_input_for_tiling");
+  static const auto region = Measurement::Intern("Pack_input_for_tiling");
+  Measurement::Start(region);
   const std::size_t in_channels = input.get_shape()[3];
   const std::size_t in_height = input.get_shape()[1];
   const std::size_t in_width = input.get_shape()[2];
@@ -45,8 +38,7 @@ void pack_input_for_tiling(const TensorView<QUANTIZED_NOT_PACKED, MemoryLayout::
   
   constexpr std::size_t InTypeBitWidth = CHAR_BIT * sizeof(uint32_t);
   const std::size_t in_stride = (in_channels + InTypeBitWidth - 1) / InTypeBitWidth;
-#pragma omp parallel for schedule(dynamic)
-  for (std::size_t in_ch_high = 0; in_ch_high < in_stride; ++in_ch_high) {
+  dlk::parallel_for<std::size_t>(0, in_stride, [&](std::size_t in_ch_high) {
     for (std::size_t row = 0; row < in_height; ++row) {
       for (std::size_t col = 0; col < in_width; ++col) {
         for (std::size_t in_bit_ch = 0; in_bit_ch < in_bitwidth; ++in_bit_ch) {
@@ -54,9 +46,8 @@ void pack_input_for_tiling(const TensorView<QUANTIZED_NOT_PACKED, MemoryLayout::
         }
       }
     }
-  }
-#pragma omp parallel for schedule(dynamic)
-  for (std::size_t row = 0; row < in_height; ++row) {
+  });
+  dlk::parallel_for<std::size_t>(0, in_height, [&](std::size_t row) {
     for (std::size_t col = 0; col < in_width; ++col) {
       for (std::size_t in_ch_high = 0; in_ch_high < in_channels; in_ch_high += InTypeBitWidth) {
         for (std::size_t in_ch_low = 0; in_ch_low < InTypeBitWidth; ++in_ch_low) {
@@ -70,14 +61,15 @@ void pack_input_for_tiling(const TensorView<QUANTIZED_NOT_PACKED, MemoryLayout::
         }
       }
     }
-  }
+  });
 
   Measurement::Stop();
 }
 
 void QuantizedConv2DTiling(const tiling_input_t& input,
                                   const kernel_t& kernel,
-                                  const binary_convolution_parameters &p) {
+                                  const binary_convolution_parameters &p,
+                                  const tiling_rows_t& rows) {
   constexpr std::size_t InTypeBitWidth = tiling_input_elem_t::BitCount;
   convolution_parameters cp = p.normal_conv_params;
   const std::size_t out_channels = cp.output_channels;
@@ -92,12 +84,20 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
   const std::size_t out_height = cp.output_height;
   const std::size_t out_width = cp.output_width;
   const std::size_t out_size = out_height * out_width * out_channels;
+  const std::size_t in_rows = input.get_shape()[1];
+  const std::size_t out_rows = rows.out_rows;
+  const std::size_t row_begin = rows.row_begin;
+  const std::size_t row_end = rows.row_end;
 
   //assert(kh * kw < 32);
   assert(in_height * in_width == out_height * out_width);
   assert((in_channels % InTypeBitWidth) == 0);
 
-  Measurement::Start("Quantized Conv2D Tiling");
+  // per call, as several bands of different layers may run at once
+  alignas(32) BIN_CONV_OUTPUT buf_th0[MAX_IN_C];
+  alignas(32) BIN_CONV_OUTPUT buf_th1[MAX_IN_C];
+  alignas(32) BIN_CONV_OUTPUT buf_th2[MAX_IN_C];
+  alignas(32) BIN_CONV_OUTPUT buf_flg[MAX_IN_C];
   if (p.thresholds != nullptr) {
     const auto table = _mm256_setr_epi8(
         0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15,
@@ -131,10 +131,10 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
       const auto res0 = _mm256_sub_epi16(th0, is_neg);
       const auto res1 = _mm256_sub_epi16(th1, is_neg);
       const auto res2 = _mm256_sub_epi16(th2, is_neg);
-      _mm256_storeu_si256(reinterpret_cast<__m256i*>(buf_th0.get() + i), res0);
-      _mm256_storeu_si256(reinterpret_cast<__m256i*>(buf_th1.get() + i), res1);
-      _mm256_storeu_si256(reinterpret_cast<__m256i*>(buf_th2.get() + i), res2);
-      _mm256_storeu_si256(reinterpret_cast<__m256i*>(buf_flg.get() + i), flg);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(buf_th0 + i), res0);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(buf_th1 + i), res1);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(buf_th2 + i), res2);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(buf_flg + i), flg);
     }
   }
 
@@ -145,7 +145,7 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
     constexpr std::size_t OutChBlocks = OutChUnroll2 / OutChUnroll;
     constexpr std::size_t InBitChUnroll = 2; // hardcoded, not configurable
     constexpr std::size_t ColUnroll = 4; // hardcoded, not configurable
-    const auto row_tile_count = in_height;
+    const auto row_tile_count = row_end - row_begin;
     const auto col_tile_count = (in_width + ColUnroll - 1) / ColUnroll;
     const auto total_tile_count = row_tile_count * col_tile_count;
     alignas(32) int16_t nksum_ary[MAX_IN_C];
@@ -174,14 +174,13 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
       0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
       0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4
     );
-#pragma omp parallel for schedule(guided)
-    for (std::size_t tile_index = 0; tile_index < total_tile_count; ++tile_index) {
+    dlk::parallel_for<std::size_t>(0, total_tile_count, [&](std::size_t tile_index) {
       const auto col = tile_index % col_tile_count * ColUnroll;
-      const auto row = tile_index / col_tile_count;
+      const auto row = row_begin + tile_index / col_tile_count;
       alignas(32) uint32_t in_buf[MAX_IN_C/InTypeBitWidth][ColUnroll][2];
       for (std::size_t in_ch_high = 0; in_ch_high < in_channels/InTypeBitWidth; ++in_ch_high) {
-        const auto in_index = in_ch_high * in_height * in_width * in_bitwidth
-          + row * in_width * in_bitwidth
+        const auto in_index = in_ch_high * in_rows * in_width * in_bitwidth
+          + (row - rows.in_row_offset) * in_width * in_bitwidth
           + col * in_bitwidth;
         for (std::size_t j = 0; j < ColUnroll; ++j) {
           if (col + j >= in_width) {
@@ -251,10 +250,10 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
         const auto Ohh = Oh / OutChUnroll2;
         const auto Om = Oh / OutChUnroll % OutChBlocks;
         if (p.thresholds != nullptr) {
-          const auto th0 = _mm256_loadu_si256(reinterpret_cast<__m256i*>(buf_th0.get() + Oh));
-          const auto th1 = _mm256_loadu_si256(reinterpret_cast<__m256i*>(buf_th1.get() + Oh));
-          const auto th2 = _mm256_loadu_si256(reinterpret_cast<__m256i*>(buf_th2.get() + Oh));
-          const auto flg = _mm256_loadu_si256(reinterpret_cast<__m256i*>(buf_flg.get() + Oh));
+          const auto th0 = _mm256_loadu_si256(reinterpret_cast<__m256i*>(buf_th0 + Oh));
+          const auto th1 = _mm256_loadu_si256(reinterpret_cast<__m256i*>(buf_th1 + Oh));
+          const auto th2 = _mm256_loadu_si256(reinterpret_cast<__m256i*>(buf_th2 + Oh));
+          const auto flg = _mm256_loadu_si256(reinterpret_cast<__m256i*>(buf_flg + Oh));
           const auto is_neg = _mm256_cmpgt_epi16(_mm256_setzero_si256(), flg);
           const auto m2 = _mm256_sub_epi16(flg, _mm256_set1_epi16(2));
           const auto is_not_const = _mm256_cmpgt_epi16(_mm256_setzero_si256(), m2);
@@ -276,8 +275,8 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
     reinterpret_cast<uint16_t*>(p.device_output_buf)[out_index + i * 2 * OutChBlocks + 0 * OutChBlocks] = lsb; \
     reinterpret_cast<uint16_t*>(p.device_output_buf)[out_index + i * 2 * OutChBlocks + 1 * OutChBlocks] = msb; \
   } while(0)
-          const auto out_index = Ohh * out_height * out_width * 2 * OutChBlocks
-              + row * out_width * 2 * OutChBlocks
+          const auto out_index = Ohh * out_rows * out_width * 2 * OutChBlocks
+              + (row - rows.out_row_offset) * out_width * 2 * OutChBlocks
               + col * 2 * OutChBlocks
               + Om;
           APPLY_PACK(0);
@@ -288,8 +287,8 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
 #define OUT(i) \
   if (col + i >= out_width) continue; \
   do { \
-    const auto out_index = Ohh * out_height * out_width * OutChUnroll2 \
-        + row * out_width * OutChUnroll2 \
+    const auto out_index = Ohh * out_rows * out_width * OutChUnroll2 \
+        + (row - rows.out_row_offset) * out_width * OutChUnroll2 \
         + (col + i) * OutChUnroll2 \
         + Om * OutChUnroll; \
     _mm256_storeu_si256(reinterpret_cast<__m256i*>(p.device_output_buf + out_index), ans##i); \
@@ -301,7 +300,7 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
 #undef OUT
         }
       }
-    }
+    });
   } else {
     constexpr std::size_t InChUnroll = InTypeBitWidth; // hardcoded, not configurable
     constexpr std::size_t OutChUnroll = 8; // hardcoded, not configurable
@@ -311,21 +310,20 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
     constexpr std::size_t ColUnroll = 3; // hardcoded, not configurable
     const std::size_t TileHeightMax = 20; // configurable
     const std::size_t TileWidthMax = 21; // configurable
-    const std::size_t TileHeight = std::min(in_height, TileHeightMax);
+    const std::size_t TileHeight = std::min(row_end - row_begin, TileHeightMax);
     const std::size_t TileWidth = std::min(in_width + (ColUnroll - in_width % ColUnroll) % ColUnroll, TileWidthMax);
     const std::size_t khMax = 5;
     const std::size_t kwMax = 5;
     
-    const std::size_t row_tile_count = (in_height + TileHeight - 1) / TileHeight;
+    const std::size_t row_tile_count = (row_end - row_begin + TileHeight - 1) / TileHeight;
     const std::size_t col_tile_count = (in_width + TileWidth - 1) / TileWidth;
     const std::size_t out_tile_count = (out_channels + OutChUnroll - 1) / OutChUnroll;
     const std::size_t total_tile_count = row_tile_count * col_tile_count * out_tile_count;
     const auto vone = _mm256_set1_epi8(0x01);
-#pragma omp parallel for schedule(guided)
-    for (std::size_t tile_index = 0; tile_index < total_tile_count; ++tile_index) {
+    dlk::parallel_for<std::size_t>(0, total_tile_count, [&](std::size_t tile_index) {
       const auto out_ch_high = tile_index % out_tile_count;
       const auto col_high = (tile_index / out_tile_count) % col_tile_count * TileWidth;
-      const auto row_high = tile_index / (out_tile_count * col_tile_count) * TileHeight;
+      const auto row_high = row_begin + tile_index / (out_tile_count * col_tile_count) * TileHeight;
       alignas(32) BIN_CONV_OUTPUT out_tile[TileHeightMax][TileWidthMax][OutChUnroll];
       for (std::size_t row = 0; row < TileHeight; ++row) {
         for (std::size_t col = 0; col < TileWidth; ++col) {
@@ -360,7 +358,7 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
         for (std::size_t in_bit_ch_high = 0; in_bit_ch_high < in_bitwidth; in_bit_ch_high += InBitChUnroll) {
           alignas(32) tiling_input_elem_t in_tile[TileHeightMax + khMax - 1][TileWidthMax + kwMax - 1][InBitChUnroll];
           for (std::size_t row = 0; row < TileHeight + kh - 1; ++row) {
-            if (row_high + row >= in_height + 2*padding) break;
+            if (row_high + row >= in_height + 2*padding || row_high + row >= row_end + kh - 1) break;
             for (std::size_t col = 0; col < TileWidth + kw - 1; ++col) {
               if (col_high + col >= in_width + 2*padding) break;
               for (std::size_t in_bit_ch = 0; in_bit_ch < InBitChUnroll; ++in_bit_ch) {
@@ -368,8 +366,8 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
                     || col_high + col < padding || col_high + col >= in_width + padding) {
                   in_tile[row][col][in_bit_ch] = tiling_input_elem_t(0);
                 } else {
-                  const auto index = (in_ch_high / InTypeBitWidth) * in_height * in_width * in_bitwidth
-                    + (row_high + row - padding) * in_width * in_bitwidth
+                  const auto index = (in_ch_high / InTypeBitWidth) * in_rows * in_width * in_bitwidth
+                    + (row_high + row - padding - rows.in_row_offset) * in_width * in_bitwidth
                     + (col_high + col - padding) * in_bitwidth
                     + (in_bit_ch_high + in_bit_ch);
                   in_tile[row][col][in_bit_ch] = input.data()[index];
@@ -465,15 +463,15 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
         }
       }
       if (p.thresholds != nullptr) {
-        const auto th0 = _mm_loadu_si128(reinterpret_cast<__m128i*>(buf_th0.get() + out_ch_high * OutChUnroll));
-        const auto th1 = _mm_loadu_si128(reinterpret_cast<__m128i*>(buf_th1.get() + out_ch_high * OutChUnroll));
-        const auto th2 = _mm_loadu_si128(reinterpret_cast<__m128i*>(buf_th2.get() + out_ch_high * OutChUnroll));
-        const auto flg = _mm_loadu_si128(reinterpret_cast<__m128i*>(buf_flg.get() + out_ch_high * OutChUnroll));
+        const auto th0 = _mm_loadu_si128(reinterpret_cast<__m128i*>(buf_th0 + out_ch_high * OutChUnroll));
+        const auto th1 = _mm_loadu_si128(reinterpret_cast<__m128i*>(buf_th1 + out_ch_high * OutChUnroll));
+        const auto th2 = _mm_loadu_si128(reinterpret_cast<__m128i*>(buf_th2 + out_ch_high * OutChUnroll));
+        const auto flg = _mm_loadu_si128(reinterpret_cast<__m128i*>(buf_flg + out_ch_high * OutChUnroll));
         const auto is_neg = _mm_cmpgt_epi16(_mm_setzero_si128(), flg);
         const auto m2 = _mm_sub_epi16(flg, _mm_set1_epi16(2));
         const auto is_not_const = _mm_cmpgt_epi16(_mm_setzero_si128(), m2);
         for (std::size_t row = 0; row < TileHeight; ++row) {
-          if (row_high + row >= out_height) break;
+          if (row_high + row >= row_end) break;
           for (std::size_t col = 0; col < TileWidth; ++col) {
             if (col_high + col >= out_width) break;
             const auto vec = _mm_loadu_si128(reinterpret_cast<__m128i*>(&out_tile[row][col][0]));
@@ -489,8 +487,8 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
             const auto msb = _mm_movemask_epi8(vmsb);
             const auto Ohh = out_ch_high / OutChBlocks;
             const auto Om = out_ch_high % OutChBlocks;
-            const auto index = Ohh * out_height * out_width * 2 * OutChBlocks
-                + (row_high + row) * out_width * 2 * OutChBlocks
+            const auto index = Ohh * out_rows * out_width * 2 * OutChBlocks
+                + (row_high + row - rows.out_row_offset) * out_width * 2 * OutChBlocks
                 + (col_high + col) * 2 * OutChBlocks
                 + Om;
             reinterpret_cast<uint8_t*>(p.device_output_buf)[index + 0] = lsb;
@@ -499,22 +497,31 @@ void QuantizedConv2DTiling(const tiling_input_t& input,
         }
       } else {
         for (std::size_t row = 0; row < TileHeight; ++row) {
-          if (row_high + row >= out_height) break;
+          if (row_high + row >= row_end) break;
           for (std::size_t col = 0; col < TileWidth; ++col) {
             if (col_high + col >= out_width) break;
             const auto vec = _mm_load_si128(reinterpret_cast<__m128i*>(&out_tile[row][col][0]));
             const auto Ohh = out_ch_high / OutChBlocks;
             const auto Om = out_ch_high % OutChBlocks;
-            const auto index = Ohh * out_height * out_width * OutChUnroll2
-                + (row_high + row) * out_width * OutChUnroll2
+            const auto index = Ohh * out_rows * out_width * OutChUnroll2
+                + (row_high + row - rows.out_row_offset) * out_width * OutChUnroll2
                 + (col_high + col) * OutChUnroll2
                 + Om * OutChUnroll;
             _mm_storeu_si128(reinterpret_cast<__m128i*>(p.device_output_buf + index), vec);
           }
         }
       }
-    }
+    });
   }
+}
+
+void QuantizedConv2DTiling(const tiling_input_t& input,
+                                  const kernel_t& kernel,
+                                  const binary_convolution_parameters &p) {
+  const std::size_t out_height = p.normal_conv_params.output_height;
+  static const auto region = Measurement::Intern("Quantized Conv2D Tiling");
+  Measurement::Start(region);
+  QuantizedConv2DTiling(input, kernel, p, {0, out_height, 0, 0, out_height});
   Measurement::Stop();
 }
 
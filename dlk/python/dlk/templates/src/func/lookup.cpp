@@ -15,6 +15,7 @@ limitations under the License.
 
 #include "global.h"
 #include "func/lookup.h"
+#include "thread_pool.h"
 #include "time_measurement.h"
 #ifdef USE_AVX
 #include <x86intrin.h>
@@ -31,7 +32,8 @@ void func_Lookup(const TensorView<float, MemoryLayout::NHWC>& input,
 
   int b = 32;
   int packed_depth = 2;
-  Measurement::Start("Lookup");
+  static const auto region = Measurement::Intern("Lookup");
+  Measurement::Start(region);
 
   const float * in_ptr = input.data();
   const QUANTIZED_PACKED_KERNEL * lsb_ptr = lsb.data();
@@ -97,8 +99,7 @@ void func_Lookup(const TensorView<float, MemoryLayout::NHWC>& input,
   }
 #else
   int len = h * w;
-#pragma omp parallel for
-  for(int i = 0; i < len; i++) {
+  dlk::parallel_for<int>(0, len, [&](int i) {
     int r = int(in_ptr[i * 3 + 0] * 255.0f);
     int g = int(in_ptr[i * 3 + 1] * 255.0f);
     int b = int(in_ptr[i * 3 + 2] * 255.0f);
@@ -112,7 +113,7 @@ void func_Lookup(const TensorView<float, MemoryLayout::NHWC>& input,
 
     out_ptr[i * 2 + 0] = QUANTIZED_PACKED((b_lsb.Raw() << 20) | (g_lsb.Raw() << 10) | r_lsb.Raw());
     out_ptr[i * 2 + 1] = QUANTIZED_PACKED((b_msb.Raw() << 20) | (g_msb.Raw() << 10) | r_msb.Raw());
-  }
+  });
 #endif
 
   Measurement::Stop();
@@ -21,7 +21,8 @@ void func_Matmul(const TensorView<T_FLOAT, MemoryLayout::NC>& input,
     const TensorView<T_FLOAT, MemoryLayout::NC>& factor,
     const TensorView<T_FLOAT, MemoryLayout::NC>& output) {
 #ifndef RUN_AS_HLS
-  Measurement::Start("MatMul");
+  static const auto region = Measurement::Intern("MatMul");
+  Measurement::Start(region);
 #endif
   T_UINT in_size = input.size();
   T_UINT out_depth = output.size();
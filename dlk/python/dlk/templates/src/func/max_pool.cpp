@@ -103,7 +103,8 @@ void max_pooling_with_argmax(
 void func_MaxPool(const TensorView<T_FLOAT, MemoryLayout::NHWC>& input,
     const TensorView<T_FLOAT, MemoryLayout::NHWC>& output,
     struct max_pooling_parameters mpp) {
-  Measurement::Start("MaxPooling");
+  static const auto region = Measurement::Intern("MaxPooling");
+  Measurement::Start(region);
 
   max_pooling(input, output, mpp);
 
@@ -113,7 +114,8 @@ void func_MaxPool(const TensorView<T_FLOAT, MemoryLayout::NHWC>& input,
 void func_MaxPool(const TensorView<QUANTIZED_NOT_PACKED, MemoryLayout::NHWC>& input,
     const TensorView<QUANTIZED_NOT_PACKED, MemoryLayout::NHWC>& output,
     struct max_pooling_parameters mpp) {
-  Measurement::Start("MaxPooling");
+  static const auto region = Measurement::Intern("MaxPooling");
+  Measurement::Start(region);
 
   max_pooling(input, output, mpp);
 
@@ -124,7 +126,8 @@ void func_MaxPoolWithArgmax(const TensorView<Quantized_t, MemoryLayout::NHWC>& i
     const TensorView<Quantized_t, MemoryLayout::NHWC>& output,
     const TensorView<T_UINT, MemoryLayout::NHWC>& indices,
     struct MaxPoolWithArgmax_parameters mpp) {
-  Measurement::Start("MaxPoolingWithArgmax");
+  static const auto region = Measurement::Intern("MaxPoolingWithArgmax");
+  Measurement::Start(region);
 
   max_pooling_with_argmax(input, output, indices, mpp);
 
@@ -20,7 +20,8 @@ void func_Pad(const TensorView<T_FLOAT, MemoryLayout::NHWC>& input,
     const TensorView<int32_t, MemoryLayout::Padding>& padding,
     const TensorView<T_FLOAT, MemoryLayout::NHWC>& output) {
 #ifndef RUN_AS_HLS
-  Measurement::Start("Pad");
+  static const auto region = Measurement::Intern("Pad");
+  Measurement::Start(region);
 #endif
 
   T_UINT in_depth = input.get_shape()[3];
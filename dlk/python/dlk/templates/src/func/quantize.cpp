@@ -21,7 +21,8 @@ limitations under the License.
 
 void func_Quantize(T_FLOAT input[], Quantized_t output[], T_UINT out_height,
                    T_UINT out_width, T_UINT out_depth) {
-  Measurement::Start("Quantize");
+  static const auto region = Measurement::Intern("Quantize");
+  Measurement::Start(region);
 
   T_UINT elements = out_height * out_width * out_depth;
 
@@ -0,0 +1,123 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include "global.h"
+#include "func/quantized_conv2d.h"
+#include "func/impl/quantized_conv2d_tiling.h"
+#include "thread_pool.h"
+
+namespace {
+
+bool env_enabled() {
+  const char* value = std::getenv("DLK_CONV_FUSION");
+  return value == nullptr || std::atoi(value) != 0;
+}
+
+} // namespace
+
+std::atomic<bool> QuantizedConv2DChain::enabled(env_enabled());
+
+#if (defined USE_NEON || defined USE_AVX) && !defined RUN_ON_FPGA
+
+namespace {
+
+// the intermediate rows of a band are kept under this many bytes per thread
+constexpr std::size_t band_cache_bytes = 256 << 10;
+// thinner bands would spend more on their halo than they save
+constexpr std::size_t min_band_rows = 4;
+
+} // namespace
+
+namespace dlk {
+
+namespace impl {
+
+void QuantizedConv2DTilingChain(const tiling_input_t& input,
+    const kernel_t* const kernels[],
+    const binary_convolution_parameters params[],
+    std::size_t count,
+    tiling_input_elem_t* output) {
+  constexpr std::size_t InTypeBitWidth = tiling_input_elem_t::BitCount;
+  const std::size_t height = params[0].normal_conv_params.output_height;
+  const std::size_t width = params[0].normal_conv_params.output_width;
+
+  // rows layer k computes on each side of a band for the layers after it
+  std::vector<std::size_t> halo(count, 0);
+  // words of an intermediate output row, the largest one
+  std::size_t row_words = 1;
+  for (std::size_t k = count - 1; k-- > 0;) {
+    halo[k] = halo[k + 1] + params[k + 1].normal_conv_params.padding;
+    row_words = std::max<std::size_t>(row_words,
+        params[k].normal_conv_params.output_channels / InTypeBitWidth
+        * width * params[k + 1].bin_input_bitwidth);
+  }
+
+  // two intermediates are live at a time
+  const std::size_t threads = ThreadPool::Size();
+  const std::size_t fit = band_cache_bytes / (2 * row_words * sizeof(tiling_input_elem_base_t));
+  std::size_t band = fit > 2 * halo[0] + min_band_rows ? fit - 2 * halo[0] : min_band_rows;
+  band = std::min(band, (height + threads - 1) / threads);
+  band = std::max(band, std::min(min_band_rows, height));
+  const std::size_t band_count = (height + band - 1) / band;
+  const std::size_t scratch_words = row_words * std::min(height, band + 2 * halo[0]);
+
+  parallel_for<std::size_t>(0, band_count, [&](std::size_t band_index) {
+    thread_local std::vector<tiling_input_elem_base_t> scratch;
+    if (scratch.size() < 2 * scratch_words) {
+      scratch.resize(2 * scratch_words);
+    }
+    const std::size_t band_begin = band_index * band;
+    const std::size_t band_end = std::min(height, band_begin + band);
+
+    tiling_input_t in = input;
+    std::size_t in_row_offset = 0;
+    for (std::size_t k = 0; k < count; ++k) {
+      auto p = params[k];
+      const std::size_t row_begin = band_begin > halo[k] ? band_begin - halo[k] : 0;
+      const std::size_t row_end = std::min(height, band_end + halo[k]);
+      if (k + 1 == count) {
+        p.device_output_buf = reinterpret_cast<BIN_CONV_OUTPUT*>(output);
+        QuantizedConv2DTiling(in, *kernels[k], p, {row_begin, row_end, in_row_offset, 0, height});
+        break;
+      }
+
+      // ping-pong between the two halves of the scratch
+      auto* const out = reinterpret_cast<tiling_input_elem_t*>(scratch.data() + k % 2 * scratch_words);
+      p.device_output_buf = reinterpret_cast<BIN_CONV_OUTPUT*>(out);
+      QuantizedConv2DTiling(in, *kernels[k], p,
+          {row_begin, row_end, in_row_offset, row_begin, row_end - row_begin});
+
+      tiling_input_t::tensor_info_t<std::size_t> shape = {
+        p.normal_conv_params.output_channels / InTypeBitWidth,
+        row_end - row_begin,
+        width,
+        params[k + 1].bin_input_bitwidth,
+        InTypeBitWidth
+      };
+      in = tiling_input_t(out, shape);
+      in_row_offset = row_begin;
+    }
+  });
+}
+
+} // namespace impl
+
+} // namespace dlk
+
+#endif
@@ -21,7 +21,8 @@ limitations under the License.
 
 void func_Softmax(const TensorView<T_FLOAT, MemoryLayout::NC>& input,
     const TensorView<T_FLOAT, MemoryLayout::NC>& output) {
-  Measurement::Start("SoftMax");
+  static const auto region = Measurement::Intern("SoftMax");
+  Measurement::Start(region);
 
   T_UINT out_width = output.size();
 
@@ -20,7 +20,8 @@ limitations under the License.
 void func_Unpooling(const TensorView<T_UINT, MemoryLayout::NHWC>& indices,
     const TensorView<Quantized_t, MemoryLayout::NHWC>& input,
     const TensorView<Quantized_t, MemoryLayout::NHWC>& output) {
-  Measurement::Start("Unpooling");
+  static const auto region = Measurement::Intern("Unpooling");
+  Measurement::Start(region);
 
   const auto input_elements = input.size();
   for (T_UINT i = 0; i < input_elements; i++)
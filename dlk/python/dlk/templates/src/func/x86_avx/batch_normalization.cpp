@@ -18,6 +18,7 @@ limitations under the License.
 
 #include "global.h"
 #include "func/batch_normalization.h"
+#include "thread_pool.h"
 #include "time_measurement.h"
 
 #include <x86intrin.h>
@@ -32,7 +33,8 @@ void func_BatchNormalization(const TensorView<T_FLOAT, MemoryLayout::NHWC>& inpu
     const TensorView<T_FLOAT, MemoryLayout::C>& variance,
     T_FLOAT epsilon,
     const TensorView<T_FLOAT, MemoryLayout::NHWC>& output) {
-  Measurement::Start("BatchNorm");
+  static const auto region = Measurement::Intern("BatchNorm");
+  Measurement::Start(region);
 
   const unsigned out_height = output.get_shape()[1];
   const unsigned out_width = output.get_shape()[2];
@@ -44,8 +46,7 @@ void func_BatchNormalization(const TensorView<T_FLOAT, MemoryLayout::NHWC>& inpu
   }
 
   std::size_t size = out_height * out_width;
-#pragma omp parallel for
-  for (std::size_t f = 0; f < size; ++f) {
+  dlk::parallel_for<std::size_t>(0, size, [&](std::size_t f) {
     std::size_t d;
     for (d = 0; d + 7 < out_depth; d += 8) {
       const auto index = f * out_depth + d;
@@ -60,7 +61,7 @@ void func_BatchNormalization(const TensorView<T_FLOAT, MemoryLayout::NHWC>& inpu
       const auto index = f * out_depth + d;
       output.data()[index] = input.data()[index] * scale[d] + shift[d];
     }
-  }
+  });
 
   Measurement::Stop();
 }
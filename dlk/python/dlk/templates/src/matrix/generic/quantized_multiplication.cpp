@@ -15,12 +15,12 @@ limitations under the License.
 
 #include <algorithm>
 #include <cassert>
-#include <thread>
 #include <vector>
 
 #include "global.h"
 #include "matrix_view.h"
 #include "matrix/quantized_multiplication.h"
+#include "thread_pool.h"
 #include "time_measurement.h"
 
 namespace {
@@ -191,25 +191,16 @@ void quantized_matrix_multiplication(
   const MatrixView<QUANTIZED_PACKED_KERNEL, MatrixOrder::RowMajor>& A,
   const MatrixView<QUANTIZED_PACKED, MatrixOrder::ColMajor>& B,
   MatrixView<BIN_CONV_OUTPUT, MatrixOrder::ColMajor>& C) {
-  Measurement::Start("quantized_matrix_multiplication");
+  static const auto region = Measurement::Intern("quantized_matrix_multiplication");
+  Measurement::Start(region);
 
   assert(A.cols() * 2 == B.rows());
 
-  unsigned int chunk_size = B.cols() / std::thread::hardware_concurrency();
-  if (chunk_size == 0) {
-    chunk_size += 1;
-  }
-
-  std::vector<std::thread> threads;
-  for (unsigned int i = 0; i < B.cols(); i += chunk_size) {
-    threads.emplace_back(std::thread([A, B, &C, i, chunk_size] {
-          quantized_matrix_multiplication_body(A, B, i, std::min(i + chunk_size, static_cast<unsigned int>(B.cols())), C);
-    }));
-  }
-
-  for (auto& th: threads) {
-    th.join();
-  }
+  // chunks of whole 4-column blocks
+  const unsigned int cols = B.cols();
+  dlk::parallel_for_range(0u, (cols + 3) / 4, [&](unsigned int begin, unsigned int end) {
+    quantized_matrix_multiplication_body(A, B, begin * 4, std::min(end * 4, cols), C);
+  });
 
   Measurement::Stop();
 }
@@ -17,6 +17,7 @@ limitations under the License.
 #include <memory>
 #include "global.h"
 #include "matrix/row_major_to_col_major.h"
+#include "thread_pool.h"
 
 #ifdef USE_NEON
   #include <arm_neon.h>
@@ -117,8 +118,7 @@ void matrix_multiplication_impl(
       }
     }
   }
-#pragma omp parallel for
-  for (std::size_t i = 0; i < A.rows(); i += regblock_n) {
+  dlk::parallel_for<std::size_t>(0, A.rows(), regblock_n, [&](std::size_t i) {
     float A_buf[regblock_n * A.cols()];
     for (std::size_t k = 0; k < A.cols(); ++k) {
       for (std::size_t i2 = 0; i2 < regblock_n; ++i2) {
@@ -244,7 +244,7 @@ void matrix_multiplication_impl(
         }
       }
     }
-  }
+  });
 #elif defined USE_AVX
   constexpr std::size_t regblock_n = 16;
   constexpr std::size_t regblock_m = 4;
@@ -300,8 +300,7 @@ void matrix_multiplication_impl(
       }
     }
   }
-#pragma omp parallel for
-  for (std::size_t i = 0; i < A.rows(); i += regblock_n) {
+  dlk::parallel_for<std::size_t>(0, A.rows(), regblock_n, [&](std::size_t i) {
     alignas(32) float A_buf[regblock_n * kmax];
     for (std::size_t k = 0; k < kmax; ++k) {
       for (std::size_t i2 = 0; i2 < regblock_n; ++i2) {
@@ -362,7 +361,7 @@ void matrix_multiplication_impl(
       _mm256_maskstore_ps(C.data(i + 0, j + 3), mask0, accum30);
       _mm256_maskstore_ps(C.data(i + 8, j + 3), mask1, accum31);
     }
-  }
+  });
 #endif
 }
 
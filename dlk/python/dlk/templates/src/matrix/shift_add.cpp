@@ -17,6 +17,7 @@ limitations under the License.
 #include "matrix_view.h"
 #include "matrix/shift_add.h"
 #include "operators.h" // FIXME(nikolay): for convolution_parameters definition, rid of it later
+#include "thread_pool.h"
 #include "time_measurement.h"
 
 #ifdef USE_NEON
@@ -32,7 +33,8 @@ void matrix_shift_add(MatrixView<float, MatrixOrder::ColMajor>& buf,
                       MatrixView<float, MatrixOrder::ColMajor>& result,
                       const struct convolution_parameters& p,
                       const int block_offset) {
-  Measurement::Start("matrix_shift_add_f1");
+  static const auto clear_region = Measurement::Intern("matrix_shift_add_f1");
+  Measurement::Start(clear_region);
 
   const int h = p.input_height;
   const int w = p.input_width;
@@ -59,12 +61,12 @@ void matrix_shift_add(MatrixView<float, MatrixOrder::ColMajor>& buf,
 
   Measurement::Stop();
 
-  Measurement::Start("matrix_shift_add_f2");
+  static const auto add_region = Measurement::Intern("matrix_shift_add_f2");
+  Measurement::Start(add_region);
 
   const auto res_col_start = std::max(0, block_offset - w - 1);
   const auto res_col_end = std::min(h * w, block_offset + col_block + w + 1);
-#pragma omp parallel for
-  for (int k = res_col_start; k < res_col_end; ++k) {
+  dlk::parallel_for<int>(res_col_start, res_col_end, [&](int k) {
     const auto buf_k = k - block_offset;
     for (unsigned int i = 0; i < kh * kw; ++i) {
       int offset = calc_offset(i, w);
@@ -96,7 +98,7 @@ void matrix_shift_add(MatrixView<float, MatrixOrder::ColMajor>& buf,
         r[j] += b[j];
       }
     }
-  }
+  });
 
   Measurement::Stop();
 }
@@ -106,7 +108,8 @@ void matrix_shift_add(MatrixView<int32_t, MatrixOrder::ColMajor>& buf,
                       MatrixView<int32_t, MatrixOrder::ColMajor>& result,
                       const struct convolution_parameters& p,
                       const int block_offset) {
-  Measurement::Start("matrix_shift_add_i1");
+  static const auto clear_region = Measurement::Intern("matrix_shift_add_i1");
+  Measurement::Start(clear_region);
 
   const int h = p.input_height;
   const int w = p.input_width;
@@ -130,12 +133,12 @@ void matrix_shift_add(MatrixView<int32_t, MatrixOrder::ColMajor>& buf,
 
   Measurement::Stop();
 
-  Measurement::Start("matrix_shift_add_i2");
+  static const auto add_region = Measurement::Intern("matrix_shift_add_i2");
+  Measurement::Start(add_region);
 
   const auto res_col_start = std::max(0, block_offset - w - 1);
   const auto res_col_end = std::min(h * w, block_offset + col_block + w + 1);
-#pragma omp parallel for
-  for (int k = res_col_start; k < res_col_end; ++k) {
+  dlk::parallel_for<int>(res_col_start, res_col_end, [&](int k) {
     const auto buf_k = k - block_offset;
     for (unsigned int i = 0; i < kh * kw; ++i) {
       int offset = calc_offset(i, w);
@@ -167,7 +170,7 @@ void matrix_shift_add(MatrixView<int32_t, MatrixOrder::ColMajor>& buf,
         r[j] += b[j];
       }
     }
-  }
+  });
 
   Measurement::Stop();
 }
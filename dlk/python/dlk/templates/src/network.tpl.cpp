@@ -13,6 +13,7 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <climits>
@@ -50,6 +51,12 @@ limitations under the License.
 #include "operators.h"
 #include "quantizer.h"
 #include "network.h"
+#include "time_measurement.h"
+#include "activation_dump.h"
+#include "device_slots.h"
+#include "drift_monitor.h"
+#include "task_graph.h"
+#include "thread_pool.h"
 
 #ifdef HARD_QUANTIZATION_ACTIVE
 #include "scaling_factors.h"
@@ -63,69 +70,9 @@ limitations under the License.
 #include "operators.h"
 
 #ifdef RUN_ON_FPGA
-#include "memdriver.h"
+#include "weight_store.h"
 #endif
 
-{% if config.debug -%}
-#include "c2numpy.h"
-
-void save_float32_data(const std::string &name, uint32_t size, uint32_t postfix, float *data, float scale)
-{
-  c2numpy_writer writer;
-  c2numpy_init(&writer, name.c_str(), postfix, 1<<31);
-  c2numpy_addcolumn(&writer, "data", C2NUMPY_FLOAT32);
-  c2numpy_addcolumn(&writer, "scale", C2NUMPY_FLOAT32);
-
-  for(int i = 0; i < size; i++) {
-    c2numpy_float32(&writer, data[i]);
-    c2numpy_float32(&writer, scale);
-  }
-  c2numpy_close(&writer);
-}
-
-void save_int32_data(const std::string &name, uint32_t size, uint32_t postfix, int32_t *data, float scale)
-{
-  c2numpy_writer writer;
-  c2numpy_init(&writer, name.c_str(), postfix, 1<<31);
-  c2numpy_addcolumn(&writer, "data", C2NUMPY_INT32);
-  c2numpy_addcolumn(&writer, "scale", C2NUMPY_FLOAT32);
-
-  for(int i = 0; i < size; i++) {
-    c2numpy_int32(&writer, data[i]);
-    c2numpy_float32(&writer, scale);
-  }
-  c2numpy_close(&writer);
-}
-
-void save_int16_data(const std::string &name, uint32_t size, uint32_t postfix, int16_t *data, float scale)
-{
-  c2numpy_writer writer;
-  c2numpy_init(&writer, name.c_str(), postfix, 1<<31);
-  c2numpy_addcolumn(&writer, "data", C2NUMPY_INT16);
-  c2numpy_addcolumn(&writer, "scale", C2NUMPY_FLOAT32);
-
-  for(int i = 0; i < size; i++) {
-    c2numpy_int16(&writer, data[i]);
-    c2numpy_float32(&writer, scale);
-  }
-  c2numpy_close(&writer);
-}
-
-void save_uint32_data(const std::string &name, uint32_t size, uint32_t postfix, uint32_t *data, float scale)
-{
-  c2numpy_writer writer;
-  c2numpy_init(&writer, name.c_str(), postfix, 1<<31);
-  c2numpy_addcolumn(&writer, "data", C2NUMPY_UINT32);
-  c2numpy_addcolumn(&writer, "scale", C2NUMPY_FLOAT32);
-
-  for(int i = 0; i < size; i++) {
-    c2numpy_uint32(&writer, data[i]);
-    c2numpy_float32(&writer, scale);
-  }
-  c2numpy_close(&writer);
-}
-
-{% endif %}
 {{ '\n' -}}
 
 /////////////////////////////////////////
@@ -136,14 +83,68 @@ void save_uint32_data(const std::string &name, uint32_t size, uint32_t postfix,
 {% endfor %}
 {{ '\n' -}}
 /////////////////////////////////////////
+// per-layer cost for roofline_report
+/////////////////////////////////////////
+namespace {
+
+struct LayerCost {
+  const char* name;
+  double ops;
+  double bytes;
+  bool binary; // bit operations of a bit-serial convolution rather than FLOPs
+};
+
+const LayerCost layer_costs[] = {
+  {% for node in graph.non_variables -%}
+  { "{{ node.name }}", {{ node.view.cost_as_cpp }} },
+  {% endfor %}
+};
+
+#ifdef RUN_ON_FPGA
+// Quantized convolutions run on the accelerator, one at a time, out of one of
+// the DeviceSlots; the CPU only packs their input and copies out their
+// output, so they neither need the whole pool nor exclude each other.
+constexpr double device_cost(double) { return 0; }
+constexpr bool device_exclusive = false;
+#else
+constexpr double device_cost(double ops) { return ops; }
+constexpr bool device_exclusive = true;
+#endif
+
+// nodes in the order of the sequential schedule, see CodeGenerater.build_task_graph
+const dlk::TaskGraph& task_graph() {
+  static const dlk::TaskGraph graph({
+    {% for node in graph.non_variables -%}
+    {% set task = tasks[loop.index0] -%}
+    {% set ops -%}
+    {% for n in task.cost_nodes %}layer_costs[{{ n }}].ops{{ ' + ' if not loop.last }}{% endfor %}
+    {%- endset -%}
+    {% if task.device -%}
+    { device_cost({{ ops }}), device_exclusive, { {{ task.deps|join(', ') }} } },
+    {% else -%}
+    { {{ ops }}, {{ 'true' if task.exclusive else 'false' }}, { {{ task.deps|join(', ') }} } },
+    {% endif -%}
+    {% endfor %}
+  });
+  return graph;
+}
+
+} // namespace
+{{ '\n' -}}
+/////////////////////////////////////////
 
 Network::Network()
 {}
 
 Network::~Network()
 {
+  const auto dropped = ActivationDump::Flush();
+  if (dropped > 0) {
+    std::cerr << "ActivationDump: " << dropped << " dumps dropped" << std::endl;
+  }
+
   {% for node in graph.non_variables -%}
-  {% if node.available_buffer == '' -%}
+  {% if node.available_buffer == '' and node.aliased_buffer == '' -%}
   {% for out_k in node.output_ops.keys() -%}
   {% if node.output_ops.keys()|length > 1 %}
   delete []{{ node.name + '_' + out_k }}_raw;
@@ -173,56 +174,42 @@ bool Network::init()
 
 #if defined RUN_ON_FPGA
 
-  if(
-    !dma_input_buffer.init(
-        {% if config.cache %}
-          "udmabuf0",
-        {% else %}
-          "mem",
-        {% endif %}
-        max_device_input_elems,
-        sizeof(QUANTIZED_PACKED),
-        {% if config.cache %}
-          true, 0
-        {% else %}
-          false, INPUT_ADDR
-        {% endif %}
-    )
-  )
-  {
-    return false;
-  }
-
-  if(
-    !dma_output_buffer.init(
-        {% if config.cache %}
-          "udmabuf1",
-        {% else %}
-          "mem",
-        {% endif %}
-        max_device_output_elems,
-        sizeof(BIN_CONV_OUTPUT),
-        {% if config.cache %}
-          true, 0
-        {% else %}
-          false, OUTPUT_ADDR
-        {% endif %}
-    )
-  )
-  {
-    return false;
+{% if not config.cache %}
+  const unsigned long input_addr[] = { INPUT0_ADDR, INPUT1_ADDR };
+  const unsigned long output_addr[] = { OUTPUT0_ADDR, OUTPUT1_ADDR };
+{% endif %}
+  for (unsigned slot = 0; slot < DeviceSlots::max_slots; ++slot) {
+    const bool ok =
+    {% if config.cache %}
+      dma_input_buffer[slot].init(dma_memory, max_device_input_elems, sizeof(QUANTIZED_PACKED)) &&
+      dma_output_buffer[slot].init(dma_memory, max_device_output_elems, sizeof(BIN_CONV_OUTPUT));
+    {% else %}
+      dma_input_buffer[slot].init("mem", max_device_input_elems, sizeof(QUANTIZED_PACKED), false, input_addr[slot]) &&
+      dma_output_buffer[slot].init("mem", max_device_output_elems, sizeof(BIN_CONV_OUTPUT), false, output_addr[slot]);
+    {% endif %}
+    if (!ok) {
+      // without a second pair the convolutions simply take turns on the first
+      if (slot > 0) {
+        break;
+      }
+      return false;
+    }
+    device_slots.Add({
+      (QUANTIZED_PACKED*) dma_input_buffer[slot].buffer(),
+      (BIN_CONV_OUTPUT*) dma_output_buffer[slot].buffer(),
+      &dma_input_buffer[slot],
+      &dma_output_buffer[slot]
+    });
   }
 
-  device_input_buf = (QUANTIZED_PACKED*) dma_input_buffer.buffer();
-  device_output_buf = (BIN_CONV_OUTPUT*) dma_output_buffer.buffer();
-
 #else
   device_input_buf = new QUANTIZED_PACKED[max_device_input_elems]();
   device_output_buf = new BIN_CONV_OUTPUT[max_device_output_elems]();
+  device_slots.Add({ device_input_buf, device_output_buf, nullptr, nullptr });
 #endif
 
   {% for node in graph.non_variables -%}
-  {% if node.available_buffer == '' %}
+  {% if node.available_buffer == '' and node.aliased_buffer == '' %}
   {% for out_k in node.output_ops.keys() -%}
   {% if node.output_ops.keys()|length > 1 %}
   {{ node.name + '_' + out_k }}_raw = new {{ node.dtype.cpptype() }}[{{ node.view.size_in_words_as_cpp }}]();
@@ -241,25 +228,41 @@ bool Network::init()
   {{ '\n' -}}
 
 #if defined RUN_ON_FPGA
-  MappedMem kernel_mmap(KERNEL_ADDR, total_kernel_size);
-  auto kernel_buffer = reinterpret_cast<uint8_t*>(kernel_mmap.get());
+  // uploaded only when the board does not hold them yet, see WeightStore
+  const std::vector<de10_nano::WeightStore::Chunk> kernels = {
   {% for qconv in graph.convs(quantized_only=True) -%}
   {%    set kernel = qconv.input_nodes[1] -%}
-  std::memcpy(kernel_buffer + {{qconv.name}}_kernel_offset, {{kernel.name}}.data(), {{qconv.name}}_kernel_size);
+    { {{qconv.name}}_kernel_offset, {{kernel.name}}.data(), {{qconv.name}}_kernel_size },
   {% endfor -%}
-
-  MappedMem thresholds_mmap(THRESHOLD_ADDR, total_thresholds_size);
-  auto thresholds_buffer = reinterpret_cast<uint8_t*>(thresholds_mmap.get());
-  {% for qconv in graph.convs(quantized_only=True) -%}
-      {% if qconv.has_thresholds -%}
-          {% set thresholds = qconv.thresholds -%}
-  std::memcpy(thresholds_buffer + {{qconv.name}}_thresholds_offset, const_cast<T_INT16*>({{qconv.name}}_thresholds), {{qconv.name}}_thresholds_size);
-      {% endif -%}
+  };
+  const std::vector<de10_nano::WeightStore::Chunk> thresholds = {
+  {% for qconv in graph.convs(quantized_only=True) if qconv.has_thresholds -%}
+    { {{qconv.name}}_thresholds_offset, const_cast<T_INT16*>({{qconv.name}}_thresholds), {{qconv.name}}_thresholds_size },
   {% endfor -%}
+  };
+  de10_nano::WeightStore::Placement weights;
+  if (!de10_nano::WeightStore::Place(weights_id, kernels, total_kernel_size, thresholds, total_thresholds_size, weights)) {
+    return false;
+  }
+  kernel_phys_base = weights.kernel_addr;
+  thresholds_phys_base = weights.thresholds_addr;
+{% for chain in conv_chains %}
+  {
+    const std::size_t output_elems[] = { {% for c in chain %}{{ c.height * c.width * ((c.channel + 31) // 32 * 32) }}{{ ', ' if not loop.last }}{% endfor %} };
+    {{ chain[0].name }}_fused = dlk::impl::TCAConv2dChainFits(output_elems, {{ chain|length }}, dma_input_buffer[0], dma_output_buffer[0]);
+  }
+{%- endfor %}
 #endif // RUN_ON_FPGA
 
-#pragma omp parallel
-  std::cout << std::flush;
+{% if config.debug %}
+  // --debug projects dump every node unless DLK_DUMP selects others
+  if (!ActivationDump::IsEnabled()) {
+    ActivationDump::Select("*");
+  }
+{% endif %}
+
+  // start the workers now rather than in the first run
+  dlk::ThreadPool::Size();
 
   return true;
 }
@@ -286,19 +289,19 @@ void Network::get_output_shape(int32_t *shape)
 
 bool Network::run(float *network_input, float *network_output)
 {
-  struct convolution_parameters Conv2D_struct;
-  struct binary_convolution_parameters binConv2D_struct;
-  struct max_pooling_parameters MaxPool_struct;
-  struct avg_pooling_parameters AveragePool_struct;
-  struct MaxPoolWithArgmax_parameters MaxPoolWithArgmax_struct;
-
-  #if defined RUN_ON_FPGA
-  binConv2D_struct.device_input_phys_addr = dma_input_buffer.physical_address();
-  binConv2D_struct.device_output_phys_addr = dma_output_buffer.physical_address();
-
-  binConv2D_struct.dma_input_buffer = &dma_input_buffer;
-  binConv2D_struct.dma_output_buffer = &dma_output_buffer;
-  #endif
+  // copied by every convolution, which may run on another thread
+  // the device buffers come from a DeviceSlots::Lease
+  struct binary_convolution_parameters binConv2D_defaults;
+
+  {% if conv_chains -%}
+  const bool dumped = ActivationDump::BeginRun();
+  const bool checked = DriftMonitor::BeginRun();
+  // fused chains skip the intermediate outputs these look at
+  const bool fuse_convs = QuantizedConv2DChain::IsEnabled() && !dumped && !checked;
+  {%- else -%}
+  ActivationDump::BeginRun();
+  DriftMonitor::BeginRun();
+  {%- endif %}
 
   TensorView<{{ graph_input.dtype.cpptype() }}, MemoryLayout::{{ graph_input.dimension }}>::tensor_info_t<std::size_t> {{ graph_input.name }}_shape = {
     {% for len in graph_input.shape -%}
@@ -309,69 +312,103 @@ bool Network::run(float *network_input, float *network_output)
   {{ '\n' -}}
 
   {% for node in graph.non_variables -%}
-  {% if node.available_buffer == '' %}
+  {% if node.available_buffer == '' and node.aliased_buffer == '' %}
   {% for out_k in node.output_ops.keys() -%}
   {% if node.output_ops.keys()|length > 1 %}
-  TensorView<{{ node.dtype.cpptype() }}, MemoryLayout::{{ node.dimension }}>::tensor_info_t<std::size_t> {{ node.name + '_' + out_k }}_shape = {
-    {% for len in node.shape -%}
-    {{- len -}},
-    {%- endfor %}
-  };
-  TensorView<{{ node.dtype.cpptype() }}, MemoryLayout::{{ node.dimension }}>
-    {{ node.name + '_' + out_k }}({{ node.name + '_' + out_k }}_raw, {{ node.name + '_' + out_k }}_shape);
+  StaticTensorView<{{ node.dtype.cpptype() }}, MemoryLayout::{{ node.dimension }}, {{ node.shape|join(', ') }}>
+    {{ node.name + '_' + out_k }}({{ node.name + '_' + out_k }}_raw);
   {% else %}
-  TensorView<{{ node.dtype.cpptype() }}, MemoryLayout::{{ node.dimension }}>::tensor_info_t<std::size_t> {{ node.name }}_shape = {
-    {% for len in node.shape -%}
-    {{- len -}},
-    {%- endfor %}
-  };
-  TensorView<{{ node.dtype.cpptype() }}, MemoryLayout::{{ node.dimension }}>
-    {{ node.name }}({{ node.name }}_raw, {{ node.name }}_shape);
+  StaticTensorView<{{ node.dtype.cpptype() }}, MemoryLayout::{{ node.dimension }}, {{ node.shape|join(', ') }}>
+    {{ node.name }}({{ node.name }}_raw);
   {% endif %}
   {%- endfor %}
   {% elif node.available_buffer != '' and node.output_ops.keys()|length > 1 %}
   {% for out_k in node.output_ops.keys() -%}
   {% if out_k != node.output_ops.keys()|list|first %}
-  TensorView<{{ node.dtype.cpptype() }}, MemoryLayout::{{ node.dimension }}>::tensor_info_t<std::size_t> {{ node.name + '_' + out_k }}_shape = {
-    {% for len in node.shape -%}
-    {{- len -}},
-    {%- endfor %}
-  };
-  TensorView<{{ node.dtype.cpptype() }}, MemoryLayout::{{ node.dimension }}>
-    {{ node.name + '_' + out_k }}({{ node.name + '_' + out_k }}_raw, {{ node.name + '_' + out_k }}_shape);
+  StaticTensorView<{{ node.dtype.cpptype() }}, MemoryLayout::{{ node.dimension }}, {{ node.shape|join(', ') }}>
+    {{ node.name + '_' + out_k }}({{ node.name + '_' + out_k }}_raw);
   {% endif %}
   {%- endfor %}
   {% endif %}
   {%- endfor %}
   {{ '\n' -}}
 
-  {%- for node in graph.non_variables %}
-  {{ node.view.run() }}
-
-  {% if config.debug -%}
-    {# Temporary: better access to the quantizer #}
-
-    {% if node.dtype.cpptype() in ['int', 'int32_t'] -%}
-      save_int32_data("debug/{{ node.name }}", {{ node.view.size_in_words_as_cpp }}, 0, {{ node.name }}.data(), 3.0 / 2.0 );
-    {% elif node.dtype.cpptype() in ['unsigned', 'uint32_t'] -%}
-      save_uint32_data("debug/{{ node.name }}", {{ node.view.size_in_words_as_cpp }}, 0, {{ node.name }}.data(), 1.0);
-    {% elif node.dtype.cpptype() == 'QUANTIZED_PACKED' -%}
-      save_uint32_data("debug/{{ node.name }}", {{ node.view.size_in_words_as_cpp }}, 0, reinterpret_cast<uint32_t*>({{ node.name }}.data()), 1.0);
-    {% elif node.dtype.cpptype() == 'float' -%}
-      {% if node.output_ops.keys()|length > 1 %}
-        {% for k in node.output_ops.keys() -%}
-          save_float32_data("debug/{{ node.name }}", {{ node.view.size_in_words_as_cpp }}, {{ loop.index0 }}, {{ node.name }}[{{ loop.index0 }}].data(), 1.0);
-          {{ '\n' -}}
-        {%- endfor %}
-      {% else %}
-        save_float32_data("debug/{{ node.name }}", {{ node.view.size_in_words_as_cpp }}, 0, {{ node.name }}.data(), 1.0);
-      {% endif %}
-    {% endif %}
+  {% for node in graph.non_variables -%}
+  {% if node.aliased_buffer != '' %}
+  TensorView<{{ node.dtype.cpptype() }}, MemoryLayout::{{ node.dimension }}>
+    {{ node.name }} = channel_high_slice({{ node.aliased_buffer }}, {{ node.aliased_offset }}, {{ node.shape[0] }});
   {% endif %}
+  {%- endfor %}
+  {{ '\n' -}}
 
-  {% endfor -%}
+  {% for node in graph.non_variables -%}
+  {% if node.view.declaration != '' %}
+  {{ node.view.declaration }}
+  {% endif %}
+  {%- endfor %}
+
+  const auto run_node = [&](unsigned index) {
+    switch (index) {
+    {%- for node in graph.non_variables %}
+    case {{ loop.index0 }}: {
+      {%- if node.view.parameters_declaration != '' %}
+      {{ node.view.parameters_declaration|indent(6) }}
+      {%- endif %}
+      static const auto region = Measurement::Intern("{{ node.name }}");
+      Measurement::Start(region);
+      {{ node.view.run()|indent(6) }}
+      Measurement::Stop();
+
+      if (ActivationDump::Wants({{ loop.index0 }}, "{{ node.name }}")) {
+        {%- if node.output_ops.keys()|length > 1 %}
+        {%- for out_k in node.output_ops.keys() %}
+        ActivationDump::Dump("{{ node.name }}", {{ loop.index0 }}, {{ node.name + '_' + out_k }});
+        {%- endfor %}
+        {%- else %}
+        ActivationDump::Dump("{{ node.name }}", 0, {{ node.name }});
+        {%- endif %}
+      }
+      break;
+    }
+    {%- endfor %}
+    }
+  };
+  task_graph().Run(run_node);
 
   std::copy({{ graph_output.name }}.data(), {{ graph_output.name }}.data() + {{ graph_output.view.size_in_words_as_cpp }}, network_output);
 
   return true;
 }
+
+void Network::roofline_report(double peak_gflops, double peak_gbps, double peak_gbops) const
+{
+  // a layer further than this below its roofline is flagged
+  constexpr double flag_ratio = 0.2;
+  const double to_seconds = static_cast<double>(TIME_ORDER::period::num) / TIME_ORDER::period::den;
+
+  std::printf("%-40s %4s %14s %14s %8s %12s %10s %10s %8s\n",
+      "layer", "kind", "ops", "bytes", "ops/B", "median[s]", "GOPS", "GB/s", "roofline");
+  for (const auto& layer : layer_costs) {
+    auto durations = Measurement::Durations(layer.name);
+    if (durations.empty()) {
+      continue;
+    }
+    std::nth_element(durations.begin(), durations.begin() + durations.size() / 2, durations.end());
+    const double seconds = durations[durations.size() / 2] * to_seconds;
+    if (seconds <= 0) {
+      continue;
+    }
+
+    const double gops = layer.ops / seconds * 1e-9;
+    const double gbps = layer.bytes / seconds * 1e-9;
+    const double intensity = layer.ops / layer.bytes;
+    const double peak_compute = layer.binary ? peak_gbops : peak_gflops;
+    std::printf("%-40s %4s %14.0f %14.0f %8.2f %12.6f %10.3f %10.3f",
+        layer.name, layer.binary ? "bop" : "flop", layer.ops, layer.bytes, intensity, seconds, gops, gbps);
+    if (peak_compute > 0 && peak_gbps > 0) {
+      const double roof = std::min(peak_compute, intensity * peak_gbps);
+      std::printf(" %7.1f%%%s", 100 * gops / roof, gops < flag_ratio * roof ? "  <<" : "");
+    }
+    std::printf("\n");
+  }
+}
@@ -14,6 +14,12 @@ limitations under the License.
 ==============================================================================*/
 
 #include "network.h"
+#include "activation_dump.h"
+#include "drift_monitor.h"
+#include "func/quantized_conv2d.h"
+#include "task_graph.h"
+#include "tca_wait.h"
+#include "thread_pool.h"
 
 
 extern "C" __attribute__ ((visibility ("default"))) Network* network_create()
@@ -56,3 +62,48 @@ extern "C" __attribute__ ((visibility ("default"))) void network_run(Network *nn
 {
   nn->run(input, output);
 }
+
+extern "C" __attribute__ ((visibility ("default"))) void network_dump_activations(const char *nodes, unsigned every, const char *dir)
+{
+  ActivationDump::SetEvery(every);
+  if (dir != nullptr)
+    ActivationDump::SetDirectory(dir);
+  ActivationDump::Select(nodes != nullptr ? nodes : "");
+}
+
+extern "C" __attribute__ ((visibility ("default"))) size_t network_flush_activations()
+{
+  return ActivationDump::Flush();
+}
+
+extern "C" __attribute__ ((visibility ("default"))) void network_set_drift_monitor(unsigned every)
+{
+  DriftMonitor::SetEvery(every);
+}
+
+extern "C" __attribute__ ((visibility ("default"))) bool network_write_drift_summary(const char *path)
+{
+  return DriftMonitor::WriteSummary(path);
+}
+
+// Pins the calling thread to the first of the CPUs; call it from the
+// thread that runs the network.
+extern "C" __attribute__ ((visibility ("default"))) bool network_set_threads(unsigned n, unsigned long long cpu_mask)
+{
+  return dlk::ThreadPool::Configure(n, cpu_mask);
+}
+
+extern "C" __attribute__ ((visibility ("default"))) void network_set_parallel_branches(bool on)
+{
+  dlk::TaskGraph::SetEnabled(on);
+}
+
+extern "C" __attribute__ ((visibility ("default"))) void network_set_conv_fusion(bool on)
+{
+  QuantizedConv2DChain::SetEnabled(on);
+}
+
+extern "C" __attribute__ ((visibility ("default"))) bool network_set_tca_wait(const char *policy)
+{
+  return de10_nano::Completion::SetPolicy(policy);
+}
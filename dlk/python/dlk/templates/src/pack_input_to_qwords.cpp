@@ -16,6 +16,7 @@ limitations under the License.
 #include "global.h"
 #include "pack_input_to_qwords.h"
 #include "operators.h" // FIXME(nikolay): for convolution_parameters definition, rid of it later
+#include "thread_pool.h"
 #include "time_measurement.h"
 #ifdef USE_NEON
 #include <arm_neon.h>
@@ -27,7 +28,8 @@ limitations under the License.
 int pack_input(QUANTIZED_NOT_PACKED input[], size_t input_height, size_t input_width, size_t input_depth,
   size_t bits_per_input, QUANTIZED_PACKED output[]) {
 
-  Measurement::Start("pack_input");
+  static const auto region = Measurement::Intern("pack_input");
+  Measurement::Start(region);
   const int bits_per_word = sizeof(QUANTIZED_PACKED) * CHAR_BIT;
   int full_words_in_depth = input_depth / bits_per_word;
   int remainder_bits_in_depth = input_depth % bits_per_word;
@@ -46,8 +48,7 @@ int pack_input(QUANTIZED_NOT_PACKED input[], size_t input_height, size_t input_w
     constexpr int b = 32;
     constexpr int n_bits = 2;
     const auto blocks = len / b;
-#pragma omp parallel for
-    for (int i = 0; i < blocks; ++i) {
+    dlk::parallel_for<int>(0, blocks, [&](int i) {
       const auto v0 = vld1q_u8(input + i * b +  0);
       const auto v1 = vld1q_u8(input + i * b + 16);
       const auto l0 = vandq_u8(v0, vone);
@@ -66,7 +67,7 @@ int pack_input(QUANTIZED_NOT_PACKED input[], size_t input_height, size_t input_w
       const auto bm = vpadd_u8(am0, am1);
       const auto c = vpadd_u8(bl, bm);
       vst1_u8(reinterpret_cast<uint8_t*>(output + i * n_bits), c);
-    }
+    });
     Measurement::Stop();
     return 0;
   }
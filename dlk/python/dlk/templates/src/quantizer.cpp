@@ -27,13 +27,11 @@ limitations under the License.
 
 #include "quantizer.h"
 #include "pack_input_to_qwords.h"
+#include "thread_pool.h"
 #include "time_measurement.h"
 #ifdef USE_NEON
   #include <arm_neon.h>
 #endif
-#ifdef _OPENMP
-  #include <omp.h>
-#endif
 #ifdef USE_AVX
   #include <x86intrin.h>
 #endif
@@ -158,22 +156,14 @@ void func_QTZ_linear_mid_tread_half(
     const TensorView<T_INT, MemoryLayout::Atom>& nbit,
     const TensorView<T_FLOAT, MemoryLayout::Atom>& max_value,
     const TensorView<QUANTIZED_PACKED, MemoryLayout::HWChBCl>& output) {
-  Measurement::Start("QTZ_linear_mid_tread_half");
+  static const auto region = Measurement::Intern("QTZ_linear_mid_tread_half");
+  Measurement::Start(region);
 
   unsigned num_elems = input.size();
 
-#ifdef _OPENMP
-  const unsigned threads = omp_get_max_threads();
-#else
-  const unsigned threads = 1;
-#endif
-  unsigned int chunk_size = (num_elems + threads - 1) / threads;
-
-#pragma omp parallel for
-  for (unsigned int i = 0; i < num_elems; i += chunk_size) {
-    func_QTZ_linear_mid_tread_half_body(input.data(), nbit(), max_value(), output_not_packed.get(), i,
-                                              std::min(i + chunk_size, static_cast<unsigned int>(num_elems)));
-  }
+  dlk::parallel_for_range(0u, num_elems, [&](unsigned int begin, unsigned int end) {
+    func_QTZ_linear_mid_tread_half_body(input.data(), nbit(), max_value(), output_not_packed.get(), begin, end);
+  });
 
   const auto in_shape = input.get_shape();
   const auto in_height = in_shape[1];
@@ -189,7 +179,8 @@ void func_QTZ_linear_mid_tread_half(
   const TensorView<T_INT, MemoryLayout::Atom>& nbit,
   const TensorView<T_FLOAT, MemoryLayout::Atom>& max_value,
   const TensorView<T_FLOAT, MemoryLayout::NHWC>& output) {
-  Measurement::Start("func_QTZ_linear_mid_tread_half");
+  static const auto region = Measurement::Intern("func_QTZ_linear_mid_tread_half");
+  Measurement::Start(region);
 
   T_FLOAT min_value = 0.f;
   T_FLOAT n = (1 << nbit()) - 1.f;
@@ -205,9 +196,7 @@ void func_QTZ_linear_mid_tread_half(
   const auto min_value_v = vdupq_n_f32(min_value);
   const auto coeff_v = vdupq_n_f32(coeff);
   const auto inv_coeff_v = vdupq_n_f32(inv_coeff);
-#pragma omp parallel for
-  for (unsigned i = 0; i < num_elems_floor; i += SIMD_WIDTH)
-  {
+  dlk::parallel_for<unsigned>(0, num_elems_floor, SIMD_WIDTH, [&](unsigned i) {
     const auto in = vld1q_f32(input.data() + i);
     const auto lbounded = vmaxq_f32(in, min_value_v);
     const auto ubounded = vminq_f32(lbounded, max_value_v);
@@ -221,7 +210,7 @@ void func_QTZ_linear_mid_tread_half(
 #endif
     const auto result = vmulq_f32(rounded, inv_coeff_v);
     vst1q_f32(output.data() + i, result);
-  }
+  });
   i = num_elems_floor;
 #elif defined USE_AVX
   constexpr std::size_t SIMD_WIDTH = 8;
@@ -230,9 +219,7 @@ void func_QTZ_linear_mid_tread_half(
   const auto min_value_v = _mm256_set1_ps(min_value);
   const auto coeff_v = _mm256_set1_ps(coeff);
   const auto inv_coeff_v = _mm256_set1_ps(inv_coeff);
-#pragma omp parallel for
-  for (unsigned i = 0; i < num_elems_floor; i += SIMD_WIDTH)
-  {
+  dlk::parallel_for<unsigned>(0, num_elems_floor, SIMD_WIDTH, [&](unsigned i) {
     const auto in = _mm256_loadu_ps(input.data() + i);
     const auto lbounded = _mm256_max_ps(in, min_value_v);
     const auto ubounded = _mm256_min_ps(lbounded, max_value_v);
@@ -240,7 +227,7 @@ void func_QTZ_linear_mid_tread_half(
     const auto rounded = _mm256_round_ps(normed, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
     const auto result = _mm256_mul_ps(rounded, inv_coeff_v);
     _mm256_storeu_ps(output.data() + i, result);
-  }
+  });
   i = num_elems_floor;
 #endif
   for (; i < num_elems; i++)
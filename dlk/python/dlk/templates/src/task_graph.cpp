@@ -0,0 +1,216 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include "task_graph.h"
+#include "thread_pool.h"
+
+namespace {
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  asm volatile("yield");
+#endif
+}
+
+bool env_enabled() {
+  const char* value = std::getenv("DLK_GRAPH_PARALLEL");
+  return value == nullptr || std::atoi(value) != 0;
+}
+
+struct Queue {
+  std::mutex mutex;
+  std::deque<unsigned> nodes;
+};
+
+// State of one TaskGraph::Run.
+class Schedule {
+ public:
+  using node_fn = void (*)(void* ctx, unsigned node);
+
+  Schedule(const std::vector<dlk::TaskGraph::Node>& nodes,
+      const std::vector<std::vector<unsigned>>& successors,
+      unsigned threads, node_fn fn, void* ctx)
+    : nodes(nodes), successors(successors),
+      waiting(new std::atomic<unsigned>[nodes.size()]), queues(threads),
+      fn(fn), ctx(ctx) {
+    for (unsigned i = 0; i < nodes.size(); ++i) {
+      waiting[i].store(nodes[i].deps.size(), std::memory_order_relaxed);
+    }
+    for (unsigned i = 0; i < nodes.size(); ++i) {
+      if (nodes[i].deps.empty()) {
+        ready(i, 0);
+      }
+    }
+  }
+
+  void run() {
+    while (true) {
+      if (outstanding.load(std::memory_order_acquire) > 0) {
+        dlk::ThreadPool::Run(queues.size(), [this](std::size_t, std::size_t) { participate(); });
+        continue;
+      }
+      unsigned node;
+      {
+        std::lock_guard<std::mutex> lock(wide_mutex);
+        if (wide.empty()) {
+          return;
+        }
+        // the earliest first, to stay close to the sequential order
+        const auto first = std::min_element(wide.begin(), wide.end());
+        node = *first;
+        wide.erase(first);
+      }
+      fn(ctx, node);
+      finish(node, 0);
+    }
+  }
+
+ private:
+  const std::vector<dlk::TaskGraph::Node>& nodes;
+  const std::vector<std::vector<unsigned>>& successors;
+  std::unique_ptr<std::atomic<unsigned>[]> waiting; // unfinished dependencies
+
+  std::mutex wide_mutex;
+  std::vector<unsigned> wide; // ready nodes that get the whole pool
+
+  std::vector<Queue> queues; // ready narrow nodes, one queue per thread
+  Queue exclusive_queue;
+  std::atomic<unsigned> exclusive_ready{0};
+  std::atomic<bool> exclusive_busy{false};
+  std::atomic<unsigned> outstanding{0}; // narrow nodes ready or running
+
+  const node_fn fn;
+  void* const ctx;
+
+  bool narrow(unsigned node) const {
+    return nodes[node].cost < dlk::TaskGraph::wide_cost;
+  }
+
+  void ready(unsigned node, unsigned thread) {
+    if (!narrow(node)) {
+      std::lock_guard<std::mutex> lock(wide_mutex);
+      wide.push_back(node);
+      return;
+    }
+    outstanding.fetch_add(1, std::memory_order_relaxed);
+    auto& queue = nodes[node].exclusive ? exclusive_queue : queues[thread];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.nodes.push_back(node);
+    if (nodes[node].exclusive) {
+      exclusive_ready.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void finish(unsigned node, unsigned thread) {
+    for (const auto next : successors[node]) {
+      if (waiting[next].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        ready(next, thread);
+      }
+    }
+  }
+
+  static bool take(Queue& queue, bool newest, unsigned& node) {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.nodes.empty()) {
+      return false;
+    }
+    if (newest) {
+      node = queue.nodes.back();
+      queue.nodes.pop_back();
+    } else {
+      node = queue.nodes.front();
+      queue.nodes.pop_front();
+    }
+    return true;
+  }
+
+  bool pop(unsigned thread, unsigned& node) {
+    if (exclusive_ready.load(std::memory_order_relaxed) > 0
+        && !exclusive_busy.exchange(true, std::memory_order_acquire)) {
+      if (take(exclusive_queue, false, node)) {
+        exclusive_ready.fetch_sub(1, std::memory_order_relaxed);
+        return true; // keeps exclusive_busy until it is done
+      }
+      exclusive_busy.store(false, std::memory_order_release);
+    }
+    // own work newest first, stolen work oldest first
+    if (take(queues[thread], true, node)) {
+      return true;
+    }
+    for (std::size_t k = 1; k < queues.size(); ++k) {
+      if (take(queues[(thread + k) % queues.size()], false, node)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void participate() {
+    const unsigned thread = dlk::ThreadPool::ThreadIndex() % queues.size();
+    while (outstanding.load(std::memory_order_acquire) > 0) {
+      unsigned node;
+      if (!pop(thread, node)) {
+        cpu_relax();
+        continue;
+      }
+      fn(ctx, node);
+      if (nodes[node].exclusive) {
+        exclusive_busy.store(false, std::memory_order_release);
+      }
+      finish(node, thread);
+      outstanding.fetch_sub(1, std::memory_order_acq_rel);
+    }
+  }
+};
+
+} // namespace
+
+namespace dlk {
+
+std::atomic<bool> TaskGraph::enabled(env_enabled());
+
+TaskGraph::TaskGraph(std::vector<Node> nodes)
+  : nodes(std::move(nodes)), successors(this->nodes.size()), chain(true) {
+  for (unsigned i = 0; i < this->nodes.size(); ++i) {
+    const auto& deps = this->nodes[i].deps;
+    for (const auto dep : deps) {
+      successors[dep].push_back(i);
+    }
+    if (i > 0 && std::find(deps.begin(), deps.end(), i - 1) == deps.end()) {
+      chain = false;
+    }
+  }
+}
+
+void TaskGraph::Execute(node_fn fn, void* ctx) const {
+  const unsigned threads = ThreadPool::Size();
+  if (!IsEnabled() || chain || threads == 1) {
+    for (unsigned i = 0; i < nodes.size(); ++i) {
+      fn(ctx, i);
+    }
+    return;
+  }
+  Schedule(nodes, successors, threads, fn, ctx).run();
+}
+
+} // namespace dlk
@@ -0,0 +1,381 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "de10_nano.h"
+#include "tca_emulator.h"
+
+namespace {
+
+using de10_nano::Csr;
+
+constexpr unsigned csr_count = static_cast<unsigned>(Csr::statusRegister) + 1;
+constexpr uint32_t status_done = 127;
+constexpr uint32_t b = 32;
+
+// the reserved DDR range (INPUT_ADDR .. THRESHOLD_ADDR) and, above it, the
+// ranges handed out by Allocate
+constexpr unsigned long ddr_base = HW_BUFFERS_PHYS_ADDR_BASE;
+constexpr unsigned long ddr_size = 0x40000000;
+constexpr unsigned long allocate_base = 0x40000000;
+constexpr unsigned long csr_size = 0x1000;
+
+inline int pop_count(uint32_t x) {
+  return __builtin_popcount(x);
+}
+
+struct Job {
+  uint32_t r[csr_count];
+  uint32_t operator[](Csr c) const { return r[static_cast<unsigned>(c)]; }
+};
+
+class Emulator {
+ public:
+  Emulator() {
+    void* p = mmap(nullptr, ddr_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+      throw std::runtime_error("TCA emulator: cannot reserve the emulated DDR");
+    }
+    ddr = static_cast<uint8_t*>(p);
+    csr[static_cast<unsigned>(Csr::statusRegister)] = status_done;
+    const char* gops_env = std::getenv("DLK_TCA_EMULATOR_GOPS");
+    if (gops_env != nullptr) {
+      gops = std::atof(gops_env);
+    }
+    std::thread([this] { worker(); }).detach();
+  }
+
+  void* map(unsigned long phys, std::size_t size) {
+    if (phys >= HPS_TO_FPGA_LW_BASE && phys + size <= HPS_TO_FPGA_LW_BASE + csr_size) {
+      return const_cast<uint8_t*>(reinterpret_cast<volatile uint8_t*>(csr)) + (phys - HPS_TO_FPGA_LW_BASE);
+    }
+    void* p = translate(phys, size);
+    if (p == nullptr) {
+      throw std::out_of_range("TCA emulator: no emulated memory at this address");
+    }
+    return p;
+  }
+
+  unsigned long allocate(std::size_t size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const unsigned long phys = next_free;
+    next_free += (size + 0xFFF) & ~0xFFFul;
+    if (next_free > ddr_base + ddr_size) {
+      throw std::out_of_range("TCA emulator: emulated DDR exhausted");
+    }
+    return phys;
+  }
+
+  void start(volatile uint32_t* regs) {
+    Job job;
+    for (unsigned i = 0; i < csr_count; ++i) {
+      job.r[i] = regs[i];
+    }
+    // busy from now on, as the hardware is
+    regs[static_cast<unsigned>(Csr::start)] = 0;
+    regs[static_cast<unsigned>(Csr::statusRegister)] = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      queue.push_back({job, regs});
+    }
+    queued.notify_one();
+  }
+
+  int interrupt_fd() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (irq[0] < 0) {
+      if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, irq) != 0) {
+        throw std::runtime_error("TCA emulator: cannot create the interrupt socket");
+      }
+      fcntl(irq[1], F_SETFL, O_NONBLOCK);
+    }
+    return irq[0];
+  }
+
+  std::atomic<std::size_t> jobs{0};
+  std::atomic<std::size_t> errors{0};
+
+ private:
+  uint8_t* ddr;
+  volatile uint32_t csr[csr_size / sizeof(uint32_t)] = {};
+  double gops = 0;
+
+  std::mutex mutex;
+  std::condition_variable queued;
+  std::deque<std::pair<Job, volatile uint32_t*>> queue;
+  unsigned long next_free = allocate_base;
+
+  // the driver's end and ours of the interrupt socket, and its state
+  int irq[2] = {-1, -1};
+  bool irq_unmasked = false;
+  uint32_t irq_events = 0;
+
+  void* translate(unsigned long phys, std::size_t size) const {
+    if (phys < ddr_base || phys + size > ddr_base + ddr_size) {
+      return nullptr;
+    }
+    return ddr + (phys - ddr_base);
+  }
+
+  void worker() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      queued.wait(lock, [this] { return !queue.empty(); });
+      const auto job = queue.front();
+      queue.pop_front();
+      lock.unlock();
+
+      const auto begin = std::chrono::steady_clock::now();
+      const double ops = run(job.first);
+      if (gops > 0) {
+        std::this_thread::sleep_until(begin + std::chrono::duration<double>(ops / (gops * 1e9)));
+      }
+      ++jobs;
+      // the output is visible before the status says so
+      std::atomic_thread_fence(std::memory_order_release);
+      job.second[static_cast<unsigned>(Csr::statusRegister)] = status_done;
+
+      lock.lock();
+      interrupt();
+    }
+  }
+
+  // Raises the interrupt if it is unmasked; called with the mutex held.
+  void interrupt() {
+    if (irq[1] < 0) {
+      return;
+    }
+    uint32_t word;
+    while (read(irq[1], &word, sizeof(word)) == sizeof(word)) {
+      irq_unmasked = word != 0;
+    }
+    if (irq_unmasked) {
+      ++irq_events;
+      irq_unmasked = false;
+      if (write(irq[1], &irq_events, sizeof(irq_events)) != sizeof(irq_events)) {
+        reject("interrupt lost");
+      }
+    }
+  }
+
+  void reject(const char* reason) {
+    std::cerr << "TCA emulator: " << reason << std::endl;
+    ++errors;
+  }
+
+  // Runs the job and returns its operations (two per multiply-accumulate).
+  double run(const Job& r) {
+    const uint32_t kh = r[Csr::a2fKernelVCount];
+    const uint32_t kw = r[Csr::a2fKernelHCount];
+    const uint32_t h_count = r[Csr::admaInputHCount];
+    const uint32_t w_count = r[Csr::admaInputWCount];
+    const uint32_t in_blocks = r[Csr::admaInputCCount];
+    const uint32_t out_blocks = r[Csr::fdmaOutputCCount];
+    if (kh == 0 || kw == 0 || h_count == 0 || w_count == 0 || in_blocks == 0 || out_blocks == 0
+        || r[Csr::admaMiddleTileW] == 0 || r[Csr::a2fTileStep] != 1
+        || h_count != r[Csr::fdmaOutputHCount] || w_count != r[Csr::fdmaOutputWCount]
+        || h_count != r[Csr::a2fOutputHCount] || w_count != r[Csr::a2fOutputWCount]
+        || in_blocks != r[Csr::a2fInputCCount]) {
+      reject("inconsistent tile counts");
+      return 0;
+    }
+    const uint32_t pad = r[Csr::admaTopBottomMiddlePad] / r[Csr::admaMiddleTileW];
+    const uint32_t dep_h = kh - 1;
+    const uint32_t dep_w = kw - 1;
+
+    // ADMA: where each input tile starts and how many real rows / columns
+    // it reads; the outer tiles get pad zeros on their outer sides
+    const auto tile_rows = [&](uint32_t th) {
+      return th == 0 ? r[Csr::admaTopTileH]
+          : th == h_count - 1 ? r[Csr::admaBottomTileH] : r[Csr::admaMiddleTileH];
+    };
+    const auto tile_row_begin = [&](uint32_t th) {
+      return th == 0 ? 0 : (r[Csr::admaTopTileH] - dep_h) + (th - 1) * (r[Csr::admaMiddleTileH] - dep_h);
+    };
+    const auto tile_cols = [&](uint32_t tw) {
+      return tw == 0 ? r[Csr::admaLeftTileW]
+          : tw == w_count - 1 ? r[Csr::admaRightTileW] : r[Csr::admaMiddleTileW];
+    };
+    const auto tile_col_begin = [&](uint32_t tw) {
+      return tw == 0 ? 0 : r[Csr::admaLeftStep] + (tw - 1) * r[Csr::admaMiddleStep];
+    };
+    const uint32_t in_h = tile_row_begin(h_count - 1) + tile_rows(h_count - 1);
+    const uint32_t in_w = tile_col_begin(w_count - 1) + tile_cols(w_count - 1);
+
+    // FDMA: output tiles
+    const uint32_t out_h = (h_count - 1) * r[Csr::fdmaRegularTileH] + r[Csr::fdmaLastTileH];
+    const uint32_t out_w = (w_count - 1) * r[Csr::fdmaRegularTileW] + r[Csr::fdmaLastTileW];
+    if (in_h * in_w != r[Csr::admaInputSpace] || out_h * out_w != r[Csr::fdmaOutputSpace]) {
+      reject("tiles do not cover the input or output");
+      return 0;
+    }
+    if (r[Csr::wdmaKernelBlockCount] != out_blocks * in_blocks * kh * kw) {
+      reject("kernel block count does not match the shape");
+      return 0;
+    }
+
+    const bool bnq = r[Csr::bnqEnable] != 0;
+    const std::size_t input_words = std::size_t(in_blocks) * in_h * in_w * 2;
+    const std::size_t kernel_words = std::size_t(out_blocks) * in_blocks * kh * kw * b;
+    const std::size_t output_bytes = std::size_t(out_blocks) * out_h * out_w * (bnq ? 2 * 4 : b * 2);
+    const auto* input = static_cast<const uint32_t*>(translate(r[Csr::admaInputAddress], input_words * 4));
+    const auto* kernel = static_cast<const uint32_t*>(translate(r[Csr::wdmaStartAddress], kernel_words * 4));
+    void* output = translate(r[Csr::fdmaOutputAddress], output_bytes);
+    const auto* thresholds = bnq
+        ? static_cast<const int16_t*>(translate(r[Csr::qdmaStartAddress], out_blocks * b * NUM_OF_A2W1_THRESHOLD * 2))
+        : nullptr;
+    if (input == nullptr || kernel == nullptr || output == nullptr || (bnq && thresholds == nullptr)) {
+      reject("address outside the emulated memory");
+      return 0;
+    }
+
+    std::vector<int32_t> acc(b);
+    for (uint32_t th = 0; th < h_count; ++th) {
+      const uint32_t pad_top = th == 0 ? pad : 0;
+      const uint32_t rows = pad_top + tile_rows(th) + (th == h_count - 1 ? pad : 0);
+      const uint32_t out_rows = th == h_count - 1 ? r[Csr::a2fLastTileH] : r[Csr::a2fRegularTileH];
+      const uint32_t out_row0 = th * r[Csr::fdmaRegularTileH];
+      for (uint32_t tw = 0; tw < w_count; ++tw) {
+        const uint32_t pad_left = tw == 0 ? pad : 0;
+        const uint32_t cols = pad_left + tile_cols(tw) + (tw == w_count - 1 ? pad : 0);
+        const uint32_t out_cols = tw == w_count - 1 ? r[Csr::a2fLastTileW] : r[Csr::a2fRegularTileW];
+        const uint32_t out_col0 = tw * r[Csr::fdmaRegularTileW];
+        if (out_rows + dep_h > rows || out_cols + dep_w > cols
+            || out_row0 + out_rows > out_h || out_col0 + out_cols > out_w) {
+          reject("A2F tile does not fit its input or output tile");
+          return 0;
+        }
+
+        for (uint32_t y = 0; y < out_rows; ++y) {
+          for (uint32_t x = 0; x < out_cols; ++x) {
+            for (uint32_t ob = 0; ob < out_blocks; ++ob) {
+              std::fill(acc.begin(), acc.end(), 0);
+              for (uint32_t ky = 0; ky < kh; ++ky) {
+                const uint32_t ty = y + ky;
+                if (ty < pad_top || ty >= pad_top + tile_rows(th)) {
+                  continue; // zero rows add nothing
+                }
+                const uint32_t in_row = tile_row_begin(th) + ty - pad_top;
+                for (uint32_t kx = 0; kx < kw; ++kx) {
+                  const uint32_t tx = x + kx;
+                  if (tx < pad_left || tx >= pad_left + tile_cols(tw)) {
+                    continue;
+                  }
+                  const uint32_t in_col = tile_col_begin(tw) + tx - pad_left;
+                  for (uint32_t ib = 0; ib < in_blocks; ++ib) {
+                    const uint32_t* in = input + ((std::size_t(ib) * in_h + in_row) * in_w + in_col) * 2;
+                    const uint32_t* k = kernel + (((std::size_t(ob) * in_blocks + ib) * kh + ky) * kw + kx) * b;
+                    for (uint32_t o = 0; o < b; ++o) {
+                      // the kernel bits are inverted, see the TCA layout in the optimizer
+                      acc[o] += pop_count(k[o] ^ in[0]) + 2 * pop_count(k[o] ^ in[1]) - 3 * pop_count(k[o]);
+                    }
+                  }
+                }
+              }
+
+              const std::size_t element = (std::size_t(ob) * out_h + out_row0 + y) * out_w + out_col0 + x;
+              if (bnq) {
+                uint32_t lsb = 0;
+                uint32_t msb = 0;
+                for (uint32_t o = 0; o < b; ++o) {
+                  const uint32_t v = quantize(acc[o], thresholds + (ob * b + o) * NUM_OF_A2W1_THRESHOLD);
+                  lsb |= (v & 1) << o;
+                  msb |= (v >> 1) << o;
+                }
+                static_cast<uint32_t*>(output)[element * 2] = lsb;
+                static_cast<uint32_t*>(output)[element * 2 + 1] = msb;
+              } else {
+                for (uint32_t o = 0; o < b; ++o) {
+                  static_cast<int16_t*>(output)[element * b + o] = static_cast<int16_t>(acc[o]);
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+    return 2.0 * out_h * out_w * out_blocks * b * kh * kw * in_blocks * b;
+  }
+
+  // as ApplyThresholds
+  static uint32_t quantize(int32_t d, const int16_t* t) {
+    const int32_t flag = t[3];
+    if (flag == 1) {
+      return d < t[0] ? 0 : d < t[1] ? 1 : d < t[2] ? 2 : 3;
+    } else if (flag == -1) {
+      return d > t[2] ? 0 : d > t[1] ? 1 : d > t[0] ? 2 : 3;
+    } else if (flag == 0) {
+      return 0;
+    }
+    return (flag - 2) & 3;
+  }
+};
+
+// Never destroyed: the worker may still be running during exit.
+Emulator& instance() {
+  static Emulator* e = new Emulator();
+  return *e;
+}
+
+} // namespace
+
+namespace de10_nano {
+
+namespace emulator {
+
+void* Map(unsigned long phys, std::size_t size) {
+  return instance().map(phys, size);
+}
+
+unsigned long Allocate(std::size_t size) {
+  return instance().allocate(size);
+}
+
+void Start(volatile uint32_t* csr) {
+  instance().start(csr);
+}
+
+int InterruptFd() {
+  return instance().interrupt_fd();
+}
+
+std::size_t Jobs() {
+  return instance().jobs.load();
+}
+
+std::size_t Errors() {
+  return instance().errors.load();
+}
+
+} // namespace emulator
+
+} // namespace de10_nano
@@ -0,0 +1,175 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include "tca_wait.h"
+#ifdef TCA_EMULATOR
+#include "tca_emulator.h"
+#endif
+
+namespace {
+
+using de10_nano::WaitPolicy;
+
+constexpr uint32_t status_done = 127;
+
+// poll: reads before the first sleep, and the range of the sleeps
+constexpr unsigned poll_spins = 64;
+constexpr auto min_sleep = std::chrono::microseconds(10);
+constexpr auto max_sleep = std::chrono::microseconds(200);
+
+// interrupt: how long to sleep before looking at the status register
+// again, in case an interrupt went missing
+constexpr int interrupt_timeout_ms = 10;
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  asm volatile("yield");
+#endif
+}
+
+bool parse(const char* name, WaitPolicy& policy) {
+  if (std::strcmp(name, "spin") == 0) {
+    policy = WaitPolicy::spin;
+  } else if (std::strcmp(name, "poll") == 0) {
+    policy = WaitPolicy::poll;
+  } else if (std::strcmp(name, "interrupt") == 0) {
+    policy = WaitPolicy::interrupt;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+WaitPolicy env_policy() {
+  WaitPolicy policy = WaitPolicy::poll;
+  const char* value = std::getenv("DLK_TCA_WAIT");
+  if (value != nullptr && !parse(value, policy)) {
+    std::cerr << "DLK_TCA_WAIT: unknown policy " << value << ", polling" << std::endl;
+  }
+  return policy;
+}
+
+int open_uio() {
+#ifdef TCA_EMULATOR
+  return de10_nano::emulator::InterruptFd();
+#else
+  const char* path = std::getenv("DLK_TCA_UIO");
+  if (path == nullptr) {
+    path = "/dev/uio0";
+  }
+  const int fd = open(path, O_RDWR | O_CLOEXEC);
+  if (fd < 0) {
+    std::cerr << "TCA: cannot open " << path << " (" << std::strerror(errno) << "), polling instead" << std::endl;
+  }
+  return fd;
+#endif
+}
+
+// The UIO device, opened on first use; -1 when there is none.
+int uio_fd() {
+  static const int fd = open_uio();
+  return fd;
+}
+
+void wait_spin(volatile uint32_t* status) {
+  while (*status != status_done) {
+    cpu_relax();
+  }
+}
+
+void wait_poll(volatile uint32_t* status) {
+  auto sleep = min_sleep;
+  for (unsigned spins = 0; *status != status_done; ++spins) {
+    if (spins < poll_spins) {
+      cpu_relax();
+    } else {
+      std::this_thread::sleep_for(sleep);
+      sleep = std::min(sleep * 2, max_sleep);
+    }
+  }
+}
+
+void wait_interrupt(volatile uint32_t* status, int fd) {
+  while (*status != status_done) {
+    pollfd p = {fd, POLLIN, 0};
+    if (poll(&p, 1, interrupt_timeout_ms) > 0 && (p.revents & POLLIN)) {
+      uint32_t count;
+      if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+        wait_poll(status);
+        return;
+      }
+    }
+  }
+}
+
+} // namespace
+
+namespace de10_nano {
+
+std::atomic<WaitPolicy> Completion::policy(env_policy());
+
+bool Completion::SetPolicy(const char* name) {
+  WaitPolicy p;
+  if (name == nullptr || !parse(name, p)) {
+    return false;
+  }
+  SetPolicy(p);
+  return true;
+}
+
+void Completion::Arm() {
+  if (Policy() != WaitPolicy::interrupt || uio_fd() < 0) {
+    return;
+  }
+  // uio_pdrv_genirq masks the interrupt once it fires; writing 1 unmasks it
+  const uint32_t unmask = 1;
+  if (write(uio_fd(), &unmask, sizeof(unmask)) != sizeof(unmask)) {
+    std::cerr << "TCA: cannot unmask the interrupt (" << std::strerror(errno) << ")" << std::endl;
+  }
+}
+
+void Completion::Wait(volatile uint32_t* status) {
+  switch (Policy()) {
+  case WaitPolicy::spin:
+    wait_spin(status);
+    break;
+  case WaitPolicy::interrupt:
+    if (uio_fd() >= 0) {
+      wait_interrupt(status, uio_fd());
+      break;
+    }
+    wait_poll(status);
+    break;
+  case WaitPolicy::poll:
+    wait_poll(status);
+    break;
+  }
+}
+
+} // namespace de10_nano
@@ -0,0 +1,277 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "thread_pool.h"
+
+namespace {
+
+// idle workers sleep after spinning this long
+constexpr auto spin_time = std::chrono::microseconds(100);
+// chunks handed out per thread and loop
+constexpr std::size_t chunks_per_thread = 4;
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  asm volatile("yield");
+#endif
+}
+
+struct Cpu {
+  int id;
+  long capacity;
+};
+
+long read_number(const std::string& path) {
+  std::ifstream in(path);
+  long value = 0;
+  return in >> value ? value : 0;
+}
+
+// CPUs the process may run on, fastest first.
+std::vector<Cpu> allowed_cpus() {
+  std::vector<Cpu> cpus;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+    return cpus;
+  }
+  for (int id = 0; id < CPU_SETSIZE; ++id) {
+    if (!CPU_ISSET(id, &set)) {
+      continue;
+    }
+    const std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(id);
+    long capacity = read_number(dir + "/cpu_capacity");
+    if (capacity == 0) {
+      capacity = read_number(dir + "/cpufreq/cpuinfo_max_freq");
+    }
+    cpus.push_back({id, capacity});
+  }
+  std::stable_sort(cpus.begin(), cpus.end(),
+      [](const Cpu& a, const Cpu& b) { return a.capacity > b.capacity; });
+  return cpus;
+}
+
+unsigned env_number(const char* name) {
+  const char* value = std::getenv(name);
+  return value != nullptr && std::atoi(value) > 0 ? std::atoi(value) : 0;
+}
+
+using chunk_fn = void (*)(void* ctx, std::size_t first, std::size_t last);
+
+thread_local unsigned thread_index = 0;
+thread_local bool in_loop = false;
+
+class Pool {
+ public:
+  Pool() {
+    unsigned n = env_number("DLK_NUM_THREADS");
+    if (n == 0) {
+      n = env_number("OMP_NUM_THREADS");
+    }
+    const char* mask = std::getenv("DLK_CPU_MASK");
+    if (!configure(n, mask != nullptr ? std::strtoull(mask, nullptr, 0) : 0)) {
+      configure(n, 0);
+    }
+  }
+
+  bool configure(unsigned n, std::uint64_t mask) {
+    std::vector<Cpu> cpus;
+    for (const auto& cpu : allowed_cpus()) {
+      if (mask == 0 || (cpu.id < 64 && (mask >> cpu.id) & 1)) {
+        cpus.push_back(cpu);
+      }
+    }
+    if (cpus.empty() && mask != 0) {
+      return false;
+    }
+    if (n == 0) {
+      if (mask != 0) {
+        n = cpus.size();
+      } else {
+        n = std::max<unsigned>(1, std::count_if(cpus.begin(), cpus.end(),
+            [&](const Cpu& cpu) { return cpu.capacity == cpus.front().capacity; }));
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(dispatch_mutex);
+    stop_workers();
+    // the calling thread runs share 0 of every loop, on the first CPU
+    if (!cpus.empty()) {
+      pin(cpus.front().id);
+    }
+    const auto seen = generation.load();
+    for (unsigned i = 1; i < n; ++i) {
+      const int cpu = cpus.empty() ? -1 : cpus[i % cpus.size()].id;
+      workers.emplace_back([this, i, cpu, seen] { worker(i, cpu, seen); });
+    }
+    return true;
+  }
+
+  unsigned size() const { return workers.size() + 1; }
+
+  void dispatch(std::size_t count, chunk_fn fn, void* ctx);
+
+ private:
+  std::vector<std::thread> workers;
+  std::mutex dispatch_mutex; // one loop at a time
+
+  chunk_fn job_fn = nullptr;
+  void* job_ctx = nullptr;
+  std::size_t job_count = 0;
+  std::size_t job_chunk = 1;
+  std::atomic<std::size_t> next{0};
+  std::atomic<unsigned> pending{0}; // workers still in the current loop
+
+  std::atomic<std::uint64_t> generation{0};
+  std::atomic<bool> stop{false};
+  std::mutex park_mutex;
+  std::condition_variable park_cv;
+  std::atomic<unsigned> parked{0};
+
+  void work() {
+    while (true) {
+      const auto first = next.fetch_add(job_chunk, std::memory_order_relaxed);
+      if (first >= job_count) {
+        return;
+      }
+      job_fn(job_ctx, first, std::min(first + job_chunk, job_count));
+    }
+  }
+
+  void wake_all() {
+    generation.fetch_add(1);
+    if (parked.load() > 0) {
+      std::lock_guard<std::mutex> lock(park_mutex);
+      park_cv.notify_all();
+    }
+  }
+
+  void stop_workers() {
+    stop = true;
+    wake_all();
+    for (auto& w : workers) {
+      w.join();
+    }
+    workers.clear();
+    stop = false;
+  }
+
+  static void pin(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  }
+
+  void worker(unsigned index, int cpu, std::uint64_t seen) {
+    if (cpu >= 0) {
+      pin(cpu);
+    }
+    thread_index = index;
+    in_loop = true; // loops inside a job run serially
+
+    while (true) {
+      const auto start = std::chrono::steady_clock::now();
+      for (unsigned spins = 1; generation.load(std::memory_order_acquire) == seen; ++spins) {
+        cpu_relax();
+        if (spins % 64 == 0 && std::chrono::steady_clock::now() - start > spin_time) {
+          std::unique_lock<std::mutex> lock(park_mutex);
+          ++parked;
+          park_cv.wait(lock, [&] { return generation.load() != seen; });
+          --parked;
+        }
+      }
+      seen = generation.load(std::memory_order_acquire);
+      if (stop) {
+        return;
+      }
+      work();
+      pending.fetch_sub(1, std::memory_order_release);
+    }
+  }
+};
+
+void Pool::dispatch(std::size_t count, chunk_fn fn, void* ctx) {
+  if (count == 0) {
+    return;
+  }
+  if (workers.empty() || count == 1 || in_loop || !dispatch_mutex.try_lock()) {
+    fn(ctx, 0, count);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(dispatch_mutex, std::adopt_lock);
+  job_fn = fn;
+  job_ctx = ctx;
+  job_count = count;
+  job_chunk = std::max<std::size_t>(1, count / (size() * chunks_per_thread));
+  next.store(0, std::memory_order_relaxed);
+  pending.store(workers.size(), std::memory_order_relaxed);
+  wake_all();
+
+  in_loop = true;
+  work();
+  in_loop = false;
+  for (unsigned spins = 1; pending.load(std::memory_order_acquire) != 0; ++spins) {
+    if (spins % 1024 == 0) {
+      std::this_thread::yield();
+    } else {
+      cpu_relax();
+    }
+  }
+}
+
+// Never destroyed: workers may be parked in it during exit.
+Pool& pool() {
+  static Pool* p = new Pool();
+  return *p;
+}
+
+} // namespace
+
+namespace dlk {
+
+bool ThreadPool::Configure(unsigned n, std::uint64_t cpu_mask) {
+  return pool().configure(n, cpu_mask);
+}
+
+unsigned ThreadPool::Size() {
+  return pool().size();
+}
+
+unsigned ThreadPool::ThreadIndex() {
+  return thread_index;
+}
+
+void ThreadPool::Dispatch(std::size_t count, chunk_fn fn, void* ctx) {
+  pool().dispatch(count, fn, ctx);
+}
+
+} // namespace dlk
@@ -14,95 +14,571 @@ limitations under the License.
 ==============================================================================*/
 
 #include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "time_measurement.h"
 
-std::map<std::string, std::vector<Measurement::measure> > Measurement::times;
-std::vector<std::string> Measurement::current_context;
-std::vector<Measurement::Node*> Measurement::stack;
-std::vector<std::unique_ptr<Measurement::Node>> Measurement::roots;
-
-#ifndef FUNC_TIME_MEASUREMENT
-/* NOP */
-void Measurement::Start(const std::string &measure_name){}
-void Measurement::Stop(){}
-void Measurement::Report(){}
-void Measurement::DumpTimeTree(const Node& node, int level){}
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr std::size_t num_counters = 5;
+using Counters = std::array<std::uint64_t, num_counters>;
+const char* const counter_names[num_counters] = {
+  "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"
+};
+
+std::atomic<bool> counters_enabled(std::getenv("DLK_PROFILE_COUNTERS") != nullptr
+    && std::strcmp(std::getenv("DLK_PROFILE_COUNTERS"), "0") != 0);
+
+// perf_event_open group of the calling thread. Events the PMU does not have
+// are left out and read as zero; without the leader nothing is counted.
+class CounterGroup {
+public:
+  CounterGroup() { fds.fill(-1); }
+  ~CounterGroup() {
+    for (auto fd : fds) {
+      if (fd != -1) {
+#ifdef __linux__
+        close(fd);
+#endif
+      }
+    }
+  }
+
+  bool open() {
+    tried = true;
+#ifdef __linux__
+    const std::pair<std::uint32_t, std::uint64_t> events[num_counters] = {
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+      {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+          | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    };
+    for (std::size_t i = 0; i < num_counters; ++i) {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = events[i].first;
+      attr.config = events[i].second;
+      attr.read_format = PERF_FORMAT_GROUP;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      const int fd = syscall(__NR_perf_event_open, &attr, 0, -1, fds[0], 0);
+      if (fd == -1) {
+        if (i == 0) {
+          warn_once(std::strerror(errno));
+          return false;
+        }
+        continue;
+      }
+      fds[i] = fd;
+      slot[i] = members++;
+    }
+    return true;
+#else
+    warn_once("not supported on this platform");
+    return false;
+#endif
+  }
+
+  bool active() const { return fds[0] != -1; }
+  bool attempted() const { return tried; }
+
+  Counters read() const {
+    Counters result = {};
+#ifdef __linux__
+    // PERF_FORMAT_GROUP layout: nr, then one value per member in opening order
+    std::uint64_t buf[1 + num_counters];
+    if (::read(fds[0], buf, sizeof(buf)) < static_cast<ssize_t>(sizeof(std::uint64_t))) {
+      return result;
+    }
+    for (std::size_t i = 0; i < num_counters; ++i) {
+      if (fds[i] != -1 && slot[i] < buf[0]) {
+        result[i] = buf[1 + slot[i]];
+      }
+    }
+#endif
+    return result;
+  }
+
+private:
+  static void warn_once(const char* reason) {
+    static std::once_flag flag;
+    std::call_once(flag, [reason] {
+      std::cout << "WARNING: hardware counters unavailable (" << reason << "), measuring time only" << std::endl;
+    });
+  }
+
+  std::array<int, num_counters> fds;
+  std::array<std::uint64_t, num_counters> slot = {};
+  std::uint64_t members = 0;
+  bool tried = false;
+};
+
+// finished region, appended on Stop
+struct Record {
+  std::uint64_t start;
+  std::uint64_t end;
+  Measurement::RegionId id;
+  std::uint16_t depth;
+  std::uint16_t counted;
+};
+
+struct Sample {
+  Record rec;
+  Counters counters;
+};
+
+constexpr std::size_t max_depth = 64;
+constexpr std::size_t log_capacity = 1 << 14;
+
+// Written only by its own thread. `count` is published with release so that a
+// reader sees complete records up to it.
+struct ThreadLog {
+  explicit ThreadLog(std::uint32_t index)
+    : records(std::make_unique<Record[]>(log_capacity)), count(0), depth(0), index(index) {}
+
+  std::unique_ptr<Record[]> records;
+  // counter deltas of records, allocated once the counter group is open
+  std::unique_ptr<Counters[]> counter_records;
+  std::atomic<std::uint64_t> count;
+  struct {
+    std::uint64_t start;
+    Measurement::RegionId id;
+    bool counted;
+    Counters counters;
+  } open[max_depth];
+  CounterGroup counters;
+  std::uint32_t depth;
+  const std::uint32_t index;
+  // name address -> id and interned name, so that Start("...") skips the
+  // global lookup. The name is compared on every hit: a buffer reused for
+  // another name must not keep the old region.
+  std::unordered_map<const char*, std::pair<Measurement::RegionId, const char*>> cache;
+};
+
+struct Registry {
+  std::mutex mutex;
+  std::unordered_map<std::string, Measurement::RegionId> ids;
+  std::vector<std::unique_ptr<std::string>> names;
+  std::vector<std::unique_ptr<ThreadLog>> logs;
+};
+
+Registry& registry() {
+  static Registry r;
+  return r;
+}
+
+ThreadLog& thread_log() {
+  thread_local ThreadLog* log = nullptr;
+  if (log == nullptr) {
+    auto& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.logs.emplace_back(std::make_unique<ThreadLog>(r.logs.size()));
+    log = r.logs.back().get();
+  }
+  return *log;
+}
+
+bool initially_enabled() {
+  if (const char* env = std::getenv("DLK_PROFILE")) {
+    return std::strcmp(env, "0") != 0;
+  }
+#ifdef FUNC_TIME_MEASUREMENT
+  return true;
+#else
+  return false;
+#endif
+}
+
+double nanoseconds_per_tick() {
+#if defined(__x86_64__) || defined(__i386__)
+  using clock = std::chrono::steady_clock;
+  const auto t0 = clock::now();
+  const auto c0 = Measurement::Now();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  const auto t1 = clock::now();
+  const auto c1 = Measurement::Now();
+  return std::chrono::duration<double, std::nano>(t1 - t0).count() / (c1 - c0);
+#elif defined(__aarch64__)
+  std::uint64_t freq;
+  asm volatile("mrs %0, cntfrq_el0" : "=r"(freq));
+  return 1e9 / freq;
 #else
-void Measurement::Start(const std::string &measure_name)
-{
-  measure m;
-  m.start = std::chrono::system_clock::now();
-  m.end = std::chrono::system_clock::time_point();
-
-  if (stack.empty()) {
-      roots.emplace_back(std::make_unique<Node>(measure_name, 0));
-      auto* current = roots.back().get();
-      current->measurements.emplace_back(m);
-      stack.emplace_back(current);
-  }
-  else {
-      auto* parent = stack.back();
-      auto it = parent->children.find(measure_name);
-      if (it == parent->children.end()) {
-        it = parent->children.emplace(std::piecewise_construct,
-          std::forward_as_tuple(measure_name),
-          std::forward_as_tuple(std::make_unique<Node>(measure_name, parent->children.size()))).first;
+  return 1.0;
+#endif
+}
+
+// the records still held by a log, oldest first
+std::vector<Sample> snapshot(const ThreadLog& log) {
+  const auto count = log.count.load(std::memory_order_acquire);
+  const auto n = std::min<std::uint64_t>(count, log_capacity);
+  std::vector<Sample> result;
+  result.reserve(n);
+  for (auto i = count - n; i < count; ++i) {
+    const auto& rec = log.records[i % log_capacity];
+    result.push_back({rec, rec.counted ? log.counter_records[i % log_capacity] : Counters{}});
+  }
+  return result;
+}
+
+std::vector<std::pair<const ThreadLog*, std::vector<Sample>>> collect() {
+  std::vector<const ThreadLog*> logs;
+  {
+    auto& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (auto& log : r.logs) {
+      logs.push_back(log.get());
+    }
+  }
+
+  std::vector<std::pair<const ThreadLog*, std::vector<Sample>>> result;
+  for (auto* log : logs) {
+    result.emplace_back(log, snapshot(*log));
+  }
+  return result;
+}
+
+double to_time_order(std::uint64_t ticks) {
+  return Measurement::TicksToNanoseconds(ticks)
+    * TIME_ORDER::period::den / TIME_ORDER::period::num / 1e9;
+}
+
+std::string json_escape(const char* s) {
+  std::string out;
+  for (; *s != '\0'; ++s) {
+    if (*s == '"' || *s == '\\') {
+      out += '\\';
+    }
+    out += *s;
+  }
+  return out;
+}
+
+struct Node {
+  Node(Measurement::RegionId id, std::size_t position)
+    : id(id), position(position) {}
+
+  Measurement::RegionId id;
+  std::size_t position;
+  std::vector<double> durations;
+  Counters counters = {};
+  std::size_t counted = 0;
+  std::vector<std::unique_ptr<Node>> children;
+
+  Node* child(Measurement::RegionId child_id) {
+    for (auto& c : children) {
+      if (c->id == child_id) {
+        return c.get();
       }
-      auto* current = it->second.get();
-      current->measurements.emplace_back(m);
-      stack.emplace_back(current);
+    }
+    children.emplace_back(std::make_unique<Node>(child_id, children.size()));
+    return children.back().get();
   }
+};
 
-  times[measure_name].push_back(m);
-  current_context.push_back(measure_name);
+void dump_time_tree(const Node& node, int level) {
+  std::cout << std::string(level * 2, '.') << Measurement::Name(node.id) << " ";
+  double sum = 0.0;
+  for (auto t : node.durations) {
+    std::cout << t << ",";
+    sum += t;
+  }
+  std::cout << "  sum:" << sum / 1000 << "ms";
+  if (node.counted != 0) {
+    for (std::size_t i = 0; i < num_counters; ++i) {
+      std::cout << " " << counter_names[i] << ":" << node.counters[i];
+    }
+    if (node.counters[0] != 0) {
+      std::cout << " ipc:" << static_cast<double>(node.counters[1]) / node.counters[0];
+    }
+  }
+  std::cout << std::endl;
+  for (auto& child : node.children) {
+    dump_time_tree(*child, level + 1);
+  }
 }
 
-void Measurement::Stop()
-{
-  if(current_context.size() == 0 || times[current_context.back()].size() == 0) {
+} // namespace
+
+std::atomic<bool> Measurement::enabled(initially_enabled());
+
+Measurement::RegionId Measurement::Intern(const char* name) {
+  auto& r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  auto it = r.ids.find(name);
+  if (it != r.ids.end()) {
+    return it->second;
+  }
+  const auto id = static_cast<RegionId>(r.names.size());
+  r.names.emplace_back(std::make_unique<std::string>(name));
+  r.ids.emplace(name, id);
+  return id;
+}
+
+const char* Measurement::Name(RegionId id) {
+  auto& r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  return id < r.names.size() ? r.names[id]->c_str() : "?";
+}
+
+double Measurement::TicksToNanoseconds(std::uint64_t ticks) {
+  static const double ns_per_tick = nanoseconds_per_tick();
+  return ticks * ns_per_tick;
+}
+
+void Measurement::EnableCounters(bool on) {
+  counters_enabled.store(on, std::memory_order_relaxed);
+}
+
+bool Measurement::CountersEnabled() {
+  return counters_enabled.load(std::memory_order_relaxed);
+}
+
+void Measurement::Begin(RegionId id) {
+  auto& log = thread_log();
+  if (log.depth < max_depth) {
+    auto& open = log.open[log.depth];
+    open.id = id;
+    open.counted = false;
+    if (counters_enabled.load(std::memory_order_relaxed)) {
+      if (!log.counters.attempted() && log.counters.open()) {
+        log.counter_records = std::make_unique<Counters[]>(log_capacity);
+      }
+      if (log.counters.active()) {
+        open.counted = true;
+        open.counters = log.counters.read();
+      }
+    }
+    open.start = Now();
+  }
+  ++log.depth;
+}
+
+void Measurement::Begin(const char* measure_name) {
+  auto& log = thread_log();
+  auto& entry = log.cache[measure_name];
+  if (entry.second == nullptr || std::strcmp(entry.second, measure_name) != 0) {
+    // interned names are never freed or changed, so they are read without the lock
+    entry.first = Intern(measure_name);
+    entry.second = Name(entry.first);
+  }
+  Begin(entry.first);
+}
+
+void Measurement::End() {
+  const auto end = Now();
+  auto& log = thread_log();
+  if (log.depth == 0) {
     std::cout << "ERROR: wrong Start/Stop pairs" << std::endl;
     return;
   }
 
-  if (stack.empty()) {
-    std::cout << "ERROR: wrong Start/Stop pairs" << std::endl;
+  --log.depth;
+  if (log.depth >= max_depth) {
     return;
   }
+  const auto& open = log.open[log.depth];
+  const auto count = log.count.load(std::memory_order_relaxed);
+  const auto slot = count % log_capacity;
+  if (open.counted) {
+    const auto now = log.counters.read();
+    for (std::size_t i = 0; i < num_counters; ++i) {
+      log.counter_records[slot][i] = now[i] - open.counters[i];
+    }
+  }
+  log.records[slot] = {open.start, end, open.id, static_cast<std::uint16_t>(log.depth), open.counted};
+  log.count.store(count + 1, std::memory_order_release);
+}
+
+void Measurement::Clear() {
+  auto& r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  for (auto& log : r.logs) {
+    log->count.store(0, std::memory_order_release);
+  }
+}
 
-  stack.back()->measurements.back().end = std::chrono::system_clock::now();
-  stack.pop_back();
+void Measurement::Report() {
+  for (auto& entry : collect()) {
+    const auto* log = entry.first;
+    auto& records = entry.second;
+    const std::uint64_t dropped = log->count.load(std::memory_order_acquire) - records.size();
+    if (records.empty()) {
+      continue;
+    }
+    if (log->index != 0) {
+      std::cout << "thread " << log->index << ":" << std::endl;
+    }
+    if (dropped != 0) {
+      std::cout << "(" << dropped << " oldest regions dropped)" << std::endl;
+    }
 
-  times[current_context.back()].back().end = std::chrono::system_clock::now();
-  current_context.pop_back();
+    // parents end after their children, so order by start to rebuild the nesting
+    std::stable_sort(records.begin(), records.end(), [](const Sample& a, const Sample& b) {
+      return a.rec.start != b.rec.start ? a.rec.start < b.rec.start : a.rec.depth < b.rec.depth;
+    });
+
+    Node root(0, 0);
+    std::vector<std::pair<std::uint32_t, Node*>> stack;
+    for (const auto& sample : records) {
+      const auto& rec = sample.rec;
+      while (!stack.empty() && stack.back().first >= rec.depth) {
+        stack.pop_back();
+      }
+      Node* parent = stack.empty() ? &root : stack.back().second;
+      Node* node = parent->child(rec.id);
+      node->durations.push_back(std::floor(to_time_order(rec.end - rec.start)));
+      if (rec.counted) {
+        for (std::size_t i = 0; i < num_counters; ++i) {
+          node->counters[i] += sample.counters[i];
+        }
+        ++node->counted;
+      }
+      stack.emplace_back(rec.depth, node);
+    }
+
+    for (auto& node : root.children) {
+      dump_time_tree(*node, 0);
+    }
+  }
 }
 
-void Measurement::Report()
-{
- for (auto& root: roots) {
-    DumpTimeTree(*root, 0);
+std::vector<double> Measurement::Durations(const char* name) {
+  const auto id = Intern(name);
+  std::vector<double> result;
+  for (const auto& entry : collect()) {
+    for (const auto& sample : entry.second) {
+      if (sample.rec.id == id) {
+        result.push_back(to_time_order(sample.rec.end - sample.rec.start));
+      }
+    }
   }
+  return result;
 }
 
-void Measurement::DumpTimeTree(const Node& node, int level) {
-    std::cout << std::string(level * 2, '.') << node.name << " ";
-    double sum = 0.0;
-    for (auto& m : node.measurements) {
-      double t = std::chrono::duration_cast<TIME_ORDER>(m.end - m.start).count();
-      std::cout << t << ",";
-      sum += t;
+bool Measurement::WriteTrace(const std::string& path) {
+  std::ofstream out(path);
+  if (!out) {
+    std::cout << "ERROR: cannot open " << path << std::endl;
+    return false;
+  }
+
+  const auto logs = collect();
+  std::uint64_t origin = UINT64_MAX;
+  for (const auto& entry : logs) {
+    for (const auto& sample : entry.second) {
+      origin = std::min(origin, sample.rec.start);
     }
-    std::cout << "  sum:" << sum / 1000 << "ms";
-    std::cout << std::endl;
-    std::vector<const Node*> sorted;
-    for (auto& p : node.children) {
-      sorted.emplace_back(p.second.get());
+  }
+
+  // timestamps are microseconds in this format
+  const auto us = [](std::uint64_t ticks) { return TicksToNanoseconds(ticks) / 1000; };
+  out << std::fixed << std::setprecision(3);
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool first = true;
+  for (const auto& entry : logs) {
+    const auto tid = entry.first->index;
+    out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << tid
+        << ",\"args\":{\"name\":\"" << (tid == 0 ? "main" : "worker " + std::to_string(tid)) << "\"}}";
+    first = false;
+    for (const auto& sample : entry.second) {
+      const auto& rec = sample.rec;
+      out << ",\n{\"name\":\"" << json_escape(Name(rec.id)) << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << tid
+          << ",\"ts\":" << us(rec.start - origin) << ",\"dur\":" << us(rec.end - rec.start);
+      if (rec.counted) {
+        out << ",\"args\":{";
+        for (std::size_t i = 0; i < num_counters; ++i) {
+          out << (i == 0 ? "" : ",") << "\"" << counter_names[i] << "\":" << sample.counters[i];
+        }
+        out << "}";
+      }
+      out << "}";
     }
-    std::sort(sorted.begin(), sorted.end(), [](auto* a, auto* b) {
-      return a->position < b->position;
-    });
-    for (auto* child : sorted) {
-      DumpTimeTree(*child, level + 1);
+  }
+  out << "\n]}\n";
+  return static_cast<bool>(out);
+}
+
+bool Measurement::WriteSummary(const std::string& path) {
+  std::ofstream out(path);
+  if (!out) {
+    std::cout << "ERROR: cannot open " << path << std::endl;
+    return false;
+  }
+
+  std::vector<std::vector<double>> durations;
+  std::vector<std::pair<Counters, std::size_t>> counters;
+  for (const auto& entry : collect()) {
+    for (const auto& sample : entry.second) {
+      const auto& rec = sample.rec;
+      if (rec.id >= durations.size()) {
+        durations.resize(rec.id + 1);
+        counters.resize(rec.id + 1);
+      }
+      durations[rec.id].push_back(to_time_order(rec.end - rec.start));
+      if (rec.counted) {
+        for (std::size_t i = 0; i < num_counters; ++i) {
+          counters[rec.id].first[i] += sample.counters[i];
+        }
+        ++counters[rec.id].second;
+      }
     }
+  }
+
+  // counter columns are means over the counted regions, empty when none was counted
+  out << "region,count,min,median,p99,mean,total";
+  for (auto name : counter_names) {
+    out << "," << name;
+  }
+  out << ",ipc" << std::endl;
+  for (RegionId id = 0; id < durations.size(); ++id) {
+    auto& d = durations[id];
+    if (d.empty()) {
+      continue;
+    }
+    std::sort(d.begin(), d.end());
+    double total = 0;
+    for (auto t : d) {
+      total += t;
+    }
+    // nearest-rank percentiles
+    const auto rank = [&d](double q) { return d[static_cast<std::size_t>(std::ceil(q * d.size())) - 1]; };
+    out << "\"" << Name(id) << "\"," << d.size() << "," << d.front() << "," << rank(0.5) << ","
+        << rank(0.99) << "," << total / d.size() << "," << total;
+    const auto& c = counters[id];
+    for (std::size_t i = 0; i < num_counters; ++i) {
+      out << ",";
+      if (c.second != 0) {
+        out << static_cast<double>(c.first[i]) / c.second;
+      }
+    }
+    out << ",";
+    if (c.second != 0 && c.first[0] != 0) {
+      out << static_cast<double>(c.first[1]) / c.first[0];
+    }
+    out << std::endl;
+  }
+  return static_cast<bool>(out);
 }
-#endif /* FUNC_TIME_MEASUREMENT */
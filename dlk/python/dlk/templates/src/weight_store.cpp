@@ -0,0 +1,279 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "global.h"
+#include "memdriver.h"
+#include "weight_store.h"
+
+namespace {
+
+using de10_nano::WeightStore;
+
+constexpr uint32_t table_magic = 0x574b4c44; // "DLKW"
+constexpr uint32_t table_version = 1;
+constexpr std::size_t page_size = 4096;
+constexpr unsigned max_models = 32;
+
+// the table takes the first page of the kernel range
+constexpr unsigned long kernels_begin = KERNEL_ADDR + page_size;
+constexpr unsigned long kernels_end = THRESHOLD_ADDR;
+constexpr unsigned long thresholds_begin = THRESHOLD_ADDR;
+constexpr unsigned long thresholds_end = THRESHOLD_ADDR + 0x1000000;
+
+struct Entry {
+  uint64_t id; // 0 when free
+  uint64_t digest; // of the kernels, then the thresholds
+  uint64_t last_placed; // Table::clock at the time
+  uint32_t kernel_offset; // from kernels_begin
+  uint32_t kernel_size;
+  uint32_t thresholds_offset; // from thresholds_begin
+  uint32_t thresholds_size;
+};
+
+struct Table {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t clock;
+  Entry entries[max_models];
+  uint64_t checksum; // of everything above
+};
+
+static_assert(sizeof(Table) <= page_size, "the table must fit in its page");
+
+// FNV-1a over 32-bit words; sizes are multiples of 4 here
+class Digest {
+ public:
+  void Add(const volatile void* data, std::size_t size) {
+    auto words = reinterpret_cast<const volatile uint32_t*>(data);
+    for (std::size_t i = 0; i < size / sizeof(uint32_t); ++i) {
+      h = (h ^ words[i]) * 0x100000001b3ull;
+    }
+  }
+  uint64_t Value() const { return h; }
+ private:
+  uint64_t h = 0xcbf29ce484222325ull;
+};
+
+uint64_t checksum(const Table& table) {
+  Digest d;
+  d.Add(&table, offsetof(Table, checksum));
+  return d.Value();
+}
+
+bool env_flag(const char* name) {
+  const char* value = std::getenv(name);
+  return value != nullptr && std::strcmp(value, "1") == 0;
+}
+
+std::size_t round_up(std::size_t size) {
+  return (size + page_size - 1) / page_size * page_size;
+}
+
+// Serializes the table updates of all processes on the board.
+class TableLock {
+ public:
+  TableLock() {
+    const char* path = std::getenv("DLK_WEIGHTS_LOCK");
+    fd = open(path != nullptr ? path : "/tmp/dlk_weights.lock", O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (fd >= 0) {
+      flock(fd, LOCK_EX);
+    }
+  }
+  ~TableLock() {
+    if (fd >= 0) {
+      flock(fd, LOCK_UN);
+      close(fd);
+    }
+  }
+ private:
+  int fd;
+};
+
+bool mapped(const MappedMem& mem) {
+  return mem.get() != MAP_FAILED && mem.get() != nullptr;
+}
+
+// The table as found in memory, or an empty one when there was none.
+void load(const void* mem, Table& table) {
+  std::memcpy(&table, mem, sizeof(Table));
+  if (table.magic != table_magic || table.version != table_version || table.checksum != checksum(table)) {
+    std::memset(&table, 0, sizeof(Table));
+    table.magic = table_magic;
+    table.version = table_version;
+  }
+}
+
+void store(Table& table, void* mem) {
+  table.checksum = checksum(table);
+  std::memcpy(mem, &table, sizeof(Table));
+}
+
+// First offset in [0, limit) where size bytes do not overlap what the
+// models in use hold of that range; limit when there is none.
+std::size_t find_room(const Table& table, bool kernels, std::size_t size, std::size_t limit) {
+  std::size_t offset = 0;
+  bool moved = true;
+  while (moved && offset + size <= limit) {
+    moved = false;
+    for (const Entry& e : table.entries) {
+      if (e.id == 0) {
+        continue;
+      }
+      const std::size_t begin = kernels ? e.kernel_offset : e.thresholds_offset;
+      const std::size_t end = begin + round_up(kernels ? e.kernel_size : e.thresholds_size);
+      if (begin < offset + size && offset < end) {
+        offset = end;
+        moved = true;
+      }
+    }
+  }
+  return offset + size <= limit ? offset : limit;
+}
+
+Entry* least_recently_placed(Table& table) {
+  Entry* lru = nullptr;
+  for (Entry& e : table.entries) {
+    if (e.id != 0 && (lru == nullptr || e.last_placed < lru->last_placed)) {
+      lru = &e;
+    }
+  }
+  return lru;
+}
+
+} // namespace
+
+namespace de10_nano {
+
+bool WeightStore::Place(uint64_t id,
+                        const std::vector<Chunk>& kernels, std::size_t kernel_size,
+                        const std::vector<Chunk>& thresholds, std::size_t thresholds_size,
+                        Placement& placement) {
+  const std::size_t kernel_limit = kernels_end - kernels_begin;
+  const std::size_t thresholds_limit = thresholds_end - thresholds_begin;
+  if (kernel_size > kernel_limit || thresholds_size > thresholds_limit) {
+    std::cerr << "WeightStore: the weights do not fit in the reserved memory" << std::endl;
+    return false;
+  }
+
+  TableLock lock;
+  MappedMem table_mmap(KERNEL_ADDR, page_size);
+  if (!mapped(table_mmap)) {
+    return false;
+  }
+  Table table;
+  load(table_mmap.get(), table);
+
+  for (Entry& e : table.entries) {
+    if (e.id != id) {
+      continue;
+    }
+    if (e.kernel_size != kernel_size || e.thresholds_size != thresholds_size || env_flag("DLK_WEIGHTS_UPLOAD")) {
+      e.id = 0;
+      break;
+    }
+    placement = { kernels_begin + e.kernel_offset, thresholds_begin + e.thresholds_offset, false };
+    if (env_flag("DLK_WEIGHTS_VERIFY")) {
+      MappedMem kernel_mmap(placement.kernel_addr, kernel_size);
+      MappedMem thresholds_mmap(placement.thresholds_addr, thresholds_size);
+      if (!mapped(kernel_mmap) || !mapped(thresholds_mmap)) {
+        return false;
+      }
+      Digest d;
+      d.Add(kernel_mmap.get(), kernel_size);
+      d.Add(thresholds_mmap.get(), thresholds_size);
+      if (d.Value() != e.digest) {
+        std::cerr << "WeightStore: resident weights are corrupted, uploading again" << std::endl;
+        e.id = 0;
+        break;
+      }
+    }
+    e.last_placed = ++table.clock;
+    store(table, table_mmap.get());
+    return true;
+  }
+
+  // make room: free entries first, then the least recently placed models
+  std::size_t kernel_offset, thresholds_offset;
+  Entry* slot = nullptr;
+  while (true) {
+    kernel_offset = find_room(table, true, kernel_size, kernel_limit);
+    thresholds_offset = find_room(table, false, thresholds_size, thresholds_limit);
+    for (Entry& e : table.entries) {
+      if (e.id == 0) {
+        slot = &e;
+        break;
+      }
+    }
+    if (slot != nullptr && kernel_offset != kernel_limit && thresholds_offset != thresholds_limit) {
+      break;
+    }
+    // there is room once every model is gone, see the size check above
+    least_recently_placed(table)->id = 0;
+    slot = nullptr;
+  }
+
+  // until the upload is complete the entry, and the evicted ones, are free
+  store(table, table_mmap.get());
+
+  placement = { kernels_begin + kernel_offset, thresholds_begin + thresholds_offset, true };
+  Digest d;
+  {
+    MappedMem kernel_mmap(placement.kernel_addr, kernel_size);
+    MappedMem thresholds_mmap(placement.thresholds_addr, thresholds_size);
+    if (!mapped(kernel_mmap) || !mapped(thresholds_mmap)) {
+      return false;
+    }
+    auto kernel_buffer = reinterpret_cast<uint8_t*>(kernel_mmap.get());
+    auto thresholds_buffer = reinterpret_cast<uint8_t*>(thresholds_mmap.get());
+    for (const Chunk& c : kernels) {
+      std::memcpy(kernel_buffer + c.offset, c.data, c.size);
+    }
+    for (const Chunk& c : thresholds) {
+      std::memcpy(thresholds_buffer + c.offset, c.data, c.size);
+    }
+    // the chunks tile the ranges in order, so this is the digest of the copy
+    for (const Chunk& c : kernels) {
+      d.Add(c.data, c.size);
+    }
+    for (const Chunk& c : thresholds) {
+      d.Add(c.data, c.size);
+    }
+  }
+
+  *slot = { id, d.Value(), ++table.clock,
+            static_cast<uint32_t>(kernel_offset), static_cast<uint32_t>(kernel_size),
+            static_cast<uint32_t>(thresholds_offset), static_cast<uint32_t>(thresholds_size) };
+  store(table, table_mmap.get());
+  return true;
+}
+
+void WeightStore::Clear() {
+  TableLock lock;
+  MappedMem table_mmap(KERNEL_ADDR, page_size);
+  if (mapped(table_mmap)) {
+    std::memset(table_mmap.get(), 0, sizeof(Table));
+  }
+}
+
+} // namespace de10_nano
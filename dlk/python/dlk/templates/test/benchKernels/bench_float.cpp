@@ -0,0 +1,140 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <memory>
+#include <tuple>
+
+#include "bench_util.h"
+#include "global.h"
+#include "quantizer.h"
+#include "tensor_view.h"
+#include "func/batch_normalization.h"
+#include "func/concat_on_depth.h"
+#include "func/lookup.h"
+#include "matrix/multiplication.h"
+
+namespace {
+
+constexpr std::size_t b = 32;
+
+// kernel (9 oc x ic) * input (ic x hw), the kn2row product of a 3x3 float conv
+void BM_MatrixMultiplication(benchmark::State& state) {
+  const std::size_t h = state.range(0), w = state.range(1), ic = state.range(2), oc = state.range(3);
+  const std::size_t m = 9 * oc, k = ic, n = h * w;
+  if (!bench::fits(state, k * n, MAX_SIZE_INPUTS_PER_LAYER, "MAX_SIZE_INPUTS_PER_LAYER")) {
+    return;
+  }
+  auto a_buf = bench::random_buffer<float>(m * k, -1.0f, 1.0f);
+  auto b_buf = bench::random_buffer<float>(k * n, -1.0f, 1.0f);
+  auto c_buf = std::make_unique<float[]>(m * n);
+  auto A = dlk::MatrixView<float, dlk::MatrixOrder::RowMajor>(a_buf.get(), m, k);
+  auto B = dlk::MatrixView<float, dlk::MatrixOrder::ColMajor>(b_buf.get(), k, n);
+  auto C = dlk::MatrixView<float, dlk::MatrixOrder::ColMajor>(c_buf.get(), m, n);
+  for (auto _ : state) {
+    dlk::matrix_multiplication(A, B, C);
+    benchmark::ClobberMemory();
+  }
+  bench::set_ops(state, 2.0 * m * k * n);
+}
+BENCHMARK(BM_MatrixMultiplication)->Apply(bench::conv_shapes)->Unit(benchmark::kMicrosecond);
+
+void BM_BatchNormalization(benchmark::State& state) {
+  const std::size_t h = state.range(0), w = state.range(1), c = state.range(3);
+  if (!bench::fits(state, c, MAX_IN_C, "MAX_IN_C")) {
+    return;
+  }
+  auto input_buf = bench::random_buffer<T_FLOAT>(h * w * c, -1.0f, 1.0f);
+  auto output_buf = std::make_unique<T_FLOAT[]>(h * w * c);
+  auto gamma_buf = bench::random_buffer<T_FLOAT>(c, 0.5f, 1.5f);
+  auto beta_buf = bench::random_buffer<T_FLOAT>(c, -0.5f, 0.5f);
+  auto mean_buf = bench::random_buffer<T_FLOAT>(c, -0.5f, 0.5f);
+  auto var_buf = bench::random_buffer<T_FLOAT>(c, 0.5f, 1.5f);
+  TensorView<T_FLOAT, MemoryLayout::NHWC> input(input_buf.get(), {1, h, w, c});
+  TensorView<T_FLOAT, MemoryLayout::NHWC> output(output_buf.get(), {1, h, w, c});
+  TensorView<T_FLOAT, MemoryLayout::C> gamma(gamma_buf.get(), {c});
+  TensorView<T_FLOAT, MemoryLayout::C> beta(beta_buf.get(), {c});
+  TensorView<T_FLOAT, MemoryLayout::C> mean(mean_buf.get(), {c});
+  TensorView<T_FLOAT, MemoryLayout::C> variance(var_buf.get(), {c});
+  for (auto _ : state) {
+    func_BatchNormalization(input, gamma, beta, mean, variance, 1e-3f, output);
+    benchmark::ClobberMemory();
+  }
+  // scale and shift per element
+  bench::set_ops(state, 2.0 * h * w * c);
+  state.SetBytesProcessed(state.iterations() * 2 * h * w * c * sizeof(T_FLOAT));
+}
+BENCHMARK(BM_BatchNormalization)->Apply(bench::conv_shapes);
+
+void BM_QuantizeLinearMidTreadHalf(benchmark::State& state) {
+  const std::size_t h = state.range(0), w = state.range(1), c = state.range(2);
+  if (!bench::fits(state, h * w * c, MAX_SIZE_INPUTS_PER_LAYER, "MAX_SIZE_INPUTS_PER_LAYER")) {
+    return;
+  }
+  auto input_buf = bench::random_buffer<T_FLOAT>(h * w * c, -0.5f, 2.5f);
+  auto output_buf = std::make_unique<QUANTIZED_PACKED[]>(h * w * (c / b) * 2);
+  T_INT nbit_data = 2;
+  T_FLOAT max_data = 2.0f;
+  TensorView<T_FLOAT, MemoryLayout::NHWC> input(input_buf.get(), {1, h, w, c});
+  TensorView<T_INT, MemoryLayout::Atom> nbit(&nbit_data, {});
+  TensorView<T_FLOAT, MemoryLayout::Atom> max_value(&max_data, {});
+  TensorView<QUANTIZED_PACKED, MemoryLayout::HWChBCl> output(output_buf.get(), {h, w, c / b, 2, b});
+  for (auto _ : state) {
+    func_QTZ_linear_mid_tread_half(input, nbit, max_value, output);
+    benchmark::ClobberMemory();
+  }
+  bench::set_ops(state, h * w * c);
+  state.SetBytesProcessed(state.iterations() * h * w * c * sizeof(T_FLOAT));
+}
+BENCHMARK(BM_QuantizeLinearMidTreadHalf)->Apply(bench::conv_shapes);
+
+// first layer: RGB image in [0, 1) looked up into 2-bit thermometer codes
+void BM_Lookup(benchmark::State& state) {
+  const std::size_t h = state.range(0) * 4, w = state.range(1) * 4;
+  auto input_buf = bench::random_buffer<float>(h * w * 3, 0.0f, 0.999f);
+  auto lsb_buf = bench::random_packed<QUANTIZED_PACKED_KERNEL::base_t>(256);
+  auto msb_buf = bench::random_packed<QUANTIZED_PACKED_KERNEL::base_t>(256);
+  auto output_buf = std::make_unique<QUANTIZED_PACKED[]>(h * w * 2);
+  TensorView<float, MemoryLayout::NHWC> input(input_buf.get(), {1, h, w, 3});
+  TensorView<QUANTIZED_PACKED_KERNEL, MemoryLayout::TC> lsb(lsb_buf.get(), {256, b});
+  TensorView<QUANTIZED_PACKED_KERNEL, MemoryLayout::TC> msb(msb_buf.get(), {256, b});
+  TensorView<QUANTIZED_PACKED, MemoryLayout::ChHWBCl> output(output_buf.get(), {1, h, w, 2, b});
+  for (auto _ : state) {
+    func_Lookup(input, lsb, msb, output);
+    benchmark::ClobberMemory();
+  }
+  bench::set_ops(state, h * w * 3);
+  state.SetBytesProcessed(state.iterations() * h * w * 3 * sizeof(float));
+}
+BENCHMARK(BM_Lookup)->Apply(bench::conv_shapes);
+
+// two equal halves of a packed activation, as in the DarkNet-style concat
+void BM_ConcatOnDepth(benchmark::State& state) {
+  const std::size_t h = state.range(0), w = state.range(1), c = state.range(2);
+  const std::size_t half = h * w * (c / b) * 2;
+  auto a_buf = bench::random_packed<QUANTIZED_PACKED::base_t>(half);
+  auto b_buf = bench::random_packed<QUANTIZED_PACKED::base_t>(half);
+  auto output_buf = std::make_unique<QUANTIZED_PACKED[]>(2 * half);
+  TensorView<QUANTIZED_PACKED, MemoryLayout::HWChBCl> a(a_buf.get(), {h, w, c / b, 2, b});
+  TensorView<QUANTIZED_PACKED, MemoryLayout::HWChBCl> b_in(b_buf.get(), {h, w, c / b, 2, b});
+  TensorView<QUANTIZED_PACKED, MemoryLayout::HWChBCl> output(output_buf.get(), {h, w, 2 * c / b, 2, b});
+  for (auto _ : state) {
+    func_ConcatOnDepth(std::make_tuple(a, b_in), output);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * 4 * half * sizeof(QUANTIZED_PACKED));
+}
+BENCHMARK(BM_ConcatOnDepth)->Apply(bench::conv_shapes);
+
+} // namespace
@@ -0,0 +1,189 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <algorithm>
+#include <memory>
+
+#include "bench_util.h"
+#include "global.h"
+#include "operators.h"
+#include "pack_input_to_qwords.h"
+#include "tensor_convert.h"
+#include "tensor_view.h"
+#include "func/impl/quantized_conv2d_kn2row.h"
+#include "func/impl/quantized_conv2d_tiling.h"
+
+namespace {
+
+constexpr std::size_t b = 32;
+constexpr std::size_t in_bits = 2;
+
+// 3x3, stride 1, padding 1 (the shape QuantizedConv2D dispatches to the kernels)
+binary_convolution_parameters conv3x3_params(const std::size_t h, const std::size_t w,
+    const std::size_t ic, const std::size_t oc, BIN_CONV_OUTPUT* output_buf) {
+  binary_convolution_parameters p = {};
+  auto& cp = p.normal_conv_params;
+  cp.input_height = h;
+  cp.input_width = w;
+  cp.output_channels = oc;
+  cp.output_height = h;
+  cp.output_width = w;
+  cp.kernel_height = 3;
+  cp.kernel_width = 3;
+  cp.kernel_depth = ic;
+  cp.kernel_elements = 3 * 3 * ic;
+  cp.stride_along_height = 1;
+  cp.stride_along_width = 1;
+  cp.padding = 1;
+  cp.padding_top = 1;
+  cp.padding_bottom = 1;
+  cp.padding_left = 1;
+  cp.padding_right = 1;
+  cp.winograd_weights = nullptr;
+  cp.winograd_tile = 0;
+  p.bin_input_bitwidth = in_bits;
+  p.n_bit = 2;
+  p.max_value = 2.0f;
+  p.thresholds = nullptr;
+  p.device_output_buf = output_buf;
+  p.debug_name = "bench";
+  return p;
+}
+
+// one binary op per input bit and kernel bit pair, counted as multiply + add
+double conv3x3_ops(const std::size_t h, const std::size_t w,
+    const std::size_t ic, const std::size_t oc) {
+  return 2.0 * h * w * oc * 9 * ic * in_bits;
+}
+
+void BM_PackInput(benchmark::State& state) {
+  const std::size_t h = state.range(0), w = state.range(1), ic = state.range(2);
+  auto input = bench::random_buffer<QUANTIZED_NOT_PACKED>(h * w * ic, 0, (1 << in_bits) - 1);
+  auto output = std::make_unique<QUANTIZED_PACKED[]>(h * w * ic * in_bits / b);
+  for (auto _ : state) {
+    pack_input(input.get(), h, w, ic, in_bits, output.get());
+    benchmark::ClobberMemory();
+  }
+  bench::set_ops(state, h * w * ic);
+  state.SetBytesProcessed(state.iterations() * h * w * ic * sizeof(QUANTIZED_NOT_PACKED));
+}
+BENCHMARK(BM_PackInput)->Apply(bench::conv_shapes);
+
+void BM_ConvertHWChBClToChHWBCl(benchmark::State& state) {
+  const std::size_t h = state.range(0), w = state.range(1), ic = state.range(2);
+  const std::size_t size = h * w * (ic / b) * in_bits;
+  auto before_buf = bench::random_packed<QUANTIZED_PACKED::base_t>(size);
+  auto after_buf = std::make_unique<QUANTIZED_PACKED[]>(size);
+  TensorView<QUANTIZED_PACKED, MemoryLayout::HWChBCl> before(before_buf.get(), {h, w, ic / b, in_bits, b});
+  TensorView<QUANTIZED_PACKED, MemoryLayout::ChHWBCl> after(after_buf.get(), {ic / b, h, w, in_bits, b});
+  for (auto _ : state) {
+    convert_tensor(before, after);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * 2 * size * sizeof(QUANTIZED_PACKED));
+}
+BENCHMARK(BM_ConvertHWChBClToChHWBCl)->Apply(bench::conv_shapes);
+
+void BM_ConvertChHWBClToHWChBCl(benchmark::State& state) {
+  const std::size_t h = state.range(0), w = state.range(1), ic = state.range(2);
+  const std::size_t size = h * w * (ic / b) * in_bits;
+  auto before_buf = bench::random_packed<QUANTIZED_PACKED::base_t>(size);
+  auto after_buf = std::make_unique<QUANTIZED_PACKED[]>(size);
+  TensorView<QUANTIZED_PACKED, MemoryLayout::ChHWBCl> before(before_buf.get(), {ic / b, h, w, in_bits, b});
+  TensorView<QUANTIZED_PACKED, MemoryLayout::HWChBCl> after(after_buf.get(), {h, w, ic / b, in_bits, b});
+  for (auto _ : state) {
+    convert_tensor(before, after);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * 2 * size * sizeof(QUANTIZED_PACKED));
+}
+BENCHMARK(BM_ConvertChHWBClToHWChBCl)->Apply(bench::conv_shapes);
+
+void BM_ConvertCopy(benchmark::State& state) {
+  const std::size_t h = state.range(0), w = state.range(1), ic = state.range(2);
+  auto before_buf = bench::random_buffer<T_FLOAT>(h * w * ic, -1.0f, 1.0f);
+  auto after_buf = std::make_unique<T_FLOAT[]>(h * w * ic);
+  TensorView<T_FLOAT, MemoryLayout::NHWC> before(before_buf.get(), {1, h, w, ic});
+  TensorView<T_FLOAT, MemoryLayout::NHWC> after(after_buf.get(), {1, h, w, ic});
+  for (auto _ : state) {
+    convert_tensor(before, after);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * 2 * h * w * ic * sizeof(T_FLOAT));
+}
+BENCHMARK(BM_ConvertCopy)->Apply(bench::conv_shapes);
+
+#if (defined USE_NEON || defined USE_AVX) && !defined RUN_ON_FPGA
+
+void BM_PackInputForTiling(benchmark::State& state) {
+  const std::size_t h = state.range(0), w = state.range(1), ic = state.range(2);
+  auto input_buf = bench::random_buffer<QUANTIZED_NOT_PACKED>(h * w * ic, 0, (1 << in_bits) - 1);
+  auto output_buf = std::make_unique<dlk::impl::tiling_input_elem_t[]>(h * w * ic * in_bits / b);
+  TensorView<QUANTIZED_NOT_PACKED, MemoryLayout::NHWC> input(input_buf.get(), {1, h, w, ic});
+  dlk::impl::tiling_input_t output(output_buf.get(), {ic / b, h, w, in_bits, b});
+  for (auto _ : state) {
+    convert_tensor(input, output);
+    benchmark::ClobberMemory();
+  }
+  bench::set_ops(state, h * w * ic);
+  state.SetBytesProcessed(state.iterations() * h * w * ic * sizeof(QUANTIZED_NOT_PACKED));
+}
+BENCHMARK(BM_PackInputForTiling)->Apply(bench::conv_shapes);
+
+void BM_QuantizedConv2DTiling(benchmark::State& state) {
+  const std::size_t h = state.range(0), w = state.range(1), ic = state.range(2), oc = state.range(3);
+  if (!bench::fits(state, std::max(ic, oc), MAX_IN_C, "MAX_IN_C")
+      || !bench::fits(state, oc * ic / b, MAX_SIZE_QKERNELS_PER_LAYER, "MAX_SIZE_QKERNELS_PER_LAYER")) {
+    return;
+  }
+  auto input_buf = bench::random_packed<dlk::impl::tiling_input_elem_base_t>(h * w * ic * in_bits / b);
+  auto kernel_buf = bench::random_packed<QUANTIZED_PACKED_KERNEL::base_t>(oc * 9 * ic / b);
+  auto output_buf = std::make_unique<BIN_CONV_OUTPUT[]>(h * w * oc);
+  dlk::impl::tiling_input_t input(input_buf.get(), {ic / b, h, w, in_bits, b});
+  kernel_t kernel(kernel_buf.get(), {oc, 3, 3, ic});
+  const auto p = conv3x3_params(h, w, ic, oc, output_buf.get());
+  for (auto _ : state) {
+    dlk::impl::QuantizedConv2DTiling(input, kernel, p);
+    benchmark::ClobberMemory();
+  }
+  bench::set_ops(state, conv3x3_ops(h, w, ic, oc));
+}
+BENCHMARK(BM_QuantizedConv2DTiling)->Apply(bench::conv_shapes)->Unit(benchmark::kMicrosecond);
+
+#elif !defined RUN_ON_FPGA
+
+void BM_QuantizedConv2DKn2Row(benchmark::State& state) {
+  const std::size_t h = state.range(0), w = state.range(1), ic = state.range(2), oc = state.range(3);
+  const std::size_t col_block = std::min<std::size_t>(MAX_SIZE_KN2ROW_COL_BLOCK, h * w);
+  if (!bench::fits(state, oc * 9 * col_block, MAX_SIZE_KN2ROW_BUFFER_PER_LAYER, "MAX_SIZE_KN2ROW_BUFFER_PER_LAYER")) {
+    return;
+  }
+  auto input_buf = bench::random_packed<QUANTIZED_PACKED::base_t>(h * w * ic * in_bits / b);
+  auto kernel_buf = bench::random_packed<QUANTIZED_PACKED_KERNEL::base_t>(9 * oc * ic / b);
+  auto output_buf = std::make_unique<BIN_CONV_OUTPUT[]>(h * w * oc);
+  dlk::impl::kn2row_input_t input(input_buf.get(), {h, w, ic / b, in_bits, b});
+  kernel_t kernel(kernel_buf.get(), {3, 3, oc, ic});
+  const auto p = conv3x3_params(h, w, ic, oc, output_buf.get());
+  for (auto _ : state) {
+    dlk::impl::QuantizedConv2DKn2Row(input, kernel, p);
+    benchmark::ClobberMemory();
+  }
+  bench::set_ops(state, conv3x3_ops(h, w, ic, oc));
+}
+BENCHMARK(BM_QuantizedConv2DKn2Row)->Apply(bench::conv_shapes)->Unit(benchmark::kMicrosecond);
+
+#endif
+
+} // namespace
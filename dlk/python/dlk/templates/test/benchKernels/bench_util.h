@@ -0,0 +1,79 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef DLK_BENCH_UTIL_H_INCLUDED
+#define DLK_BENCH_UTIL_H_INCLUDED
+
+#include <memory>
+#include <random>
+#include <string>
+
+#include "benchmark/benchmark.h"
+#include "global.h"
+
+namespace bench {
+
+// Synthetic constants: the numbers only need to look like real data to the kernels.
+template <typename T>
+std::unique_ptr<T[]> random_buffer(std::size_t size, T low, T high) {
+  std::mt19937 engine(size);
+  auto buf = std::make_unique<T[]>(size);
+  for (std::size_t i = 0; i < size; ++i) {
+    if (std::is_floating_point<T>::value) {
+      buf[i] = std::uniform_real_distribution<double>(low, high)(engine);
+    } else {
+      buf[i] = std::uniform_int_distribution<long long>(low, high)(engine);
+    }
+  }
+  return buf;
+}
+
+template <typename pack_type>
+std::unique_ptr<QuantizedPacked<pack_type>[]> random_packed(std::size_t size) {
+  using base_t = typename QuantizedPacked<pack_type>::base_t;
+  std::mt19937 engine(size);
+  auto buf = std::make_unique<QuantizedPacked<pack_type>[]>(size);
+  for (std::size_t i = 0; i < size; ++i) {
+    buf[i] = QuantizedPacked<pack_type>(static_cast<base_t>(engine()));
+  }
+  return buf;
+}
+
+// Reports `ops` per iteration as a rate (shown as G/s for GOPS) next to ns per iteration.
+inline void set_ops(benchmark::State& state, double ops) {
+  state.counters["ops"] = benchmark::Counter(ops, benchmark::Counter::kIsIterationInvariantRate);
+}
+
+// The library sizes its scratch buffers for the generated network (MAX_SIZE_*,
+// MAX_IN_C in global.h), so larger shapes are reported as skipped, not run.
+inline bool fits(benchmark::State& state, std::size_t size, std::size_t limit, const char* limit_name) {
+  if (size <= limit) {
+    return true;
+  }
+  state.SkipWithError((std::string("shape exceeds ") + limit_name + " of this project").c_str());
+  return false;
+}
+
+// {height, width, input channels, output channels} of typical layers
+inline void conv_shapes(benchmark::internal::Benchmark* b) {
+  b->Args({56, 56, 64, 64});
+  b->Args({28, 28, 128, 128});
+  b->Args({14, 14, 256, 256});
+  b->Args({7, 7, 512, 1024});
+}
+
+} // namespace bench
+
+#endif // DLK_BENCH_UTIL_H_INCLUDED
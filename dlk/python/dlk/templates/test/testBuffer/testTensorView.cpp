@@ -0,0 +1,275 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <cstdint>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "global.h"
+#include "tensor_view.h"
+#include "func/relu.h"
+#include "func/split.h"
+
+namespace {
+
+using packed_t = QuantizedPacked<uint32_t>;
+using chhwbcl_t = TensorView<packed_t, MemoryLayout::ChHWBCl>;
+
+// 3 channel blocks of 2x3 pixels, 2 bits of 32 channels each
+constexpr std::size_t blocks = 3, height = 2, width = 3, bits = 2;
+constexpr std::size_t block_words = height * width * bits;
+
+using nhwc_t = TensorView<float, MemoryLayout::NHWC>;
+using strided_nhwc_t = StridedTensorView<float, MemoryLayout::NHWC>;
+
+// 1x2x3x4, every element its own offset
+std::vector<float> iota_nhwc() {
+  std::vector<float> buffer(2 * 3 * 4);
+  for (std::size_t i = 0; i < buffer.size(); ++i) {
+    buffer[i] = static_cast<float>(i);
+  }
+  return buffer;
+}
+
+} // namespace
+
+TEST(ChannelHighSliceTest, ViewsTheBlocksInPlace) {
+  std::vector<packed_t> buffer(blocks * block_words);
+  const chhwbcl_t concat(buffer.data(), {blocks, height, width, bits, 32});
+
+  // the producers of a concat of 64 and 32 channels
+  const auto first = channel_high_slice(concat, 0, 2);
+  const auto second = channel_high_slice(concat, 2, 1);
+
+  EXPECT_EQ(first.data(), buffer.data());
+  EXPECT_EQ(second.data(), buffer.data() + 2 * block_words);
+  EXPECT_EQ(first.get_shape()[0], 2u);
+  EXPECT_EQ(second.get_shape()[0], 1u);
+  for (std::size_t i = 1; i < 5; ++i) {
+    EXPECT_EQ(first.get_shape()[i], concat.get_shape()[i]);
+    EXPECT_EQ(second.get_shape()[i], concat.get_shape()[i]);
+  }
+  EXPECT_EQ(first.size() + second.size(), concat.size());
+}
+
+TEST(ChannelHighSliceTest, ProducersFillTheConcat) {
+  std::vector<packed_t> buffer(blocks * block_words);
+  const chhwbcl_t concat(buffer.data(), {blocks, height, width, bits, 32});
+  const chhwbcl_t slices[] = { channel_high_slice(concat, 0, 1), channel_high_slice(concat, 1, 2) };
+
+  for (std::size_t s = 0; s < 2; ++s) {
+    const auto& slice = slices[s];
+    for (std::size_t ch = 0; ch < slice.get_shape()[0]; ++ch) {
+      for (std::size_t h = 0; h < height; ++h) {
+        for (std::size_t w = 0; w < width; ++w) {
+          for (std::size_t b = 0; b < bits; ++b) {
+            slice(ch, h, w, b, 0) = packed_t(static_cast<uint32_t>(((s * 10 + ch) * 10 + h) * 100 + w * 10 + b));
+          }
+        }
+      }
+    }
+  }
+
+  for (std::size_t ch = 0; ch < blocks; ++ch) {
+    const std::size_t s = ch == 0 ? 0 : 1;
+    const std::size_t local = ch == 0 ? 0 : ch - 1;
+    for (std::size_t h = 0; h < height; ++h) {
+      for (std::size_t w = 0; w < width; ++w) {
+        for (std::size_t b = 0; b < bits; ++b) {
+          EXPECT_EQ(concat(ch, h, w, b, 0).Raw(), ((s * 10 + local) * 10 + h) * 100 + w * 10 + b);
+        }
+      }
+    }
+  }
+}
+
+TEST(ChannelHighSliceTest, LastInputOfFewerChannels) {
+  // a last input of 16 channels still takes a whole block of the concat
+  std::vector<packed_t> buffer(blocks * block_words);
+  const chhwbcl_t concat(buffer.data(), {blocks, height, width, bits, 32});
+  const auto last = channel_high_slice(concat, 2, 1);
+
+  EXPECT_EQ(last.data() + last.size(), buffer.data() + buffer.size());
+  EXPECT_EQ(last.data(0, height - 1, width - 1, bits - 1, 0), &buffer.back());
+}
+
+TEST(StridedTensorViewTest, DenseStrides) {
+  auto buffer = iota_nhwc();
+  const strided_nhwc_t view(nhwc_t(buffer.data(), {1, 2, 3, 4}));
+  const strided_nhwc_t::tensor_info_t<std::size_t> strides = {24, 12, 4, 1};
+
+  EXPECT_EQ(view.get_strides(), strides);
+  EXPECT_TRUE(view.is_contiguous());
+  EXPECT_EQ(view(0, 1, 2, 3), 23.0f);
+  EXPECT_EQ(view.dense().data(), buffer.data());
+}
+
+TEST(StridedTensorViewTest, ChannelSliceIndexesTheParent) {
+  auto buffer = iota_nhwc();
+  const nhwc_t tensor(buffer.data(), {1, 2, 3, 4});
+  const auto channels = slice(tensor, 3, 1, 2);
+
+  EXPECT_FALSE(channels.is_contiguous());
+  EXPECT_EQ(channels.size(), 12u);
+  for (std::size_t h = 0; h < 2; ++h) {
+    for (std::size_t w = 0; w < 3; ++w) {
+      for (std::size_t c = 0; c < 2; ++c) {
+        EXPECT_EQ(channels.data(0, h, w, c), &tensor(0, h, w, c + 1));
+      }
+    }
+  }
+}
+
+TEST(StridedTensorViewTest, RowSliceIsContiguous) {
+  auto buffer = iota_nhwc();
+  const nhwc_t tensor(buffer.data(), {1, 2, 3, 4});
+  const auto row = slice(tensor, 1, 1, 1);
+
+  EXPECT_TRUE(row.is_contiguous());
+  EXPECT_EQ(row.dense().data(), buffer.data() + 12);
+}
+
+TEST(StridedTensorViewTest, SubviewOfASlice) {
+  auto buffer = iota_nhwc();
+  const nhwc_t tensor(buffer.data(), {1, 2, 3, 4});
+  const auto box = subview(tensor, {0, 1, 1, 1}, {1, 1, 2, 3}).slice(3, 1, 2);
+
+  EXPECT_EQ(box.get_shape(), strided_nhwc_t::tensor_info_t<std::size_t>({1, 1, 2, 2}));
+  EXPECT_EQ(box(0, 0, 0, 0), tensor(0, 1, 1, 2));
+  EXPECT_EQ(box(0, 0, 1, 1), tensor(0, 1, 2, 3));
+}
+
+TEST(StridedTensorViewTest, NextVisitsRowMajor) {
+  auto buffer = iota_nhwc();
+  const auto view = slice(nhwc_t(buffer.data(), {1, 2, 3, 4}), 3, 2, 2);
+  strided_nhwc_t::tensor_info_t<std::size_t> index = {};
+  std::vector<float> visited;
+  do {
+    visited.push_back(view(index[0], index[1], index[2], index[3]));
+  } while (view.next(index));
+
+  EXPECT_EQ(visited, std::vector<float>({2, 3, 6, 7, 10, 11, 14, 15, 18, 19, 22, 23}));
+  EXPECT_EQ(index, strided_nhwc_t::tensor_info_t<std::size_t>({0, 0, 0, 0}));
+}
+
+TEST(StridedTensorViewTest, QuantizedSliceCountsBlocks) {
+  std::vector<packed_t> buffer(height * width * blocks * bits);
+  using hwchbcl_t = TensorView<packed_t, MemoryLayout::HWChBCl>;
+  const hwchbcl_t tensor(buffer.data(), {height, width, blocks, bits, 32});
+  const auto second = slice(tensor, 2, 1, 2);
+
+  // the innermost axis of 32 channels is one packed word
+  EXPECT_EQ(second.size(), height * width * 2 * bits);
+  EXPECT_EQ(second.get_strides()[4], 1u);
+  EXPECT_EQ(second.data(1, 2, 1, 1, 0), &tensor(1, 2, 2, 1, 0));
+}
+
+TEST(StridedReluTest, ChannelSliceInPlace) {
+  std::vector<float> buffer(2 * 3 * 4);
+  for (std::size_t i = 0; i < buffer.size(); ++i) {
+    buffer[i] = i % 2 ? -static_cast<float>(i) : static_cast<float>(i);
+  }
+  const nhwc_t tensor(buffer.data(), {1, 2, 3, 4});
+  const auto channels = slice(tensor, 3, 1, 2);
+  dlk::impl::unary_op(channels, channels, relu<float>);
+
+  for (std::size_t i = 0; i < buffer.size(); ++i) {
+    const std::size_t c = i % 4;
+    const float x = i % 2 ? -static_cast<float>(i) : static_cast<float>(i);
+    EXPECT_EQ(buffer[i], (c == 1 || c == 2) ? std::max(x, 0.0f) : x) << "at " << i;
+  }
+}
+
+TEST(StridedReluTest, IntoADenseTensor) {
+  std::vector<float> buffer(2 * 3 * 4);
+  for (std::size_t i = 0; i < buffer.size(); ++i) {
+    buffer[i] = static_cast<float>(i) - 12.0f;
+  }
+  std::vector<float> out(2 * 3 * 2, -1.0f);
+  const nhwc_t tensor(buffer.data(), {1, 2, 3, 4});
+  const nhwc_t output(out.data(), {1, 2, 3, 2});
+  dlk::impl::unary_op(slice(tensor, 3, 2, 2), strided_nhwc_t(output), relu<float>);
+
+  for (std::size_t p = 0; p < 6; ++p) {
+    for (std::size_t c = 0; c < 2; ++c) {
+      EXPECT_EQ(out[p * 2 + c], std::max(buffer[p * 4 + c + 2], 0.0f));
+    }
+  }
+}
+
+TEST(SplitTest, NHWCChannels) {
+  auto buffer = iota_nhwc();
+  std::vector<float> a(2 * 3 * 2), b(2 * 3 * 2);
+  const nhwc_t outputs[] = { nhwc_t(a.data(), {1, 2, 3, 2}), nhwc_t(b.data(), {1, 2, 3, 2}) };
+  T_UINT depths[] = { 2, 2 };
+  func_Split(nhwc_t(buffer.data(), {1, 2, 3, 4}), outputs, depths, 2);
+
+  for (std::size_t p = 0; p < 6; ++p) {
+    for (std::size_t c = 0; c < 2; ++c) {
+      EXPECT_EQ(a[p * 2 + c], buffer[p * 4 + c]);
+      EXPECT_EQ(b[p * 2 + c], buffer[p * 4 + c + 2]);
+    }
+  }
+  // depths are left as they were given
+  EXPECT_EQ(depths[1], 2u);
+}
+
+TEST(SplitTest, QuantizedHWChBCl) {
+  using hwchbcl_t = TensorView<packed_t, MemoryLayout::HWChBCl>;
+  std::vector<packed_t> buffer(height * width * 2 * bits);
+  for (std::size_t i = 0; i < buffer.size(); ++i) {
+    buffer[i] = packed_t(static_cast<uint32_t>(i));
+  }
+  std::vector<packed_t> a(height * width * bits), b(height * width * bits);
+  const hwchbcl_t outputs[] = {
+    hwchbcl_t(a.data(), {height, width, 1, bits, 32}),
+    hwchbcl_t(b.data(), {height, width, 1, bits, 32})
+  };
+  T_UINT depths[] = { 32, 32 };
+  const hwchbcl_t input(buffer.data(), {height, width, 2, bits, 32});
+  func_Split(input, outputs, depths, 2);
+
+  for (std::size_t h = 0; h < height; ++h) {
+    for (std::size_t w = 0; w < width; ++w) {
+      for (std::size_t digit = 0; digit < bits; ++digit) {
+        EXPECT_EQ(outputs[0](h, w, 0, digit, 0).Raw(), input(h, w, 0, digit, 0).Raw());
+        EXPECT_EQ(outputs[1](h, w, 0, digit, 0).Raw(), input(h, w, 1, digit, 0).Raw());
+      }
+    }
+  }
+}
+
+TEST(SplitTest, QuantizedChHWBCl) {
+  std::vector<packed_t> buffer(blocks * block_words);
+  for (std::size_t i = 0; i < buffer.size(); ++i) {
+    buffer[i] = packed_t(static_cast<uint32_t>(i));
+  }
+  std::vector<packed_t> a(block_words), b(2 * block_words);
+  const chhwbcl_t outputs[] = {
+    chhwbcl_t(a.data(), {1, height, width, bits, 32}),
+    chhwbcl_t(b.data(), {2, height, width, bits, 32})
+  };
+  T_UINT depths[] = { 32, 64 };
+  func_Split(chhwbcl_t(buffer.data(), {blocks, height, width, bits, 32}), outputs, depths, 2);
+
+  // each output is one run of whole blocks
+  for (std::size_t i = 0; i < block_words; ++i) {
+    EXPECT_EQ(a[i].Raw(), i);
+  }
+  for (std::size_t i = 0; i < 2 * block_words; ++i) {
+    EXPECT_EQ(b[i].Raw(), block_words + i);
+  }
+}
@@ -0,0 +1,193 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "func/impl/conv2d_winograd.h"
+
+namespace {
+
+using dlk::impl::winograd_oc_align;
+
+// G of F(2x2, 3x3) and F(4x4, 3x3), as in pass_winograd_weights
+const double G2[4][3] = {
+  {1, 0, 0},
+  {1.0 / 2, 1.0 / 2, 1.0 / 2},
+  {1.0 / 2, -1.0 / 2, 1.0 / 2},
+  {0, 0, 1},
+};
+const double G4[6][3] = {
+  {1.0 / 4, 0, 0},
+  {-1.0 / 6, -1.0 / 6, -1.0 / 6},
+  {-1.0 / 6, 1.0 / 6, -1.0 / 6},
+  {1.0 / 24, 1.0 / 12, 1.0 / 6},
+  {1.0 / 24, -1.0 / 12, 1.0 / 6},
+  {0, 0, 1},
+};
+
+struct Shape {
+  std::size_t tile;
+  std::size_t height, width, ic, oc;
+  std::size_t pad_top, pad_bottom, pad_left, pad_right;
+};
+
+// U = G g G^T laid out as [alpha * alpha][ic][oc rounded up to winograd_oc_align],
+// where kernels is OHWI.
+std::vector<float> transform_kernels(const Shape& s, const std::vector<float>& kernels) {
+  const std::size_t alpha = s.tile + 2;
+  const std::size_t oc_pad = (s.oc + winograd_oc_align - 1) / winograd_oc_align * winograd_oc_align;
+  auto g = [&](std::size_t a, std::size_t k) {
+    return s.tile == 4 ? G4[a][k] : G2[a][k];
+  };
+  std::vector<float> u(alpha * alpha * s.ic * oc_pad, 0.0f);
+  for (std::size_t a = 0; a < alpha; ++a) {
+    for (std::size_t b = 0; b < alpha; ++b) {
+      for (std::size_t c = 0; c < s.ic; ++c) {
+        for (std::size_t o = 0; o < s.oc; ++o) {
+          double acc = 0;
+          for (std::size_t k = 0; k < 3; ++k) {
+            for (std::size_t l = 0; l < 3; ++l) {
+              acc += g(a, k) * kernels[((o * 3 + k) * 3 + l) * s.ic + c] * g(b, l);
+            }
+          }
+          u[((a * alpha + b) * s.ic + c) * oc_pad + o] = static_cast<float>(acc);
+        }
+      }
+    }
+  }
+  return u;
+}
+
+// 3x3 stride 1 convolution of NHWC input and OHWI kernels, in double.
+std::vector<double> direct_convolution(const Shape& s, const std::vector<float>& input,
+    const std::vector<float>& kernels, std::size_t out_height, std::size_t out_width) {
+  std::vector<double> output(out_height * out_width * s.oc, 0.0);
+  for (std::size_t y = 0; y < out_height; ++y) {
+    for (std::size_t x = 0; x < out_width; ++x) {
+      for (std::size_t o = 0; o < s.oc; ++o) {
+        double acc = 0;
+        for (std::size_t k = 0; k < 3; ++k) {
+          for (std::size_t l = 0; l < 3; ++l) {
+            const auto row = static_cast<std::ptrdiff_t>(y + k) - static_cast<std::ptrdiff_t>(s.pad_top);
+            const auto col = static_cast<std::ptrdiff_t>(x + l) - static_cast<std::ptrdiff_t>(s.pad_left);
+            if (row < 0 || row >= static_cast<std::ptrdiff_t>(s.height)
+                || col < 0 || col >= static_cast<std::ptrdiff_t>(s.width)) {
+              continue;
+            }
+            for (std::size_t c = 0; c < s.ic; ++c) {
+              acc += static_cast<double>(input[(row * s.width + col) * s.ic + c])
+                * kernels[((o * 3 + k) * 3 + l) * s.ic + c];
+            }
+          }
+        }
+        output[(y * out_width + x) * s.oc + o] = acc;
+      }
+    }
+  }
+  return output;
+}
+
+void check(const Shape& s) {
+  const std::size_t out_height = s.height + s.pad_top + s.pad_bottom - 2;
+  const std::size_t out_width = s.width + s.pad_left + s.pad_right - 2;
+
+  std::mt19937 gen(static_cast<unsigned>(s.tile * 1000 + s.ic * 31 + s.oc));
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  std::vector<float> input(s.height * s.width * s.ic);
+  std::vector<float> kernels(s.oc * 3 * 3 * s.ic);
+  for (auto& v : input) v = dist(gen);
+  for (auto& v : kernels) v = dist(gen);
+  const auto u = transform_kernels(s, kernels);
+
+  // guard values past the end catch stores beyond the last output channel
+  const float guard = 12345.0f;
+  std::vector<float> output(out_height * out_width * s.oc + winograd_oc_align, guard);
+
+  convolution_parameters p = {};
+  p.input_height = s.height;
+  p.input_width = s.width;
+  p.output_channels = s.oc;
+  p.output_height = out_height;
+  p.output_width = out_width;
+  p.kernel_depth = s.ic;
+  p.kernel_height = 3;
+  p.kernel_width = 3;
+  p.kernel_elements = 9;
+  p.stride_along_height = 1;
+  p.stride_along_width = 1;
+  p.padding = s.pad_top;
+  p.padding_top = s.pad_top;
+  p.padding_bottom = s.pad_bottom;
+  p.padding_left = s.pad_left;
+  p.padding_right = s.pad_right;
+  p.winograd_weights = u.data();
+  p.winograd_tile = s.tile;
+
+  using view_t = TensorView<T_FLOAT, MemoryLayout::NHWC>;
+  const view_t in_view(input.data(), {1, s.height, s.width, s.ic});
+  const view_t out_view(output.data(), {1, out_height, out_width, s.oc});
+  dlk::impl::conv3x3_winograd(in_view, out_view, p);
+
+  const auto expected = direct_convolution(s, input, kernels, out_height, out_width);
+  // the transforms of F(4x4, 3x3) lose a few more bits than those of F(2x2, 3x3)
+  const double tolerance = (s.tile == 4 ? 1e-4 : 1e-5) * 9 * s.ic;
+  for (std::size_t y = 0; y < out_height; ++y) {
+    for (std::size_t x = 0; x < out_width; ++x) {
+      for (std::size_t o = 0; o < s.oc; ++o) {
+        const std::size_t i = (y * out_width + x) * s.oc + o;
+        ASSERT_NEAR(output[i], expected[i], tolerance)
+          << "at (" << y << ", " << x << ", " << o << ") with F(" << s.tile << "x" << s.tile << ", 3x3)";
+      }
+    }
+  }
+  for (std::size_t i = out_height * out_width * s.oc; i < output.size(); ++i) {
+    ASSERT_EQ(output[i], guard);
+  }
+}
+
+} // namespace
+
+TEST(Conv2dWinogradTest, F2MatchesDirectConvolution) {
+  check({2, 8, 8, 16, 16, 1, 1, 1, 1});
+}
+
+TEST(Conv2dWinogradTest, F4MatchesDirectConvolution) {
+  check({4, 16, 16, 16, 24, 1, 1, 1, 1});
+}
+
+TEST(Conv2dWinogradTest, PartialTiles) {
+  // odd output sizes leave the last row and column of tiles partly outside
+  check({2, 7, 9, 16, 16, 1, 1, 1, 1});
+  check({4, 9, 11, 16, 16, 1, 1, 1, 1});
+  check({4, 6, 5, 16, 16, 1, 1, 1, 1});
+}
+
+TEST(Conv2dWinogradTest, UnalignedChannels) {
+  // neither count is a multiple of any vector width
+  check({2, 8, 8, 5, 13, 1, 1, 1, 1});
+  check({4, 12, 12, 13, 5, 1, 1, 1, 1});
+  check({4, 8, 8, 1, 1, 1, 1, 1, 1});
+}
+
+TEST(Conv2dWinogradTest, AsymmetricPadding) {
+  check({2, 7, 9, 5, 13, 0, 2, 2, 0});
+  check({4, 11, 10, 13, 5, 2, 0, 1, 1});
+  check({4, 10, 10, 16, 8, 0, 1, 0, 1});
+}
@@ -0,0 +1,204 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "dma_buffer.h"
+
+namespace {
+
+// udmabuf devices as files under a temporary directory: <root>/dev/<name>
+// to map, and <root>/sys/class/udmabuf/<name>/ with the attributes of the
+// driver. The control files are plain files, so every value written to them
+// is kept, one per line.
+class DmaBufferTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char dir[] = "/tmp/dlk_dma_test_XXXXXX";
+    ASSERT_NE(mkdtemp(dir), nullptr);
+    root = dir;
+    ASSERT_EQ(0, mkdir((root + "/dev").c_str(), 0755));
+    ASSERT_EQ(0, mkdir((root + "/sys").c_str(), 0755));
+    ASSERT_EQ(0, mkdir((root + "/sys/class").c_str(), 0755));
+    ASSERT_EQ(0, mkdir((root + "/sys/class/udmabuf").c_str(), 0755));
+  }
+
+  void TearDown() override {
+    std::system(("rm -rf " + root).c_str());
+  }
+
+  void AddDevice(const std::string& name, unsigned long phys_addr, unsigned long size) {
+    const std::string dev = root + "/dev/" + name;
+    std::ofstream(dev).close();
+    ASSERT_EQ(0, truncate(dev.c_str(), size));
+    const std::string sys = root + "/sys/class/udmabuf/" + name;
+    ASSERT_EQ(0, mkdir(sys.c_str(), 0755));
+    std::ofstream(sys + "/phys_addr") << std::hex << "0x" << phys_addr << "\n";
+    std::ofstream(sys + "/size") << size << "\n";
+    for (const char* ctrl : {"sync_for_cpu", "sync_for_device", "sync_offset", "sync_size"}) {
+      std::ofstream(sys + "/" + ctrl).close();
+    }
+  }
+
+  std::vector<std::string> Written(const std::string& name, const std::string& ctrl) const {
+    std::ifstream in(root + "/sys/class/udmabuf/" + name + "/" + ctrl);
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(in, line)) {
+      lines.push_back(line);
+    }
+    return lines;
+  }
+
+  // the range of the last sync, and how many of each direction there were
+  struct Syncs {
+    std::string offset, size;
+    std::size_t for_cpu, for_device;
+  };
+
+  Syncs LastSync(const std::string& name) const {
+    const auto offsets = Written(name, "sync_offset");
+    const auto sizes = Written(name, "sync_size");
+    std::ifstream cpu(root + "/sys/class/udmabuf/" + name + "/sync_for_cpu");
+    std::ifstream device(root + "/sys/class/udmabuf/" + name + "/sync_for_device");
+    std::stringstream cpu_text, device_text;
+    cpu_text << cpu.rdbuf();
+    device_text << device.rdbuf();
+    return {
+      offsets.empty() ? "" : offsets.back(),
+      sizes.empty() ? "" : sizes.back(),
+      cpu_text.str().size(),
+      device_text.str().size()
+    };
+  }
+
+  std::string root;
+};
+
+} // namespace
+
+TEST_F(DmaBufferTest, SubAllocatesAtPageBoundaries) {
+  AddDevice("udmabuf0", 0x3e000000, 1 << 20);
+  DMA_Memory memory("udmabuf", 8, root);
+  DMA_Buffer a, b, c;
+  ASSERT_TRUE(a.init(memory, 1000, 4));
+  ASSERT_TRUE(b.init(memory, 3000, 2));
+  ASSERT_TRUE(c.init(memory, 10, 1));
+
+  EXPECT_EQ(a.physical_address(), 0x3e000000ul);
+  EXPECT_EQ(b.physical_address(), 0x3e000000ul + 4096);
+  EXPECT_EQ(c.physical_address(), 0x3e000000ul + 3 * 4096);
+  EXPECT_EQ(b.size_in_bytes(), 6000ul);
+
+  // one mapping of the device behind all of them
+  const auto base = static_cast<volatile uint8_t*>(a.buffer());
+  EXPECT_EQ(static_cast<volatile uint8_t*>(b.buffer()), base + 4096);
+  EXPECT_EQ(static_cast<volatile uint8_t*>(c.buffer()), base + 3 * 4096);
+}
+
+TEST_F(DmaBufferTest, ReportsExhaustion) {
+  AddDevice("udmabuf0", 0x3e000000, 64 << 10);
+  DMA_Memory memory("udmabuf", 8, root);
+  DMA_Buffer a, b, c;
+  ASSERT_TRUE(a.init(memory, 40000, 1));
+  // there is no udmabuf1 for what does not fit udmabuf0
+  EXPECT_FALSE(b.init(memory, 40000, 1));
+  EXPECT_EQ(b.buffer(), nullptr);
+  // the rest of udmabuf0 is still there
+  ASSERT_TRUE(c.init(memory, 20000, 1));
+  EXPECT_EQ(c.physical_address(), 0x3e000000ul + 40960);
+}
+
+TEST_F(DmaBufferTest, TakesTheNextDevice) {
+  AddDevice("udmabuf0", 0x3e000000, 64 << 10);
+  AddDevice("udmabuf1", 0x3f000000, 64 << 10);
+  DMA_Memory memory("udmabuf", 8, root);
+  DMA_Buffer a, b, c;
+  ASSERT_TRUE(a.init(memory, 40000, 1));
+  ASSERT_TRUE(b.init(memory, 40000, 1));
+  EXPECT_EQ(b.physical_address(), 0x3f000000ul);
+  // udmabuf0 is tried first
+  ASSERT_TRUE(c.init(memory, 20000, 1));
+  EXPECT_EQ(c.physical_address(), 0x3e000000ul + 40960);
+  DMA_Buffer d;
+  EXPECT_FALSE(d.init(memory, 1 << 20, 1));
+}
+
+TEST_F(DmaBufferTest, SyncsOnlyTheRequestedRange) {
+  AddDevice("udmabuf0", 0x3e000000, 1 << 20);
+  DMA_Memory memory("udmabuf", 8, root);
+  DMA_Buffer a, b;
+  ASSERT_TRUE(a.init(memory, 1000, 4));
+  ASSERT_TRUE(b.init(memory, 3000, 2));
+
+  ASSERT_TRUE(a.sync_for_device(0, 400));
+  auto s = LastSync("udmabuf0");
+  EXPECT_EQ(s.offset, "0");
+  EXPECT_EQ(s.size, "400");
+  EXPECT_EQ(s.for_device, 1u);
+  EXPECT_EQ(s.for_cpu, 0u);
+
+  // offsets are relative to the buffer
+  ASSERT_TRUE(b.sync_for_cpu(100, 1000));
+  s = LastSync("udmabuf0");
+  EXPECT_EQ(s.offset, "4196");
+  EXPECT_EQ(s.size, "1000");
+  EXPECT_EQ(s.for_cpu, 1u);
+
+  // clamped to the end of the buffer
+  ASSERT_TRUE(b.sync_for_cpu(5990, 100));
+  s = LastSync("udmabuf0");
+  EXPECT_EQ(s.offset, "10086");
+  EXPECT_EQ(s.size, "10");
+
+  // the range set with sync_offset / sync_size
+  b.sync_offset(8);
+  b.sync_size(64);
+  ASSERT_TRUE(b.sync_for_device());
+  s = LastSync("udmabuf0");
+  EXPECT_EQ(s.offset, "4104");
+  EXPECT_EQ(s.size, "64");
+  EXPECT_EQ(s.for_device, 2u);
+
+  // nothing to sync past the end
+  ASSERT_TRUE(b.sync_for_cpu(6000, 100));
+  EXPECT_EQ(LastSync("udmabuf0").for_cpu, 2u);
+}
+
+TEST_F(DmaBufferTest, WritesChangedAttributesOnly) {
+  AddDevice("udmabuf0", 0x3e000000, 1 << 20);
+  DMA_Memory memory("udmabuf", 8, root);
+  DMA_Buffer a;
+  ASSERT_TRUE(a.init(memory, 1000, 4));
+
+  ASSERT_TRUE(a.sync_for_device(0, 400));
+  ASSERT_TRUE(a.sync_for_cpu(0, 400));
+  ASSERT_TRUE(a.sync_for_device(0, 800));
+
+  EXPECT_EQ(Written("udmabuf0", "sync_offset"), std::vector<std::string>({"0"}));
+  EXPECT_EQ(Written("udmabuf0", "sync_size"), std::vector<std::string>({"400", "800"}));
+  EXPECT_EQ(LastSync("udmabuf0").for_device, 2u);
+  EXPECT_EQ(LastSync("udmabuf0").for_cpu, 1u);
+}
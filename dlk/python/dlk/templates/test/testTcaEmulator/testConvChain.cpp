@@ -0,0 +1,181 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "dma_buffer.h"
+#include "func/impl/quantized_conv2d_kn2row.h"
+#include "global.h"
+#include "operators.h"
+#include "tca_emulator.h"
+
+namespace {
+
+constexpr unsigned b = 32;
+constexpr std::size_t height = 20, width = 18;
+
+struct Layer {
+  unsigned k, in_c, out_c;
+};
+
+// bytes of the 2-bit output of a layer, as the next one reads it
+std::size_t output_bytes(const Layer& l) {
+  return l.out_c / b * height * width * 2 * sizeof(uint32_t);
+}
+
+// the emulated device memory is plain memory to the test
+void* data(DMA_Buffer& buf) {
+  return const_cast<void*>(buf.buffer());
+}
+
+class ConvChainTest : public ::testing::Test {
+ protected:
+  // kernels and thresholds of every layer in the device memory, the
+  // thresholds giving all four levels and some constant channels
+  void SetUp() override {
+    std::mt19937 rng(7);
+    unsigned long kernel_offset = 0, thresholds_offset = 0;
+    for (const Layer& l : layers) {
+      const std::size_t kernel_words = l.k * l.k * l.out_c * l.in_c / b;
+      auto* kernel = static_cast<uint32_t*>(de10_nano::emulator::Map(KERNEL_ADDR + kernel_offset, kernel_words * 4));
+      for (std::size_t i = 0; i < kernel_words; ++i) {
+        kernel[i] = rng();
+      }
+      auto* th = static_cast<int16_t*>(de10_nano::emulator::Map(THRESHOLD_ADDR + thresholds_offset,
+          l.out_c * NUM_OF_A2W1_THRESHOLD * 2));
+      for (unsigned o = 0; o < l.out_c; ++o) {
+        int16_t* t = &th[o * NUM_OF_A2W1_THRESHOLD];
+        const int base = l.k == 3 ? -30 : -4;
+        t[0] = base + static_cast<int>(rng() % 5);
+        t[1] = t[0] + 8 + static_cast<int>(rng() % 5);
+        t[2] = t[1] + 8;
+        t[3] = o % 7 == 0 ? -1 : o % 11 == 0 ? 2 : 1;
+        if (t[3] == -1) {
+          std::swap(t[0], t[2]);
+        }
+      }
+
+      binary_convolution_parameters p = {};
+      auto& cp = p.normal_conv_params;
+      cp.input_height = cp.output_height = height;
+      cp.input_width = cp.output_width = width;
+      cp.output_channels = l.out_c;
+      cp.kernel_height = cp.kernel_width = l.k;
+      cp.kernel_depth = l.in_c;
+      cp.kernel_elements = l.k * l.k * l.in_c;
+      cp.stride_along_height = cp.stride_along_width = 1;
+      cp.padding = cp.padding_top = cp.padding_bottom = cp.padding_left = cp.padding_right = l.k / 2;
+      p.bin_input_bitwidth = 2;
+      p.n_bit = 2;
+      p.max_value = 2;
+      p.thresholds = reinterpret_cast<BIN_CONV_OUTPUT*>(th);
+      p.device_kernel_phys_addr = KERNEL_ADDR + kernel_offset;
+      p.device_thresholds_phys_addr = THRESHOLD_ADDR + thresholds_offset;
+      p.device_input_phys_addr = INPUT0_ADDR;
+      p.device_output_phys_addr = OUTPUT0_ADDR;
+      params.push_back(p);
+
+      kernel_offset += kernel_words * 4;
+      thresholds_offset += l.out_c * NUM_OF_A2W1_THRESHOLD * 2;
+    }
+
+    input.resize(layers[0].in_c / b * height * width * 2);
+    for (auto& v : input) {
+      v = rng();
+    }
+  }
+
+  // every layer runs on these device buffers
+  void Attach(DMA_Buffer& in_buf, DMA_Buffer& out_buf) {
+    for (auto& p : params) {
+      p.device_input_buf = static_cast<QUANTIZED_PACKED*>(data(in_buf));
+      p.device_output_buf = static_cast<BIN_CONV_OUTPUT*>(data(out_buf));
+      p.dma_input_buffer = &in_buf;
+      p.dma_output_buffer = &out_buf;
+    }
+  }
+
+  std::vector<std::size_t> OutputElems() const {
+    std::vector<std::size_t> elems;
+    for (const Layer& l : layers) {
+      elems.push_back(height * width * l.out_c);
+    }
+    return elems;
+  }
+
+  const std::vector<Layer> layers = {{3, 64, 64}, {1, 64, 32}, {3, 32, 96}, {1, 96, 64}, {3, 64, 32}};
+  std::vector<binary_convolution_parameters> params;
+  std::vector<uint32_t> input;
+};
+
+} // namespace
+
+TEST_F(ConvChainTest, MatchesLayerByLayer) {
+  DMA_Buffer in_buf, out_buf;
+  ASSERT_TRUE(in_buf.init("mem", 96 / 16 * height * width, sizeof(QUANTIZED_PACKED), false, INPUT0_ADDR));
+  ASSERT_TRUE(out_buf.init("mem", 96 * height * width, sizeof(BIN_CONV_OUTPUT), false, OUTPUT0_ADDR));
+  Attach(in_buf, out_buf);
+  const auto elems = OutputElems();
+  ASSERT_TRUE(dlk::impl::TCAConv2dChainFits(elems.data(), layers.size(), in_buf, out_buf));
+
+  const dlk::impl::kn2row_input_t::tensor_info_t<std::size_t> shape = {
+    layers[0].in_c / b, height, width, 2, b
+  };
+  QUANTIZED_PACKED_KERNEL dummy;
+  const kernel_t kernel(&dummy, {1, 1, 1, 1, 1, 1});
+
+  // one convolution at a time, the output of each copied to the input of the next
+  std::vector<uint32_t> expected = input;
+  for (std::size_t k = 0; k < layers.size(); ++k) {
+    std::memcpy(data(in_buf), expected.data(), expected.size() * 4);
+    const dlk::impl::kn2row_input_t x(static_cast<QUANTIZED_PACKED*>(data(in_buf)), shape);
+    dlk::impl::TCAConv2d(x, kernel, params[k]);
+    expected.resize(output_bytes(layers[k]) / 4);
+    std::memcpy(expected.data(), data(out_buf), output_bytes(layers[k]));
+  }
+
+  std::memset(data(out_buf), 0, out_buf.size_in_bytes());
+  std::memcpy(data(in_buf), input.data(), input.size() * 4);
+  const dlk::impl::kn2row_input_t x(static_cast<QUANTIZED_PACKED*>(data(in_buf)), shape);
+  const std::size_t errors = de10_nano::emulator::Errors();
+  const QUANTIZED_PACKED* result = dlk::impl::TCAConv2dChain(x, params.data(), params.size());
+  ASSERT_EQ(de10_nano::emulator::Errors(), errors);
+
+  ASSERT_EQ(0, std::memcmp(result, expected.data(), output_bytes(layers.back())));
+}
+
+TEST_F(ConvChainTest, DoesNotFitSmallBuffers) {
+  const auto elems = OutputElems();
+
+  // the third layer's 96 channels go to the output buffer, the others fit
+  DMA_Buffer in_buf, out_buf;
+  ASSERT_TRUE(in_buf.init("mem", 96 / 16 * height * width, sizeof(QUANTIZED_PACKED), false, INPUT0_ADDR));
+  ASSERT_TRUE(out_buf.init("mem", 64 / 16 * height * width, sizeof(QUANTIZED_PACKED), false, OUTPUT0_ADDR));
+  EXPECT_FALSE(dlk::impl::TCAConv2dChainFits(elems.data(), layers.size(), in_buf, out_buf));
+  EXPECT_TRUE(dlk::impl::TCAConv2dChainFits(elems.data(), 2, in_buf, out_buf));
+
+  // the second layer's output goes to the input buffer
+  DMA_Buffer small_in, big_out;
+  ASSERT_TRUE(small_in.init("mem", 16 / 16 * height * width, sizeof(QUANTIZED_PACKED), false, INPUT1_ADDR));
+  ASSERT_TRUE(big_out.init("mem", 96 / 16 * height * width, sizeof(QUANTIZED_PACKED), false, OUTPUT1_ADDR));
+  EXPECT_TRUE(dlk::impl::TCAConv2dChainFits(elems.data(), 1, small_in, big_out));
+  EXPECT_FALSE(dlk::impl::TCAConv2dChainFits(elems.data(), 2, small_in, big_out));
+}
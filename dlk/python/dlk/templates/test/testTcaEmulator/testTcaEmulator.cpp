@@ -0,0 +1,186 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "de10_nano.h"
+#include "global.h"
+#include "tca_emulator.h"
+#include "tca_wait.h"
+
+namespace {
+
+constexpr unsigned b = 32;
+
+struct Shape {
+  unsigned h, w, in_c, out_c, k;
+};
+
+// What the TCA computes, from first principles: a kernel bit of 0 in the
+// TCA layout is a weight of +1, a 1 is -1; inputs are 2-bit values split
+// into a low and a high bit plane.
+int32_t reference(const std::vector<uint32_t>& input, const std::vector<uint32_t>& kernel,
+    const Shape& s, unsigned y, unsigned x, unsigned o) {
+  const unsigned in_blocks = s.in_c / b;
+  const int pad = s.k / 2;
+  const unsigned ob = o / b;
+  int32_t sum = 0;
+  for (unsigned ky = 0; ky < s.k; ++ky) {
+    for (unsigned kx = 0; kx < s.k; ++kx) {
+      const int iy = int(y + ky) - pad;
+      const int ix = int(x + kx) - pad;
+      if (iy < 0 || ix < 0 || iy >= int(s.h) || ix >= int(s.w)) {
+        continue;
+      }
+      for (unsigned ib = 0; ib < in_blocks; ++ib) {
+        const uint32_t* in = &input[((ib * s.h + iy) * s.w + ix) * 2];
+        const uint32_t k = kernel[(((ob * in_blocks + ib) * s.k + ky) * s.k + kx) * b + o % b];
+        for (unsigned c = 0; c < b; ++c) {
+          const int32_t v = ((in[0] >> c) & 1) + 2 * ((in[1] >> c) & 1);
+          sum += ((k >> c) & 1) ? -v : v;
+        }
+      }
+    }
+  }
+  return sum;
+}
+
+uint32_t apply(int32_t d, const int16_t* t) {
+  if (t[3] == 1) {
+    return d < t[0] ? 0 : d < t[1] ? 1 : d < t[2] ? 2 : 3;
+  } else if (t[3] == -1) {
+    return d > t[2] ? 0 : d > t[1] ? 1 : d > t[0] ? 2 : 3;
+  } else if (t[3] == 0) {
+    return 0;
+  }
+  return t[3] - 2;
+}
+
+void check(const Shape& s, bool thresholds) {
+  std::mt19937 rng(s.h * 131 + s.w * 17 + s.in_c + s.out_c + s.k + thresholds);
+  const unsigned in_blocks = s.in_c / b;
+  const unsigned out_blocks = s.out_c / b;
+
+  std::vector<uint32_t> input(in_blocks * s.h * s.w * 2);
+  std::vector<uint32_t> kernel(out_blocks * in_blocks * s.k * s.k * b);
+  for (auto& v : input) v = rng();
+  for (auto& v : kernel) v = rng();
+  std::vector<int16_t> th(s.out_c * NUM_OF_A2W1_THRESHOLD);
+  const int range = s.k * s.k * s.in_c;
+  for (unsigned o = 0; o < s.out_c; ++o) {
+    int16_t* t = &th[o * NUM_OF_A2W1_THRESHOLD];
+    std::uniform_int_distribution<int> level(-range / 4, range / 4);
+    int v[3] = {level(rng), level(rng), level(rng)};
+    std::sort(v, v + 3);
+    const int flag = o % 8 == 6 ? 0 : o % 8 == 7 ? 3 : o % 2 ? -1 : 1;
+    t[0] = v[0]; t[1] = v[1]; t[2] = v[2]; t[3] = flag;
+  }
+
+  const std::size_t output_words = out_blocks * s.h * s.w * (thresholds ? 2 : b / 2);
+  std::memcpy(de10_nano::emulator::Map(INPUT_ADDR, input.size() * 4), input.data(), input.size() * 4);
+  std::memcpy(de10_nano::emulator::Map(KERNEL_ADDR, kernel.size() * 4), kernel.data(), kernel.size() * 4);
+  std::memcpy(de10_nano::emulator::Map(THRESHOLD_ADDR, th.size() * 2), th.data(), th.size() * 2);
+  auto* output = static_cast<uint32_t*>(de10_nano::emulator::Map(OUTPUT_ADDR, output_words * 4));
+  std::memset(output, 0xA5, output_words * 4);
+
+  const std::size_t errors = de10_nano::emulator::Errors();
+  de10_nano::RunTCA(INPUT_ADDR, OUTPUT_ADDR, KERNEL_ADDR, thresholds ? THRESHOLD_ADDR : 0,
+      s.w, s.h, s.in_c, MAX_NBIT_QINPUT, s.w, s.h, s.out_c, s.k, s.k, s.k / 2, 1);
+  ASSERT_EQ(de10_nano::emulator::Errors(), errors);
+
+  for (unsigned ob = 0; ob < out_blocks; ++ob) {
+    for (unsigned y = 0; y < s.h; ++y) {
+      for (unsigned x = 0; x < s.w; ++x) {
+        const std::size_t element = (ob * s.h + y) * s.w + x;
+        uint32_t lsb = 0, msb = 0;
+        for (unsigned o = 0; o < b; ++o) {
+          const int32_t expected = reference(input, kernel, s, y, x, ob * b + o);
+          if (thresholds) {
+            const uint32_t q = apply(expected, &th[(ob * b + o) * NUM_OF_A2W1_THRESHOLD]);
+            lsb |= (q & 1) << o;
+            msb |= (q >> 1) << o;
+          } else {
+            ASSERT_EQ(reinterpret_cast<int16_t*>(output)[element * b + o], expected)
+                << "at " << y << "," << x << "," << ob * b + o;
+          }
+        }
+        if (thresholds) {
+          ASSERT_EQ(output[element * 2], lsb) << "at " << y << "," << x << "," << ob;
+          ASSERT_EQ(output[element * 2 + 1], msb) << "at " << y << "," << x << "," << ob;
+        }
+      }
+    }
+  }
+}
+
+const Shape shapes[] = {
+  {8, 8, 32, 32, 3},
+  {32, 32, 64, 32, 3},
+  {45, 70, 32, 64, 3},
+  {64, 40, 64, 64, 3},
+  {16, 16, 64, 32, 1},
+  {45, 70, 32, 64, 1},
+};
+
+} // namespace
+
+TEST(TcaEmulator, Convolution) {
+  for (const auto& s : shapes) {
+    SCOPED_TRACE(::testing::Message() << s.h << "x" << s.w << "x" << s.in_c << " -> " << s.out_c << ", " << s.k << "x" << s.k);
+    check(s, false);
+  }
+}
+
+TEST(TcaEmulator, ConvolutionWithThresholds) {
+  for (const auto& s : shapes) {
+    SCOPED_TRACE(::testing::Message() << s.h << "x" << s.w << "x" << s.in_c << " -> " << s.out_c << ", " << s.k << "x" << s.k);
+    check(s, true);
+  }
+}
+
+TEST(TcaEmulator, WaitPolicies) {
+  const de10_nano::WaitPolicy policy = de10_nano::Completion::Policy();
+  for (const char* name : {"spin", "poll", "interrupt"}) {
+    SCOPED_TRACE(name);
+    ASSERT_TRUE(de10_nano::Completion::SetPolicy(name));
+    const std::size_t jobs = de10_nano::emulator::Jobs();
+    for (int i = 0; i < 3; ++i) {
+      check(shapes[2], i % 2 == 0);
+    }
+    EXPECT_EQ(de10_nano::emulator::Jobs(), jobs + 3);
+  }
+  EXPECT_FALSE(de10_nano::Completion::SetPolicy("sleep"));
+  de10_nano::Completion::SetPolicy(policy);
+}
+
+TEST(TcaEmulator, RejectsInconsistentRegisters) {
+  const std::size_t errors = de10_nano::emulator::Errors();
+  de10_nano::RunTCA(INPUT_ADDR, OUTPUT_ADDR, KERNEL_ADDR, 0, 8, 8, 32, MAX_NBIT_QINPUT, 8, 8, 32, 3, 3, 1, 1);
+  ASSERT_EQ(de10_nano::emulator::Errors(), errors);
+
+  // the same job, but the input space no longer matches the tiles
+  volatile uint32_t* csr = de10_nano::CsrBlock();
+  csr[static_cast<std::size_t>(de10_nano::Csr::admaInputSpace)] += 1;
+  csr[static_cast<std::size_t>(de10_nano::Csr::start)] = 1;
+  de10_nano::emulator::Start(csr);
+  de10_nano::WaitTCA();
+  EXPECT_EQ(de10_nano::emulator::Errors(), errors + 1);
+}
@@ -0,0 +1,145 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "global.h"
+#include "tca_emulator.h"
+#include "weight_store.h"
+
+namespace {
+
+using de10_nano::WeightStore;
+
+// A model of two convolutions, with kernels and thresholds filled from seed.
+struct Model {
+  uint64_t id;
+  std::vector<uint32_t> kernel[2];
+  std::vector<int16_t> thresholds[2];
+  std::vector<WeightStore::Chunk> kernel_chunks, threshold_chunks;
+  std::size_t kernel_size = 0, thresholds_size = 0;
+
+  Model(uint64_t id, std::size_t kernel_words, uint32_t seed) : id(id) {
+    for (unsigned i = 0; i < 2; ++i) {
+      kernel[i].resize(kernel_words);
+      for (std::size_t j = 0; j < kernel_words; ++j) {
+        kernel[i][j] = seed * 2654435761u + i * 977 + j;
+      }
+      kernel_chunks.push_back({ kernel_size, kernel[i].data(), kernel_words * 4 });
+      kernel_size += kernel_words * 4;
+      thresholds[i].assign(64, static_cast<int16_t>(seed + i));
+      threshold_chunks.push_back({ thresholds_size, thresholds[i].data(), 128 });
+      thresholds_size += 128;
+    }
+  }
+
+  WeightStore::Placement Place() const {
+    WeightStore::Placement p;
+    EXPECT_TRUE(WeightStore::Place(id, kernel_chunks, kernel_size, threshold_chunks, thresholds_size, p));
+    return p;
+  }
+
+  bool Resident(const WeightStore::Placement& p) const {
+    auto k = static_cast<const uint8_t*>(de10_nano::emulator::Map(p.kernel_addr, kernel_size));
+    auto t = static_cast<const uint8_t*>(de10_nano::emulator::Map(p.thresholds_addr, thresholds_size));
+    return std::memcmp(k, kernel[0].data(), kernel[0].size() * 4) == 0
+      && std::memcmp(k + kernel[0].size() * 4, kernel[1].data(), kernel[1].size() * 4) == 0
+      && std::memcmp(t, thresholds[0].data(), 128) == 0
+      && std::memcmp(t + 128, thresholds[1].data(), 128) == 0;
+  }
+};
+
+class WeightStoreTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    setenv("DLK_WEIGHTS_LOCK", "/tmp/dlk_weights_test.lock", 1);
+    unsetenv("DLK_WEIGHTS_VERIFY");
+    unsetenv("DLK_WEIGHTS_UPLOAD");
+    WeightStore::Clear();
+  }
+};
+
+} // namespace
+
+TEST_F(WeightStoreTest, SkipsResidentModels) {
+  const Model a(1, 1000, 1);
+  const auto first = a.Place();
+  EXPECT_TRUE(first.uploaded);
+  EXPECT_TRUE(a.Resident(first));
+
+  const auto second = a.Place();
+  EXPECT_FALSE(second.uploaded);
+  EXPECT_EQ(second.kernel_addr, first.kernel_addr);
+  EXPECT_EQ(second.thresholds_addr, first.thresholds_addr);
+
+  setenv("DLK_WEIGHTS_UPLOAD", "1", 1);
+  EXPECT_TRUE(a.Place().uploaded);
+}
+
+TEST_F(WeightStoreTest, KeepsModelsSideBySide) {
+  const Model a(1, 1000, 1), b(2, 3000, 2);
+  const auto pa = a.Place();
+  const auto pb = b.Place();
+  EXPECT_TRUE(pb.uploaded);
+  EXPECT_GE(pb.kernel_addr, pa.kernel_addr + a.kernel_size);
+  EXPECT_GE(pb.thresholds_addr, pa.thresholds_addr + a.thresholds_size);
+  EXPECT_GE(pa.kernel_addr, static_cast<unsigned long>(KERNEL_ADDR) + 4096);
+  EXPECT_EQ(pa.kernel_addr % 4096, 0u);
+  EXPECT_EQ(pb.kernel_addr % 4096, 0u);
+
+  EXPECT_FALSE(a.Place().uploaded);
+  EXPECT_FALSE(b.Place().uploaded);
+  EXPECT_TRUE(a.Resident(pa));
+  EXPECT_TRUE(b.Resident(pb));
+}
+
+TEST_F(WeightStoreTest, EvictsLeastRecentlyPlaced) {
+  // three of these do not fit in the kernel range
+  const std::size_t words = (THRESHOLD_ADDR - KERNEL_ADDR) / 4 / 2 / 5 * 2;
+  const Model a(1, words, 1), b(2, words, 2), c(3, words, 3);
+  a.Place();
+  b.Place();
+  a.Place(); // b is now the least recently placed
+
+  const auto pc = c.Place();
+  EXPECT_TRUE(pc.uploaded);
+  EXPECT_TRUE(c.Resident(pc));
+  EXPECT_FALSE(a.Place().uploaded);
+  EXPECT_TRUE(b.Place().uploaded);
+}
+
+TEST_F(WeightStoreTest, VerifiesOnRequest) {
+  const Model a(1, 1000, 1);
+  const auto pa = a.Place();
+  static_cast<uint32_t*>(de10_nano::emulator::Map(pa.kernel_addr, 4))[0] ^= 1;
+
+  EXPECT_FALSE(a.Place().uploaded);
+  setenv("DLK_WEIGHTS_VERIFY", "1", 1);
+  const auto again = a.Place();
+  EXPECT_TRUE(again.uploaded);
+  EXPECT_TRUE(a.Resident(again));
+  EXPECT_FALSE(a.Place().uploaded);
+}
+
+TEST_F(WeightStoreTest, RejectsOversizedModels) {
+  const Model a(1, (THRESHOLD_ADDR - KERNEL_ADDR) / 8, 1);
+  WeightStore::Placement p;
+  EXPECT_FALSE(WeightStore::Place(a.id, a.kernel_chunks, a.kernel_size, a.threshold_chunks, a.thresholds_size, p));
+}
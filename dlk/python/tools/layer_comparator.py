@@ -25,7 +25,7 @@ import numpy as np
     "-d",
     "--debug_data_path",
     type=click.Path(exists=True),
-    help="Directory containing the debug data generated in runtime",
+    help="Directory containing the debug data of one run, e.g. debug/0",
 )
 @click.option(
     "-e",
@@ -69,7 +69,10 @@ def main(debug_data_path, expected_data_path):
                 r_tol = 0.0001
                 a_tol = 0.0001
 
-                within_tolerance = np.isclose(data_ex.flatten() * data_dbg['scale'], data_dbg['data'],
+                # int32 outputs are the accumulated conv results, scaled by 3/2
+                scale = 3.0 / 2.0 if data_dbg.dtype == np.int32 else 1.0
+
+                within_tolerance = np.isclose(data_ex.flatten() * scale, data_dbg.flatten(),
                                               rtol=r_tol, atol=a_tol)
 
                 if np.all(within_tolerance):
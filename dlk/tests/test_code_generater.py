@@ -0,0 +1,98 @@
+# -*- coding: utf-8 -*-
+# Copyright 2019 The Blueoil Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+# =============================================================================
+"""Test file for the graph passes of CodeGenerater."""
+import unittest
+from typing import List, Tuple
+
+import numpy as np
+
+from code_generater import CodeGenerater
+from core.config import Config
+from core.data_types import QUANTIZED_PACKED
+from core.graph import Graph
+from core.operators import ConcatOnDepth, Constant, Input, Operator, Output, Relu
+
+
+class TestAliasConcatInputs(unittest.TestCase):
+    """Test class for writing the inputs of a concat in place."""
+
+    @staticmethod
+    def shape(blocks: int, low: int = 32) -> List[int]:
+        return [blocks, 8, 8, 2, low]
+
+    def run_pass(self, inputs: List[Operator], outputs: Tuple[Operator, ...] = ()) -> None:
+        blocks = sum(x.shape[0] for x in inputs)
+        cat = ConcatOnDepth('cat', self.shape(blocks), QUANTIZED_PACKED(),
+                            {f'input{i + 1}': x for i, x in enumerate(inputs)}, dimension_format='ChHWBCl')
+        graph = Graph()
+        graph.add_op_and_inputs(Output('output', self.shape(blocks), QUANTIZED_PACKED(), {'input': cat},
+                                       dimension_format='ChHWBCl'))
+        # the code generator wants exactly one graph input
+        x = Input('input', self.shape(1), QUANTIZED_PACKED(), dimension_format='ChHWBCl')
+        graph.add_op_and_inputs(Output('input_copy', self.shape(1), QUANTIZED_PACKED(), {'input': x},
+                                       dimension_format='ChHWBCl'))
+        for y in outputs:
+            graph.add_op_and_inputs(y)
+        CodeGenerater(graph, None, Config(output_pj_path='')).alias_concat_inputs()
+
+    def constant(self, name: str, shape: List[int]) -> Operator:
+        return Constant(name, QUANTIZED_PACKED(), np.zeros(shape), dimension_format='ChHWBCl')
+
+    def producers(self, *shapes: List[int]) -> List[Operator]:
+        return [Relu(f'relu{i}', s, QUANTIZED_PACKED(), {'X': self.constant(f'weight{i}', s)},
+                     dimension_format='ChHWBCl')
+                for i, s in enumerate(shapes)]
+
+    def test_offsets(self) -> None:
+        a, b = self.producers(self.shape(2), self.shape(1))
+        self.run_pass([a, b])
+
+        self.assertEqual((a.aliased_buffer, a.aliased_offset), ('cat', 0))
+        self.assertEqual((b.aliased_buffer, b.aliased_offset), ('cat', 2))
+
+    def test_unaligned_last_input(self) -> None:
+        a, b = self.producers(self.shape(2), self.shape(1, 16))
+        self.run_pass([a, b])
+
+        self.assertEqual((b.aliased_buffer, b.aliased_offset), ('cat', 2))
+
+    def test_unaligned_first_input(self) -> None:
+        a, b = self.producers(self.shape(1, 16), self.shape(2))
+        self.run_pass([a, b])
+
+        self.assertEqual(a.aliased_buffer, '')
+        self.assertEqual(b.aliased_buffer, '')
+
+    def test_producer_with_several_consumers(self) -> None:
+        a, b = self.producers(self.shape(2), self.shape(1))
+        other = Output('other', self.shape(2), QUANTIZED_PACKED(), {'input': a}, dimension_format='ChHWBCl')
+        self.run_pass([a, b], (other,))
+
+        self.assertEqual(a.aliased_buffer, '')
+        self.assertEqual(b.aliased_buffer, '')
+
+    def test_constant_input(self) -> None:
+        a, b = self.producers(self.shape(2), self.shape(1))
+        c = self.constant('constant', self.shape(1))
+        self.run_pass([a, c, b])
+
+        # nothing writes the constant into the concat buffer
+        self.assertEqual(a.aliased_buffer, '')
+        self.assertEqual(b.aliased_buffer, '')
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -15,13 +15,14 @@
 # =============================================================================
 """Test file for Optimizer."""
 import unittest
+from typing import List
 from core.data_types import Float32, PackedUint32, Int32, QUANTIZED_PACKED
 from core.optimizer import pass_remove_identities, pass_transpose, pass_constant_folding, \
-    pass_propagate_quantization_details_into_conv, pass_compute_thresholds, pass_pack_weights, \
-    pass_quantize_convolutions, pass_propagate_datatypes, pass_propagate_output_type_backward
+    pass_fold_pad_into_conv, pass_propagate_quantization_details_into_conv, pass_compute_thresholds, pass_pack_weights, \
+    pass_quantize_convolutions, pass_propagate_datatypes, pass_propagate_output_type_backward, pass_winograd_weights
 from core.graph import Graph
 from core.operators import Add, AveragePool, BatchNormalization, Constant, Conv, Identity, Input, \
-    MaxPool, Operator, Output, Transpose, QTZ_binary_mean_scaling, QTZ_linear_mid_tread_half, Reshape, Softmax, \
+    MaxPool, Operator, Output, Pad, Transpose, QTZ_binary_mean_scaling, QTZ_linear_mid_tread_half, Reshape, Softmax, \
     SpaceToDepth
 
 import numpy as np
@@ -547,5 +548,120 @@ class TestPassConstantFolding(unittest.TestCase):
         return graph
 
 
+class TestPassFoldPadIntoConv(unittest.TestCase):
+    """Test class for folding pad into convolution."""
+    def test_pass_fold_pad_into_conv(self) -> None:
+        """Test pass."""
+        data = np.random.rand(2, 2, 2, 4)
+        graph1 = self.create_sample_graph(data)
+
+        pass_fold_pad_into_conv(graph1)
+
+        conv = graph1.get_op('conv')
+        self.assertIsNone(graph1.get_op('pad'), '[Failed] Pad node was not removed')
+        self.assertEqual(conv.input_ops['X'].name, 'placeholder')
+        self.assertTrue(np.array_equal(conv.input_ops['W'].data, data[:, :, :, 1:4]),
+                        '[Failed] Weights for the padded channels were not dropped')
+
+        print("Test pass fold pad into conv passed!")
+
+    def test_pass_fold_spatial_pad_into_conv(self) -> None:
+        """Test pass with height and width paddings."""
+        data = np.random.rand(2, 2, 2, 4)
+        # one row above, two below, one column right, on top of the pads of the conv
+        graph1 = self.create_sample_graph(data, [[0, 0], [1, 2], [0, 1], [1, 0]], [1, 0, 0, 1])
+
+        pass_fold_pad_into_conv(graph1)
+
+        conv = graph1.get_op('conv')
+        self.assertIsNone(graph1.get_op('pad'), '[Failed] Pad node was not removed')
+        self.assertEqual(conv.input_ops['X'].name, 'placeholder')
+        self.assertEqual(conv.pads, [2, 2, 0, 2], '[Failed] Spatial paddings were not added to the conv')
+        self.assertTrue(np.array_equal(conv.input_ops['W'].data, data[:, :, :, 1:4]))
+
+        print("Test pass fold spatial pad into conv passed!")
+
+    @staticmethod
+    def create_sample_graph(data: np.ndarray,
+                            paddings_data: List[List[int]] = [[0, 0], [0, 0], [0, 0], [1, 0]],
+                            conv_pads: List[int] = [0, 0, 0, 0]) -> Graph:
+        graph = Graph()
+
+        x = Input('placeholder', [1, 5, 5, 3], Float32())
+
+        # one channel padded in front unless told otherwise
+        paddings = Constant('paddings', Int32(), np.array(paddings_data))
+        padded_shape = [a + sum(p) for a, p in zip([1, 5, 5, 3], paddings_data)]
+        pad = Pad('pad', padded_shape, Float32(), {'A': x, 'B': paddings})
+
+        # pads are [top, bottom, left, right]
+        out_h = padded_shape[1] + conv_pads[0] + conv_pads[1] - 1
+        out_w = padded_shape[2] + conv_pads[2] + conv_pads[3] - 1
+        w = Constant('weight', Float32(), data)
+        conv = Conv('conv', [1, out_h, out_w, 2], Float32(), {'X': pad, 'W': w}, kernel_shape=[2, 2],
+                    pads=conv_pads)
+
+        y = Output('output', [1, out_h, out_w, 2], Float32(), {'input': conv})
+
+        graph.add_op_and_inputs(y)
+
+        return graph
+
+
+class TestPassWinogradWeights(unittest.TestCase):
+    """Test class for transforming weights for Winograd convolution."""
+    def test_pass_winograd_weights(self) -> None:
+        """Test pass."""
+        data = np.random.rand(20, 3, 3, 16).astype(np.float32)
+        graph1 = self.create_sample_graph(data, [1, 8, 8, 20])
+
+        pass_winograd_weights(graph1)
+
+        w = graph1.get_op('weight')
+        self.assertEqual(w.winograd_tile, 4)
+        self.assertEqual(w.winograd_data.shape, (36, 16, 24))
+        self.assertTrue(np.all(w.winograd_data[:, :, 20:] == 0), '[Failed] Padded output channels are not zero')
+
+        # the first tap of F(4x4, 3x3) is G[0] g G[0]^T = g[0, 0] / 16
+        self.assertTrue(np.allclose(w.winograd_data[0][:, :20], data[:, 0, 0, :].T / 16, atol=1e-6))
+        self.assertTrue(np.all(w.winograd_data[0][:, 20:24] == 0))
+
+        print("Test pass winograd weights passed!")
+
+    def test_pass_winograd_weights_small_output(self) -> None:
+        """Test pass."""
+        data = np.random.rand(16, 3, 3, 16).astype(np.float32)
+        graph1 = self.create_sample_graph(data, [1, 4, 4, 16])
+
+        pass_winograd_weights(graph1)
+
+        w = graph1.get_op('weight')
+        self.assertEqual(w.winograd_tile, 2)
+        self.assertEqual(w.winograd_data.shape, (16, 16, 16))
+
+    def test_pass_winograd_weights_few_channels(self) -> None:
+        """Test pass."""
+        data = np.random.rand(8, 3, 3, 16).astype(np.float32)
+        graph1 = self.create_sample_graph(data, [1, 8, 8, 8])
+
+        pass_winograd_weights(graph1)
+
+        self.assertIsNone(graph1.get_op('weight').winograd_data, '[Failed] Small convolution was transformed')
+
+    @staticmethod
+    def create_sample_graph(data: np.ndarray, out_shape: List[int]) -> Graph:
+        graph = Graph()
+
+        n, h, w, c = out_shape
+        x = Input('placeholder', [1, h + 2, w + 2, data.shape[3]], Float32())
+        weight = Constant('weight', Float32(), data)
+        conv = Conv('conv', out_shape, Float32(), {'X': x, 'W': weight}, kernel_shape=[3, 3])
+        y = Output('output', out_shape, Float32(), {'input': conv})
+
+        graph.add_op_and_inputs(y)
+
+        return graph
+
+
 if __name__ == '__main__':
     unittest.main()
@@ -0,0 +1,199 @@
+/* Copyright 2019 The Blueoil Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+=============================================================================*/
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "blueoil.hpp"
+
+
+typedef std::vector<blueoil::Predictor::StageTime> StageTimes;
+
+struct WorkerResult {
+  StageTimes times;
+  // span of the measured (non-warmup) frames
+  std::chrono::steady_clock::time_point begin, end;
+};
+
+static bool HasImageExtension(const std::string& name) {
+  const char* exts[] = {".png", ".npy"};
+  for (const char* ext : exts) {
+    const size_t len = std::strlen(ext);
+    if (name.size() > len && name.compare(name.size() - len, len, ext) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// PNG/NPY files of a directory in name order, or the path itself if it is a file.
+static std::vector<std::string> ListImages(const std::string& path) {
+  std::vector<std::string> files;
+  DIR* dir = opendir(path.c_str());
+  if (dir == NULL) {
+    files.push_back(path);
+    return files;
+  }
+  while (struct dirent* entry = readdir(dir)) {
+    const std::string name = entry->d_name;
+    if (HasImageExtension(name)) {
+      files.push_back(path + "/" + name);
+    }
+  }
+  closedir(dir);
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+static double Percentile(const std::vector<double>& sorted, double p) {
+  // nearest rank
+  size_t rank = static_cast<size_t>(p / 100.0 * sorted.size() + 0.999999);
+  rank = std::min(std::max<size_t>(rank, 1), sorted.size());
+  return sorted[rank - 1];
+}
+
+// Runs iterations frames (after warmup ones), cycling through the images.
+static void Worker(blueoil::Predictor* predictor, const std::vector<std::string>* images,
+                   int offset, int warmup, int iterations, WorkerResult* result) {
+  for (int i = -warmup; i < iterations; i++) {
+    if (i == 0) {
+      result->begin = std::chrono::steady_clock::now();
+    }
+    const std::string& file = (*images)[(offset + i + warmup) % images->size()];
+    StageTimes frame;
+
+    const auto start = std::chrono::steady_clock::now();
+    blueoil::Tensor image = blueoil::Tensor_loadImage(file);
+    frame.push_back({"decode", std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count()});
+
+    predictor->Run(image, &frame);
+    frame.push_back({"total", std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count()});
+
+    if (i >= 0) {
+      result->times.insert(result->times.end(), frame.begin(), frame.end());
+    }
+  }
+  result->end = std::chrono::steady_clock::now();
+}
+
+
+int main(int argc, char **argv) {
+  std::string images_path, meta_yaml;
+  int iterations = 100, warmup = 5, threads = 1;
+
+  for (int i = 1; i < (argc-1); i++) {
+    char *arg = argv[i];
+    char *arg2 = argv[i+1];
+    if ((arg[0] == '-') && (std::strlen(arg) == 2) && (arg2[0] != '-')) {
+      switch (arg[1]) {
+        case 'i':  // image directory or file (PNG/NPY)
+          images_path = std::string(arg2);
+          break;
+        case 'c':  // config file (meta.yaml)
+          meta_yaml = std::string(arg2);
+          break;
+        case 'n':  // measured frames per thread
+          iterations = std::atoi(arg2);
+          break;
+        case 'w':  // warmup frames per thread
+          warmup = std::atoi(arg2);
+          break;
+        case 't':  // threads, each with its own Predictor
+          threads = std::atoi(arg2);
+          break;
+      }
+    }
+  }
+
+  if (images_path.empty() || meta_yaml.empty() || iterations <= 0 || warmup < 0 || threads <= 0) {
+    std::cerr << "Usage: blueoil_bench -i <image dir or file> -c <configfile> "
+              << "[-n iterations] [-w warmup] [-t threads]" << std::endl;
+    std::cerr << "ex) blueoil_bench -i images/ -c meta.yaml -n 200 -t 2" << std::endl;
+    std::exit(1);
+  }
+
+  const std::vector<std::string> images = ListImages(images_path);
+  if (images.empty()) {
+    std::cerr << "no PNG/NPY images in " << images_path << std::endl;
+    std::exit(1);
+  }
+
+  std::vector<std::unique_ptr<blueoil::Predictor>> predictors;
+  for (int t = 0; t < threads; t++) {
+    predictors.emplace_back(new blueoil::Predictor(meta_yaml));
+  }
+
+  std::vector<WorkerResult> results(threads);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++) {
+    workers.emplace_back(Worker, predictors[t].get(), &images, t * iterations,
+                         warmup, iterations, &results[t]);
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  auto begin = results[0].begin, end = results[0].end;
+  for (const WorkerResult& r : results) {
+    begin = std::min(begin, r.begin);
+    end = std::max(end, r.end);
+  }
+  const double wall_sec = std::chrono::duration<double>(end - begin).count();
+
+  // per stage in order of first appearance
+  std::vector<std::string> order;
+  std::map<std::string, std::vector<double>> stages;
+  for (const WorkerResult& r : results) {
+    for (const blueoil::Predictor::StageTime& st : r.times) {
+      if (stages.find(st.name) == stages.end()) {
+        order.push_back(st.name);
+      }
+      stages[st.name].push_back(st.msec);
+    }
+  }
+
+  const int frames = iterations * threads;
+  std::printf("images: %zu, threads: %d, frames: %d (+%d warmup per thread)\n",
+              images.size(), threads, frames, warmup);
+  std::printf("%-24s %10s %10s %10s %10s %10s %10s\n",
+              "stage [ms]", "mean", "min", "p50", "p90", "p99", "max");
+  for (const std::string& name : order) {
+    std::vector<double>& v = stages[name];
+    std::sort(v.begin(), v.end());
+    double sum = 0;
+    for (double x : v) {
+      sum += x;
+    }
+    std::printf("%-24s %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+                name.c_str(), sum / v.size(), v.front(),
+                Percentile(v, 50), Percentile(v, 90), Percentile(v, 99), v.back());
+  }
+  std::printf("throughput: %.2f frames/s (%.2f frames/s per thread)\n",
+              frames / wall_sec, frames / wall_sec / threads);
+
+  std::exit(0);
+}
@@ -20,6 +20,7 @@ limitations under the License.
 #include <string>
 #include <vector>
 #include <functional>
+#include <memory>
 
 
 // TODO(wakisaka): Should use netowrk.h from dlk. But dlk's netwrok.h has so many dependancies.
@@ -83,25 +84,56 @@ class Predictor {
 
   Tensor Run(const Tensor& image);
 
-  // constructor
+  // Wall-clock time of one stage of Run() in milliseconds.
+  struct StageTime {
+    std::string name;
+    double msec;
+  };
+  // Same as Run(image), and appends the time of each pre-processor, network_run
+  // and each post-processor to stage_times, in execution order.
+  Tensor Run(const Tensor& image, std::vector<StageTime>* stage_times);
+
+  // Same as Run(image) for every image, with network_run held once for the whole batch.
+  std::vector<Tensor> Run(const std::vector<Tensor>& images);
+
+  // constructor, for the network linked into the program.
   explicit Predictor(const std::string& meta_yaml_path);
+  // Loads the network from a generated lib_*.so instead, with dlopen(RTLD_LOCAL), so that
+  // the networks of several libraries (e.g. a detector and a classifier) live in one process.
+  // Throws std::runtime_error when the library or one of its network_* functions is missing.
+  Predictor(const std::string& meta_yaml_path, const std::string& dlk_so_lib_path);
 
 
  private:
-  // void SetupNetwork(const std::string dlk_so_lib_path);
-  void SetupNetwork();
+  // network_* functions of the linked-in network or of a loaded library.
+  struct NetworkFunctions {
+    Network* (*create)();
+    void (*destroy)(Network *nn);
+    bool (*init)(Network *nn);
+    int (*get_input_rank)(const Network *nn);
+    int (*get_output_rank)(const Network *nn);
+    void (*get_input_shape)(const Network *nn, int *shape);
+    void (*get_output_shape)(const Network *nn, int *shape);
+    void (*run)(Network *nn, const float *input, float *output);
+  };
+
+  // lib is the dlopen handle of the library the functions come from, or null.
+  void SetupNetwork(const NetworkFunctions& functions, std::shared_ptr<void> lib);
   void SetupMeta(const std::string& meta_yaml_path);
   Tensor RunPreProcess(const Tensor& input);
   Tensor RunPostProcess(const Tensor& input);
 
-  Network* net_;
-  // NetworkRun network_run;
+  NetworkFunctions network_;
+  // shared by copies; deleted before its library is closed.
+  std::shared_ptr<Network> net_;
   std::vector<int> network_input_shape_;
   std::vector<int> network_output_shape_;
   std::vector<int> image_size_;
 
   std::vector<Processor> pre_process_;
   std::vector<Processor> post_process_;
+  std::vector<std::string> pre_process_names_;
+  std::vector<std::string> post_process_names_;
 };
 
 namespace box_util {
@@ -128,6 +160,27 @@ struct DetectedBox:Box {
 std::vector<DetectedBox> FormatDetectedBox(const Tensor& output_tensor);
 
 }  // namespace box_util
+
+// Object detection followed by a classification of every detected box.
+class Cascade {
+ public:
+  struct Detection {
+    box_util::DetectedBox box;  // in the coordinates of the image given to Run
+    Tensor classification;  // post-processed output of the classifier
+  };
+
+  // detector: an OBJECT_DETECTION predictor whose output FormatDetectedBox takes.
+  // Neither predictor is owned.
+  Cascade(Predictor* detector, Predictor* classifier);
+
+  // Runs the detector on image (HWC), crops and resizes every box to the input of the
+  // classifier in one pass over image, and classifies the crops as one batch.
+  std::vector<Detection> Run(const Tensor& image);
+
+ private:
+  Predictor* detector_;
+  Predictor* classifier_;
+};
 }  // namespace blueoil
 
 #endif  // RUNTIME_INCLUDE_BLUEOIL_HPP_
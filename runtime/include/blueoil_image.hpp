@@ -17,6 +17,7 @@ limitations under the License.
 #define RUNTIME_INCLUDE_BLUEOIL_IMAGE_HPP_
 
 #include <string>
+#include <vector>
 #include "blueoil.hpp"
 
 namespace blueoil {
@@ -32,6 +33,13 @@ Tensor LoadImage(const std::string filename);
 Tensor Resize(const Tensor& image, const int width, const int height,
               const enum ResizeFilter filter);
 
+// Crops every box out of image (HWC) and resizes it to width x height, reading the source
+// frame once per box without intermediate crops. A box covers the pixels it overlaps,
+// clipped to the image (at least one), and each result equals Resize of that crop.
+std::vector<Tensor> CropAndResize(const Tensor& image, const std::vector<box_util::Box>& boxes,
+                                  const int width, const int height,
+                                  const enum ResizeFilter filter);
+
 }  // namespace image
 }  // namespace blueoil
 
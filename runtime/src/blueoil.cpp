@@ -22,8 +22,12 @@ limitations under the License.
 #include <cstdio>
 #include <cstring>
 #include <cmath>
+#include <chrono>
+#include <mutex>
 #include <utility>
 #include <functional>
+#include <memory>
+#include <stdexcept>
 
 #include "blueoil.hpp"
 #include "blueoil_image.hpp"
@@ -249,7 +253,8 @@ Tensor Tensor_loadImage(std::string filename) {
 
 
 // mapping process node to functions vector.
-void MappingProcess(const YAML::Node processors_node, std::vector<Processor>* functions) {
+void MappingProcess(const YAML::Node processors_node, std::vector<Processor>* functions,
+                    std::vector<std::string>* names) {
   switch (processors_node.Type()) {
     case YAML::NodeType::Null: {
       break;
@@ -295,6 +300,7 @@ void MappingProcess(const YAML::Node processors_node, std::vector<Processor>* fu
             std::cout <<  method_name << " is not register method: " << std::endl;
             exit(1);
           }
+          names->push_back(method_name);
         }
       }
       break;
@@ -308,35 +314,77 @@ void MappingProcess(const YAML::Node processors_node, std::vector<Processor>* fu
 }
 
 
-void Predictor::SetupNetwork() {
-  net_ = network_create();
-  bool ret = network_init(net_);
+// dlsym of a network_* function, with the type of the NetworkFunctions member it fills.
+template <typename F>
+static void LoadFunction(void* lib, const char* name, F* function) {
+  void* symbol = dlsym(lib, name);
+  if (symbol == nullptr) {
+    throw std::runtime_error(std::string("network library has no ") + name);
+  }
+  *function = reinterpret_cast<F>(symbol);
+}
+
+void Predictor::SetupNetwork(const NetworkFunctions& functions, std::shared_ptr<void> lib) {
+  network_ = functions;
+  auto destroy = network_.destroy;
+  // the deleter keeps the library open until the network is gone
+  net_ = std::shared_ptr<Network>(network_.create(), [destroy, lib](Network* nn) {
+    if (nn != nullptr) {
+      destroy(nn);
+    }
+  });
+  bool ret = network_.init(net_.get());
 
   if (ret == false) {
     std::cout << "network init error" << std::endl;
     exit(1);
   }
 
-  const int input_rank = network_get_input_rank(net_);
-  const int output_rank = network_get_output_rank(net_);
+  const int input_rank = network_.get_input_rank(net_.get());
+  const int output_rank = network_.get_output_rank(net_.get());
 
   network_input_shape_.resize(input_rank);
   network_output_shape_.resize(output_rank);
 
-  network_get_input_shape(net_, network_input_shape_.data());
-  network_get_output_shape(net_, network_output_shape_.data());
+  network_.get_input_shape(net_.get(), network_input_shape_.data());
+  network_.get_output_shape(net_.get(), network_output_shape_.data());
 
   expected_input_shape = network_input_shape_;
 }
 
 
 Predictor::Predictor(const std::string& meta_yaml_path) {
-  SetupNetwork();
+  SetupNetwork({network_create, network_delete, network_init,
+                network_get_input_rank, network_get_output_rank,
+                network_get_input_shape, network_get_output_shape,
+                network_run}, nullptr);
   SetupMeta(meta_yaml_path);
   // TODO(wakisaka): check network input shape is the same as meta's image size.
   // TODO(wakisaka): check network output shape is the same as meta's number of class when type is classsification.
 }
 
+Predictor::Predictor(const std::string& meta_yaml_path, const std::string& dlk_so_lib_path) {
+  // RTLD_LOCAL: every library keeps its own network_* symbols, buffers and thread pool
+  void* handle = dlopen(dlk_so_lib_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (handle == nullptr) {
+    throw std::runtime_error(std::string("cannot load network library: ") + dlerror());
+  }
+  std::shared_ptr<void> lib(handle, [](void* h) { dlclose(h); });
+
+  NetworkFunctions functions;
+  LoadFunction(handle, "network_create", &functions.create);
+  LoadFunction(handle, "network_delete", &functions.destroy);
+  LoadFunction(handle, "network_init", &functions.init);
+  LoadFunction(handle, "network_get_input_rank", &functions.get_input_rank);
+  LoadFunction(handle, "network_get_output_rank", &functions.get_output_rank);
+  LoadFunction(handle, "network_get_input_shape", &functions.get_input_shape);
+  LoadFunction(handle, "network_get_output_shape", &functions.get_output_shape);
+  LoadFunction(handle, "network_run", &functions.run);
+
+  SetupNetwork(functions, std::move(lib));
+  SetupMeta(meta_yaml_path);
+}
+
 void Predictor::SetupMeta(const std::string& meta_yaml_path) {
   YAML::Node meta = YAML::LoadFile(meta_yaml_path.c_str());
 
@@ -347,10 +395,10 @@ void Predictor::SetupMeta(const std::string& meta_yaml_path) {
   classes = meta["CLASSES"].as<std::vector<std::string>>();
 
   YAML::Node pre_processor_node = meta["PRE_PROCESSOR"];
-  MappingProcess(pre_processor_node, &pre_process_);
+  MappingProcess(pre_processor_node, &pre_process_, &pre_process_names_);
 
   YAML::Node post_processor_node = meta["POST_PROCESSOR"];
-  MappingProcess(post_processor_node, &post_process_);
+  MappingProcess(post_processor_node, &post_process_, &post_process_names_);
 }
 
 
@@ -372,24 +420,149 @@ Tensor Predictor::RunPostProcess(const Tensor& input) {
   return tmp;
 }
 
+// dlk kernels share static scratch buffers (and the FPGA), so network_run
+// of several Predictor instances must not overlap. Networks loaded from
+// different libraries have buffers and a thread pool each, but still share
+// the FPGA and the CPUs: one run at a time lets their pools take turns on
+// the same cores instead of oversubscribing them.
+static std::mutex network_run_mutex;
+
 Tensor Predictor::Run(const Tensor& image) {
   Tensor pre_processed = RunPreProcess(image);
 
   // build network output tensor.
   Tensor n_output(network_output_shape_);
 
-  network_run(net_, pre_processed.dataAsArray(), n_output.dataAsArray());
+  {
+    std::lock_guard<std::mutex> lock(network_run_mutex);
+    network_.run(net_.get(), pre_processed.dataAsArray(), n_output.dataAsArray());
+  }
 
   Tensor post_processed = RunPostProcess(n_output);
 
   return post_processed;
 }
 
+static double ElapsedMsec(std::chrono::steady_clock::time_point* since) {
+  const auto now = std::chrono::steady_clock::now();
+  const double msec = std::chrono::duration<double, std::milli>(now - *since).count();
+  *since = now;
+  return msec;
+}
+
+Tensor Predictor::Run(const Tensor& image, std::vector<StageTime>* stage_times) {
+  auto t = std::chrono::steady_clock::now();
+
+  Tensor tmp = image;
+  for (size_t i = 0; i < pre_process_.size(); i++) {
+    tmp = pre_process_[i](tmp);
+    stage_times->push_back({pre_process_names_[i], ElapsedMsec(&t)});
+  }
+
+  Tensor n_output(network_output_shape_);
+  {
+    std::lock_guard<std::mutex> lock(network_run_mutex);
+    // time spent waiting for another instance's network_run
+    stage_times->push_back({"network_wait", ElapsedMsec(&t)});
+    network_.run(net_.get(), tmp.dataAsArray(), n_output.dataAsArray());
+    stage_times->push_back({"network_run", ElapsedMsec(&t)});
+  }
+
+  tmp = n_output;
+  for (size_t i = 0; i < post_process_.size(); i++) {
+    tmp = post_process_[i](tmp);
+    stage_times->push_back({post_process_names_[i], ElapsedMsec(&t)});
+  }
+
+  return tmp;
+}
+
+std::vector<Tensor> Predictor::Run(const std::vector<Tensor>& images) {
+  std::vector<Tensor> pre_processed;
+  pre_processed.reserve(images.size());
+  for (const Tensor& image : images) {
+    pre_processed.push_back(RunPreProcess(image));
+  }
+
+  std::vector<Tensor> n_outputs(images.size(), Tensor(network_output_shape_));
+  {
+    std::lock_guard<std::mutex> lock(network_run_mutex);
+    for (size_t i = 0; i < images.size(); i++) {
+      network_.run(net_.get(), pre_processed[i].dataAsArray(), n_outputs[i].dataAsArray());
+    }
+  }
+
+  std::vector<Tensor> post_processed;
+  post_processed.reserve(images.size());
+  for (const Tensor& n_output : n_outputs) {
+    post_processed.push_back(RunPostProcess(n_output));
+  }
+  return post_processed;
+}
+
 
 namespace box_util {
 
-// TODO(wakiska): implement this func.
-std::vector<DetectedBox> FormatDetectedBox(const blueoil::Tensor& output_tensor);
+// output_tensor: [1, num_boxes, (x, y, w, h, class_id, score)], as from FormatYoloV2 and NMS.
+std::vector<DetectedBox> FormatDetectedBox(const blueoil::Tensor& output_tensor) {
+  auto shape = output_tensor.shape();
+  if ((shape.size() != 3) || (shape[0] != 1) || (shape[2] != 6)) {
+    throw std::invalid_argument("detection output must be shaped [1, num_boxes, 6]");
+  }
+  std::vector<DetectedBox> boxes(shape[1]);
+  for (int i = 0; i < shape[1]; i++) {
+    const float* prediction = output_tensor.dataAsArray({0, i, 0});
+    DetectedBox& box = boxes[i];
+    box.x = prediction[0];
+    box.y = prediction[1];
+    box.w = prediction[2];
+    box.h = prediction[3];
+    box.class_id = static_cast<int>(prediction[4]);
+    box.score = prediction[5];
+  }
+  return boxes;
+}
 }  // namespace box_util
 
+
+Cascade::Cascade(Predictor* detector, Predictor* classifier)
+  : detector_(detector),
+    classifier_(classifier) {
+}
+
+std::vector<Cascade::Detection> Cascade::Run(const Tensor& image) {
+  // NHWC network inputs
+  const std::vector<int>& detector_shape = detector_->expected_input_shape;
+  const std::vector<int>& classifier_shape = classifier_->expected_input_shape;
+  if ((detector_shape.size() != 4) || (classifier_shape.size() != 4) || (image.shape().size() != 3)) {
+    throw std::invalid_argument("Cascade takes an HWC image and NHWC networks");
+  }
+
+  // boxes come in the coordinates of the resized image the detector ran on
+  std::vector<box_util::DetectedBox> boxes = box_util::FormatDetectedBox(detector_->Run(image));
+  const float x_scale = static_cast<float>(image.shape()[1]) / detector_shape[2];
+  const float y_scale = static_cast<float>(image.shape()[0]) / detector_shape[1];
+  std::vector<box_util::Box> rois;
+  rois.reserve(boxes.size());
+  for (box_util::DetectedBox& box : boxes) {
+    box.x *= x_scale;
+    box.w *= x_scale;
+    box.y *= y_scale;
+    box.h *= y_scale;
+    rois.push_back(box);
+  }
+
+  // nearest neighbor, as the Resize pre-process, which then leaves the crops alone
+  std::vector<Tensor> crops = image::CropAndResize(image, rois, classifier_shape[2], classifier_shape[1],
+                                                   image::RESIZE_FILTER_NEAREST_NEIGHBOR);
+  std::vector<Tensor> classifications = classifier_->Run(crops);
+
+  std::vector<Detection> detections;
+  detections.reserve(boxes.size());
+  for (size_t i = 0; i < boxes.size(); i++) {
+    detections.push_back({boxes[i], classifications[i]});
+  }
+  return detections;
+}
+
 }  // namespace blueoil
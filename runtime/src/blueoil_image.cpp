@@ -17,6 +17,8 @@ limitations under the License.
 #include <cmath>
 #include <cassert>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "blueoil.hpp"
 #include "blueoil_image.hpp"
@@ -245,6 +247,136 @@ Tensor Resize(const Tensor& image, const int width, const int height,
   return dstImage;
 }
 
+/*
+ * Crop and Resize
+ */
+// Source pixels and weights of every destination pixel along one axis, the
+// same as those of ResizeHorizontal_* / ResizeVertical_* for these sizes.
+struct ResizeTaps {
+  std::vector<int> begin;  // taps of destination pixel i: [begin[i], begin[i + 1])
+  std::vector<int> index;
+  std::vector<float> weight;
+};
+
+static ResizeTaps MakeResizeTaps(const int srcSize, const int dstSize,
+                                 const enum ResizeFilter filter, const bool vertical) {
+  ResizeTaps taps;
+  taps.begin.push_back(0);
+  const float scale = static_cast<float>(dstSize) / static_cast<float>(srcSize);
+  if (filter == RESIZE_FILTER_NEAREST_NEIGHBOR) {
+    const float srcScaled = 1.0f / scale;
+    float srcIndexF = 0.5 / scale;
+    for (int dst = 0; dst < dstSize; dst++) {
+      taps.index.push_back(static_cast<int>(srcIndexF));
+      taps.weight.push_back(1.0);
+      taps.begin.push_back(taps.index.size());
+      srcIndexF += srcScaled;
+    }
+    return taps;
+  }
+  float srcWindow = (scale < 1.0)? (1.0f/scale): 1.0;
+  if (vertical) {
+    srcWindow = static_cast<int>(srcWindow);  // as ResizeVertical_BiLinear
+  }
+  for (int dst = 0; dst < dstSize; dst++) {
+    float srcF = (dst + 0.5)/scale - 0.5;
+    int start = std::ceil(srcF - srcWindow);
+    int end = std::floor(srcF + srcWindow);
+    if (start >= end) {  // for enlarge scale
+      start = std::floor(srcF);
+      end = std::ceil(srcF);
+    }
+    // don't convolve pixels outside the frame
+    if (start < 0) {
+      start = 0;
+    }
+    if (end >= srcSize) {
+      end = srcSize - 1;
+    }
+    for (int src = start; src <= end; src++) {
+      float d = std::abs(static_cast<float>(src) - srcF) / srcWindow;
+      if (d < 1.0) {
+        taps.index.push_back(src);
+        taps.weight.push_back(1.0 - d);
+      }
+    }
+    taps.begin.push_back(taps.index.size());
+  }
+  return taps;
+}
+
+// dst[i] = weighted average of the src pixels taps name for i, for pixels
+// stride floats apart; channels are the innermost dimension of both.
+static void ApplyResizeTaps(const ResizeTaps& taps, const float* src, const int srcStride,
+                            float* dst, const int dstStride, const int channels) {
+  const int dstSize = taps.begin.size() - 1;
+  for (int i = 0; i < dstSize; i++) {
+    for (int c = 0; c < channels; c++) {
+      float v = 0.0;
+      float totalW = 0.0;
+      for (int t = taps.begin[i]; t < taps.begin[i + 1]; t++) {
+        v += taps.weight[t] * src[taps.index[t] * srcStride + c];
+        totalW += taps.weight[t];
+      }
+      dst[i * dstStride + c] = (v)? (v/totalW): 0;
+    }
+  }
+}
+
+std::vector<Tensor> CropAndResize(const Tensor& image, const std::vector<box_util::Box>& boxes,
+                                  const int width, const int height,
+                                  const enum ResizeFilter filter) {
+  auto shape = image.shape();
+  assert(shape.size() == 3);  // 3D shape: HWC
+  assert((filter == RESIZE_FILTER_NEAREST_NEIGHBOR) || (filter == RESIZE_FILTER_BI_LINEAR));
+  const int srcHeight = shape[0];
+  const int srcWidth  = shape[1];
+  const int channels  = shape[2];
+  const float *srcImageData = image.dataAsArray();
+
+  std::vector<Tensor> crops;
+  crops.reserve(boxes.size());
+  std::vector<float> rows;  // bi-linear: the rows of a crop, resized horizontally
+  for (const box_util::Box& box : boxes) {
+    const int x0 = clamp(static_cast<int>(std::floor(box.x)), 0, srcWidth - 1);
+    const int y0 = clamp(static_cast<int>(std::floor(box.y)), 0, srcHeight - 1);
+    const int x1 = clamp(static_cast<int>(std::ceil(box.x + box.w)), x0 + 1, srcWidth);
+    const int y1 = clamp(static_cast<int>(std::ceil(box.y + box.h)), y0 + 1, srcHeight);
+    const ResizeTaps xTaps = MakeResizeTaps(x1 - x0, width, filter, false);
+    const ResizeTaps yTaps = MakeResizeTaps(y1 - y0, height, filter, true);
+    const float *srcCrop = srcImageData + (y0 * srcWidth + x0) * channels;
+    const int srcScanLineSize = srcWidth * channels;
+    const int dstScanLineSize = width * channels;
+
+    Tensor dstTensor({height, width, channels});
+    float *dstRGB = dstTensor.dataAsArray();
+    if (filter == RESIZE_FILTER_NEAREST_NEIGHBOR) {
+      for (int dstY = 0; dstY < height; dstY++) {
+        const float *srcRGBline = srcCrop + yTaps.index[dstY] * srcScanLineSize;
+        for (int dstX = 0; dstX < width; dstX++) {
+          const float *srcRGB = srcRGBline + xTaps.index[dstX] * channels;
+          for (int c = 0; c < channels; c++) {
+            *dstRGB++ = srcRGB[c];
+          }
+        }
+      }
+    } else {  // RESIZE_FILTER_BI_LINEAR
+      const int cropHeight = y1 - y0;
+      rows.resize(cropHeight * dstScanLineSize);
+      for (int y = 0; y < cropHeight; y++) {
+        ApplyResizeTaps(xTaps, srcCrop + y * srcScanLineSize, channels,
+                        rows.data() + y * dstScanLineSize, channels, channels);
+      }
+      for (int dstX = 0; dstX < width; dstX++) {
+        ApplyResizeTaps(yTaps, rows.data() + dstX * channels, dstScanLineSize,
+                        dstRGB + dstX * channels, dstScanLineSize, channels);
+      }
+    }
+    crops.push_back(std::move(dstTensor));
+  }
+  return crops;
+}
+
 
 }  // namespace image
 }  // namespace blueoil
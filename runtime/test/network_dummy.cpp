@@ -17,6 +17,7 @@ limitations under the License.
 
 extern "C" {  // dummy functions
   Network *network_create() { return NULL; }
+  void network_delete(Network *) { ; }
   bool network_init(Network *) { return true; }
   int network_get_input_rank(const Network *) { return 0; }
   int network_get_output_rank(const Network *) { return 0; }
@@ -16,6 +16,7 @@ limitations under the License.
 #include <cstdlib>
 #include <iostream>
 #include <utility>
+#include <vector>
 
 #include "blueoil.hpp"
 #include "blueoil_image.hpp"
@@ -226,6 +227,25 @@ int test_data_processor_nms() {
   return EXIT_SUCCESS;
 }
 
+int test_format_detected_box() {
+  blueoil::Tensor input({1, 4, 6}, reinterpret_cast<float *>(nms_expect));
+  std::vector<blueoil::box_util::DetectedBox> boxes = blueoil::box_util::FormatDetectedBox(input);
+  if (boxes.size() != 4) {
+    std::cerr << "test_format_detected_box: " << boxes.size() << " boxes" << std::endl;
+    return EXIT_FAILURE;
+  }
+  for (int i = 0; i < 4; i++) {
+    const float* p = input.dataAsArray({0, i, 0});
+    const blueoil::box_util::DetectedBox& box = boxes[i];
+    if ((box.x != p[0]) || (box.y != p[1]) || (box.w != p[2]) || (box.h != p[3]) ||
+        (box.class_id != static_cast<int>(p[4])) || (box.score != p[5])) {
+      std::cerr << "test_format_detected_box: box " << i << " != expect" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
+
 int main(void) {
   int status_code = 0;
   std::cerr << "test_data_processor_resize" << std::endl;
@@ -248,5 +268,10 @@ int main(void) {
   if (status_code != EXIT_SUCCESS) {
     std::exit(status_code);
   }
+  std::cerr << "test_format_detected_box" << std::endl;
+  status_code = test_format_detected_box();
+  if (status_code != EXIT_SUCCESS) {
+    std::exit(status_code);
+  }
   std::exit(EXIT_SUCCESS);
 }
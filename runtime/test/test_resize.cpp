@@ -13,8 +13,11 @@ See the License for the specific language governing permissions and
 limitations under the License.
 =============================================================================*/
 
+#include <algorithm>
+#include <cmath>
 #include <cstdlib>
 #include <iostream>
+#include <vector>
 
 #include "blueoil.hpp"
 #include "blueoil_image.hpp"
@@ -123,6 +126,48 @@ int test_resize() {
   return EXIT_SUCCESS;
 }
 
+// CropAndResize must match Resize of the cropped image.
+int test_crop_and_resize() {
+  const int srcHeight = 17, srcWidth = 20, channels = 3;
+  blueoil::Tensor input({srcHeight, srcWidth, channels});
+  for (int i = 0; i < input.size(); i++) {
+    input.data()[i] = (i * 37) % 256;
+  }
+  // whole image, fractional, partly outside, thin
+  const std::vector<blueoil::box_util::Box> boxes = {
+    {0, 0, 20, 17}, {2.5, 3.2, 7.1, 9.6}, {-4, 12, 10, 9}, {19.5, 0, 3, 1},
+  };
+  const blueoil::image::ResizeFilter filters[] = {
+    blueoil::image::RESIZE_FILTER_NEAREST_NEIGHBOR, blueoil::image::RESIZE_FILTER_BI_LINEAR,
+  };
+  const int width = 6, height = 5;
+  for (auto filter : filters) {
+    std::vector<blueoil::Tensor> outputs = blueoil::image::CropAndResize(input, boxes, width, height, filter);
+    for (size_t i = 0; i < boxes.size(); i++) {
+      const int x0 = std::max(0, static_cast<int>(std::floor(boxes[i].x)));
+      const int y0 = std::max(0, static_cast<int>(std::floor(boxes[i].y)));
+      const int x1 = std::max(x0 + 1, std::min(srcWidth, static_cast<int>(std::ceil(boxes[i].x + boxes[i].w))));
+      const int y1 = std::max(y0 + 1, std::min(srcHeight, static_cast<int>(std::ceil(boxes[i].y + boxes[i].h))));
+      blueoil::Tensor crop({y1 - y0, x1 - x0, channels});
+      for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+          for (int c = 0; c < channels; c++) {
+            *crop.dataAsArray({y - y0, x - x0, c}) = *input.dataAsArray({y, x, c});
+          }
+        }
+      }
+      blueoil::Tensor expect = blueoil::image::Resize(crop, width, height, filter);
+      if (!outputs[i].allequal(expect)) {
+        std::cerr << "test_crop_and_resize: output != expect (box " << i << ", filter " << filter << ")" << std::endl;
+        blueoil::util::Tensor_HWC_to_CHW(outputs[i]).dump();
+        blueoil::util::Tensor_HWC_to_CHW(expect).dump();
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  return EXIT_SUCCESS;
+}
+
 int command_resize(int argc, char **argv) {
 #ifdef USE_OPENCV
   char *infile = argv[1];
@@ -164,10 +209,10 @@ int main(int argc, char **argv) {
   }
   if (argc == 1) {
     status_code = test_resize();
-    if (status_code != EXIT_FAILURE) {
-      std::exit(status_code);
+    if (status_code == EXIT_SUCCESS) {
+      status_code = test_crop_and_resize();
     }
-    std::exit(EXIT_SUCCESS);
+    std::exit(status_code);
   }
   std::cerr <<
     "Usage: " << argv[0] << " # unit test. no news is good news" << std::endl <<